@@ -52,7 +52,8 @@ bool DnsConfig::EqualsIgnoreHosts(const DnsConfig& d) const {
          (rotate == d.rotate) && (use_local_ipv6 == d.use_local_ipv6) &&
          (doh_config == d.doh_config) &&
          (secure_dns_mode == d.secure_dns_mode) &&
-         (allow_dns_over_https_upgrade == d.allow_dns_over_https_upgrade);
+         (allow_dns_over_https_upgrade == d.allow_dns_over_https_upgrade) &&
+         (dns_over_https_via_proxy == d.dns_over_https_via_proxy);
 }
 
 void DnsConfig::CopyIgnoreHosts(const DnsConfig& d) {
@@ -71,6 +72,7 @@ void DnsConfig::CopyIgnoreHosts(const DnsConfig& d) {
   doh_config = d.doh_config;
   secure_dns_mode = d.secure_dns_mode;
   allow_dns_over_https_upgrade = d.allow_dns_over_https_upgrade;
+  dns_over_https_via_proxy = d.dns_over_https_via_proxy;
 }
 
 base::Value DnsConfig::ToValue() const {
@@ -100,6 +102,7 @@ base::Value DnsConfig::ToValue() const {
   dict.Set("doh_config", doh_config.ToValue());
   dict.Set("secure_dns_mode", base::strict_cast<int>(secure_dns_mode));
   dict.Set("allow_dns_over_https_upgrade", allow_dns_over_https_upgrade);
+  dict.Set("dns_over_https_via_proxy", dns_over_https_via_proxy);
 
   return base::Value(std::move(dict));
 }
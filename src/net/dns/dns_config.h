@@ -107,6 +107,12 @@ struct NET_EXPORT DnsConfig {
   // to use DoH server(s) operated by the same provider(s) when the user is
   // in AUTOMATIC mode and has not pre-specified DoH servers.
   bool allow_dns_over_https_upgrade = false;
+
+  // If set to |true|, DoH requests go through the proxy configured for the
+  // URLRequestContext that issues them instead of bypassing it. DoH server
+  // hostnames and the proxy hostname are then resolved with
+  // SecureDnsPolicy::kBootstrap to avoid a dependency loop.
+  bool dns_over_https_via_proxy = false;
 };
 
 }  // namespace net
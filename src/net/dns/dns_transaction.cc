@@ -371,6 +371,7 @@ class DnsHTTPAttempt : public DnsAttempt, public URLRequest::Delegate {
                  const string& server_template,
                  const GURL& gurl_without_parameters,
                  bool use_post,
+                 bool via_proxy,
                  URLRequestContext* url_request_context,
                  const IsolationInfo& isolation_info,
                  RequestPriority request_priority_)
@@ -444,8 +445,10 @@ class DnsHTTPAttempt : public DnsAttempt, public URLRequest::Delegate {
     // Apply special policy to DNS lookups for for a DoH server hostname to
     // avoid deadlock and enable the use of preconfigured IP addresses.
     request_->SetSecureDnsPolicy(SecureDnsPolicy::kBootstrap);
-    request_->SetLoadFlags(request_->load_flags() | LOAD_DISABLE_CACHE |
-                           LOAD_BYPASS_PROXY);
+    int load_flags = request_->load_flags() | LOAD_DISABLE_CACHE;
+    if (!via_proxy)
+      load_flags |= LOAD_BYPASS_PROXY;
+    request_->SetLoadFlags(load_flags);
     request_->set_allow_credentials(false);
     request_->set_isolation_info(isolation_info);
   }
@@ -638,7 +641,8 @@ void ConstructDnsHTTPAttempt(DnsSession* session,
       GetURLFromTemplateWithoutParameters(doh_server.server_template()));
   attempts->push_back(std::make_unique<DnsHTTPAttempt>(
       doh_server_index, std::move(query), doh_server.server_template(),
-      gurl_without_parameters, doh_server.use_post(), url_request_context,
+      gurl_without_parameters, doh_server.use_post(),
+      session->config().dns_over_https_via_proxy, url_request_context,
       isolation_info, request_priority));
 }
 
@@ -35,6 +35,7 @@ bool DnsConfigOverrides::operator==(const DnsConfigOverrides& other) const {
          dns_over_https_config == other.dns_over_https_config &&
          secure_dns_mode == other.secure_dns_mode &&
          allow_dns_over_https_upgrade == other.allow_dns_over_https_upgrade &&
+         dns_over_https_via_proxy == other.dns_over_https_via_proxy &&
          clear_hosts == other.clear_hosts;
 }
 
@@ -63,6 +64,7 @@ DnsConfigOverrides::CreateOverridingEverythingWithDefaults() {
   overrides.secure_dns_mode = defaults.secure_dns_mode;
   overrides.allow_dns_over_https_upgrade =
       defaults.allow_dns_over_https_upgrade;
+  overrides.dns_over_https_via_proxy = defaults.dns_over_https_via_proxy;
   overrides.clear_hosts = true;
 
   return overrides;
@@ -73,7 +75,8 @@ bool DnsConfigOverrides::OverridesEverything() const {
          search && append_to_multi_label_name && ndots && fallback_period &&
          attempts && doh_attempts && rotate && use_local_ipv6 &&
          dns_over_https_config && secure_dns_mode &&
-         allow_dns_over_https_upgrade && clear_hosts;
+         allow_dns_over_https_upgrade && dns_over_https_via_proxy &&
+         clear_hosts;
 }
 
 DnsConfig DnsConfigOverrides::ApplyOverrides(const DnsConfig& config) const {
@@ -112,6 +115,8 @@ DnsConfig DnsConfigOverrides::ApplyOverrides(const DnsConfig& config) const {
     overridden.allow_dns_over_https_upgrade =
         allow_dns_over_https_upgrade.value();
   }
+  if (dns_over_https_via_proxy)
+    overridden.dns_over_https_via_proxy = dns_over_https_via_proxy.value();
   if (clear_hosts)
     overridden.hosts.clear();
 
@@ -61,6 +61,7 @@ struct NET_EXPORT DnsConfigOverrides {
   absl::optional<DnsOverHttpsConfig> dns_over_https_config;
   absl::optional<SecureDnsMode> secure_dns_mode;
   absl::optional<bool> allow_dns_over_https_upgrade;
+  absl::optional<bool> dns_over_https_via_proxy;
 
   // |hosts| is not supported for overriding except to clear it.
   bool clear_hosts = false;
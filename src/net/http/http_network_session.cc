@@ -379,7 +379,7 @@ CommonConnectJobParams HttpNetworkSession::CreateCommonConnectJobParams(
     bool for_websockets) {
   // Use null websocket_endpoint_lock_manager, which is only set for WebSockets,
   // and only when not using a proxy.
-  return CommonConnectJobParams(
+  CommonConnectJobParams common_connect_job_params(
       context_.client_socket_factory, context_.host_resolver, &http_auth_cache_,
       context_.http_auth_handler_factory, &spdy_session_pool_,
       &context_.quic_context->params()->supported_versions,
@@ -388,6 +388,10 @@ CommonConnectJobParams HttpNetworkSession::CreateCommonConnectJobParams(
       context_.socket_performance_watcher_factory,
       context_.network_quality_estimator, context_.net_log,
       for_websockets ? &websocket_endpoint_lock_manager_ : nullptr);
+  common_connect_job_params.http_server_properties = http_server_properties_;
+  common_connect_job_params.happy_eyeballs_attempt_delay =
+      params_.happy_eyeballs_attempt_delay;
+  return common_connect_job_params;
 }
 
 ClientSocketPoolManager* HttpNetworkSession::GetSocketPoolManager(
@@ -23,6 +23,7 @@
 #include "base/memory/ref_counted.h"
 #include "base/memory/weak_ptr.h"
 #include "base/threading/thread_checker.h"
+#include "base/time/time.h"
 #include "base/values.h"
 #include "build/buildflag.h"
 #include "net/base/host_mapping_rules.h"
@@ -185,6 +186,12 @@ struct NET_EXPORT HttpNetworkSessionParams {
 
   // Whether to use the ALPN information in the DNS HTTPS record.
   bool use_dns_https_svcb_alpn = false;
+
+  // If set, TCP connections race attempts to all resolved addresses, starting
+  // a new attempt after this delay (Happy Eyeballs v2), and prefer addresses
+  // that connected quickly before. Otherwise IPv4 is only tried as a fallback
+  // after TransportConnectJob::kIPv6FallbackTime.
+  absl::optional<base::TimeDelta> happy_eyeballs_attempt_delay;
 };
 
   // Structure with pointers to the dependencies of the HttpNetworkSession.
@@ -594,10 +594,15 @@ int HttpProxyConnectJob::DoSpdyProxyCreateStream() {
 
   next_state_ = STATE_SPDY_PROXY_CREATE_STREAM_COMPLETE;
   spdy_stream_request_ = std::make_unique<SpdyStreamRequest>();
+  // The CONNECT request may go out as early data if the proxy's SSLConfig
+  // allows it. Whoever writes to the tunnel must call ConfirmHandshake() on
+  // the socket first if its data is not safe to replay.
+  const bool can_send_early =
+      params_->ssl_params()->ssl_config().early_data_enabled;
   return spdy_stream_request_->StartRequest(
       SPDY_BIDIRECTIONAL_STREAM, spdy_session,
-      GURL("https://" + params_->endpoint().ToString()),
-      false /* no early data */, kH2QuicTunnelPriority, socket_tag(),
+      GURL("https://" + params_->endpoint().ToString()), can_send_early,
+      kH2QuicTunnelPriority, socket_tag(),
       spdy_session->net_log(),
       base::BindOnce(&HttpProxyConnectJob::OnIOComplete,
                      base::Unretained(this)),
@@ -759,14 +764,11 @@ int HttpProxyConnectJob::DoRestartWithAuthComplete(int result) {
 }
 
 void HttpProxyConnectJob::ChangePriorityInternal(RequestPriority priority) {
-  // Do not set the priority on |spdy_stream_request_| or
-  // |quic_stream_request_|, since those should always use
+  // Do not set the priority on |spdy_stream_request_|,
+  // |quic_stream_request_| or the tunnel stream, since those should always use
   // kH2QuicTunnelPriority.
   if (nested_connect_job_)
     nested_connect_job_->ChangePriority(priority);
-
-  if (transport_socket_)
-    transport_socket_->SetStreamPriority(priority);
 }
 
 void HttpProxyConnectJob::OnTimedOutInternal() {
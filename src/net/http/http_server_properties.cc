@@ -160,7 +160,8 @@ HttpServerProperties::HttpServerProperties(
       canonical_suffixes_({".ggpht.com", ".c.youtube.com", ".googlevideo.com",
                            ".googleusercontent.com", ".gvt1.com"}),
       quic_server_info_map_(kDefaultMaxQuicServerEntries),
-      max_server_configs_stored_in_properties_(kDefaultMaxQuicServerEntries) {}
+      max_server_configs_stored_in_properties_(kDefaultMaxQuicServerEntries),
+      connect_rtt_map_(kMaxConnectRttEntries) {}
 
 HttpServerProperties::~HttpServerProperties() {
   DCHECK_CALLED_ON_VALID_THREAD(thread_checker_);
@@ -185,6 +186,7 @@ void HttpServerProperties::Clear(base::OnceClosure callback) {
   last_local_address_when_quic_worked_ = IPAddress();
   quic_server_info_map_.Clear();
   canonical_server_info_map_.clear();
+  connect_rtt_map_.Clear();
 
   if (properties_manager_) {
     // Stop waiting for initial settings.
@@ -485,6 +487,47 @@ const ServerNetworkStats* HttpServerProperties::GetServerNetworkStats(
                                        network_anonymization_key);
 }
 
+void HttpServerProperties::OnTransportConnectSucceeded(
+    const IPEndPoint& endpoint,
+    const NetworkAnonymizationKey& network_anonymization_key,
+    base::TimeDelta rtt) {
+  DCHECK_CALLED_ON_VALID_THREAD(thread_checker_);
+  ConnectRttMapKey key =
+      CreateConnectRttKey(endpoint, network_anonymization_key);
+  auto it = connect_rtt_map_.Get(key);
+  if (it == connect_rtt_map_.end() || it->second.smoothed_rtt.is_zero()) {
+    connect_rtt_map_.Put(key, ConnectRttInfo{rtt, 0});
+    return;
+  }
+  // Same gain as the TCP smoothed RTT estimator (RFC 6298).
+  it->second.smoothed_rtt = (it->second.smoothed_rtt * 7 + rtt) / 8;
+  it->second.consecutive_failures = 0;
+}
+
+void HttpServerProperties::OnTransportConnectFailed(
+    const IPEndPoint& endpoint,
+    const NetworkAnonymizationKey& network_anonymization_key) {
+  DCHECK_CALLED_ON_VALID_THREAD(thread_checker_);
+  ConnectRttMapKey key =
+      CreateConnectRttKey(endpoint, network_anonymization_key);
+  auto it = connect_rtt_map_.Get(key);
+  if (it == connect_rtt_map_.end())
+    it = connect_rtt_map_.Put(key, ConnectRttInfo());
+  ++it->second.consecutive_failures;
+}
+
+const HttpServerProperties::ConnectRttInfo*
+HttpServerProperties::GetConnectRttInfo(
+    const IPEndPoint& endpoint,
+    const NetworkAnonymizationKey& network_anonymization_key) {
+  DCHECK_CALLED_ON_VALID_THREAD(thread_checker_);
+  auto it = connect_rtt_map_.Peek(
+      CreateConnectRttKey(endpoint, network_anonymization_key));
+  if (it == connect_rtt_map_.end())
+    return nullptr;
+  return &it->second;
+}
+
 void HttpServerProperties::SetQuicServerInfo(
     const quic::QuicServerId& server_id,
     const NetworkAnonymizationKey& network_anonymization_key,
@@ -965,6 +1008,15 @@ HttpServerProperties::CreateQuicServerInfoKey(
                               use_network_anonymization_key_);
 }
 
+HttpServerProperties::ConnectRttMapKey
+HttpServerProperties::CreateConnectRttKey(
+    const IPEndPoint& endpoint,
+    const NetworkAnonymizationKey& network_anonymization_key) const {
+  return ConnectRttMapKey(endpoint, use_network_anonymization_key_
+                                        ? network_anonymization_key
+                                        : NetworkAnonymizationKey());
+}
+
 HttpServerProperties::ServerInfoMapKey
 HttpServerProperties::CreateServerInfoKey(
     const url::SchemeHostPort& server,
@@ -13,6 +13,7 @@
 #include <set>
 #include <string>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 #include "base/callback.h"
@@ -25,6 +26,7 @@
 #include "base/values.h"
 #include "net/base/host_port_pair.h"
 #include "net/base/ip_address.h"
+#include "net/base/ip_endpoint.h"
 #include "net/base/net_export.h"
 #include "net/base/network_anonymization_key.h"
 #include "net/http/alternative_service.h"
@@ -102,6 +104,9 @@ class NET_EXPORT HttpServerProperties
   // Store at most 500 MRU ServerInfos in memory and disk.
   static const int kMaxServerInfoEntries = 500;
 
+  // Store at most 1000 MRU ConnectRttInfos in memory.
+  static const int kMaxConnectRttEntries = 1000;
+
   // Provides an interface to interact with persistent preferences storage
   // implemented by the embedder. The prefs are assumed not to have been loaded
   // before HttpServerPropertiesManager construction.
@@ -226,6 +231,19 @@ class NET_EXPORT HttpServerProperties
   // limit, which is much smaller than the ServerInfoMap's limit.
   typedef base::LRUCache<QuicServerInfoMapKey, std::string> QuicServerInfoMap;
 
+  // TCP connect history of an IP endpoint. Used by TransportConnectJob to
+  // order addresses for Happy Eyeballs. Not persisted.
+  struct NET_EXPORT ConnectRttInfo {
+    // Exponentially weighted moving average of successful connect times.
+    // Zero if no connection attempt has succeeded.
+    base::TimeDelta smoothed_rtt;
+    // Number of failed attempts since the last successful one.
+    int consecutive_failures = 0;
+  };
+
+  typedef std::pair<IPEndPoint, NetworkAnonymizationKey> ConnectRttMapKey;
+  typedef base::LRUCache<ConnectRttMapKey, ConnectRttInfo> ConnectRttMap;
+
   // If a |pref_delegate| is specified, it will be used to read/write the
   // properties to a pref file. Writes are rate limited to improve performance.
   //
@@ -401,6 +419,22 @@ class NET_EXPORT HttpServerProperties
       const url::SchemeHostPort& server,
       const NetworkAnonymizationKey& network_anonymization_key);
 
+  // Records that a TCP connection to |endpoint| was established in |rtt|.
+  void OnTransportConnectSucceeded(
+      const IPEndPoint& endpoint,
+      const NetworkAnonymizationKey& network_anonymization_key,
+      base::TimeDelta rtt);
+
+  // Records that a TCP connection attempt to |endpoint| failed.
+  void OnTransportConnectFailed(
+      const IPEndPoint& endpoint,
+      const NetworkAnonymizationKey& network_anonymization_key);
+
+  // Returns the connect history of |endpoint| or nullptr if there is none.
+  const ConnectRttInfo* GetConnectRttInfo(
+      const IPEndPoint& endpoint,
+      const NetworkAnonymizationKey& network_anonymization_key);
+
   // Save QuicServerInfo (in std::string form) for the given |server_id|, in the
   // context of |network_anonymization_key|.
   void SetQuicServerInfo(
@@ -550,6 +584,10 @@ class NET_EXPORT HttpServerProperties
       const quic::QuicServerId& server_id,
       const NetworkAnonymizationKey& network_anonymization_key) const;
 
+  ConnectRttMapKey CreateConnectRttKey(
+      const IPEndPoint& endpoint,
+      const NetworkAnonymizationKey& network_anonymization_key) const;
+
   // Return the iterator for |server| in the context of
   // |network_anonymization_key|, or for its canonical host, or end. Skips over
   // ServerInfos without |alternative_service_info| populated.
@@ -663,6 +701,8 @@ class NET_EXPORT HttpServerProperties
 
   size_t max_server_configs_stored_in_properties_;
 
+  ConnectRttMap connect_rtt_map_;
+
   // Used to post calls to WriteProperties().
   base::OneShotTimer prefs_update_timer_;
 
@@ -12,6 +12,7 @@
 #include "base/time/time.h"
 #include "base/timer/timer.h"
 #include "net/quic/platform/impl/quic_chromium_clock.h"
+#include "net/quic/quic_chromium_alarm_wheel.h"
 
 namespace net {
 
@@ -71,6 +72,41 @@ class QuicChromeAlarm : public quic::QuicAlarm, public base::TickClock {
   const std::unique_ptr<base::OneShotTimer> timer_;
 };
 
+class QuicChromeWheelAlarm : public quic::QuicAlarm,
+                             public QuicChromiumAlarmWheel::Entry {
+ public:
+  QuicChromeWheelAlarm(
+      QuicChromiumAlarmWheel* wheel,
+      quic::QuicArenaScopedPtr<quic::QuicAlarm::Delegate> delegate)
+      : quic::QuicAlarm(std::move(delegate)), wheel_(wheel) {}
+
+  ~QuicChromeWheelAlarm() override { wheel_->Cancel(this); }
+
+ protected:
+  void SetImpl() override {
+    DCHECK(deadline().IsInitialized());
+    wheel_->Schedule(this, deadline());
+  }
+
+  void CancelImpl() override {
+    DCHECK(!deadline().IsInitialized());
+    wheel_->Cancel(this);
+  }
+
+  // Moves the entry within the wheel in one step rather than cancelling it
+  // first.
+  void UpdateImpl() override {
+    DCHECK(deadline().IsInitialized());
+    wheel_->Schedule(this, deadline());
+  }
+
+ private:
+  // QuicChromiumAlarmWheel::Entry:
+  void OnExpired() override { Fire(); }
+
+  const raw_ptr<QuicChromiumAlarmWheel> wheel_;
+};
+
 }  // namespace
 
 QuicChromiumAlarmFactory::QuicChromiumAlarmFactory(
@@ -78,11 +114,28 @@ QuicChromiumAlarmFactory::QuicChromiumAlarmFactory(
     const quic::QuicClock* clock)
     : task_runner_(task_runner), clock_(clock) {}
 
+QuicChromiumAlarmFactory::QuicChromiumAlarmFactory(
+    base::SequencedTaskRunner* task_runner,
+    const quic::QuicClock* clock,
+    quic::QuicTime::Delta slack)
+    : task_runner_(task_runner),
+      clock_(clock),
+      wheel_(std::make_unique<QuicChromiumAlarmWheel>(task_runner,
+                                                       clock,
+                                                       slack)) {}
+
 QuicChromiumAlarmFactory::~QuicChromiumAlarmFactory() = default;
 
 quic::QuicArenaScopedPtr<quic::QuicAlarm> QuicChromiumAlarmFactory::CreateAlarm(
     quic::QuicArenaScopedPtr<quic::QuicAlarm::Delegate> delegate,
     quic::QuicConnectionArena* arena) {
+  if (wheel_) {
+    if (arena != nullptr)
+      return arena->New<QuicChromeWheelAlarm>(wheel_.get(),
+                                              std::move(delegate));
+    return quic::QuicArenaScopedPtr<quic::QuicAlarm>(
+        new QuicChromeWheelAlarm(wheel_.get(), std::move(delegate)));
+  }
   if (arena != nullptr) {
     return arena->New<QuicChromeAlarm>(clock_, task_runner_,
                                        std::move(delegate));
@@ -94,6 +147,11 @@ quic::QuicArenaScopedPtr<quic::QuicAlarm> QuicChromiumAlarmFactory::CreateAlarm(
 
 quic::QuicAlarm* QuicChromiumAlarmFactory::CreateAlarm(
     quic::QuicAlarm::Delegate* delegate) {
+  if (wheel_) {
+    return new QuicChromeWheelAlarm(
+        wheel_.get(),
+        quic::QuicArenaScopedPtr<quic::QuicAlarm::Delegate>(delegate));
+  }
   return new QuicChromeAlarm(
       clock_, task_runner_,
       quic::QuicArenaScopedPtr<quic::QuicAlarm::Delegate>(delegate));
@@ -8,6 +8,8 @@
 #ifndef NET_QUIC_QUIC_CHROMIUM_ALARM_FACTORY_H_
 #define NET_QUIC_QUIC_CHROMIUM_ALARM_FACTORY_H_
 
+#include <memory>
+
 #include "base/memory/raw_ptr.h"
 #include "net/base/net_export.h"
 #include "net/third_party/quiche/src/quiche/quic/core/quic_alarm_factory.h"
@@ -21,11 +23,19 @@ class SequencedTaskRunner;
 
 namespace net {
 
+class QuicChromiumAlarmWheel;
+
 class NET_EXPORT_PRIVATE QuicChromiumAlarmFactory
     : public quic::QuicAlarmFactory {
  public:
   QuicChromiumAlarmFactory(base::SequencedTaskRunner* task_runner,
                            const quic::QuicClock* clock);
+  // Alarms created by this factory share one timer through a
+  // QuicChromiumAlarmWheel instead of posting a task each; see there for how
+  // |slack| is applied.
+  QuicChromiumAlarmFactory(base::SequencedTaskRunner* task_runner,
+                           const quic::QuicClock* clock,
+                           quic::QuicTime::Delta slack);
 
   QuicChromiumAlarmFactory(const QuicChromiumAlarmFactory&) = delete;
   QuicChromiumAlarmFactory& operator=(const QuicChromiumAlarmFactory&) = delete;
@@ -41,6 +51,8 @@ class NET_EXPORT_PRIVATE QuicChromiumAlarmFactory
  private:
   raw_ptr<base::SequencedTaskRunner> task_runner_;
   const raw_ptr<const quic::QuicClock> clock_;
+  // Null unless alarms share a wheel.
+  std::unique_ptr<QuicChromiumAlarmWheel> wheel_;
 };
 
 }  // namespace net
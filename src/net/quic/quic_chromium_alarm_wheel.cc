@@ -0,0 +1,216 @@
+// Copyright 2022 The Chromium Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net/quic/quic_chromium_alarm_wheel.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "base/bind.h"
+#include "base/bits.h"
+#include "base/check_op.h"
+#include "base/location.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+#include "net/quic/platform/impl/quic_chromium_clock.h"
+#include "net/third_party/quiche/src/quiche/quic/core/quic_clock.h"
+
+namespace net {
+
+namespace {
+
+// Each tick is one millisecond.
+constexpr int64_t kMicrosecondsPerTick = 1000;
+
+// Only entries due at least this many ticks out are subject to slack.
+constexpr uint64_t kMinSlackedTicks = 1000;
+
+uint64_t RotateRight(uint64_t value, int shift) {
+  return shift == 0 ? value : (value >> shift) | (value << (64 - shift));
+}
+
+}  // namespace
+
+QuicChromiumAlarmWheel::Entry::Entry() = default;
+
+QuicChromiumAlarmWheel::Entry::~Entry() {
+  DCHECK(!IsScheduled());
+}
+
+QuicChromiumAlarmWheel::QuicChromiumAlarmWheel(
+    base::SequencedTaskRunner* task_runner,
+    const quic::QuicClock* clock,
+    quic::QuicTime::Delta slack)
+    : clock_(clock),
+      slack_ticks_(std::max<int64_t>(
+          slack.ToMicroseconds() / kMicrosecondsPerTick, 1)),
+      timer_(std::make_unique<base::OneShotTimer>(this)) {
+  timer_->SetTaskRunner(task_runner);
+}
+
+QuicChromiumAlarmWheel::~QuicChromiumAlarmWheel() {
+  DCHECK_EQ(size_, 0u);
+}
+
+void QuicChromiumAlarmWheel::Schedule(Entry* entry, quic::QuicTime deadline) {
+  if (entry->IsScheduled())
+    Cancel(entry);
+
+  // Rounding up means an entry never expires before its deadline.
+  uint64_t tick = ToTick(deadline + quic::QuicTime::Delta::FromMicroseconds(
+                                        kMicrosecondsPerTick - 1));
+  if (size_ == 0 || slack_ticks_ > 1) {
+    const uint64_t now_tick = ToTick(clock_->Now());
+    // Nothing needs processing between the last expiry and now.
+    if (size_ == 0)
+      current_tick_ = std::max(current_tick_, now_tick);
+    if (slack_ticks_ > 1 && tick >= now_tick + kMinSlackedTicks)
+      tick = (tick + slack_ticks_ - 1) / slack_ticks_ * slack_ticks_;
+  }
+  entry->tick_ = tick;
+  Insert(entry);
+  ++size_;
+
+  const uint64_t wakeup_tick = NextWakeupTick();
+  if (!timer_->IsRunning() || wakeup_tick < timer_tick_)
+    ArmTimer();
+}
+
+void QuicChromiumAlarmWheel::Cancel(Entry* entry) {
+  if (!entry->IsScheduled())
+    return;
+  entry->RemoveFromList();
+  if (slots_[entry->level_][entry->slot_].empty())
+    occupied_[entry->level_] &= ~(uint64_t{1} << entry->slot_);
+  --size_;
+  // A timer that fires with nothing due is cheaper than restarting it on
+  // every cancellation, so it is only stopped once the wheel is empty.
+  if (size_ == 0)
+    timer_->Stop();
+}
+
+void QuicChromiumAlarmWheel::Insert(Entry* entry) {
+  constexpr uint64_t kMaxDelta = (uint64_t{1} << (kSlotBits * kLevels)) - 1;
+
+  // Entries which are already due go into the next slot to be processed, and
+  // those beyond the range of the wheel are parked in the top level and
+  // reinserted when it cascades.
+  uint64_t tick = std::max(entry->tick_, current_tick_);
+  uint64_t delta = tick - current_tick_;
+  if (delta > kMaxDelta) {
+    tick = current_tick_ + kMaxDelta;
+    delta = kMaxDelta;
+  }
+
+  int level = 0;
+  while (delta >= uint64_t{1} << (kSlotBits * (level + 1)))
+    ++level;
+  const int slot = (tick >> (kSlotBits * level)) & (kSlots - 1);
+
+  entry->level_ = level;
+  entry->slot_ = slot;
+  slots_[level][slot].Append(entry);
+  occupied_[level] |= uint64_t{1} << slot;
+}
+
+void QuicChromiumAlarmWheel::Cascade(int level) {
+  const int slot = (current_tick_ >> (kSlotBits * level)) & (kSlots - 1);
+  base::LinkedList<Entry>& list = slots_[level][slot];
+  occupied_[level] &= ~(uint64_t{1} << slot);
+  // Entries in this slot are now less than a slot of this level away, so
+  // reinserting them moves them down at least one level.
+  while (!list.empty()) {
+    Entry* entry = list.head()->value();
+    entry->RemoveFromList();
+    Insert(entry);
+  }
+}
+
+uint64_t QuicChromiumAlarmWheel::NextWakeupTick() const {
+  DCHECK_GT(size_, 0u);
+  uint64_t wakeup_tick = std::numeric_limits<uint64_t>::max();
+  for (int level = 0; level < kLevels; ++level) {
+    if (!occupied_[level])
+      continue;
+    // A slot in an upper level needs attention when it cascades, which is
+    // when |current_tick_| reaches the start of the span the slot covers.
+    const int shift = kSlotBits * level;
+    const uint64_t first_span =
+        (current_tick_ + (uint64_t{1} << shift) - 1) >> shift;
+    const uint64_t occupied =
+        RotateRight(occupied_[level], first_span & (kSlots - 1));
+    const uint64_t span =
+        first_span + base::bits::CountTrailingZeroBits(occupied);
+    wakeup_tick = std::min(wakeup_tick, span << shift);
+  }
+  return wakeup_tick;
+}
+
+void QuicChromiumAlarmWheel::ArmTimer() {
+  timer_tick_ = NextWakeupTick();
+  const quic::QuicTime wakeup_time =
+      quic::QuicTime::Zero() +
+      quic::QuicTime::Delta::FromMicroseconds(timer_tick_ *
+                                              kMicrosecondsPerTick);
+  const int64_t delay_us = (wakeup_time - clock_->Now()).ToMicroseconds();
+  // Unretained is safe because base::OneShotTimer never runs its task after
+  // being deleted.
+  timer_->Start(FROM_HERE, base::Microseconds(delay_us),
+                base::BindOnce(&QuicChromiumAlarmWheel::OnTimer,
+                               base::Unretained(this)));
+}
+
+void QuicChromiumAlarmWheel::OnTimer() {
+  const uint64_t now_tick = ToTick(clock_->Now());
+  while (size_ > 0) {
+    const uint64_t tick = NextWakeupTick();
+    // In tests, the time source used by the scheduler may not be in sync with
+    // |clock_|, so the timer may fire before anything is due.
+    if (tick > now_tick)
+      break;
+    current_tick_ = tick;
+
+    int top_level = 0;
+    while (top_level + 1 < kLevels &&
+           (tick & ((uint64_t{1} << (kSlotBits * (top_level + 1))) - 1)) == 0) {
+      ++top_level;
+    }
+    for (int level = top_level; level > 0; --level)
+      Cascade(level);
+
+    // Entries expiring now are detached first, since OnExpired() may
+    // schedule entries into the same slot again.
+    const int slot = tick & (kSlots - 1);
+    base::LinkedList<Entry> expired;
+    while (!slots_[0][slot].empty()) {
+      Entry* entry = slots_[0][slot].head()->value();
+      entry->RemoveFromList();
+      expired.Append(entry);
+    }
+    occupied_[0] &= ~(uint64_t{1} << slot);
+    current_tick_ = tick + 1;
+
+    while (!expired.empty()) {
+      Entry* entry = expired.head()->value();
+      entry->RemoveFromList();
+      --size_;
+      entry->OnExpired();
+    }
+  }
+  current_tick_ = std::max(current_tick_, now_tick + 1);
+
+  if (size_ > 0)
+    ArmTimer();
+}
+
+uint64_t QuicChromiumAlarmWheel::ToTick(quic::QuicTime time) const {
+  const int64_t us = (time - quic::QuicTime::Zero()).ToMicroseconds();
+  return us > 0 ? us / kMicrosecondsPerTick : 0;
+}
+
+base::TimeTicks QuicChromiumAlarmWheel::NowTicks() const {
+  return quic::QuicChromiumClock::QuicTimeToTimeTicks(clock_->Now());
+}
+
+}  // namespace net
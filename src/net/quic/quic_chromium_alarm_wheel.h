@@ -0,0 +1,111 @@
+// Copyright 2022 The Chromium Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef NET_QUIC_QUIC_CHROMIUM_ALARM_WHEEL_H_
+#define NET_QUIC_QUIC_CHROMIUM_ALARM_WHEEL_H_
+
+#include <stdint.h>
+
+#include <memory>
+
+#include "base/containers/linked_list.h"
+#include "base/memory/raw_ptr.h"
+#include "base/time/tick_clock.h"
+#include "net/base/net_export.h"
+#include "net/third_party/quiche/src/quiche/quic/core/quic_time.h"
+
+namespace base {
+class OneShotTimer;
+class SequencedTaskRunner;
+}  // namespace base
+
+namespace quic {
+class QuicClock;
+}  // namespace quic
+
+namespace net {
+
+// A hierarchical timer wheel which runs any number of alarms off a single
+// base::OneShotTimer. Scheduling, rescheduling and cancelling an entry are
+// O(1) and never touch the task queue unless the earliest deadline moves
+// earlier, so alarms that are re-armed on every packet do not leave cancelled
+// delayed tasks behind.
+//
+// Deadlines are rounded up to whole milliseconds, which is the granularity
+// QUIC sets its alarms with anyway. Entries due at least a second out, such as
+// idle and ping alarms, are further rounded up to a multiple of |slack| so that
+// those of different connections expire together.
+class NET_EXPORT_PRIVATE QuicChromiumAlarmWheel : public base::TickClock {
+ public:
+  class NET_EXPORT_PRIVATE Entry : public base::LinkNode<Entry> {
+   public:
+    Entry();
+    Entry(const Entry&) = delete;
+    Entry& operator=(const Entry&) = delete;
+
+    bool IsScheduled() const { return next() != nullptr; }
+
+   protected:
+    // Must be cancelled by the subclass before destruction.
+    virtual ~Entry();
+
+    // Runs when the deadline passed to Schedule() is reached.
+    virtual void OnExpired() = 0;
+
+   private:
+    friend class QuicChromiumAlarmWheel;
+
+    uint64_t tick_ = 0;
+    uint8_t level_ = 0;
+    uint8_t slot_ = 0;
+  };
+
+  QuicChromiumAlarmWheel(base::SequencedTaskRunner* task_runner,
+                         const quic::QuicClock* clock,
+                         quic::QuicTime::Delta slack);
+
+  QuicChromiumAlarmWheel(const QuicChromiumAlarmWheel&) = delete;
+  QuicChromiumAlarmWheel& operator=(const QuicChromiumAlarmWheel&) = delete;
+
+  ~QuicChromiumAlarmWheel() override;
+
+  // Schedules |entry| to expire at |deadline|, replacing any earlier deadline.
+  void Schedule(Entry* entry, quic::QuicTime deadline);
+
+  void Cancel(Entry* entry);
+
+ private:
+  static constexpr int kLevels = 4;
+  static constexpr int kSlotBits = 6;
+  static constexpr int kSlots = 1 << kSlotBits;
+
+  void Insert(Entry* entry);
+  void Cascade(int level);
+  // Returns the tick at which the wheel next has work to do. Must not be
+  // called while the wheel is empty.
+  uint64_t NextWakeupTick() const;
+  void ArmTimer();
+  void OnTimer();
+  uint64_t ToTick(quic::QuicTime time) const;
+
+  // base::TickClock:
+  base::TimeTicks NowTicks() const override;
+
+  const raw_ptr<const quic::QuicClock> clock_;
+  const int64_t slack_ticks_;
+  const std::unique_ptr<base::OneShotTimer> timer_;
+
+  base::LinkedList<Entry> slots_[kLevels][kSlots];
+  // One bit per non-empty slot.
+  uint64_t occupied_[kLevels] = {};
+  size_t size_ = 0;
+  // The first tick that has not been processed yet.
+  uint64_t current_tick_ = 0;
+  // The tick |timer_| fires at, if it is running.
+  uint64_t timer_tick_ = 0;
+};
+
+}  // namespace net
+
+#endif  // NET_QUIC_QUIC_CHROMIUM_ALARM_WHEEL_H_
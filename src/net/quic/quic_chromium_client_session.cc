@@ -76,6 +76,10 @@ const size_t kWaitTimeForNewNetworkSecs = 10;
 
 const size_t kMinRetryTimeForDefaultNetworkSecs = 1;
 
+// Maximum number of failed probes started on write errors, after which a
+// write error closes the connection again.
+const int kMaxProbesOnWriteError = 3;
+
 // These values are persisted to logs. Entries should not be renumbered,
 // and numeric values should never be reused.
 enum class AcceptChEntries {
@@ -289,7 +293,10 @@ base::Value NetLogQuicClientSessionParams(
     const quic::QuicConnectionId& client_connection_id,
     const quic::ParsedQuicVersionVector& supported_versions,
     int cert_verify_flags,
-    bool require_confirmation) {
+    bool require_confirmation,
+    bool migrate_on_ip_change,
+    bool migrate_on_network_change,
+    bool allow_port_migration) {
   base::Value::Dict dict;
   dict.Set("host", session_key->server_id().host());
   dict.Set("port", session_key->server_id().port());
@@ -304,6 +311,9 @@ base::Value NetLogQuicClientSessionParams(
     dict.Set("client_connection_id", client_connection_id.ToString());
   }
   dict.Set("versions", ParsedQuicVersionVectorToString(supported_versions));
+  dict.Set("migrate_on_ip_change", migrate_on_ip_change);
+  dict.Set("migrate_on_network_change", migrate_on_network_change);
+  dict.Set("allow_port_migration", allow_port_migration);
   return base::Value(std::move(dict));
 }
 
@@ -926,6 +936,7 @@ QuicChromiumClientSession::QuicChromiumClientSession(
     quic::QuicTime::Delta retransmittable_on_wire_timeout,
     bool migrate_idle_session,
     bool allow_port_migration,
+    bool migrate_on_ip_change,
     base::TimeDelta idle_migration_period,
     base::TimeDelta max_time_on_non_default_network,
     int max_migrations_to_non_default_network_on_write_error,
@@ -956,6 +967,7 @@ QuicChromiumClientSession::QuicChromiumClientSession(
           migrate_sessions_on_network_change_v2),
       migrate_idle_session_(migrate_idle_session),
       allow_port_migration_(allow_port_migration),
+      migrate_on_ip_change_(migrate_on_ip_change),
       idle_migration_period_(idle_migration_period),
       max_time_on_non_default_network_(max_time_on_non_default_network),
       max_migrations_to_non_default_network_on_write_error_(
@@ -1009,7 +1021,9 @@ QuicChromiumClientSession::QuicChromiumClientSession(
   net_log_.BeginEvent(NetLogEventType::QUIC_SESSION, [&] {
     return NetLogQuicClientSessionParams(
         &session_key, connection_id(), connection->client_connection_id(),
-        supported_versions(), cert_verify_flags, require_confirmation_);
+        supported_versions(), cert_verify_flags, require_confirmation_,
+        migrate_on_ip_change_, migrate_session_on_network_change_v2_,
+        allow_port_migration_);
   });
   IPEndPoint address;
   if (socket_raw && socket_raw->GetLocalAddress(&address) == OK &&
@@ -1023,6 +1037,8 @@ QuicChromiumClientSession::QuicChromiumClientSession(
     connection->set_initial_retransmittable_on_wire_timeout(
         retransmittable_on_wire_timeout);
   }
+  if (connection->writer()->SupportsReleaseTime())
+    connection->set_per_packet_options(&release_time_options_);
 }
 
 QuicChromiumClientSession::~QuicChromiumClientSession() {
@@ -1049,6 +1065,7 @@ QuicChromiumClientSession::~QuicChromiumClientSession() {
     CancelAllRequests(ERR_UNEXPECTED);
   }
   connection()->set_debug_visitor(nullptr);
+  connection()->set_per_packet_options(nullptr);
 
   if (connection()->connected()) {
     // Ensure that the connection is closed by the time the session is
@@ -2113,6 +2130,28 @@ int QuicChromiumClientSession::HandleWriteError(
     }
   }
 
+  // Writes fail once the address the socket sends from is gone, which may be
+  // before the IP address change is notified. Treat the packets as lost while
+  // a new socket is probed, so that they are retransmitted after migrating
+  // instead of the connection being closed.
+  if (migrate_on_ip_change_ && error_code != ERR_MSG_TOO_BIG &&
+      stream_factory_ != nullptr && OneRttKeysAvailable() &&
+      version().UsesHttp3()) {
+    if (!connection()->HasPendingPathValidation() &&
+        !probe_posted_on_write_error_) {
+      if (probes_on_write_error_ >= kMaxProbesOnWriteError)
+        return error_code;
+      probe_posted_on_write_error_ = true;
+      // Probing is not safe under the call stack of
+      // quic::QuicConnection::WritePacket.
+      task_runner_->PostTask(
+          FROM_HERE,
+          base::BindOnce(&QuicChromiumClientSession::ProbeOnWriteError,
+                         weak_factory_.GetWeakPtr()));
+    }
+    return packet->size();
+  }
+
   if (error_code == ERR_MSG_TOO_BIG || stream_factory_ == nullptr ||
       !migrate_session_on_network_change_v2_ || !OneRttKeysAvailable() ||
       !version().UsesHttp3()) {
@@ -2346,6 +2385,7 @@ void QuicChromiumClientSession::OnPortMigrationProbeSucceeded(
   LogMigrateToSocketStatus(true);
 
   num_migrations_++;
+  probes_on_write_error_ = 0;
   HistogramAndLogMigrationSuccess(connection_id());
 }
 
@@ -2852,6 +2892,20 @@ void QuicChromiumClientSession::NotifyRequestsOfConfirmation(int net_error) {
   waiting_for_confirmation_callbacks_.clear();
 }
 
+void QuicChromiumClientSession::OnIPAddressChanged() {
+  if (!migrate_on_ip_change_ || !allow_port_migration_ ||
+      migrate_session_early_v2_) {
+    return;
+  }
+  MaybeMigrateToDifferentPortOnPathDegrading();
+}
+
+void QuicChromiumClientSession::ProbeOnWriteError() {
+  probe_posted_on_write_error_ = false;
+  ++probes_on_write_error_;
+  OnIPAddressChanged();
+}
+
 void QuicChromiumClientSession::MaybeMigrateToDifferentPortOnPathDegrading() {
   DCHECK(allow_port_migration_ && !migrate_session_early_v2_);
 
@@ -561,6 +561,7 @@ class NET_EXPORT_PRIVATE QuicChromiumClientSession
       quic::QuicTime::Delta retransmittable_on_wire_timeout,
       bool migrate_idle_session,
       bool allow_port_migration,
+      bool migrate_on_ip_change,
       base::TimeDelta idle_migration_period,
       base::TimeDelta max_time_on_non_default_network,
       int max_migrations_to_non_default_network_on_write_error,
@@ -807,6 +808,15 @@ class NET_EXPORT_PRIVATE QuicChromiumClientSession
   // network. Migrates this session to |new_network| if appropriate.
   void OnNetworkMadeDefault(handles::NetworkHandle new_network);
 
+  // Called when a local IP address changes on a platform without network
+  // handles. The socket may still be using an address that is gone, so this
+  // session probes a new socket and migrates to it, as it would on path
+  // degrading with port migration.
+  void OnIPAddressChanged();
+
+  // Posted by HandleWriteError() to probe a new socket outside of the write.
+  void ProbeOnWriteError();
+
   // Schedules a migration alarm to wait for a new network.
   void OnNoNewNetwork();
 
@@ -969,6 +979,13 @@ class NET_EXPORT_PRIVATE QuicChromiumClientSession
   bool migrate_session_on_network_change_v2_;
   bool migrate_idle_session_;
   bool allow_port_migration_;
+  bool migrate_on_ip_change_;
+  // Number of probes started on write errors since the last migration. Write
+  // errors are treated as packet loss while this is under a limit.
+  int probes_on_write_error_ = 0;
+  // Whether a probe has been posted on a write error and not yet started, so
+  // that the writes failing in the meantime do not post more of them.
+  bool probe_posted_on_write_error_ = false;
   // Session can be migrated if its idle time is within this period.
   base::TimeDelta idle_migration_period_;
   base::TimeDelta max_time_on_non_default_network_;
@@ -1070,6 +1087,10 @@ class NET_EXPORT_PRIVATE QuicChromiumClientSession
 
   QuicChromiumPathValidationWriterDelegate path_validation_writer_delegate_;
 
+  // Carries the release time of each packet from the connection to the
+  // writer when the socket can pace packets itself.
+  QuicChromiumPacketWriter::ReleaseTimeOptions release_time_options_;
+
   // Map of origin to Accept-CH header field values received via ALPS.
   base::flat_map<url::SchemeHostPort, std::string>
       accept_ch_entries_received_via_alps_;
@@ -21,6 +21,7 @@
 #include "net/quic/quic_chromium_client_session.h"
 #include "net/quic/quic_http_utils.h"
 #include "net/spdy/spdy_log_util.h"
+#include "net/third_party/quiche/src/quiche/common/platform/api/quiche_mem_slice.h"
 #include "net/third_party/quiche/src/quiche/quic/core/http/quic_spdy_session.h"
 #include "net/third_party/quiche/src/quiche/quic/core/http/spdy_utils.h"
 #include "net/third_party/quiche/src/quiche/quic/core/quic_utils.h"
@@ -280,6 +281,22 @@ int QuicChromiumClientStream::Handle::WritevStreamData(
   return ERR_IO_PENDING;
 }
 
+int QuicChromiumClientStream::Handle::WriteStreamDataNoCopy(
+    scoped_refptr<IOBuffer> buffer,
+    int buf_len,
+    bool fin,
+    CompletionOnceCallback callback) {
+  ScopedBoolSaver saver(&may_invoke_callbacks_, false);
+  if (!stream_)
+    return net_error_;
+
+  if (stream_->WriteStreamDataNoCopy(std::move(buffer), buf_len, fin))
+    return HandleIOComplete(OK);
+
+  SetCallback(std::move(callback), &write_callback_);
+  return ERR_IO_PENDING;
+}
+
 int QuicChromiumClientStream::Handle::Read(IOBuffer* buf, int buf_len) {
   if (!stream_)
     return net_error_;
@@ -651,6 +668,28 @@ bool QuicChromiumClientStream::WritevStreamData(
   return !HasBufferedData();  // Was all data written?
 }
 
+bool QuicChromiumClientStream::WriteStreamDataNoCopy(
+    scoped_refptr<IOBuffer> buffer,
+    int buf_len,
+    bool fin) {
+  // For gQUIC, this must not be called when data is buffered because headers
+  // are sent on the dedicated header stream.
+  DCHECK(!HasBufferedData() || VersionUsesHttp3(quic_version_));
+  DCHECK_GT(buf_len, 0);
+  // The slice holds the only reference to |buffer| that QUICHE sees, and
+  // releases it once the data is acknowledged.
+  const char* data = buffer->data();
+  quiche::QuicheMemSlice slice(
+      quiche::QuicheMemSlice::InPlace(), data, static_cast<size_t>(buf_len),
+      base::BindOnce([](scoped_refptr<IOBuffer>) {}, std::move(buffer)));
+  if (WriteBodySlices(absl::MakeSpan(&slice, 1), fin).bytes_consumed == 0) {
+    // Over the buffered data limit, which WriteOrBufferBody() ignores. Buffer
+    // a copy instead.
+    WriteOrBufferBody(slice.AsStringView(), fin);
+  }
+  return !HasBufferedData();  // Was all data written?
+}
+
 std::unique_ptr<QuicChromiumClientStream::Handle>
 QuicChromiumClientStream::CreateHandle() {
   DCHECK(!handle_);
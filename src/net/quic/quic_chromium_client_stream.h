@@ -102,6 +102,15 @@ class NET_EXPORT_PRIVATE QuicChromiumClientStream
                          bool fin,
                          CompletionOnceCallback callback);
 
+    // Same as WriteStreamData except it writes the first |buf_len| bytes of
+    // |buffer| without copying them. A reference to |buffer| is kept until
+    // the data is acknowledged, so its contents must not be modified after
+    // this call, even once the write has completed.
+    int WriteStreamDataNoCopy(scoped_refptr<IOBuffer> buffer,
+                              int buf_len,
+                              bool fin,
+                              CompletionOnceCallback callback);
+
     // Reads at most |buf_len| bytes into |buf|. Returns the number of bytes
     // read.
     int Read(IOBuffer* buf, int buf_len);
@@ -273,6 +282,11 @@ class NET_EXPORT_PRIVATE QuicChromiumClientStream
   bool WritevStreamData(const std::vector<scoped_refptr<IOBuffer>>& buffers,
                         const std::vector<int>& lengths,
                         bool fin);
+  // Same as WriteStreamData except it writes the first |buf_len| bytes of
+  // |buffer| without copying them.
+  bool WriteStreamDataNoCopy(scoped_refptr<IOBuffer> buffer,
+                             int buf_len,
+                             bool fin);
 
   // Creates a new Handle for this stream. Must only be called once.
   std::unique_ptr<QuicChromiumClientStream::Handle> CreateHandle();
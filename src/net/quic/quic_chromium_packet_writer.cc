@@ -81,6 +81,11 @@ void QuicChromiumPacketWriter::ReusableIOBuffer::Set(const char* buffer,
   std::memcpy(data(), buffer, buf_len);
 }
 
+std::unique_ptr<quic::PerPacketOptions>
+QuicChromiumPacketWriter::ReleaseTimeOptions::Clone() const {
+  return std::make_unique<ReleaseTimeOptions>(*this);
+}
+
 QuicChromiumPacketWriter::QuicChromiumPacketWriter(
     DatagramClientSocket* socket,
     base::SequencedTaskRunner* task_runner)
@@ -124,9 +129,15 @@ quic::WriteResult QuicChromiumPacketWriter::WritePacket(
     size_t buf_len,
     const quic::QuicIpAddress& self_address,
     const quic::QuicSocketAddress& peer_address,
-    quic::PerPacketOptions* /*options*/) {
+    quic::PerPacketOptions* options) {
   DCHECK(!IsWriteBlocked());
   SetPacket(buffer, buf_len);
+  if (SupportsReleaseTime()) {
+    socket_->SetReleaseDelay(
+        options ? base::Microseconds(
+                      options->release_time_delay.ToMicroseconds())
+                : base::TimeDelta());
+  }
   return WritePacketToSocketImpl();
 }
 
@@ -254,7 +265,7 @@ quic::QuicByteCount QuicChromiumPacketWriter::GetMaxPacketSize(
 }
 
 bool QuicChromiumPacketWriter::SupportsReleaseTime() const {
-  return false;
+  return socket_->SupportsReleaseTime();
 }
 
 bool QuicChromiumPacketWriter::IsBatchMode() const {
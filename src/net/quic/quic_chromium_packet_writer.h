@@ -7,6 +7,8 @@
 
 #include <stddef.h>
 
+#include <memory>
+
 #include "base/memory/raw_ptr.h"
 #include "base/memory/weak_ptr.h"
 #include "base/timer/timer.h"
@@ -46,6 +48,13 @@ class NET_EXPORT_PRIVATE QuicChromiumPacketWriter
     size_t capacity_;
     size_t size_ = 0;
   };
+  // Through these, quic::QuicConnection passes the pacing departure time of
+  // each packet to a writer whose socket supports release time, so that the
+  // kernel paces a burst of packets instead of a send alarm per packet.
+  struct NET_EXPORT_PRIVATE ReleaseTimeOptions : public quic::PerPacketOptions {
+    std::unique_ptr<quic::PerPacketOptions> Clone() const override;
+  };
+
   // Delegate interface which receives notifications on socket write events.
   class NET_EXPORT_PRIVATE Delegate {
    public:
@@ -14,10 +14,6 @@ namespace net {
 
 namespace {
 
-// The maximum receive window sizes for QUIC sessions and streams.
-const int32_t kQuicSessionMaxRecvWindowSize = 15 * 1024 * 1024;  // 15 MB
-const int32_t kQuicStreamMaxRecvWindowSize = 6 * 1024 * 1024;    // 6 MB
-
 // Set the maximum number of undecryptable packets the connection will store.
 const int32_t kMaxUndecryptablePackets = 100;
 
@@ -61,8 +57,9 @@ quic::QuicConfig InitializeQuicConfig(const QuicParams& params) {
   config.SetClientConnectionOptions(params.client_connection_options);
   config.set_max_undecryptable_packets(kMaxUndecryptablePackets);
   config.SetInitialSessionFlowControlWindowToSend(
-      kQuicSessionMaxRecvWindowSize);
-  config.SetInitialStreamFlowControlWindowToSend(kQuicStreamMaxRecvWindowSize);
+      params.session_max_recv_window_size);
+  config.SetInitialStreamFlowControlWindowToSend(
+      params.stream_max_recv_window_size);
   config.SetBytesForConnectionIdToSend(0);
   return config;
 }
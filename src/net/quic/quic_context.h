@@ -65,6 +65,10 @@ const int64_t kMaxMigrationsToNonDefaultNetworkOnPathDegrading = 5;
 // and does not consume "too much" memory.
 const int32_t kQuicSocketReceiveBufferSize = 1024 * 1024;  // 1MB
 
+// The default maximum receive window sizes for QUIC sessions and streams.
+const int32_t kQuicSessionMaxRecvWindowSize = 15 * 1024 * 1024;  // 15 MB
+const int32_t kQuicStreamMaxRecvWindowSize = 6 * 1024 * 1024;    // 6 MB
+
 // Structure containing simple configuration options and experiments for QUIC.
 struct NET_EXPORT QuicParams {
   QuicParams();
@@ -90,8 +94,29 @@ struct NET_EXPORT QuicParams {
   // Set of QUIC tags to send in the handshake's connection options that only
   // affect the client.
   quic::QuicTagVector client_connection_options;
+  // Receive windows advertised to the peer for the whole session and for
+  // each stream.
+  int32_t session_max_recv_window_size = kQuicSessionMaxRecvWindowSize;
+  int32_t stream_max_recv_window_size = kQuicStreamMaxRecvWindowSize;
   // Enables experimental optimization for receiving data in UDPSocket.
   bool enable_socket_recv_optimization = false;
+  // If true, the alarms of all connections share one timer wheel rather than
+  // posting a delayed task each.
+  bool use_alarm_wheel = false;
+  // With |use_alarm_wheel|, alarms due at least a second out, such as idle and
+  // ping alarms, may fire up to this much late so that they coalesce across
+  // connections.
+  base::TimeDelta alarm_wheel_slack;
+  // If true, packets are handed to the socket ahead of their pacing time and
+  // stamped with a release time (SO_TXTIME), so that the kernel paces them
+  // rather than an alarm per packet. Requires the fq qdisc on Linux; ignored
+  // where the socket cannot do this.
+  bool enable_pacing_offload = false;
+  // If true, connections share one unconnected UDP socket per address family
+  // and received packets are routed to them by client connection ID. Only
+  // applies to versions that support client connection IDs. Disables
+  // connection migration.
+  bool use_shared_socket = false;
 
   // Active QUIC experiments
 
@@ -135,6 +160,10 @@ struct NET_EXPORT QuicParams {
   // If true, sessions with open streams will attempt to migrate to a different
   // port when the current path is poor.
   bool allow_port_migration = true;
+  // If true, sessions also migrate to a different port when a local IP address
+  // changes or writes start failing, on platforms where network handles are
+  // not supported. Requires |allow_port_migration|.
+  bool migrate_sessions_on_ip_change = false;
   // A session can be migrated if its idle time is within this period.
   base::TimeDelta idle_session_migration_period =
       kDefaultIdleSessionMigrationPeriod;
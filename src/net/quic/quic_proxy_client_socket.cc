@@ -22,6 +22,13 @@
 
 namespace net {
 
+namespace {
+
+// Writes smaller than this are copied even with zero-copy writes enabled.
+constexpr int kMinZeroCopyWriteSize = 16 * 1024;
+
+}  // namespace
+
 QuicProxyClientSocket::QuicProxyClientSocket(
     std::unique_ptr<QuicChromiumClientStream::Handle> stream,
     std::unique_ptr<QuicChromiumClientSession::Handle> session,
@@ -74,13 +81,19 @@ int QuicProxyClientSocket::RestartWithAuth(CompletionOnceCallback callback) {
   return ERR_UNABLE_TO_REUSE_CONNECTION_FOR_PROXY_AUTH;
 }
 
-// Ignore priority changes, just use priority of initial request. Since multiple
-// requests are pooled on the QuicProxyClientSocket, reprioritization doesn't
-// really work.
-//
-// TODO(mmenke):  Use a single priority value for all QuicProxyClientSockets,
-// regardless of what priority they're created with.
-void QuicProxyClientSocket::SetStreamPriority(RequestPriority priority) {}
+// Reprioritizes the tunnel stream relative to other streams on the session.
+// With HTTP/3 this also sends a PRIORITY_UPDATE frame with the corresponding
+// urgency. HttpProxyConnectJob does not forward request priority changes here,
+// since multiple requests are pooled on the tunnel; this is for callers which
+// own the tunnel and know what it carries.
+void QuicProxyClientSocket::SetStreamPriority(RequestPriority priority) {
+  // The stream may have closed since, e.g. on a late demotion.
+  if (!IsConnected())
+    return;
+  spdy::SpdyPriority spdy_priority =
+      ConvertRequestPriorityToQuicPriority(priority);
+  stream_->SetPriority(spdy::SpdyStreamPrecedence(spdy_priority));
+}
 
 // Sends a HEADERS frame to the proxy with a CONNECT request
 // for the specified endpoint.  Waits for the server to send back
@@ -104,6 +117,8 @@ int QuicProxyClientSocket::Connect(CompletionOnceCallback callback) {
 
 void QuicProxyClientSocket::Disconnect() {
   connect_callback_.Reset();
+  request_headers_pending_ = false;
+  pending_request_headers_.clear();
   read_callback_.Reset();
   read_buf_ = nullptr;
   write_callback_.Reset();
@@ -177,10 +192,14 @@ int QuicProxyClientSocket::Read(IOBuffer* buf,
     return 0;
   }
 
-  int rv =
-      stream_->ReadBody(buf, buf_len,
-                        base::BindOnce(&QuicProxyClientSocket::OnReadComplete,
-                                       weak_factory_.GetWeakPtr()));
+  // Nothing can be read before the request is sent.
+  int rv = SendPendingRequestHeaders();
+  if (rv < 0)
+    return rv;
+
+  rv = stream_->ReadBody(buf, buf_len,
+                         base::BindOnce(&QuicProxyClientSocket::OnReadComplete,
+                                        weak_factory_.GetWeakPtr()));
 
   if (rv == ERR_IO_PENDING) {
     read_callback_ = std::move(callback);
@@ -224,10 +243,30 @@ int QuicProxyClientSocket::Write(
   net_log_.AddByteTransferEvent(NetLogEventType::SOCKET_BYTES_SENT, buf_len,
                                 buf->data());
 
-  int rv = stream_->WriteStreamData(
-      base::StringPiece(buf->data(), buf_len), false,
-      base::BindOnce(&QuicProxyClientSocket::OnWriteComplete,
-                     weak_factory_.GetWeakPtr()));
+  // The request held back by Fast Open goes out in the same packet as the
+  // first data, which is usually small enough to fit, e.g. a ClientHello.
+  std::unique_ptr<quic::QuicConnection::ScopedPacketFlusher> bundler;
+  if (request_headers_pending_) {
+    bundler = session_->CreatePacketBundler();
+    int rv = SendPendingRequestHeaders();
+    if (rv < 0)
+      return rv;
+  }
+
+  int rv;
+  // Small writes are cheap to copy, and copying them avoids holding on to a
+  // whole read buffer for a few bytes until they are acknowledged.
+  if (zero_copy_writes_ && buf_len >= kMinZeroCopyWriteSize) {
+    rv = stream_->WriteStreamDataNoCopy(
+        buf, buf_len, false,
+        base::BindOnce(&QuicProxyClientSocket::OnWriteComplete,
+                       weak_factory_.GetWeakPtr()));
+  } else {
+    rv = stream_->WriteStreamData(
+        base::StringPiece(buf->data(), buf_len), false,
+        base::BindOnce(&QuicProxyClientSocket::OnWriteComplete,
+                       weak_factory_.GetWeakPtr()));
+  }
   if (rv == OK)
     return buf_len;
 
@@ -377,9 +416,26 @@ int QuicProxyClientSocket::DoSendRequest() {
   spdy::Http2HeaderBlock headers;
   CreateSpdyHeadersFromHttpRequest(request_, request_.extra_headers, &headers);
 
+  // With Fast Open the tunnel is usable before the reply, so the request can
+  // wait for the first Write() and share its packet.
+  if (use_fastopen_) {
+    pending_request_headers_ = std::move(headers);
+    request_headers_pending_ = true;
+    return OK;
+  }
+
   return stream_->WriteHeaders(std::move(headers), false, nullptr);
 }
 
+int QuicProxyClientSocket::SendPendingRequestHeaders() {
+  if (!request_headers_pending_)
+    return OK;
+  request_headers_pending_ = false;
+  int rv = stream_->WriteHeaders(std::move(pending_request_headers_), false,
+                                 nullptr);
+  return rv < 0 ? rv : OK;
+}
+
 int QuicProxyClientSocket::DoSendRequestComplete(int result) {
   if (result >= 0) {
     // Wait for HEADERS frame from the server
@@ -79,6 +79,19 @@ class NET_EXPORT_PRIVATE QuicProxyClientSocket : public ProxyClientSocket {
   int GetPeerAddress(IPEndPoint* address) const override;
   int GetLocalAddress(IPEndPoint* address) const override;
 
+  // Lets Write() pass the caller's buffer to the stream instead of copying
+  // it. The stream keeps a reference to the buffer until the data is
+  // acknowledged, so this is only for callers which never modify a buffer
+  // after writing it.
+  void set_zero_copy_writes(bool zero_copy_writes) {
+    zero_copy_writes_ = zero_copy_writes;
+  }
+
+  // With Fast Open, Connect() completes without sending the CONNECT request,
+  // which is then sent with the first Write(), or before the first Read().
+  // Sends it now instead, for tunnels kept unused for a while.
+  int SendPendingRequestHeaders();
+
  private:
   enum State {
     STATE_DISCONNECTED,
@@ -149,6 +162,10 @@ class NET_EXPORT_PRIVATE QuicProxyClientSocket : public ProxyClientSocket {
 
   bool use_fastopen_;
   bool read_headers_pending_;
+  // The CONNECT request held back by Fast Open.
+  bool request_headers_pending_ = false;
+  spdy::Http2HeaderBlock pending_request_headers_;
+  bool zero_copy_writes_ = false;
 
   const NetLogWithSource net_log_;
 
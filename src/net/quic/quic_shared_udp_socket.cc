@@ -0,0 +1,534 @@
+// Copyright 2022 The Chromium Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net/quic/quic_shared_udp_socket.h"
+
+#include <string.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/check.h"
+#include "base/location.h"
+#include "base/threading/thread_task_runner_handle.h"
+#include "build/build_config.h"
+#include "net/base/io_buffer.h"
+#include "net/base/ip_address.h"
+#include "net/base/net_errors.h"
+#include "net/base/network_handle.h"
+#include "net/log/net_log_event_type.h"
+#include "net/log/net_log_source_type.h"
+#include "net/quic/quic_chromium_packet_reader.h"
+#include "net/third_party/quiche/src/quiche/quic/core/crypto/quic_random.h"
+#include "net/third_party/quiche/src/quiche/quic/core/quic_constants.h"
+
+namespace net {
+
+namespace {
+
+// Length of the routing tag at the start of each client connection ID.
+constexpr size_t kTagLength = sizeof(uint32_t);
+
+// Datagrams received for an endpoint with no read pending are queued up to
+// this limit and dropped beyond it, as a socket buffer would.
+constexpr size_t kMaxQueuedPackets = 256;
+
+}  // namespace
+
+// A DatagramClientSocket on top of a QuicSharedUDPSocket. It only sees
+// datagrams routed to it which come from the address it is connected to.
+class QuicSharedUDPSocket::Endpoint : public DatagramClientSocket {
+ public:
+  Endpoint(base::WeakPtr<QuicSharedUDPSocket> owner,
+           net::NetLog* net_log,
+           const NetLogSource& source)
+      : owner_(std::move(owner)),
+        net_log_(
+            NetLogWithSource::Make(net_log, NetLogSourceType::UDP_SOCKET)) {
+    net_log_.BeginEventReferencingSource(NetLogEventType::SOCKET_ALIVE, source);
+    tag_ = owner_->Register(this);
+  }
+
+  Endpoint(const Endpoint&) = delete;
+  Endpoint& operator=(const Endpoint&) = delete;
+
+  ~Endpoint() override {
+    Close();
+    net_log_.EndEvent(NetLogEventType::SOCKET_ALIVE);
+  }
+
+  uint32_t tag() const { return tag_; }
+  const IPEndPoint& peer() const { return peer_; }
+  base::TimeTicks release_time() const { return release_time_; }
+
+  void OnPacketReceived(const IPEndPoint& address,
+                        const char* data,
+                        int length) {
+    if (!connected_ || address != peer_)
+      return;
+    if (!read_callback_) {
+      if (packets_.size() < kMaxQueuedPackets)
+        packets_.emplace_back(data, length);
+      return;
+    }
+    int rv = CopyPacket(data, length, read_buf_.get(), read_buf_len_);
+    read_buf_ = nullptr;
+    read_buf_len_ = 0;
+    std::move(read_callback_).Run(rv);
+  }
+
+  void OnWriteComplete(int result) {
+    if (write_callback_)
+      std::move(write_callback_).Run(result);
+  }
+
+  void OnReadError(int error) {
+    error_ = error;
+    if (!read_callback_)
+      return;
+    read_buf_ = nullptr;
+    read_buf_len_ = 0;
+    std::move(read_callback_).Run(error);
+  }
+
+  // DatagramClientSocket:
+  int Connect(const IPEndPoint& address) override {
+    DCHECK(!connected_);
+    if (!owner_)
+      return ERR_ABORTED;
+    int rv = owner_->OpenSocket(address.GetFamily());
+    if (rv != OK)
+      return rv;
+    peer_ = address;
+    connected_ = true;
+    return OK;
+  }
+  int ConnectUsingNetwork(handles::NetworkHandle network,
+                          const IPEndPoint& address) override {
+    return ERR_NOT_IMPLEMENTED;
+  }
+  int ConnectUsingDefaultNetwork(const IPEndPoint& address) override {
+    return ERR_NOT_IMPLEMENTED;
+  }
+  handles::NetworkHandle GetBoundNetwork() const override {
+    return handles::kInvalidNetworkHandle;
+  }
+  void ApplySocketTag(const SocketTag& tag) override {}
+  int SetMulticastInterface(uint32_t interface_index) override {
+    return ERR_NOT_IMPLEMENTED;
+  }
+
+  // DatagramSocket:
+  void Close() override {
+    if (owner_ && tag_ != 0)
+      owner_->Unregister(this);
+    tag_ = 0;
+    connected_ = false;
+    packets_.clear();
+    read_buf_ = nullptr;
+    read_buf_len_ = 0;
+    read_callback_.Reset();
+    write_callback_.Reset();
+  }
+  int GetPeerAddress(IPEndPoint* address) const override {
+    if (!connected_)
+      return ERR_SOCKET_NOT_CONNECTED;
+    *address = peer_;
+    return OK;
+  }
+  int GetLocalAddress(IPEndPoint* address) const override {
+    SharedSocket* socket = GetSharedSocket();
+    if (!socket)
+      return ERR_SOCKET_NOT_CONNECTED;
+    return socket->socket.GetLocalAddress(address);
+  }
+  void UseNonBlockingIO() override {}
+  int SetDoNotFragment() override {
+    SharedSocket* socket = GetSharedSocket();
+    if (!socket)
+      return ERR_SOCKET_NOT_CONNECTED;
+    return socket->socket.SetDoNotFragment();
+  }
+  void SetMsgConfirm(bool confirm) override {}
+  const NetLogWithSource& NetLog() const override { return net_log_; }
+
+  // DatagramClientSocket:
+  int EnableReleaseTime() override {
+#if BUILDFLAG(IS_POSIX)
+    SharedSocket* socket = GetSharedSocket();
+    if (!socket)
+      return ERR_SOCKET_NOT_CONNECTED;
+    // The option is set on the shared socket; setting it again is harmless.
+    return socket->socket.EnableReleaseTime();
+#else
+    return ERR_NOT_IMPLEMENTED;
+#endif
+  }
+  bool SupportsReleaseTime() const override {
+#if BUILDFLAG(IS_POSIX)
+    SharedSocket* socket = GetSharedSocket();
+    return socket && socket->socket.release_time_enabled();
+#else
+    return false;
+#endif
+  }
+  // Kept per endpoint and passed with each write, since the writes of other
+  // endpoints are interleaved on the shared socket.
+  void SetReleaseDelay(base::TimeDelta delay) override {
+    release_time_ = delay.is_positive() ? base::TimeTicks::Now() + delay
+                                        : base::TimeTicks();
+  }
+
+  // Socket:
+  int Read(IOBuffer* buf,
+           int buf_len,
+           CompletionOnceCallback callback) override {
+    DCHECK(!read_callback_);
+    if (error_ != OK)
+      return error_;
+    if (!connected_)
+      return ERR_SOCKET_NOT_CONNECTED;
+    if (!packets_.empty()) {
+      const std::string& packet = packets_.front();
+      int rv = CopyPacket(packet.data(), packet.size(), buf, buf_len);
+      packets_.pop_front();
+      return rv;
+    }
+    read_buf_ = buf;
+    read_buf_len_ = buf_len;
+    read_callback_ = std::move(callback);
+    return ERR_IO_PENDING;
+  }
+  int Write(IOBuffer* buf,
+            int buf_len,
+            CompletionOnceCallback callback,
+            const NetworkTrafficAnnotationTag& traffic_annotation) override {
+    DCHECK(!write_callback_);
+    if (!connected_ || !owner_)
+      return ERR_SOCKET_NOT_CONNECTED;
+    int rv = owner_->Write(this, buf, buf_len);
+    if (rv == ERR_IO_PENDING)
+      write_callback_ = std::move(callback);
+    return rv;
+  }
+  int SetReceiveBufferSize(int32_t size) override {
+    SharedSocket* socket = GetSharedSocket();
+    if (!socket)
+      return ERR_SOCKET_NOT_CONNECTED;
+    return socket->socket.SetReceiveBufferSize(size);
+  }
+  int SetSendBufferSize(int32_t size) override {
+    SharedSocket* socket = GetSharedSocket();
+    if (!socket)
+      return ERR_SOCKET_NOT_CONNECTED;
+    return socket->socket.SetSendBufferSize(size);
+  }
+
+ private:
+  static int CopyPacket(const char* data,
+                        int length,
+                        IOBuffer* buf,
+                        int buf_len) {
+    // Same as a truncated datagram on a real socket.
+    if (length > buf_len)
+      return ERR_MSG_TOO_BIG;
+    memcpy(buf->data(), data, length);
+    return length;
+  }
+
+  SharedSocket* GetSharedSocket() const {
+    if (!connected_ || !owner_)
+      return nullptr;
+    return owner_->GetSocket(peer_.GetFamily());
+  }
+
+  base::WeakPtr<QuicSharedUDPSocket> owner_;
+  NetLogWithSource net_log_;
+  uint32_t tag_ = 0;
+  IPEndPoint peer_;
+  bool connected_ = false;
+  int error_ = OK;
+  base::TimeTicks release_time_;
+
+  base::circular_deque<std::string> packets_;
+  scoped_refptr<IOBuffer> read_buf_;
+  int read_buf_len_ = 0;
+  CompletionOnceCallback read_callback_;
+  CompletionOnceCallback write_callback_;
+};
+
+QuicSharedUDPSocket::PendingWrite::PendingWrite(Endpoint* endpoint,
+                                                scoped_refptr<IOBuffer> buffer,
+                                                int length,
+                                                base::TimeTicks release_time)
+    : endpoint(endpoint),
+      buffer(std::move(buffer)),
+      length(length),
+      release_time(release_time) {}
+
+QuicSharedUDPSocket::PendingWrite::PendingWrite(PendingWrite&& other) = default;
+
+QuicSharedUDPSocket::PendingWrite& QuicSharedUDPSocket::PendingWrite::operator=(
+    PendingWrite&& other) = default;
+
+QuicSharedUDPSocket::PendingWrite::~PendingWrite() = default;
+
+QuicSharedUDPSocket::SharedSocket::SharedSocket(NetLog* net_log,
+                                                AddressFamily family)
+    : family(family),
+      socket(DatagramSocket::DEFAULT_BIND, net_log, NetLogSource()),
+      read_buffer(base::MakeRefCounted<IOBufferWithSize>(
+          static_cast<size_t>(quic::kMaxIncomingPacketSize))) {}
+
+QuicSharedUDPSocket::SharedSocket::~SharedSocket() = default;
+
+QuicSharedUDPSocket::QuicSharedUDPSocket(quic::QuicRandom* random_generator,
+                                         NetLog* net_log)
+    : random_generator_(random_generator), net_log_(net_log) {}
+
+QuicSharedUDPSocket::~QuicSharedUDPSocket() {
+  DCHECK(endpoints_.empty());
+}
+
+std::unique_ptr<DatagramClientSocket> QuicSharedUDPSocket::CreateSocket(
+    NetLog* net_log,
+    const NetLogSource& source) {
+  return std::make_unique<Endpoint>(weak_factory_.GetWeakPtr(), net_log,
+                                    source);
+}
+
+quic::QuicConnectionId QuicSharedUDPSocket::NewConnectionId(
+    const DatagramClientSocket* socket) {
+  const uint32_t tag = static_cast<const Endpoint*>(socket)->tag();
+  char bytes[quic::kQuicDefaultConnectionIdLength];
+  memcpy(bytes, &tag, kTagLength);
+  random_generator_->RandBytes(bytes + kTagLength, sizeof(bytes) - kTagLength);
+  return quic::QuicConnectionId(bytes, sizeof(bytes));
+}
+
+absl::optional<quic::QuicConnectionId>
+QuicSharedUDPSocket::GenerateNextConnectionId(
+    const quic::QuicConnectionId& original) {
+  char bytes[quic::kQuicMaxConnectionIdWithLengthPrefixLength];
+  if (original.length() <= kTagLength || original.length() > sizeof(bytes))
+    return absl::nullopt;
+  // Keep the tag, so that packets sent to the new connection ID still reach
+  // the same endpoint.
+  memcpy(bytes, original.data(), kTagLength);
+  random_generator_->RandBytes(bytes + kTagLength,
+                               original.length() - kTagLength);
+  return quic::QuicConnectionId(bytes, original.length());
+}
+
+absl::optional<quic::QuicConnectionId>
+QuicSharedUDPSocket::MaybeReplaceConnectionId(
+    const quic::QuicConnectionId& original,
+    const quic::ParsedQuicVersion& version) {
+  return absl::nullopt;
+}
+
+int QuicSharedUDPSocket::OpenSocket(AddressFamily family) {
+  std::unique_ptr<SharedSocket>& socket =
+      family == ADDRESS_FAMILY_IPV6 ? ipv6_socket_ : ipv4_socket_;
+  if (socket)
+    return OK;
+
+  auto new_socket = std::make_unique<SharedSocket>(net_log_, family);
+  int rv = new_socket->socket.Open(family);
+  if (rv != OK)
+    return rv;
+  rv = new_socket->socket.Bind(
+      IPEndPoint(family == ADDRESS_FAMILY_IPV6 ? IPAddress::IPv6AllZeros()
+                                               : IPAddress::IPv4AllZeros(),
+                 0));
+  if (rv != OK)
+    return rv;
+  socket = std::move(new_socket);
+  StartReading(family);
+  return OK;
+}
+
+QuicSharedUDPSocket::SharedSocket* QuicSharedUDPSocket::GetSocket(
+    AddressFamily family) const {
+  return family == ADDRESS_FAMILY_IPV6 ? ipv6_socket_.get()
+                                       : ipv4_socket_.get();
+}
+
+uint32_t QuicSharedUDPSocket::Register(Endpoint* endpoint) {
+  uint32_t tag;
+  do {
+    random_generator_->RandBytes(&tag, sizeof(tag));
+  } while (tag == 0 || endpoints_.count(tag));
+  endpoints_[tag] = endpoint;
+  return tag;
+}
+
+void QuicSharedUDPSocket::Unregister(Endpoint* endpoint) {
+  endpoints_.erase(endpoint->tag());
+  for (SharedSocket* socket : {ipv4_socket_.get(), ipv6_socket_.get()}) {
+    if (!socket)
+      continue;
+    if (socket->writer == endpoint)
+      socket->writer = nullptr;
+    base::EraseIf(socket->pending_writes, [endpoint](const PendingWrite& w) {
+      return w.endpoint == endpoint;
+    });
+  }
+}
+
+int QuicSharedUDPSocket::Write(Endpoint* endpoint,
+                               IOBuffer* buffer,
+                               int length) {
+  SharedSocket* socket = GetSocket(endpoint->peer().GetFamily());
+  if (!socket)
+    return ERR_SOCKET_NOT_CONNECTED;
+  if (socket->write_in_flight) {
+    socket->pending_writes.emplace_back(endpoint, buffer, length,
+                                        endpoint->release_time());
+    return ERR_IO_PENDING;
+  }
+  int rv = SendTo(socket, endpoint, buffer, length, endpoint->release_time());
+  if (rv == ERR_IO_PENDING) {
+    socket->write_in_flight = true;
+    socket->writer = endpoint;
+  }
+  return rv;
+}
+
+int QuicSharedUDPSocket::SendTo(SharedSocket* socket,
+                                Endpoint* endpoint,
+                                IOBuffer* buffer,
+                                int length,
+                                base::TimeTicks release_time) {
+#if BUILDFLAG(IS_POSIX)
+  // A write queued past its release time goes out right away.
+  socket->socket.SetReleaseDelay(release_time.is_null()
+                                     ? base::TimeDelta()
+                                     : release_time - base::TimeTicks::Now());
+#endif
+  // Unretained is safe because |socket| owns the UDPSocket, which never runs
+  // its callback after being destroyed.
+  return socket->socket.SendTo(
+      buffer, length, endpoint->peer(),
+      base::BindOnce(&QuicSharedUDPSocket::OnWriteComplete,
+                     base::Unretained(this), base::Unretained(socket)));
+}
+
+void QuicSharedUDPSocket::OnWriteComplete(SharedSocket* socket, int result) {
+  // Completions are collected by tag and reported once the queue is drained,
+  // since reporting one may close other endpoints.
+  std::vector<std::pair<uint32_t, int>> completions;
+  if (socket->writer)
+    completions.emplace_back(socket->writer->tag(), result);
+  socket->writer = nullptr;
+  socket->write_in_flight = false;
+
+  while (!socket->pending_writes.empty()) {
+    PendingWrite write = std::move(socket->pending_writes.front());
+    socket->pending_writes.pop_front();
+    int rv = SendTo(socket, write.endpoint, write.buffer.get(), write.length,
+                    write.release_time);
+    if (rv == ERR_IO_PENDING) {
+      socket->write_in_flight = true;
+      socket->writer = write.endpoint;
+      break;
+    }
+    completions.emplace_back(write.endpoint->tag(), rv);
+  }
+
+  for (const auto& completion : completions) {
+    auto it = endpoints_.find(completion.first);
+    if (it != endpoints_.end())
+      it->second->OnWriteComplete(completion.second);
+  }
+}
+
+void QuicSharedUDPSocket::StartReading(AddressFamily family) {
+  base::WeakPtr<QuicSharedUDPSocket> weak_this = weak_factory_.GetWeakPtr();
+  for (int i = 0; i < kQuicYieldAfterPacketsRead; ++i) {
+    SharedSocket* socket = GetSocket(family);
+    if (!socket)
+      return;
+    int rv = socket->socket.RecvFrom(
+        socket->read_buffer.get(), socket->read_buffer->size(),
+        &socket->read_address,
+        base::BindOnce(&QuicSharedUDPSocket::OnReadComplete,
+                       base::Unretained(this), family));
+    if (rv == ERR_IO_PENDING)
+      return;
+    if (rv == ERR_MSG_TOO_BIG)
+      continue;
+    if (rv < 0) {
+      OnReadError(socket, rv);
+      return;
+    }
+    Dispatch(socket, rv);
+    if (!weak_this)
+      return;
+  }
+  // Yield so that a busy socket does not starve other tasks.
+  base::ThreadTaskRunnerHandle::Get()->PostTask(
+      FROM_HERE, base::BindOnce(&QuicSharedUDPSocket::StartReading,
+                                weak_factory_.GetWeakPtr(), family));
+}
+
+void QuicSharedUDPSocket::OnReadComplete(AddressFamily family, int result) {
+  SharedSocket* socket = GetSocket(family);
+  DCHECK(socket);
+  if (result < 0 && result != ERR_MSG_TOO_BIG) {
+    OnReadError(socket, result);
+    return;
+  }
+  base::WeakPtr<QuicSharedUDPSocket> weak_this = weak_factory_.GetWeakPtr();
+  if (result >= 0)
+    Dispatch(socket, result);
+  if (weak_this)
+    StartReading(family);
+}
+
+void QuicSharedUDPSocket::Dispatch(SharedSocket* socket, int length) {
+  const char* data = socket->read_buffer->data();
+  if (length < 1)
+    return;
+  // Short headers carry the destination connection ID right after the first
+  // byte. Long headers carry a version and the connection ID length first.
+  size_t offset = 1;
+  if (data[0] & 0x80) {
+    offset = 6;
+    if (length < static_cast<int>(offset) ||
+        static_cast<uint8_t>(data[5]) < kTagLength) {
+      return;
+    }
+  }
+  if (length < static_cast<int>(offset + kTagLength))
+    return;
+  uint32_t tag;
+  memcpy(&tag, data + offset, kTagLength);
+  auto it = endpoints_.find(tag);
+  if (it == endpoints_.end())
+    return;
+  it->second->OnPacketReceived(socket->read_address, data, length);
+}
+
+void QuicSharedUDPSocket::OnReadError(SharedSocket* socket, int error) {
+  // The socket is closed so that new endpoints open a fresh one. Endpoints
+  // using it are failed, which closes their sessions.
+  const AddressFamily family = socket->family;
+  std::unique_ptr<SharedSocket> closed = std::move(
+      family == ADDRESS_FAMILY_IPV6 ? ipv6_socket_ : ipv4_socket_);
+  std::vector<uint32_t> tags;
+  for (const auto& entry : endpoints_) {
+    if (entry.second->peer().GetFamily() == family)
+      tags.push_back(entry.first);
+  }
+  for (uint32_t tag : tags) {
+    auto it = endpoints_.find(tag);
+    if (it != endpoints_.end())
+      it->second->OnReadError(error);
+  }
+}
+
+}  // namespace net
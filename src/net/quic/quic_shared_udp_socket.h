@@ -0,0 +1,148 @@
+// Copyright 2022 The Chromium Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef NET_QUIC_QUIC_SHARED_UDP_SOCKET_H_
+#define NET_QUIC_QUIC_SHARED_UDP_SOCKET_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+
+#include "base/containers/circular_deque.h"
+#include "base/memory/raw_ptr.h"
+#include "base/memory/scoped_refptr.h"
+#include "base/memory/weak_ptr.h"
+#include "base/time/time.h"
+#include "net/base/address_family.h"
+#include "net/base/ip_endpoint.h"
+#include "net/base/net_export.h"
+#include "net/log/net_log_with_source.h"
+#include "net/socket/datagram_client_socket.h"
+#include "net/socket/udp_socket.h"
+#include "net/third_party/quiche/src/quiche/quic/core/connection_id_generator.h"
+#include "net/third_party/quiche/src/quiche/quic/core/quic_connection_id.h"
+
+namespace quic {
+class QuicRandom;
+}  // namespace quic
+
+namespace net {
+
+class IOBuffer;
+class IOBufferWithSize;
+
+// Multiplexes the QUIC connections of a client over one unconnected UDP socket
+// per address family, much like quic::QuicDispatcher does on a server.
+//
+// CreateSocket() returns a DatagramClientSocket that behaves like a connected
+// UDP socket to the rest of the QUIC stack. Each is assigned a random routing
+// tag, which NewConnectionId() places at the start of the client connection ID
+// of the connection using it. As a quic::ConnectionIdGeneratorInterface, this
+// keeps the tag in every later client connection ID, so received packets are
+// routed by the start of their destination connection ID.
+//
+// All connections are then read in one loop on a single file descriptor, and
+// a connection no longer needs a socket, a pending read and a wakeup source of
+// its own.
+class NET_EXPORT_PRIVATE QuicSharedUDPSocket
+    : public quic::ConnectionIdGeneratorInterface {
+ public:
+  QuicSharedUDPSocket(quic::QuicRandom* random_generator, NetLog* net_log);
+
+  QuicSharedUDPSocket(const QuicSharedUDPSocket&) = delete;
+  QuicSharedUDPSocket& operator=(const QuicSharedUDPSocket&) = delete;
+
+  ~QuicSharedUDPSocket() override;
+
+  std::unique_ptr<DatagramClientSocket> CreateSocket(
+      NetLog* net_log,
+      const NetLogSource& source);
+
+  // Returns a client connection ID for a connection using |socket|, which must
+  // have been created by CreateSocket().
+  quic::QuicConnectionId NewConnectionId(const DatagramClientSocket* socket);
+
+  // quic::ConnectionIdGeneratorInterface:
+  absl::optional<quic::QuicConnectionId> GenerateNextConnectionId(
+      const quic::QuicConnectionId& original) override;
+  absl::optional<quic::QuicConnectionId> MaybeReplaceConnectionId(
+      const quic::QuicConnectionId& original,
+      const quic::ParsedQuicVersion& version) override;
+
+ private:
+  class Endpoint;
+
+  struct PendingWrite {
+    PendingWrite(Endpoint* endpoint,
+                 scoped_refptr<IOBuffer> buffer,
+                 int length,
+                 base::TimeTicks release_time);
+    PendingWrite(PendingWrite&& other);
+    PendingWrite& operator=(PendingWrite&& other);
+    ~PendingWrite();
+
+    raw_ptr<Endpoint> endpoint;
+    scoped_refptr<IOBuffer> buffer;
+    int length;
+    // The earliest time the datagram may leave the host, or null.
+    base::TimeTicks release_time;
+  };
+
+  // One unconnected socket and its read and write state.
+  struct SharedSocket {
+    SharedSocket(NetLog* net_log, AddressFamily family);
+    ~SharedSocket();
+
+    const AddressFamily family;
+    UDPSocket socket;
+    scoped_refptr<IOBufferWithSize> read_buffer;
+    IPEndPoint read_address;
+    // The endpoint whose write is in flight, or null if none is or it has
+    // been closed since.
+    raw_ptr<Endpoint> writer = nullptr;
+    bool write_in_flight = false;
+    base::circular_deque<PendingWrite> pending_writes;
+  };
+
+  // Opens the socket for |family| if needed.
+  int OpenSocket(AddressFamily family);
+  SharedSocket* GetSocket(AddressFamily family) const;
+
+  uint32_t Register(Endpoint* endpoint);
+  void Unregister(Endpoint* endpoint);
+
+  // Writes are queued behind one in progress, since a socket can only have
+  // one write in flight. Completion of a queued write is reported to its
+  // endpoint.
+  int Write(Endpoint* endpoint, IOBuffer* buffer, int length);
+  // Sends a datagram of |endpoint| no earlier than |release_time|, if the
+  // socket supports release times.
+  int SendTo(SharedSocket* socket,
+             Endpoint* endpoint,
+             IOBuffer* buffer,
+             int length,
+             base::TimeTicks release_time);
+  void OnWriteComplete(SharedSocket* socket, int result);
+
+  void StartReading(AddressFamily family);
+  void OnReadComplete(AddressFamily family, int result);
+  // Routes a datagram received on |socket| to its endpoint, if any.
+  void Dispatch(SharedSocket* socket, int length);
+  // Fails all endpoints of |socket| with |error| and closes it.
+  void OnReadError(SharedSocket* socket, int error);
+
+  const raw_ptr<quic::QuicRandom> random_generator_;
+  const raw_ptr<NetLog> net_log_;
+
+  std::unique_ptr<SharedSocket> ipv4_socket_;
+  std::unique_ptr<SharedSocket> ipv6_socket_;
+  std::map<uint32_t, Endpoint*> endpoints_;
+
+  base::WeakPtrFactory<QuicSharedUDPSocket> weak_factory_{this};
+};
+
+}  // namespace net
+
+#endif  // NET_QUIC_QUIC_SHARED_UDP_SOCKET_H_
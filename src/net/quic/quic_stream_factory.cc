@@ -55,6 +55,7 @@
 #include "net/quic/quic_crypto_client_stream_factory.h"
 #include "net/quic/quic_http_stream.h"
 #include "net/quic/quic_server_info.h"
+#include "net/quic/quic_shared_udp_socket.h"
 #include "net/socket/client_socket_factory.h"
 #include "net/socket/next_proto.h"
 #include "net/socket/socket_performance_watcher.h"
@@ -1227,6 +1228,10 @@ QuicStreamFactory::QuicStreamFactory(
   DCHECK(http_server_properties_);
   if (params_.disable_tls_zero_rtt)
     SetQuicFlag(FLAGS_quic_disable_client_tls_zero_rtt, true);
+  if (params_.use_shared_socket) {
+    shared_socket_ =
+        std::make_unique<QuicSharedUDPSocket>(random_generator_, net_log_);
+  }
   InitializeMigrationOptions();
 }
 
@@ -1247,7 +1252,8 @@ QuicStreamFactory::~QuicStreamFactory() {
   DCHECK(active_crypto_config_map_.empty());
 
   if (params_.close_sessions_on_ip_change ||
-      params_.goaway_sessions_on_ip_change) {
+      params_.goaway_sessions_on_ip_change ||
+      params_.migrate_sessions_on_ip_change) {
     NetworkChangeNotifier::RemoveIPAddressObserver(this);
   }
   if (NetworkChangeNotifier::AreNetworkHandlesSupported()) {
@@ -1532,6 +1538,10 @@ int QuicStreamFactory::ConfigureSocket(DatagramClientSocket* socket,
     socket->SetIOSNetworkServiceType(params_.ios_network_service_type);
   }
 
+  // Not fatal: without kernel support packets are paced by the connection.
+  if (params_.enable_pacing_offload)
+    socket->EnableReleaseTime();
+
   socket->GetLocalAddress(&local_address_);
   if (need_to_check_persisted_supports_quic_) {
     need_to_check_persisted_supports_quic_ = false;
@@ -1580,7 +1590,15 @@ void QuicStreamFactory::OnIPAddressChanged() {
   connectivity_monitor_.OnIPAddressChanged();
 
   set_is_quic_known_to_work_on_current_network(false);
-  if (params_.close_sessions_on_ip_change) {
+  if (params_.migrate_sessions_on_ip_change) {
+    // Sessions may be deleted while iterating through the map.
+    auto it = all_sessions_.begin();
+    while (it != all_sessions_.end()) {
+      QuicChromiumClientSession* session = it->first;
+      ++it;
+      session->OnIPAddressChanged();
+    }
+  } else if (params_.close_sessions_on_ip_change) {
     CloseAllSessions(ERR_NETWORK_CHANGED, quic::QUIC_IP_ADDRESS_CHANGED);
   } else {
     DCHECK(params_.goaway_sessions_on_ip_change);
@@ -1823,8 +1841,12 @@ int QuicStreamFactory::CreateSession(const QuicSessionAliasKey& key,
   TRACE_EVENT0(NetTracingCategory(), "QuicStreamFactory::CreateSession");
   IPEndPoint addr = *address_list.begin();
   const quic::QuicServerId& server_id = key.server_id();
+  const bool use_shared_socket =
+      shared_socket_ && quic_version.SupportsClientConnectionIds();
   std::unique_ptr<DatagramClientSocket> socket(
-      CreateSocket(net_log.net_log(), net_log.source()));
+      use_shared_socket
+          ? shared_socket_->CreateSocket(net_log.net_log(), net_log.source())
+          : CreateSocket(net_log.net_log(), net_log.source()));
 
   // Passing in handles::kInvalidNetworkHandle binds socket to default network.
   int rv = ConfigureSocket(socket.get(), addr, *network,
@@ -1853,8 +1875,15 @@ int QuicStreamFactory::CreateSession(const QuicSessionAliasKey& key,
   }
 
   if (!alarm_factory_.get()) {
-    alarm_factory_ = std::make_unique<QuicChromiumAlarmFactory>(
-        base::ThreadTaskRunnerHandle::Get().get(), clock_);
+    if (params_.use_alarm_wheel) {
+      alarm_factory_ = std::make_unique<QuicChromiumAlarmFactory>(
+          base::ThreadTaskRunnerHandle::Get().get(), clock_,
+          quic::QuicTime::Delta::FromMicroseconds(
+              params_.alarm_wheel_slack.InMicroseconds()));
+    } else {
+      alarm_factory_ = std::make_unique<QuicChromiumAlarmFactory>(
+          base::ThreadTaskRunnerHandle::Get().get(), clock_);
+    }
   }
 
   quic::QuicConnectionId connection_id =
@@ -1872,10 +1901,20 @@ int QuicStreamFactory::CreateSession(const QuicSessionAliasKey& key,
 
   QuicChromiumPacketWriter* writer =
       new QuicChromiumPacketWriter(socket.get(), task_runner_);
+  quic::ConnectionIdGeneratorInterface& connection_id_generator =
+      use_shared_socket
+          ? static_cast<quic::ConnectionIdGeneratorInterface&>(*shared_socket_)
+          : connection_id_generator_;
   quic::QuicConnection* connection = new quic::QuicConnection(
       connection_id, quic::QuicSocketAddress(), ToQuicSocketAddress(addr),
       helper_.get(), alarm_factory_.get(), writer, true /* owns_writer */,
-      quic::Perspective::IS_CLIENT, {quic_version}, connection_id_generator_);
+      quic::Perspective::IS_CLIENT, {quic_version}, connection_id_generator);
+  // Packets from the server are routed back to this connection by the client
+  // connection ID.
+  if (use_shared_socket) {
+    connection->set_client_connection_id(
+        shared_socket_->NewConnectionId(socket.get()));
+  }
   connection->set_keep_alive_ping_timeout(ping_timeout_);
   connection->SetMaxPacketLength(params_.max_packet_length);
 
@@ -1914,7 +1953,8 @@ int QuicStreamFactory::CreateSession(const QuicSessionAliasKey& key,
       params_.migrate_sessions_early_v2,
       params_.migrate_sessions_on_network_change_v2, default_network_,
       retransmittable_on_wire_timeout_, params_.migrate_idle_sessions,
-      params_.allow_port_migration, params_.idle_session_migration_period,
+      params_.allow_port_migration, params_.migrate_sessions_on_ip_change,
+      params_.idle_session_migration_period,
       params_.max_time_on_non_default_network,
       params_.max_migrations_to_non_default_network_on_write_error,
       params_.max_migrations_to_non_default_network_on_path_degrading,
@@ -2047,12 +2087,24 @@ void QuicStreamFactory::InitializeMigrationOptions() {
       params_.retry_on_alternate_network_before_handshake;
   bool migrate_idle_sessions = params_.migrate_idle_sessions;
   bool allow_port_migration = params_.allow_port_migration;
+  bool migrate_sessions_on_ip_change = params_.migrate_sessions_on_ip_change;
   params_.migrate_sessions_on_network_change_v2 = false;
   params_.migrate_sessions_early_v2 = false;
   params_.allow_port_migration = false;
+  params_.migrate_sessions_on_ip_change = false;
   params_.retry_on_alternate_network_before_handshake = false;
   params_.migrate_idle_sessions = false;
 
+  // Sessions on the shared socket cannot move to a socket of their own, and an
+  // unconnected socket follows routing changes by itself.
+  if (params_.use_shared_socket) {
+    migrate_sessions_on_network_change = false;
+    migrate_sessions_early = false;
+    retry_on_alternate_network_before_handshake = false;
+    allow_port_migration = false;
+    migrate_sessions_on_ip_change = false;
+  }
+
   // TODO(zhongyi): deprecate |goaway_sessions_on_ip_change| if the experiment
   // is no longer needed.
   // goaway_sessions_on_ip_change and close_sessions_on_ip_change should never
@@ -2076,8 +2128,16 @@ void QuicStreamFactory::InitializeMigrationOptions() {
     }
   }
 
-  if (!NetworkChangeNotifier::AreNetworkHandlesSupported())
+  if (!NetworkChangeNotifier::AreNetworkHandlesSupported()) {
+    // Without network handles, an IP address change is the only sign that the
+    // network may have changed.
+    if (allow_port_migration && migrate_sessions_on_ip_change &&
+        !handle_ip_change) {
+      params_.migrate_sessions_on_ip_change = true;
+      NetworkChangeNotifier::AddIPAddressObserver(this);
+    }
     return;
+  }
 
   NetworkChangeNotifier::AddNetworkObserver(this);
   // Perform checks on the connection migration options.
@@ -72,6 +72,7 @@ class NetworkAnonymizationKey;
 class QuicChromiumConnectionHelper;
 class QuicCryptoClientStreamFactory;
 class QuicServerInfo;
+class QuicSharedUDPSocket;
 class QuicStreamFactory;
 class QuicContext;
 class SCTAuditingDelegate;
@@ -636,6 +637,9 @@ class NET_EXPORT_PRIVATE QuicStreamFactory
   quic::DeterministicConnectionIdGenerator connection_id_generator_{
       quic::kQuicDefaultConnectionIdLength};
 
+  // Set if |params_.use_shared_socket|.
+  std::unique_ptr<QuicSharedUDPSocket> shared_socket_;
+
   base::WeakPtrFactory<QuicStreamFactory> weak_factory_{this};
 };
 
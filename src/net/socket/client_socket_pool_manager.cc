@@ -286,15 +286,20 @@ int InitSocketHandleForRawConnect2(
     const SSLConfig& ssl_config_for_proxy,
     PrivacyMode privacy_mode,
     NetworkAnonymizationKey network_anonymization_key,
+    SecureDnsPolicy secure_dns_policy,
     const NetLogWithSource& net_log,
     ClientSocketHandle* socket_handle,
     CompletionOnceCallback callback) {
   DCHECK(socket_handle);
+  // Through a proxy the only local lookup is of the proxy itself, which must
+  // not go over DoH: the DoH requests may be tunneled through that proxy.
+  if (!proxy_info.is_direct())
+    secure_dns_policy = SecureDnsPolicy::kDisable;
   return InitSocketPoolHelper(
       std::move(endpoint), request_load_flags, request_priority, session,
       proxy_info, ssl_config_for_origin, ssl_config_for_proxy,
       /*is_for_websockets=*/true, privacy_mode,
-      std::move(network_anonymization_key), SecureDnsPolicy::kDisable,
+      std::move(network_anonymization_key), secure_dns_policy,
       SocketTag(), net_log, 0, socket_handle,
       HttpNetworkSession::NORMAL_SOCKET_POOL, std::move(callback),
       ClientSocketPool::ProxyAuthCallback());
@@ -120,6 +120,8 @@ int InitSocketHandleForWebSocketRequest(
     CompletionOnceCallback callback,
     const ClientSocketPool::ProxyAuthCallback& proxy_auth_callback);
 
+// |secure_dns_policy| applies to resolving |endpoint| when |proxy_info| is
+// direct. The hostname of a proxy is never resolved over DoH.
 NET_EXPORT int InitSocketHandleForRawConnect2(
     url::SchemeHostPort endpoint,
     int request_load_flags,
@@ -130,6 +132,7 @@ NET_EXPORT int InitSocketHandleForRawConnect2(
     const SSLConfig& ssl_config_for_proxy,
     PrivacyMode privacy_mode,
     NetworkAnonymizationKey network_anonymization_key,
+    SecureDnsPolicy secure_dns_policy,
     const NetLogWithSource& net_log,
     ClientSocketHandle* socket_handle,
     CompletionOnceCallback callback);
@@ -38,6 +38,7 @@ class HttpAuthCache;
 class HttpAuthController;
 class HttpAuthHandlerFactory;
 class HttpResponseInfo;
+class HttpServerProperties;
 class HttpUserAgentSettings;
 class NetLog;
 class NetLogWithSource;
@@ -93,6 +94,13 @@ struct NET_EXPORT_PRIVATE CommonConnectJobParams {
 
   // This must only be non-null for WebSockets.
   raw_ptr<WebSocketEndpointLockManager> websocket_endpoint_lock_manager;
+
+  // Used to record and look up TCP connect RTTs per IP endpoint. May be null.
+  raw_ptr<HttpServerProperties> http_server_properties = nullptr;
+
+  // If set, TransportConnectJobs use Happy Eyeballs v2 (RFC 8305), starting a
+  // connection attempt to the next address after this delay.
+  absl::optional<base::TimeDelta> happy_eyeballs_attempt_delay;
 };
 
 // When a host resolution completes, OnHostResolutionCallback() is invoked. If
@@ -274,6 +282,9 @@ class NET_EXPORT_PRIVATE ConnectJob {
   WebSocketEndpointLockManager* websocket_endpoint_lock_manager() {
     return common_connect_job_params_->websocket_endpoint_lock_manager;
   }
+  HttpServerProperties* http_server_properties() {
+    return common_connect_job_params_->http_server_properties;
+  }
   const CommonConnectJobParams* common_connect_job_params() {
     return common_connect_job_params_;
   }
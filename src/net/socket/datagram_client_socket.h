@@ -5,7 +5,9 @@
 #ifndef NET_SOCKET_DATAGRAM_CLIENT_SOCKET_H_
 #define NET_SOCKET_DATAGRAM_CLIENT_SOCKET_H_
 
+#include "base/time/time.h"
 #include "net/base/datagram_buffer.h"
+#include "net/base/net_errors.h"
 #include "net/base/net_export.h"
 #include "net/base/network_handle.h"
 #include "net/socket/datagram_socket.h"
@@ -60,6 +62,16 @@ class NET_EXPORT_PRIVATE DatagramClientSocket : public DatagramSocket,
   // Set iOS Network Service Type for socket option SO_NET_SERVICE_TYPE.
   // No-op by default.
   virtual void SetIOSNetworkServiceType(int ios_network_service_type) {}
+
+  // Lets datagrams carry the earliest time they may leave the host, which is
+  // enforced by the kernel (SO_TXTIME with the fq qdisc on Linux). Must be
+  // called after connecting. Returns a network error code.
+  virtual int EnableReleaseTime() { return ERR_NOT_IMPLEMENTED; }
+  virtual bool SupportsReleaseTime() const { return false; }
+
+  // Datagrams written from now on are released no earlier than |delay| from
+  // now. No-op unless EnableReleaseTime() succeeded.
+  virtual void SetReleaseDelay(base::TimeDelta delay) {}
 };
 
 }  // namespace net
@@ -4,7 +4,9 @@
 
 #include "net/socket/transport_connect_job.h"
 
+#include <algorithm>
 #include <memory>
+#include <tuple>
 #include <utility>
 
 #include "base/bind.h"
@@ -24,6 +26,7 @@
 #include "net/base/trace_constants.h"
 #include "net/dns/public/host_resolver_results.h"
 #include "net/dns/public/secure_dns_policy.h"
+#include "net/http/http_server_properties.h"
 #include "net/log/net_log_event_type.h"
 #include "net/socket/socket_tag.h"
 #include "net/socket/transport_connect_sub_job.h"
@@ -162,6 +165,10 @@ LoadState TransportConnectJob::GetLoadState() const {
           load_state != LOAD_STATE_CONNECTING) {
         load_state = ipv4_job_->GetLoadState();
       }
+      for (const auto& job : happy_eyeballs_jobs_) {
+        if (load_state != LOAD_STATE_CONNECTING)
+          load_state = job->GetLoadState();
+      }
       return load_state;
     }
     case STATE_NONE:
@@ -199,6 +206,59 @@ base::TimeDelta TransportConnectJob::ConnectionTimeout() {
   return base::Minutes(4);
 }
 
+// static
+std::vector<IPEndPoint> TransportConnectJob::SortAddressesForHappyEyeballs(
+    std::vector<IPEndPoint> addresses,
+    HttpServerProperties* http_server_properties,
+    const NetworkAnonymizationKey& network_anonymization_key) {
+  if (addresses.empty())
+    return addresses;
+
+  // Lower ranks are tried first. The sort is stable so that the resolver's
+  // order is kept among addresses without history.
+  using Rank = std::tuple<int, int, base::TimeDelta>;
+  std::vector<std::pair<Rank, IPEndPoint>> ranked;
+  ranked.reserve(addresses.size());
+  for (auto& address : addresses) {
+    Rank rank(1, 0, base::TimeDelta());
+    const HttpServerProperties::ConnectRttInfo* info =
+        http_server_properties ? http_server_properties->GetConnectRttInfo(
+                                     address, network_anonymization_key)
+                               : nullptr;
+    if (info && info->consecutive_failures > 0) {
+      rank = Rank(2, info->consecutive_failures, base::TimeDelta());
+    } else if (info) {
+      rank = Rank(0, 0, info->smoothed_rtt);
+    }
+    ranked.emplace_back(rank, std::move(address));
+  }
+  std::stable_sort(
+      ranked.begin(), ranked.end(),
+      [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  // See RFC 8305, Section 4, with a First Address Family Count of one.
+  AddressFamily first_family = ranked.front().second.GetFamily();
+  std::vector<IPEndPoint> first_family_addresses, other_addresses;
+  for (auto& [rank, address] : ranked) {
+    if (address.GetFamily() == first_family) {
+      first_family_addresses.push_back(std::move(address));
+    } else {
+      other_addresses.push_back(std::move(address));
+    }
+  }
+  std::vector<IPEndPoint> sorted;
+  sorted.reserve(ranked.size());
+  for (size_t i = 0;
+       i < std::max(first_family_addresses.size(), other_addresses.size());
+       ++i) {
+    if (i < first_family_addresses.size())
+      sorted.push_back(std::move(first_family_addresses[i]));
+    if (i < other_addresses.size())
+      sorted.push_back(std::move(other_addresses[i]));
+  }
+  return sorted;
+}
+
 void TransportConnectJob::OnIOComplete(int result) {
   result = DoLoop(result);
   if (result != ERR_IO_PENDING)
@@ -356,6 +416,14 @@ int TransportConnectJob::DoTransportConnect() {
 
   const HostResolverEndpointResult& endpoint =
       GetEndpointResultForCurrentSubJobs();
+  if (common_connect_job_params()->happy_eyeballs_attempt_delay) {
+    happy_eyeballs_addresses_ = SortAddressesForHappyEyeballs(
+        endpoint.ip_endpoints, http_server_properties(),
+        params_->network_anonymization_key());
+    next_happy_eyeballs_address_ = 0;
+    return StartNextHappyEyeballsAttempt();
+  }
+
   std::vector<IPEndPoint> ipv4_addresses, ipv6_addresses;
   for (const auto& ip_endpoint : endpoint.ip_endpoints) {
     switch (ip_endpoint.GetFamily()) {
@@ -407,6 +475,8 @@ int TransportConnectJob::DoTransportConnectComplete(int result) {
   // Make sure nothing else calls back into this object.
   ipv4_job_.reset();
   ipv6_job_.reset();
+  happy_eyeballs_jobs_.clear();
+  happy_eyeballs_addresses_.clear();
   fallback_timer_.Stop();
 
   if (result == OK) {
@@ -442,6 +512,17 @@ int TransportConnectJob::HandleSubJobComplete(int result,
                                               TransportConnectSubJob* job) {
   DCHECK_NE(result, ERR_IO_PENDING);
   if (result == OK) {
+    if (job->type() == SUB_JOB_HAPPY_EYEBALLS) {
+      // Attempts that had a head start but are still connecting are likely on
+      // a broken path, so try them last next time.
+      for (const auto& other_job : happy_eyeballs_jobs_) {
+        if (other_job.get() != job && !other_job->connect_start().is_null() &&
+            other_job->connect_start() < job->connect_start()) {
+          RecordConnectAttempt(other_job->CurrentAddress(), base::TimeDelta(),
+                               ERR_TIMED_OUT);
+        }
+      }
+    }
     SetSocket(job->PassSocket(), dns_aliases_);
     return result;
   }
@@ -467,9 +548,23 @@ int TransportConnectJob::HandleSubJobComplete(int result,
         }
       }
       break;
+
+    case SUB_JOB_HAPPY_EYEBALLS: {
+      auto it = std::find_if(
+          happy_eyeballs_jobs_.begin(), happy_eyeballs_jobs_.end(),
+          [job](const auto& other_job) { return other_job.get() == job; });
+      DCHECK(it != happy_eyeballs_jobs_.end());
+      happy_eyeballs_jobs_.erase(it);
+      // Start the next attempt, rather than wait for the timer.
+      if (next_happy_eyeballs_address_ < happy_eyeballs_addresses_.size()) {
+        fallback_timer_.Stop();
+        return StartNextHappyEyeballsAttempt();
+      }
+      break;
+    }
   }
 
-  if (ipv4_job_ || ipv6_job_) {
+  if (ipv4_job_ || ipv6_job_ || !happy_eyeballs_jobs_.empty()) {
     // Wait for the other job to complete, rather than reporting |result|.
     return ERR_IO_PENDING;
   }
@@ -493,6 +588,61 @@ void TransportConnectJob::StartIPv4JobAsync() {
     OnSubJobComplete(result, ipv4_job_.get());
 }
 
+int TransportConnectJob::StartNextHappyEyeballsAttempt() {
+  DCHECK_LT(next_happy_eyeballs_address_, happy_eyeballs_addresses_.size());
+  const IPEndPoint& address =
+      happy_eyeballs_addresses_[next_happy_eyeballs_address_++];
+  happy_eyeballs_jobs_.push_back(std::make_unique<TransportConnectSubJob>(
+      std::vector<IPEndPoint>{address}, this, SUB_JOB_HAPPY_EYEBALLS));
+  TransportConnectSubJob* job = happy_eyeballs_jobs_.back().get();
+  int result = job->Start();
+  if (result != ERR_IO_PENDING)
+    return HandleSubJobComplete(result, job);
+
+  if (next_happy_eyeballs_address_ < happy_eyeballs_addresses_.size()) {
+    base::TimeDelta delay =
+        *common_connect_job_params()->happy_eyeballs_attempt_delay;
+    // Don't wait much longer than it took to connect to this address before.
+    if (http_server_properties()) {
+      const HttpServerProperties::ConnectRttInfo* info =
+          http_server_properties()->GetConnectRttInfo(
+              address, params_->network_anonymization_key());
+      if (info && info->consecutive_failures == 0 &&
+          !info->smoothed_rtt.is_zero()) {
+        delay = std::min(delay, std::max(2 * info->smoothed_rtt,
+                                         kMinConnectionAttemptDelay));
+      }
+    }
+    // This use of base::Unretained is safe because |fallback_timer_| is
+    // owned by this object.
+    fallback_timer_.Start(
+        FROM_HERE, delay,
+        base::BindOnce(&TransportConnectJob::StartNextHappyEyeballsAttemptAsync,
+                       base::Unretained(this)));
+  }
+  return ERR_IO_PENDING;
+}
+
+void TransportConnectJob::StartNextHappyEyeballsAttemptAsync() {
+  int result = StartNextHappyEyeballsAttempt();
+  if (result != ERR_IO_PENDING)
+    OnIOComplete(result);
+}
+
+void TransportConnectJob::RecordConnectAttempt(const IPEndPoint& address,
+                                               base::TimeDelta duration,
+                                               int result) {
+  if (!http_server_properties())
+    return;
+  if (result == OK) {
+    http_server_properties()->OnTransportConnectSucceeded(
+        address, params_->network_anonymization_key(), duration);
+  } else if (result != ERR_NETWORK_IO_SUSPENDED) {
+    http_server_properties()->OnTransportConnectFailed(
+        address, params_->network_anonymization_key());
+  }
+}
+
 int TransportConnectJob::ConnectInternal() {
   next_state_ = STATE_RESOLVE_HOST;
   return DoLoop(OK);
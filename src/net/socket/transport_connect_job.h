@@ -17,6 +17,7 @@
 #include "base/time/time.h"
 #include "base/timer/timer.h"
 #include "net/base/host_port_pair.h"
+#include "net/base/ip_endpoint.h"
 #include "net/base/net_export.h"
 #include "net/base/network_anonymization_key.h"
 #include "net/dns/host_resolver.h"
@@ -31,6 +32,7 @@
 
 namespace net {
 
+class HttpServerProperties;
 class NetLogWithSource;
 class SocketTag;
 class TransportConnectSubJob;
@@ -91,6 +93,12 @@ class NET_EXPORT_PRIVATE TransportSocketParams
 // (kIPv6FallbackTime) and start a connect() to a IPv4 address if the timer
 // fires. Then we race the IPv4 connect() against the IPv6 connect() (which has
 // a headstart) and return the one that completes first to the socket pool.
+//
+// If CommonConnectJobParams::happy_eyeballs_attempt_delay is set, it instead
+// follows Happy Eyeballs v2 (RFC 8305): addresses are ordered by their connect
+// history in HttpServerProperties and interleaved by family, and a connection
+// attempt to the next address starts every attempt delay, or as soon as an
+// earlier attempt fails, until one succeeds.
 class NET_EXPORT_PRIVATE TransportConnectJob : public ConnectJob {
  public:
   class NET_EXPORT_PRIVATE Factory {
@@ -116,6 +124,12 @@ class NET_EXPORT_PRIVATE TransportConnectJob : public ConnectJob {
   // they don't synchronize.
   static constexpr base::TimeDelta kIPv6FallbackTime = base::Milliseconds(300);
 
+  // Lower bound of the Happy Eyeballs v2 attempt delay when it is shortened
+  // based on the connect RTT of the address being tried. See RFC 8305,
+  // Section 5.
+  static constexpr base::TimeDelta kMinConnectionAttemptDelay =
+      base::Milliseconds(10);
+
   struct NET_EXPORT_PRIVATE EndpointResultOverride {
     EndpointResultOverride(HostResolverEndpointResult result,
                            std::set<std::string> dns_aliases);
@@ -153,6 +167,15 @@ class NET_EXPORT_PRIVATE TransportConnectJob : public ConnectJob {
 
   static base::TimeDelta ConnectionTimeout();
 
+  // Orders |addresses| for Happy Eyeballs v2: addresses that connected before
+  // come first by increasing RTT, then addresses without history in their
+  // original order, then addresses that failed last time. The result is then
+  // interleaved by address family, starting with the family of the first one.
+  static std::vector<IPEndPoint> SortAddressesForHappyEyeballs(
+      std::vector<IPEndPoint> addresses,
+      HttpServerProperties* http_server_properties,
+      const NetworkAnonymizationKey& network_anonymization_key);
+
  private:
   friend class TransportConnectSubJob;
 
@@ -167,7 +190,7 @@ class NET_EXPORT_PRIVATE TransportConnectJob : public ConnectJob {
 
   // Although it is not strictly necessary, it makes the code simpler if each
   // subjob knows what type it is.
-  enum SubJobType { SUB_JOB_IPV4, SUB_JOB_IPV6 };
+  enum SubJobType { SUB_JOB_IPV4, SUB_JOB_IPV6, SUB_JOB_HAPPY_EYEBALLS };
 
   void OnIOComplete(int result);
   int DoLoop(int result);
@@ -191,6 +214,19 @@ class NET_EXPORT_PRIVATE TransportConnectJob : public ConnectJob {
   // Called from |fallback_timer_|.
   void StartIPv4JobAsync();
 
+  // Starts a Happy Eyeballs v2 connection attempt to the next address, and
+  // arms |fallback_timer_| for the one after it. Returns the result of
+  // `HandleSubJobComplete` if the attempt completed synchronously.
+  int StartNextHappyEyeballsAttempt();
+  // Called from |fallback_timer_| in Happy Eyeballs v2 mode.
+  void StartNextHappyEyeballsAttemptAsync();
+
+  // Records the outcome of a connection attempt to |address| in
+  // HttpServerProperties, in Happy Eyeballs v2 mode.
+  void RecordConnectAttempt(const IPEndPoint& address,
+                            base::TimeDelta duration,
+                            int result);
+
   // Begins the host resolution and the TCP connect.  Returns OK on success
   // and ERR_IO_PENDING if it cannot immediately service the request.
   // Otherwise, it returns a net error code.
@@ -228,6 +264,12 @@ class NET_EXPORT_PRIVATE TransportConnectJob : public ConnectJob {
   std::unique_ptr<TransportConnectSubJob> ipv4_job_;
   std::unique_ptr<TransportConnectSubJob> ipv6_job_;
 
+  // In Happy Eyeballs v2 mode, there is one single-address sub-job per
+  // attempt started so far, and |fallback_timer_| starts the next attempt.
+  std::vector<IPEndPoint> happy_eyeballs_addresses_;
+  size_t next_happy_eyeballs_address_ = 0;
+  std::vector<std::unique_ptr<TransportConnectSubJob>> happy_eyeballs_jobs_;
+
   base::OneShotTimer fallback_timer_;
 
   ResolveErrorInfo resolve_error_info_;
@@ -11,6 +11,7 @@
 #include "base/bind.h"
 #include "base/check_op.h"
 #include "base/notreached.h"
+#include "base/time/time.h"
 #include "net/base/ip_endpoint.h"
 #include "net/base/net_errors.h"
 #include "net/log/net_log_with_source.h"
@@ -241,6 +242,7 @@ int TransportConnectSubJob::DoEndpointLockComplete() {
 
   transport_socket_->ApplySocketTag(parent_job_->socket_tag());
 
+  connect_start_ = base::TimeTicks::Now();
   // This use of base::Unretained() is safe because transport_socket_ is
   // destroyed in the destructor.
   return transport_socket_->Connect(base::BindOnce(
@@ -249,6 +251,10 @@ int TransportConnectSubJob::DoEndpointLockComplete() {
 
 int TransportConnectSubJob::DoTransportConnectComplete(int result) {
   next_state_ = STATE_DONE;
+  if (type_ == TransportConnectJob::SUB_JOB_HAPPY_EYEBALLS) {
+    parent_job_->RecordConnectAttempt(
+        CurrentAddress(), base::TimeTicks::Now() - connect_start_, result);
+  }
   if (result != OK) {
     // Drop the socket to release the endpoint lock, if any.
     transport_socket_.reset();
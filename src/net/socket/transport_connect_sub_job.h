@@ -12,6 +12,7 @@
 #include <vector>
 
 #include "base/memory/raw_ptr.h"
+#include "base/time/time.h"
 #include "net/base/address_list.h"
 #include "net/base/load_states.h"
 #include "net/socket/transport_connect_job.h"
@@ -23,9 +24,10 @@ class IPEndPoint;
 class StreamSocket;
 
 // Attempts to connect to a subset of the addresses required by a
-// TransportConnectJob, specifically either the IPv4 or IPv6 addresses. Each
-// address is tried in turn, and parent_job->OnSubJobComplete() is called when
-// the first address succeeds or the last address fails.
+// TransportConnectJob, specifically either the IPv4 or IPv6 addresses, or a
+// single address in Happy Eyeballs v2 mode. Each address is tried in turn,
+// and parent_job->OnSubJobComplete() is called when the first address
+// succeeds or the last address fails.
 class TransportConnectSubJob : public WebSocketEndpointLockManager::Waiter {
  public:
   using SubJobType = TransportConnectJob::SubJobType;
@@ -48,6 +50,12 @@ class TransportConnectSubJob : public WebSocketEndpointLockManager::Waiter {
 
   SubJobType type() const { return type_; }
 
+  const IPEndPoint& CurrentAddress() const;
+
+  // When the connect() to CurrentAddress() was started, or null if it has not
+  // been.
+  base::TimeTicks connect_start() const { return connect_start_; }
+
   std::unique_ptr<StreamSocket> PassSocket() {
     return std::move(transport_socket_);
   }
@@ -64,8 +72,6 @@ class TransportConnectSubJob : public WebSocketEndpointLockManager::Waiter {
     STATE_DONE,
   };
 
-  const IPEndPoint& CurrentAddress() const;
-
   void OnIOComplete(int result);
   int DoLoop(int result);
   int DoEndpointLock();
@@ -81,6 +87,7 @@ class TransportConnectSubJob : public WebSocketEndpointLockManager::Waiter {
   const SubJobType type_;
 
   std::unique_ptr<StreamSocket> transport_socket_;
+  base::TimeTicks connect_start_;
 };
 
 }  // namespace net
@@ -151,4 +151,26 @@ void UDPClientSocket::SetIOSNetworkServiceType(int ios_network_service_type) {
 #endif
 }
 
+int UDPClientSocket::EnableReleaseTime() {
+#if BUILDFLAG(IS_POSIX)
+  return socket_.EnableReleaseTime();
+#else
+  return ERR_NOT_IMPLEMENTED;
+#endif
+}
+
+bool UDPClientSocket::SupportsReleaseTime() const {
+#if BUILDFLAG(IS_POSIX)
+  return socket_.release_time_enabled();
+#else
+  return false;
+#endif
+}
+
+void UDPClientSocket::SetReleaseDelay(base::TimeDelta delay) {
+#if BUILDFLAG(IS_POSIX)
+  socket_.SetReleaseDelay(delay);
+#endif
+}
+
 }  // namespace net
@@ -64,6 +64,9 @@ class NET_EXPORT_PRIVATE UDPClientSocket : public DatagramClientSocket {
 
   int SetMulticastInterface(uint32_t interface_index) override;
   void SetIOSNetworkServiceType(int ios_network_service_type) override;
+  int EnableReleaseTime() override;
+  bool SupportsReleaseTime() const override;
+  void SetReleaseDelay(base::TimeDelta delay) override;
 
  private:
   UDPSocket socket_;
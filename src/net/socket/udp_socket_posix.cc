@@ -19,7 +19,9 @@
 #include <netinet/in.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <time.h>
 
+#include <cstring>
 #include <memory>
 
 #include "base/bind.h"
@@ -76,6 +78,13 @@ const int kActivityMonitorBytesThreshold = 65535;
 const int kActivityMonitorMinimumSamplesForThroughputEstimate = 2;
 const base::TimeDelta kActivityMonitorMsThreshold = base::Milliseconds(100);
 
+#if BUILDFLAG(IS_LINUX) || BUILDFLAG(IS_CHROMEOS) || BUILDFLAG(IS_ANDROID)
+// Not defined by older headers.
+#ifndef SO_TXTIME
+#define SO_TXTIME 61
+#endif
+#endif
+
 #if BUILDFLAG(IS_APPLE) && !BUILDFLAG(CRONET_BUILD)
 
 // On macOS, the file descriptor is guarded to detect the cause of
@@ -809,8 +818,13 @@ int UDPSocketPosix::InternalSendTo(IOBuffer* buf,
     }
   }
 
-  int result = HANDLE_EINTR(sendto(socket_, buf->data(), buf_len, sendto_flags_,
-                                   addr, storage.addr_len));
+  int result;
+  if (release_time_ns_ != 0) {
+    result = SendToWithReleaseTime(buf, buf_len, addr, storage.addr_len);
+  } else {
+    result = HANDLE_EINTR(sendto(socket_, buf->data(), buf_len, sendto_flags_,
+                                 addr, storage.addr_len));
+  }
   if (result < 0)
     result = MapSystemError(errno);
   if (result != ERR_IO_PENDING)
@@ -818,6 +832,35 @@ int UDPSocketPosix::InternalSendTo(IOBuffer* buf,
   return result;
 }
 
+int UDPSocketPosix::SendToWithReleaseTime(IOBuffer* buf,
+                                          int buf_len,
+                                          const struct sockaddr* addr,
+                                          socklen_t addr_len) {
+#if BUILDFLAG(IS_LINUX) || BUILDFLAG(IS_CHROMEOS) || BUILDFLAG(IS_ANDROID)
+  struct iovec iov = {buf->data(), static_cast<size_t>(buf_len)};
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(uint64_t))] = {};
+
+  struct msghdr msg = {};
+  msg.msg_name = const_cast<struct sockaddr*>(addr);
+  msg.msg_namelen = addr_len;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SO_TXTIME;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+  memcpy(CMSG_DATA(cmsg), &release_time_ns_, sizeof(uint64_t));
+
+  return HANDLE_EINTR(sendmsg(socket_, &msg, sendto_flags_));
+#else
+  NOTREACHED();
+  return -1;
+#endif
+}
+
 int UDPSocketPosix::SetMulticastOptions() {
   if (!(socket_options_ & SOCKET_OPTION_MULTICAST_LOOP)) {
     int rv;
@@ -1054,6 +1097,38 @@ void UDPSocketPosix::ApplySocketTag(const SocketTag& tag) {
   tag_ = tag;
 }
 
+int UDPSocketPosix::EnableReleaseTime() {
+  DCHECK_NE(socket_, kInvalidSocket);
+  DCHECK_CALLED_ON_VALID_THREAD(thread_checker_);
+#if BUILDFLAG(IS_LINUX) || BUILDFLAG(IS_CHROMEOS) || BUILDFLAG(IS_ANDROID)
+  // Same layout as struct sock_txtime, which older headers lack. The fq qdisc
+  // expects CLOCK_MONOTONIC.
+  struct {
+    clockid_t clockid;
+    uint32_t flags;
+  } txtime = {CLOCK_MONOTONIC, 0};
+  if (setsockopt(socket_, SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime)) != 0)
+    return MapSystemError(errno);
+  release_time_enabled_ = true;
+  return OK;
+#else
+  return ERR_NOT_IMPLEMENTED;
+#endif
+}
+
+void UDPSocketPosix::SetReleaseDelay(base::TimeDelta delay) {
+  if (!release_time_enabled_)
+    return;
+  if (!delay.is_positive()) {
+    release_time_ns_ = 0;
+    return;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  release_time_ns_ = static_cast<uint64_t>(now.tv_sec) * 1000000000 +
+                     now.tv_nsec + delay.InNanoseconds();
+}
+
 int UDPSocketPosix::SetIOSNetworkServiceType(int ios_network_service_type) {
   if (ios_network_service_type == 0) {
     return OK;
@@ -16,6 +16,7 @@
 #include "base/memory/ref_counted.h"
 #include "base/message_loop/message_pump_for_io.h"
 #include "base/threading/thread_checker.h"
+#include "base/time/time.h"
 #include "base/timer/timer.h"
 #include "net/base/address_family.h"
 #include "net/base/completion_once_callback.h"
@@ -272,6 +273,16 @@ class NET_EXPORT UDPSocketPosix {
   // Sets iOS Network Service Type for option SO_NET_SERVICE_TYPE.
   int SetIOSNetworkServiceType(int ios_network_service_type);
 
+  // Enables SO_TXTIME, which lets each datagram carry the earliest time it may
+  // leave the host. The fq qdisc holds datagrams back until then. Only
+  // supported on Linux. Returns a net error code.
+  int EnableReleaseTime();
+  bool release_time_enabled() const { return release_time_enabled_; }
+
+  // Datagrams written from now on are released no earlier than |delay| from
+  // now. No-op unless EnableReleaseTime() succeeded.
+  void SetReleaseDelay(base::TimeDelta delay);
+
  private:
   enum SocketOptions {
     SOCKET_OPTION_MULTICAST_LOOP = 1 << 0
@@ -357,6 +368,11 @@ class NET_EXPORT UDPSocketPosix {
                                          int buf_len,
                                          IPEndPoint* address);
   int InternalSendTo(IOBuffer* buf, int buf_len, const IPEndPoint* address);
+  // Same as sendto(), but attaches |release_time_ns_| to the datagram.
+  int SendToWithReleaseTime(IOBuffer* buf,
+                            int buf_len,
+                            const struct sockaddr* addr,
+                            socklen_t addr_len);
 
   // Applies |socket_options_| to |socket_|. Should be called before
   // Bind().
@@ -447,6 +463,11 @@ class NET_EXPORT UDPSocketPosix {
   // enable_experimental_recv_optimization() method.
   bool experimental_recv_optimization_enabled_ = false;
 
+  bool release_time_enabled_ = false;
+  // CLOCK_MONOTONIC time in nanoseconds at which the next datagram may be
+  // released, or 0 to release it right away.
+  uint64_t release_time_ns_ = 0;
+
   // Manages decrementing the global open UDP socket counter when this
   // UDPSocket is destroyed.
   OwnedUDPSocketCount owned_socket_count_;
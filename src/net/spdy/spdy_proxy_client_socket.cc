@@ -83,13 +83,14 @@ int SpdyProxyClientSocket::RestartWithAuth(CompletionOnceCallback callback) {
   return ERR_UNABLE_TO_REUSE_CONNECTION_FOR_PROXY_AUTH;
 }
 
-// Ignore priority changes, just use priority of initial request. Since multiple
-// requests are pooled on the SpdyProxyClientSocket, reprioritization doesn't
-// really work.
-//
-// TODO(mmenke):  Use a single priority value for all SpdyProxyClientSockets,
-// regardless of what priority they're created with.
-void SpdyProxyClientSocket::SetStreamPriority(RequestPriority priority) {}
+// Reprioritizes the tunnel stream relative to other streams on the session.
+// HttpProxyConnectJob does not forward request priority changes here, since
+// multiple requests are pooled on the tunnel; this is for callers which own
+// the tunnel and know what it carries.
+void SpdyProxyClientSocket::SetStreamPriority(RequestPriority priority) {
+  if (spdy_stream_)
+    spdy_stream_->SetPriority(priority);
+}
 
 // Sends a HEADERS frame to the proxy with a CONNECT request
 // for the specified endpoint.  Waits for the server to send back
@@ -278,6 +279,12 @@ int SpdyProxyClientSocket::GetLocalAddress(IPEndPoint* address) const {
   return spdy_stream_->GetLocalAddress(address);
 }
 
+int SpdyProxyClientSocket::ConfirmHandshake(CompletionOnceCallback callback) {
+  if (!IsConnected())
+    return ERR_SOCKET_NOT_CONNECTED;
+  return spdy_stream_->ConfirmHandshake(std::move(callback));
+}
+
 void SpdyProxyClientSocket::RunWriteCallback(CompletionOnceCallback callback,
                                              int result) const {
   std::move(callback).Run(result);
@@ -95,6 +95,7 @@ class NET_EXPORT_PRIVATE SpdyProxyClientSocket : public ProxyClientSocket,
   int SetSendBufferSize(int32_t size) override;
   int GetPeerAddress(IPEndPoint* address) const override;
   int GetLocalAddress(IPEndPoint* address) const override;
+  int ConfirmHandshake(CompletionOnceCallback callback) override;
 
   // SpdyStream::Delegate implementation.
   void OnHeadersSent() override;
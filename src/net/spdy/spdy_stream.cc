@@ -370,6 +370,10 @@ int SpdyStream::GetLocalAddress(IPEndPoint* address) const {
   return session_->GetLocalAddress(address);
 }
 
+int SpdyStream::ConfirmHandshake(CompletionOnceCallback callback) {
+  return session_->ConfirmHandshake(std::move(callback));
+}
+
 bool SpdyStream::WasEverUsed() const {
   return session_->WasEverUsed();
 }
@@ -16,6 +16,7 @@
 #include "base/memory/ref_counted.h"
 #include "base/memory/weak_ptr.h"
 #include "base/time/time.h"
+#include "net/base/completion_once_callback.h"
 #include "net/base/io_buffer.h"
 #include "net/base/net_export.h"
 #include "net/base/request_priority.h"
@@ -256,6 +257,10 @@ class NET_EXPORT_PRIVATE SpdyStream {
   int GetPeerAddress(IPEndPoint* address) const;
   int GetLocalAddress(IPEndPoint* address) const;
 
+  // Confirms the handshake of the session, so that data sent afterwards is not
+  // sent as TLS early data. See SpdySession::ConfirmHandshake().
+  int ConfirmHandshake(CompletionOnceCallback callback);
+
   // Returns true if the underlying transport socket ever had any reads or
   // writes.
   bool WasEverUsed() const;
@@ -0,0 +1,91 @@
+// Copyright 2022 The Chromium Authors
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef NET_THIRD_PARTY_QUICHE_OVERRIDES_QUICHE_PLATFORM_IMPL_QUICHE_MEM_SLICE_IMPL_H_
+#define NET_THIRD_PARTY_QUICHE_OVERRIDES_QUICHE_PLATFORM_IMPL_QUICHE_MEM_SLICE_IMPL_H_
+
+#include <memory>
+#include <utility>
+
+#include "base/callback.h"
+#include "quiche/common/platform/api/quiche_export.h"
+#include "quiche/common/quiche_buffer_allocator.h"
+#include "quiche/common/simple_buffer_allocator.h"
+
+namespace quiche {
+
+// Same as the default implementation, except that it can also refer to memory
+// owned elsewhere, e.g. a net::IOBuffer, which is released by running a
+// callback. This lets Chromium hand its buffers to QUICHE without a copy.
+class QUICHE_EXPORT_PRIVATE QuicheMemSliceImpl {
+ public:
+  QuicheMemSliceImpl() = default;
+
+  explicit QuicheMemSliceImpl(QuicheBuffer buffer)
+      : buffer_(std::move(buffer)),
+        data_(buffer_.data()),
+        length_(buffer_.size()) {}
+
+  QuicheMemSliceImpl(std::unique_ptr<char[]> buffer, size_t length)
+      : QuicheMemSliceImpl(
+            QuicheBuffer(QuicheUniqueBufferPtr(
+                             buffer.release(),
+                             QuicheBufferDeleter(SimpleBufferAllocator::Get())),
+                         length)) {}
+
+  // Refers to |length| bytes at |data| without taking ownership. The memory
+  // must stay valid and unmodified until |done_callback| is run, which happens
+  // when the slice is reset or destroyed.
+  QuicheMemSliceImpl(const char* data,
+                     size_t length,
+                     base::OnceClosure done_callback)
+      : data_(data),
+        length_(length),
+        done_callback_(std::move(done_callback)) {}
+
+  QuicheMemSliceImpl(const QuicheMemSliceImpl& other) = delete;
+  QuicheMemSliceImpl& operator=(const QuicheMemSliceImpl& other) = delete;
+
+  // Move constructors. |other| will not hold a reference to the data buffer
+  // after this call completes.
+  QuicheMemSliceImpl(QuicheMemSliceImpl&& other)
+      : buffer_(std::move(other.buffer_)),
+        data_(std::exchange(other.data_, nullptr)),
+        length_(std::exchange(other.length_, 0)),
+        done_callback_(std::move(other.done_callback_)) {}
+  QuicheMemSliceImpl& operator=(QuicheMemSliceImpl&& other) {
+    if (this != &other) {
+      Reset();
+      buffer_ = std::move(other.buffer_);
+      data_ = std::exchange(other.data_, nullptr);
+      length_ = std::exchange(other.length_, 0);
+      done_callback_ = std::move(other.done_callback_);
+    }
+    return *this;
+  }
+
+  ~QuicheMemSliceImpl() { Reset(); }
+
+  void Reset() {
+    buffer_ = QuicheBuffer();
+    data_ = nullptr;
+    length_ = 0;
+    if (done_callback_)
+      std::move(done_callback_).Run();
+  }
+
+  const char* data() const { return data_; }
+  size_t length() const { return length_; }
+  bool empty() const { return length_ == 0; }
+
+ private:
+  QuicheBuffer buffer_;
+  const char* data_ = nullptr;
+  size_t length_ = 0;
+  base::OnceClosure done_callback_;
+};
+
+}  // namespace quiche
+
+#endif  // NET_THIRD_PARTY_QUICHE_OVERRIDES_QUICHE_PLATFORM_IMPL_QUICHE_MEM_SLICE_IMPL_H_
@@ -7,6 +7,7 @@
 #include <bitset>
 #include <limits>
 
+#include "quiche/http2/hpack/huffman/huffman_spec_tables.h"
 #include "quiche/common/platform/api/quiche_logging.h"
 
 // Terminology:
@@ -343,6 +344,67 @@ struct ShortCodeInfo {
     {0x7a, 7},  // Match: 0b1111011, Symbol: z
 };
 
+// The multi-symbol table is indexed by the leading kMultiCodeBitCount bits of
+// the bit buffer, and holds the (up to two) complete codes that start those
+// bits. Two symbols per lookup are possible when both codes are short, which
+// is common for the lowercase letters and digits that dominate header values.
+constexpr HuffmanCodeBitCount kMultiCodeBitCount = 12;
+constexpr size_t kMultiCodeTableSize = 1 << kMultiCodeBitCount;
+struct MultiCodeInfo {
+  uint8_t symbols[2];
+  uint8_t symbol_count;  // 0 if the leading code is longer than the index.
+  uint8_t length;        // Total length of the codes of |symbols|.
+};
+
+// Finds the symbol whose code starts the leading |bit_count| bits of |bits|,
+// left justified. Returns false if no code fits in those bits.
+bool DecodeLeadingSymbol(HuffmanCode bits,
+                         HuffmanCodeBitCount bit_count,
+                         uint8_t* symbol,
+                         HuffmanCodeBitCount* length) {
+  for (int i = 0; i < 256; ++i) {
+    HuffmanCodeBitCount code_length = HuffmanSpecTables::kCodeLengths[i];
+    if (code_length > bit_count) {
+      continue;
+    }
+    if (((bits ^ HuffmanSpecTables::kLeftCodes[i]) >>
+         (kHuffmanCodeBitCount - code_length)) == 0) {
+      *symbol = static_cast<uint8_t>(i);
+      *length = code_length;
+      return true;
+    }
+  }
+  return false;
+}
+
+const MultiCodeInfo* BuildMultiCodeTable() {
+  auto* table = new MultiCodeInfo[kMultiCodeTableSize];
+  for (size_t index = 0; index < kMultiCodeTableSize; ++index) {
+    MultiCodeInfo& info = table[index];
+    info = {{0, 0}, 0, 0};
+    HuffmanCode bits = static_cast<HuffmanCode>(index)
+                       << (kHuffmanCodeBitCount - kMultiCodeBitCount);
+    HuffmanCodeBitCount length;
+    if (!DecodeLeadingSymbol(bits, kMultiCodeBitCount, &info.symbols[0],
+                             &length)) {
+      continue;
+    }
+    info.symbol_count = 1;
+    info.length = length;
+    if (DecodeLeadingSymbol(bits << length, kMultiCodeBitCount - length,
+                            &info.symbols[1], &length)) {
+      info.symbol_count = 2;
+      info.length += length;
+    }
+  }
+  return table;
+}
+
+const MultiCodeInfo* MultiCodeTable() {
+  static const MultiCodeInfo* const kTable = BuildMultiCodeTable();
+  return kTable;
+}
+
 }  // namespace
 
 HuffmanBitBuffer::HuffmanBitBuffer() { Reset(); }
@@ -413,12 +475,56 @@ HpackHuffmanDecoder::~HpackHuffmanDecoder() = default;
 bool HpackHuffmanDecoder::Decode(absl::string_view input, std::string* output) {
   QUICHE_DVLOG(1) << "HpackHuffmanDecoder::Decode";
 
+  const MultiCodeInfo* const multi_code_table = MultiCodeTable();
+
+  // Every symbol takes at least kMinCodeBitCount bits, which bounds the number
+  // of symbols that can be decoded. Size |*output| for that up front, plus one
+  // byte of slack for storing the second symbol of the multi-symbol table
+  // unconditionally, and shrink it to what was decoded before returning.
+  const size_t original_size = output->size();
+  output->resize(original_size +
+                 (input.size() * 8 + bit_buffer_.count()) / kMinCodeBitCount +
+                 1);
+  char* const first = &(*output)[0];
+  char* out = first + original_size;
+
   // Fill bit_buffer_ from input.
   input.remove_prefix(bit_buffer_.AppendBytes(input));
 
   while (true) {
     QUICHE_DVLOG(3) << "Enter Decode Loop, bit_buffer_: " << bit_buffer_;
-    if (bit_buffer_.count() >= 7) {
+    if (bit_buffer_.count() >= kMultiCodeBitCount) {
+      // Decode up to two symbols at a time from the high 12 bits of the bit
+      // buffer. Works on a copy of the bit buffer, which would otherwise have
+      // to be reloaded after every store to |out|.
+      HuffmanAccumulator bits = bit_buffer_.value();
+      HuffmanAccumulatorBitCount count = bit_buffer_.count();
+      do {
+        MultiCodeInfo info = multi_code_table[bits >>
+                                              (kHuffmanAccumulatorBitCount -
+                                               kMultiCodeBitCount)];
+        if (info.symbol_count == 0) {
+          break;
+        }
+        out[0] = static_cast<char>(info.symbols[0]);
+        out[1] = static_cast<char>(info.symbols[1]);
+        out += info.symbol_count;
+        bits <<= info.length;
+        count -= info.length;
+      } while (count >= kMultiCodeBitCount);
+      if (count != bit_buffer_.count()) {
+        bit_buffer_.ConsumeBits(bit_buffer_.count() - count);
+        continue;
+      }
+      // The code is more than 12 bits long. Use PrefixToInfo, etc. to decode
+      // longer codes.
+    } else if (bit_buffer_.count() >= 7) {
+      // Top up bit_buffer_ first so that the table above can be used.
+      size_t byte_count = bit_buffer_.AppendBytes(input);
+      if (byte_count > 0) {
+        input.remove_prefix(byte_count);
+        continue;
+      }
       // Get high 7 bits of the bit buffer, see if that contains a complete
       // code of 5, 6 or 7 bits.
       uint8_t short_code =
@@ -427,7 +533,7 @@ bool HpackHuffmanDecoder::Decode(absl::string_view input, std::string* output) {
       if (short_code < kShortCodeTableSize) {
         ShortCodeInfo info = kShortCodeTable[short_code];
         bit_buffer_.ConsumeBits(info.length);
-        output->push_back(static_cast<char>(info.symbol));
+        *out++ = static_cast<char>(info.symbol);
         continue;
       }
       // The code is more than 7 bits long. Use PrefixToInfo, etc. to decode
@@ -455,14 +561,14 @@ bool HpackHuffmanDecoder::Decode(absl::string_view input, std::string* output) {
       uint32_t canonical = prefix_info.DecodeToCanonical(code_prefix);
       if (canonical < 256) {
         // Valid code.
-        char c = kCanonicalToSymbol[canonical];
-        output->push_back(c);
+        *out++ = kCanonicalToSymbol[canonical];
         bit_buffer_.ConsumeBits(prefix_info.code_length);
         continue;
       }
       // Encoder is not supposed to explicity encode the EOS symbol.
       QUICHE_DLOG(ERROR) << "EOS explicitly encoded!\n " << bit_buffer_ << "\n "
                          << prefix_info;
+      output->resize(out - first);
       return false;
     }
     // bit_buffer_ doesn't have enough bits in it to decode the next symbol.
@@ -470,6 +576,7 @@ bool HpackHuffmanDecoder::Decode(absl::string_view input, std::string* output) {
     size_t byte_count = bit_buffer_.AppendBytes(input);
     if (byte_count == 0) {
       QUICHE_DCHECK_EQ(input.size(), 0u);
+      output->resize(out - first);
       return true;
     }
     input.remove_prefix(byte_count);
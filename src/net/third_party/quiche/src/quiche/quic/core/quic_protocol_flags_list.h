@@ -71,6 +71,11 @@ QUIC_PROTOCOL_FLAG(
     uint64_t, quic_send_buffer_max_data_slice_size, 4 * 1024,
     "Max size of data slice in bytes for QUIC stream send buffer.")
 
+QUIC_PROTOCOL_FLAG(
+    uint64_t, quic_sequencer_buffer_block_pool_size, 128,
+    "Max number of free blocks each thread keeps for reuse by QUIC stream "
+    "sequencer buffers.")
+
 QUIC_PROTOCOL_FLAG(
     int32_t, quic_lumpy_pacing_size, 2,
     "Number of packets that the pacing sender allows in bursts during "
@@ -8,6 +8,7 @@
 #include <cstddef>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
@@ -17,6 +18,7 @@
 #include "quiche/quic/platform/api/quic_flag_utils.h"
 #include "quiche/quic/platform/api/quic_flags.h"
 #include "quiche/quic/platform/api/quic_logging.h"
+#include "quiche/common/platform/api/quiche_thread_local.h"
 
 namespace quic {
 namespace {
@@ -38,6 +40,49 @@ constexpr size_t kInitialBlockCount = 8u;
 // Choose 4 to reduce the amount of reallocation.
 constexpr int kBlocksGrowthFactor = 4;
 
+using BufferBlock = QuicStreamSequencerBuffer::BufferBlock;
+
+// Free list of blocks shared by all sequencer buffers on a thread, so that a
+// fast stream reuses the blocks it has just consumed instead of going through
+// the allocator for every 8 KiB of data. Holds at most
+// FLAGS_quic_sequencer_buffer_block_pool_size blocks.
+class BlockPool {
+ public:
+  BufferBlock* Allocate() {
+    if (free_blocks_.empty()) {
+      // Not value-initialized, every byte is written before it is read.
+      return new BufferBlock;
+    }
+    BufferBlock* block = free_blocks_.back();
+    free_blocks_.pop_back();
+    return block;
+  }
+
+  void Release(BufferBlock* block) {
+    if (free_blocks_.size() >=
+        GetQuicFlag(FLAGS_quic_sequencer_buffer_block_pool_size)) {
+      delete block;
+      return;
+    }
+    free_blocks_.push_back(block);
+  }
+
+ private:
+  std::vector<BufferBlock*> free_blocks_;
+};
+
+// Never destroyed, like the thread itself in practice.
+DEFINE_QUICHE_THREAD_LOCAL_POINTER(SequencerBlockPool, BlockPool);
+
+BlockPool* GetBlockPool() {
+  BlockPool* pool = GET_QUICHE_THREAD_LOCAL_POINTER(SequencerBlockPool);
+  if (pool == nullptr) {
+    pool = new BlockPool();
+    SET_QUICHE_THREAD_LOCAL_POINTER(SequencerBlockPool, pool);
+  }
+  return pool;
+}
+
 }  // namespace
 
 QuicStreamSequencerBuffer::QuicStreamSequencerBuffer(size_t max_capacity_bytes)
@@ -70,7 +115,7 @@ bool QuicStreamSequencerBuffer::RetireBlock(size_t index) {
     QUIC_BUG(quic_bug_10610_1) << "Try to retire block twice";
     return false;
   }
-  delete blocks_[index];
+  GetBlockPool()->Release(blocks_[index]);
   blocks_[index] = nullptr;
   QUIC_DVLOG(1) << "Retired block with index: " << index;
   return true;
@@ -217,9 +262,8 @@ bool QuicStreamSequencerBuffer::CopyStreamData(QuicStreamOffset offset,
       return false;
     }
     if (blocks_[write_block_num] == nullptr) {
-      // TODO(danzh): Investigate if using a freelist would improve performance.
       // Same as RetireBlock().
-      blocks_[write_block_num] = new BufferBlock();
+      blocks_[write_block_num] = GetBlockPool()->Allocate();
     }
 
     const size_t bytes_to_copy =
@@ -167,7 +167,7 @@ class QUIC_EXPORT_PRIVATE QuicStreamSequencerBuffer {
   bool CopyStreamData(QuicStreamOffset offset, absl::string_view data,
                       size_t* bytes_copy, std::string* error_details);
 
-  // Dispose the given buffer block.
+  // Dispose the given buffer block, returning it to the per-thread pool.
   // After calling this method, blocks_[index] is set to nullptr
   // in order to indicate that no memory set is allocated for that block.
   // Returns true on success, false otherwise.
@@ -0,0 +1,411 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#include "net/tools/naive/bounded_net_log_observer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "base/bind.h"
+#include "base/files/file.h"
+#include "base/logging.h"
+#include "base/strings/string_piece.h"
+#include "base/task/sequenced_task_runner.h"
+#include "base/task/thread_pool.h"
+#include "base/time/time.h"
+#include "net/log/file_net_log_observer.h"
+#include "net/log/net_log_entry.h"
+#include "net/log/net_log_source.h"
+#include "net/log/net_log_util.h"
+
+namespace net {
+
+namespace {
+constexpr size_t kLengthSize = 4;
+
+// Tags of the binary base::Value encoding.
+enum ValueTag : uint8_t {
+  kTagNone = 0,
+  kTagFalse,
+  kTagTrue,
+  kTagInt,
+  kTagDouble,
+  kTagString,
+  kTagBinary,
+  kTagDict,
+  kTagList,
+};
+
+void WriteVarint(uint64_t v, std::string* out) {
+  while (v >= 0x80) {
+    out->push_back(static_cast<char>((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  out->push_back(static_cast<char>(v));
+}
+
+void WriteBytes(base::StringPiece bytes, std::string* out) {
+  WriteVarint(bytes.size(), out);
+  out->append(bytes.data(), bytes.size());
+}
+
+void WriteValue(const base::Value& value, std::string* out) {
+  switch (value.type()) {
+    case base::Value::Type::NONE:
+      out->push_back(kTagNone);
+      break;
+    case base::Value::Type::BOOLEAN:
+      out->push_back(value.GetBool() ? kTagTrue : kTagFalse);
+      break;
+    case base::Value::Type::INTEGER: {
+      out->push_back(kTagInt);
+      // Zigzag encoding keeps small negative numbers short.
+      int64_t v = value.GetInt();
+      WriteVarint(static_cast<uint64_t>((v << 1) ^ (v >> 63)), out);
+      break;
+    }
+    case base::Value::Type::DOUBLE: {
+      out->push_back(kTagDouble);
+      double v = value.GetDouble();
+      char bytes[sizeof(v)];
+      std::memcpy(bytes, &v, sizeof(v));
+      out->append(bytes, sizeof(v));
+      break;
+    }
+    case base::Value::Type::STRING:
+      out->push_back(kTagString);
+      WriteBytes(value.GetString(), out);
+      break;
+    case base::Value::Type::BINARY: {
+      out->push_back(kTagBinary);
+      const auto& blob = value.GetBlob();
+      WriteBytes(base::StringPiece(reinterpret_cast<const char*>(blob.data()),
+                                   blob.size()),
+                 out);
+      break;
+    }
+    case base::Value::Type::DICT:
+      out->push_back(kTagDict);
+      WriteVarint(value.GetDict().size(), out);
+      for (const auto [key, child] : value.GetDict()) {
+        WriteBytes(key, out);
+        WriteValue(child, out);
+      }
+      break;
+    case base::Value::Type::LIST:
+      out->push_back(kTagList);
+      WriteVarint(value.GetList().size(), out);
+      for (const auto& child : value.GetList()) {
+        WriteValue(child, out);
+      }
+      break;
+  }
+}
+
+class Reader {
+ public:
+  explicit Reader(base::StringPiece data) : data_(data) {}
+
+  bool ReadVarint(uint64_t* v) {
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (data_.empty())
+        return false;
+      uint8_t byte = data_[0];
+      data_.remove_prefix(1);
+      *v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return true;
+    }
+    return false;
+  }
+
+  bool ReadBytes(base::StringPiece* bytes) {
+    uint64_t size;
+    if (!ReadVarint(&size) || size > data_.size())
+      return false;
+    *bytes = data_.substr(0, size);
+    data_.remove_prefix(size);
+    return true;
+  }
+
+  bool ReadValue(base::Value* value) {
+    if (data_.empty())
+      return false;
+    uint8_t tag = data_[0];
+    data_.remove_prefix(1);
+    switch (tag) {
+      case kTagNone:
+        *value = base::Value();
+        return true;
+      case kTagFalse:
+      case kTagTrue:
+        *value = base::Value(tag == kTagTrue);
+        return true;
+      case kTagInt: {
+        uint64_t v;
+        if (!ReadVarint(&v))
+          return false;
+        *value = base::Value(static_cast<int>((v >> 1) ^ -(v & 1)));
+        return true;
+      }
+      case kTagDouble: {
+        double v;
+        if (data_.size() < sizeof(v))
+          return false;
+        std::memcpy(&v, data_.data(), sizeof(v));
+        data_.remove_prefix(sizeof(v));
+        *value = base::Value(v);
+        return true;
+      }
+      case kTagString: {
+        base::StringPiece s;
+        if (!ReadBytes(&s))
+          return false;
+        *value = base::Value(s);
+        return true;
+      }
+      case kTagBinary: {
+        base::StringPiece s;
+        if (!ReadBytes(&s))
+          return false;
+        *value = base::Value(base::Value::BlobStorage(s.begin(), s.end()));
+        return true;
+      }
+      case kTagDict: {
+        uint64_t n;
+        if (!ReadVarint(&n))
+          return false;
+        base::Value::Dict dict;
+        for (uint64_t i = 0; i < n; ++i) {
+          base::StringPiece key;
+          base::Value child;
+          if (!ReadBytes(&key) || !ReadValue(&child))
+            return false;
+          dict.Set(key, std::move(child));
+        }
+        *value = base::Value(std::move(dict));
+        return true;
+      }
+      case kTagList: {
+        uint64_t n;
+        if (!ReadVarint(&n))
+          return false;
+        base::Value::List list;
+        for (uint64_t i = 0; i < n; ++i) {
+          base::Value child;
+          if (!ReadValue(&child))
+            return false;
+          list.Append(std::move(child));
+        }
+        *value = base::Value(std::move(list));
+        return true;
+      }
+      default:
+        return false;
+    }
+  }
+
+ private:
+  base::StringPiece data_;
+};
+
+base::TimeTicks MicrosecondsToTicks(uint64_t us) {
+  return base::TimeTicks() + base::Microseconds(us);
+}
+
+uint64_t TicksToMicroseconds(base::TimeTicks ticks) {
+  return (ticks - base::TimeTicks()).InMicroseconds();
+}
+
+// Record layout: time, type, phase, source type, source id, source start
+// time, params.
+void EncodeEntry(const NetLogEntry& entry, std::string* out) {
+  WriteVarint(TicksToMicroseconds(entry.time), out);
+  WriteVarint(static_cast<uint64_t>(entry.type), out);
+  WriteVarint(static_cast<uint64_t>(entry.phase), out);
+  WriteVarint(static_cast<uint64_t>(entry.source.type), out);
+  WriteVarint(entry.source.id, out);
+  WriteVarint(TicksToMicroseconds(entry.source.start_time), out);
+  WriteValue(entry.params, out);
+}
+
+bool DecodeEntry(base::StringPiece record, base::Value* out) {
+  Reader reader(record);
+  uint64_t time, type, phase, source_type, source_id, source_start_time;
+  base::Value params;
+  if (!reader.ReadVarint(&time) || !reader.ReadVarint(&type) ||
+      !reader.ReadVarint(&phase) || !reader.ReadVarint(&source_type) ||
+      !reader.ReadVarint(&source_id) ||
+      !reader.ReadVarint(&source_start_time) || !reader.ReadValue(&params)) {
+    return false;
+  }
+  if (type >= static_cast<uint64_t>(NetLogEventType::COUNT) ||
+      source_type >= static_cast<uint64_t>(NetLogSourceType::COUNT) ||
+      phase > static_cast<uint64_t>(NetLogEventPhase::END)) {
+    return false;
+  }
+  NetLogEntry entry(
+      static_cast<NetLogEventType>(type),
+      NetLogSource(static_cast<NetLogSourceType>(source_type),
+                   static_cast<uint32_t>(source_id),
+                   MicrosecondsToTicks(source_start_time)),
+      static_cast<NetLogEventPhase>(phase), MicrosecondsToTicks(time),
+      std::move(params));
+  *out = entry.ToValue();
+  return true;
+}
+
+bool WriteToFile(base::File* file, base::StringPiece data) {
+  return file->WriteAtCurrentPos(data.data(), data.size()) ==
+         static_cast<int>(data.size());
+}
+
+// Runs on the file task runner. |snapshot| is a sequence of length-prefixed
+// records.
+void WriteSnapshot(const base::FilePath& path,
+                   const std::string& constants_json,
+                   std::string snapshot) {
+  base::File file(path, base::File::FLAG_CREATE_ALWAYS |
+                            base::File::FLAG_WRITE);
+  if (!file.IsValid()) {
+    LOG(ERROR) << "Failed to open " << path << ": "
+               << base::File::ErrorToString(file.error_details());
+    return;
+  }
+
+  bool ok = WriteToFile(&file, "{\"constants\":") &&
+            WriteToFile(&file, constants_json) &&
+            WriteToFile(&file, ",\n\"events\": [\n");
+  base::StringPiece rest(snapshot);
+  size_t num_events = 0;
+  while (ok && rest.size() >= kLengthSize) {
+    uint32_t length;
+    std::memcpy(&length, rest.data(), kLengthSize);
+    rest.remove_prefix(kLengthSize);
+    if (length > rest.size())
+      break;
+    base::Value value;
+    if (DecodeEntry(rest.substr(0, length), &value)) {
+      if (num_events++ > 0)
+        ok = WriteToFile(&file, ",\n");
+      ok = ok && WriteToFile(&file, SerializeNetLogValueToJson(value));
+    }
+    rest.remove_prefix(length);
+  }
+  ok = ok && WriteToFile(&file, "]}\n");
+  if (!ok) {
+    LOG(ERROR) << "Failed to write " << path;
+    return;
+  }
+  LOG(INFO) << "Saved " << num_events << " NetLog events to " << path;
+}
+}  // namespace
+
+BoundedNetLogObserver::BoundedNetLogObserver(
+    size_t max_bytes,
+    const std::vector<NetLogEventType>& event_types,
+    std::unique_ptr<base::Value> constants)
+    : constants_(std::move(constants)),
+      file_task_runner_(base::ThreadPool::CreateSequencedTaskRunner(
+          {base::MayBlock(), base::TaskPriority::USER_VISIBLE,
+           base::TaskShutdownBehavior::BLOCK_SHUTDOWN})),
+      ring_(max_bytes) {
+  if (event_types.empty()) {
+    filter_.set();
+  } else {
+    for (NetLogEventType type : event_types) {
+      filter_.set(static_cast<size_t>(type));
+    }
+  }
+  if (!constants_)
+    constants_ = std::make_unique<base::Value>(GetNetConstants());
+}
+
+BoundedNetLogObserver::~BoundedNetLogObserver() {
+  StopObserving();
+}
+
+void BoundedNetLogObserver::StartObserving(NetLog* net_log,
+                                           NetLogCaptureMode capture_mode) {
+  net_log->AddObserver(this, capture_mode);
+}
+
+void BoundedNetLogObserver::StopObserving() {
+  if (net_log())
+    net_log()->RemoveObserver(this);
+}
+
+void BoundedNetLogObserver::Dump(const base::FilePath& path) {
+  std::string snapshot;
+  uint64_t num_dropped;
+  {
+    base::AutoLock lock(lock_);
+    snapshot.resize(size_);
+    CopyOutLocked(head_, size_, &snapshot[0]);
+    num_dropped = num_dropped_;
+  }
+  if (num_dropped > 0) {
+    LOG(INFO) << "NetLog buffer full, " << num_dropped
+              << " older events were dropped";
+  }
+  file_task_runner_->PostTask(
+      FROM_HERE, base::BindOnce(&WriteSnapshot, path,
+                                SerializeNetLogValueToJson(*constants_),
+                                std::move(snapshot)));
+}
+
+void BoundedNetLogObserver::OnAddEntry(const NetLogEntry& entry) {
+  // Filters before doing any encoding work.
+  if (!filter_.test(static_cast<size_t>(entry.type)))
+    return;
+
+  std::string record(kLengthSize, '\0');
+  EncodeEntry(entry, &record);
+  uint32_t length = record.size() - kLengthSize;
+  std::memcpy(&record[0], &length, kLengthSize);
+
+  base::AutoLock lock(lock_);
+  AppendLocked(record);
+}
+
+void BoundedNetLogObserver::AppendLocked(const std::string& record) {
+  const size_t capacity = ring_.size();
+  if (record.size() > capacity) {
+    ++num_dropped_;
+    return;
+  }
+  // Evicts the oldest records until there is room.
+  while (capacity - size_ < record.size()) {
+    size_t evicted = kLengthSize + ReadLengthLocked(head_);
+    head_ = (head_ + evicted) % capacity;
+    size_ -= evicted;
+    ++num_dropped_;
+  }
+  size_t tail = (head_ + size_) % capacity;
+  size_t first = std::min(record.size(), capacity - tail);
+  std::memcpy(&ring_[tail], record.data(), first);
+  std::memcpy(&ring_[0], record.data() + first, record.size() - first);
+  size_ += record.size();
+}
+
+size_t BoundedNetLogObserver::ReadLengthLocked(size_t pos) const {
+  uint32_t length;
+  CopyOutLocked(pos, kLengthSize, reinterpret_cast<char*>(&length));
+  return length;
+}
+
+void BoundedNetLogObserver::CopyOutLocked(size_t pos,
+                                          size_t size,
+                                          char* out) const {
+  const size_t capacity = ring_.size();
+  if (size == 0)
+    return;
+  size_t first = std::min(size, capacity - pos);
+  std::memcpy(out, &ring_[pos], first);
+  std::memcpy(out + first, &ring_[0], size - first);
+}
+
+}  // namespace net
@@ -0,0 +1,71 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#ifndef NET_TOOLS_NAIVE_BOUNDED_NET_LOG_OBSERVER_H_
+#define NET_TOOLS_NAIVE_BOUNDED_NET_LOG_OBSERVER_H_
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/memory/scoped_refptr.h"
+#include "base/synchronization/lock.h"
+#include "base/thread_annotations.h"
+#include "base/values.h"
+#include "net/log/net_log.h"
+#include "net/log/net_log_event_type.h"
+
+namespace base {
+class SequencedTaskRunner;
+}  // namespace base
+
+namespace net {
+
+// Keeps the most recent NetLog events in a fixed-size ring buffer using a
+// compact binary encoding, so it can stay enabled in production. Events not
+// in the filter are dropped before any encoding. Dump() converts a snapshot
+// of the ring to the JSON format of FileNetLogObserver on a background
+// sequence, which can be loaded in netlog-viewer.
+class BoundedNetLogObserver : public NetLog::ThreadSafeObserver {
+ public:
+  // |event_types| empty means capturing all events.
+  BoundedNetLogObserver(size_t max_bytes,
+                        const std::vector<NetLogEventType>& event_types,
+                        std::unique_ptr<base::Value> constants);
+  ~BoundedNetLogObserver() override;
+  BoundedNetLogObserver(const BoundedNetLogObserver&) = delete;
+  BoundedNetLogObserver& operator=(const BoundedNetLogObserver&) = delete;
+
+  void StartObserving(NetLog* net_log, NetLogCaptureMode capture_mode);
+  void StopObserving();
+
+  // Writes the buffered events to |path|, overwriting it.
+  void Dump(const base::FilePath& path);
+
+  // NetLog::ThreadSafeObserver implementation.
+  void OnAddEntry(const NetLogEntry& entry) override;
+
+ private:
+  void AppendLocked(const std::string& record) EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  size_t ReadLengthLocked(size_t pos) const EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  void CopyOutLocked(size_t pos, size_t size, char* out) const
+      EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  std::bitset<static_cast<size_t>(NetLogEventType::COUNT)> filter_;
+  std::unique_ptr<base::Value> constants_;
+  scoped_refptr<base::SequencedTaskRunner> file_task_runner_;
+
+  mutable base::Lock lock_;
+  // Records are stored as a 4-byte length followed by the encoded event and
+  // may wrap around the end of the buffer.
+  std::vector<char> ring_ GUARDED_BY(lock_);
+  size_t head_ GUARDED_BY(lock_) = 0;
+  size_t size_ GUARDED_BY(lock_) = 0;
+  uint64_t num_dropped_ GUARDED_BY(lock_) = 0;
+};
+
+}  // namespace net
+#endif  // NET_TOOLS_NAIVE_BOUNDED_NET_LOG_OBSERVER_H_
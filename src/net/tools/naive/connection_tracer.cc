@@ -0,0 +1,187 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#include "net/tools/naive/connection_tracer.h"
+
+#include <utility>
+
+#include "base/bind.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/json/json_writer.h"
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/task/thread_pool.h"
+#include "base/values.h"
+#include "net/base/net_errors.h"
+
+namespace net {
+
+namespace {
+
+const char* const kDirectionNames[kNumDirections] = {"client", "server"};
+
+// Runs on the thread pool.
+void WriteTrace(const base::FilePath& path, const std::string& json) {
+  if (!base::WriteFile(path, json))
+    LOG(ERROR) << "Failed to write " << path;
+}
+
+class TraceWriter {
+ public:
+  TraceWriter(base::TimeTicks start_time, base::TimeTicks now)
+      : start_time_(start_time), now_(now) {}
+
+  void Add(const ConnectionTrace& trace, bool open) {
+    base::Value::Dict thread_args;
+    thread_args.Set("name", "Connection " + base::NumberToString(trace.id) +
+                                " " + trace.origin);
+    base::Value::Dict thread_name = Event(trace, "thread_name", "M");
+    thread_name.Set("args", std::move(thread_args));
+    events_.Append(std::move(thread_name));
+
+    base::Value::Dict args;
+    args.Set("origin", trace.origin);
+    args.Set("close", open ? "open" : ErrorToShortString(trace.close_reason));
+    for (int i = 0; i < kNumDirections; ++i) {
+      std::string from = std::string("_from_") + kDirectionNames[i];
+      std::string to = std::string("_to_") + kDirectionNames[i];
+      args.Set("bytes" + from, static_cast<double>(trace.bytes[i]));
+      args.Set("stalls" + to, trace.num_stalls[i]);
+      args.Set("stall_ms" + to, trace.stall_duration[i].InMillisecondsF());
+      args.Set("max_stall_ms" + to,
+               trace.max_stall_duration[i].InMillisecondsF());
+    }
+    base::TimeTicks end = open ? now_ : trace.close_time;
+    base::Value::Dict connection =
+        Span(trace, "Connection", trace.accept_time, end);
+    connection.Set("args", std::move(args));
+    events_.Append(std::move(connection));
+
+    if (!trace.handshake_time.is_null()) {
+      events_.Append(Span(trace, "Client handshake", trace.accept_time,
+                          trace.handshake_time));
+    }
+    if (!trace.connect_start_time.is_null()) {
+      base::TimeTicks connect_end = trace.connect_end_time.is_null()
+                                        ? end
+                                        : trace.connect_end_time;
+      events_.Append(
+          Span(trace, "Connect", trace.connect_start_time, connect_end));
+    }
+    for (int i = 0; i < kNumDirections; ++i) {
+      if (trace.first_byte_time[i].is_null())
+        continue;
+      base::Value::Dict first_byte =
+          Event(trace, std::string("First byte from ") + kDirectionNames[i],
+                "i");
+      first_byte.Set("ts", Microseconds(trace.first_byte_time[i]));
+      first_byte.Set("s", "t");
+      events_.Append(std::move(first_byte));
+    }
+  }
+
+  std::string Finish() {
+    base::Value::Dict root;
+    root.Set("traceEvents", std::move(events_));
+    root.Set("displayTimeUnit", "ms");
+    std::string json;
+    base::JSONWriter::Write(root, &json);
+    return json;
+  }
+
+ private:
+  base::Value::Dict Event(const ConnectionTrace& trace,
+                          const std::string& name,
+                          const char* phase) {
+    base::Value::Dict event;
+    event.Set("name", name);
+    event.Set("cat", "naive");
+    event.Set("ph", phase);
+    event.Set("pid", 1);
+    event.Set("tid", static_cast<double>(trace.id));
+    return event;
+  }
+
+  base::Value::Dict Span(const ConnectionTrace& trace,
+                         const char* name,
+                         base::TimeTicks begin,
+                         base::TimeTicks end) {
+    base::Value::Dict event = Event(trace, name, "X");
+    event.Set("ts", Microseconds(begin));
+    event.Set("dur", (end - begin).InMicrosecondsF());
+    return event;
+  }
+
+  double Microseconds(base::TimeTicks time) const {
+    return (time - start_time_).InMicrosecondsF();
+  }
+
+  base::TimeTicks start_time_;
+  base::TimeTicks now_;
+  base::Value::List events_;
+};
+
+}  // namespace
+
+ConnectionTrace::ConnectionTrace() = default;
+
+ConnectionTrace::ConnectionTrace(const ConnectionTrace&) = default;
+
+ConnectionTrace& ConnectionTrace::operator=(const ConnectionTrace&) = default;
+
+ConnectionTrace::~ConnectionTrace() = default;
+
+ConnectionTracer::ConnectionTracer(base::TimeDelta stall_threshold)
+    : stall_threshold_(stall_threshold),
+      start_time_(base::TimeTicks::Now()),
+      oldest_closed_trace_(0) {
+  closed_traces_.reserve(kMaxClosedTraces);
+}
+
+ConnectionTracer::~ConnectionTracer() = default;
+
+ConnectionTrace* ConnectionTracer::Begin(unsigned int id) {
+  auto trace = std::make_unique<ConnectionTrace>();
+  trace->id = id;
+  trace->accept_time = base::TimeTicks::Now();
+  auto* trace_ptr = trace.get();
+  open_traces_[id] = std::move(trace);
+  return trace_ptr;
+}
+
+void ConnectionTracer::End(unsigned int id, int reason) {
+  auto it = open_traces_.find(id);
+  if (it == open_traces_.end())
+    return;
+  ConnectionTrace& trace = *it->second;
+  trace.close_time = base::TimeTicks::Now();
+  trace.close_reason = reason;
+
+  if (closed_traces_.size() < kMaxClosedTraces) {
+    closed_traces_.push_back(std::move(trace));
+  } else {
+    closed_traces_[oldest_closed_trace_] = std::move(trace);
+    oldest_closed_trace_ = (oldest_closed_trace_ + 1) % kMaxClosedTraces;
+  }
+  open_traces_.erase(it);
+}
+
+void ConnectionTracer::Dump(const base::FilePath& path) const {
+  TraceWriter writer(start_time_, base::TimeTicks::Now());
+  for (const auto& trace : closed_traces_)
+    writer.Add(trace, /*open=*/false);
+  for (const auto& [id, trace] : open_traces_)
+    writer.Add(*trace, /*open=*/true);
+  LOG(INFO) << "Saving " << closed_traces_.size() << " closed and "
+            << open_traces_.size() << " open connections to " << path;
+
+  base::ThreadPool::PostTask(
+      FROM_HERE,
+      {base::MayBlock(), base::TaskPriority::USER_VISIBLE,
+       base::TaskShutdownBehavior::BLOCK_SHUTDOWN},
+      base::BindOnce(&WriteTrace, path, writer.Finish()));
+}
+
+}  // namespace net
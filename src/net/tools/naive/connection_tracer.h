@@ -0,0 +1,86 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#ifndef NET_TOOLS_NAIVE_CONNECTION_TRACER_H_
+#define NET_TOOLS_NAIVE_CONNECTION_TRACER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/time/time.h"
+#include "net/tools/naive/naive_protocol.h"
+
+namespace base {
+class FilePath;
+}  // namespace base
+
+namespace net {
+
+// Timing of one client connection, indexed by Direction where it applies.
+// Times not reached yet are null.
+struct ConnectionTrace {
+  ConnectionTrace();
+  ConnectionTrace(const ConnectionTrace&);
+  ConnectionTrace& operator=(const ConnectionTrace&);
+  ~ConnectionTrace();
+
+  unsigned int id = 0;
+  std::string origin;
+  base::TimeTicks accept_time;
+  // The client finished its proxy handshake, e.g. SOCKS5, and named the
+  // origin.
+  base::TimeTicks handshake_time;
+  // Connecting to the origin through the proxy or directly, until the
+  // tunnel is usable.
+  base::TimeTicks connect_start_time;
+  base::TimeTicks connect_end_time;
+  // First data read from each side, and all data read from it.
+  base::TimeTicks first_byte_time[kNumDirections];
+  int64_t bytes[kNumDirections] = {0, 0};
+  // Writes to each side which stayed pending for at least the stall
+  // threshold of the tracer.
+  int num_stalls[kNumDirections] = {0, 0};
+  base::TimeDelta stall_duration[kNumDirections];
+  base::TimeDelta max_stall_duration[kNumDirections];
+  base::TimeTicks close_time;
+  int close_reason = 0;
+};
+
+// Keeps a ConnectionTrace for every open connection, and those of the most
+// recent closed connections in a fixed-size ring. Dump() writes them in the
+// Trace Event JSON format, which the Perfetto UI and chrome://tracing load,
+// one track per connection.
+class ConnectionTracer {
+ public:
+  static constexpr size_t kMaxClosedTraces = 1024;
+
+  explicit ConnectionTracer(base::TimeDelta stall_threshold);
+  ~ConnectionTracer();
+  ConnectionTracer(const ConnectionTracer&) = delete;
+  ConnectionTracer& operator=(const ConnectionTracer&) = delete;
+
+  base::TimeDelta stall_threshold() const { return stall_threshold_; }
+
+  // Starts the trace of connection |id|, which stays owned by this.
+  ConnectionTrace* Begin(unsigned int id);
+  // Moves the trace of connection |id| to the ring, invalidating it.
+  void End(unsigned int id, int reason);
+
+  // Writes all traces to |path|, overwriting it.
+  void Dump(const base::FilePath& path) const;
+
+ private:
+  const base::TimeDelta stall_threshold_;
+  const base::TimeTicks start_time_;
+  std::map<unsigned int, std::unique_ptr<ConnectionTrace>> open_traces_;
+  std::vector<ConnectionTrace> closed_traces_;
+  // Replaced by the next closed trace once the ring is full.
+  size_t oldest_closed_trace_;
+};
+
+}  // namespace net
+#endif  // NET_TOOLS_NAIVE_CONNECTION_TRACER_H_
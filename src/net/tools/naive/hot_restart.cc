@@ -0,0 +1,154 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#include "net/tools/naive/hot_restart.h"
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/logging.h"
+#include "base/posix/eintr_wrapper.h"
+#include "base/posix/unix_domain_socket.h"
+#include "net/base/ip_endpoint.h"
+#include "net/base/net_errors.h"
+#include "net/base/sockaddr_storage.h"
+#include "net/base/sockaddr_util_posix.h"
+#include "net/socket/unix_domain_server_socket_posix.h"
+
+namespace net {
+
+namespace {
+constexpr char kHandOffMessage[] = "naive-listen-socket";
+constexpr int kHandOffBackLog = 1;
+// How long the new process waits for the old one to answer.
+constexpr int kTakeOverTimeoutSeconds = 5;
+
+// Only processes of the same user may take the socket.
+bool IsSameUser(const UnixDomainServerSocket::Credentials& credentials) {
+  return credentials.user_id == geteuid();
+}
+}  // namespace
+
+HotRestart::HotRestart(const std::string& path)
+    : path_(path),
+      listen_socket_(kInvalidSocket),
+      accepted_socket_(kInvalidSocket) {}
+
+HotRestart::~HotRestart() = default;
+
+// static
+base::ScopedFD HotRestart::TakeOver(const std::string& path,
+                                    const IPEndPoint& address) {
+  SockaddrStorage unix_address;
+  if (!FillUnixAddress(path, /*use_abstract_namespace=*/false,
+                       &unix_address)) {
+    LOG(ERROR) << "Invalid hot restart path " << path;
+    return base::ScopedFD();
+  }
+  base::ScopedFD fd(socket(AF_UNIX, SOCK_STREAM, 0));
+  if (!fd.is_valid()) {
+    PLOG(ERROR) << "socket";
+    return base::ScopedFD();
+  }
+  // Fails if no process is serving the path, e.g. on the first start or
+  // after a crash, which leaves a stale socket file.
+  if (HANDLE_EINTR(connect(fd.get(), unix_address.addr,
+                           unix_address.addr_len)) != 0) {
+    return base::ScopedFD();
+  }
+  struct timeval timeout = {kTakeOverTimeoutSeconds, 0};
+  if (setsockopt(fd.get(), SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                 sizeof(timeout)) != 0) {
+    PLOG(ERROR) << "setsockopt";
+    return base::ScopedFD();
+  }
+
+  char message[sizeof(kHandOffMessage)];
+  std::vector<base::ScopedFD> fds;
+  ssize_t size =
+      base::UnixDomainSocket::RecvMsg(fd.get(), message, sizeof(message), &fds);
+  if (size != sizeof(kHandOffMessage) ||
+      memcmp(message, kHandOffMessage, sizeof(kHandOffMessage)) != 0 ||
+      fds.size() != 1) {
+    LOG(ERROR) << "No listening socket received from " << path;
+    return base::ScopedFD();
+  }
+
+  SockaddrStorage storage;
+  IPEndPoint local_address;
+  if (getsockname(fds[0].get(), storage.addr, &storage.addr_len) != 0 ||
+      !local_address.FromSockAddr(storage.addr, storage.addr_len) ||
+      local_address != address) {
+    LOG(WARNING) << "Previous process listened on "
+                 << local_address.ToString() << ", not taking it over";
+    return base::ScopedFD();
+  }
+  return std::move(fds[0]);
+}
+
+int HotRestart::Start(SocketDescriptor listen_socket,
+                      base::OnceClosure callback) {
+  DCHECK(!server_socket_);
+  listen_socket_ = listen_socket;
+  callback_ = std::move(callback);
+
+  // The previous process, if any, has handed off and stops serving it.
+  base::DeleteFile(base::FilePath(path_));
+  server_socket_ = std::make_unique<UnixDomainServerSocket>(
+      base::BindRepeating(&IsSameUser), /*use_abstract_namespace=*/false);
+  int rv = server_socket_->BindAndListen(path_, kHandOffBackLog);
+  if (rv != OK) {
+    server_socket_.reset();
+    return rv;
+  }
+  DoAcceptLoop();
+  return OK;
+}
+
+void HotRestart::DoAcceptLoop() {
+  int result;
+  do {
+    result = server_socket_->AcceptSocketDescriptor(
+        &accepted_socket_,
+        base::BindOnce(&HotRestart::OnAcceptComplete,
+                       weak_ptr_factory_.GetWeakPtr()));
+    if (result == ERR_IO_PENDING)
+      return;
+    HandleAcceptResult(result);
+  } while (result == OK && server_socket_);
+}
+
+void HotRestart::OnAcceptComplete(int result) {
+  HandleAcceptResult(result);
+  if (result == OK && server_socket_)
+    DoAcceptLoop();
+}
+
+void HotRestart::HandleAcceptResult(int result) {
+  if (result != OK) {
+    LOG(ERROR) << "Hot restart accept error: rv=" << result;
+    return;
+  }
+  base::ScopedFD peer(accepted_socket_);
+  accepted_socket_ = kInvalidSocket;
+  if (!base::UnixDomainSocket::SendMsg(peer.get(), kHandOffMessage,
+                                       sizeof(kHandOffMessage),
+                                       {listen_socket_})) {
+    PLOG(ERROR) << "Failed to hand over listening socket";
+    return;
+  }
+  LOG(INFO) << "Handed listening socket over to new process";
+  // Leaves the path to the new process.
+  server_socket_.reset();
+  std::move(callback_).Run();
+}
+
+}  // namespace net
@@ -0,0 +1,62 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#ifndef NET_TOOLS_NAIVE_HOT_RESTART_H_
+#define NET_TOOLS_NAIVE_HOT_RESTART_H_
+
+#include <memory>
+#include <string>
+
+#include "base/callback.h"
+#include "base/files/scoped_file.h"
+#include "base/memory/weak_ptr.h"
+#include "net/socket/socket_descriptor.h"
+
+namespace net {
+
+class IPEndPoint;
+class UnixDomainServerSocket;
+
+// Hands the listening socket of this process over to the next naive started
+// with the same Unix socket path, so that a new binary or config takes over
+// without refusing connections in between.
+//
+// The new process calls TakeOver() instead of listening, which connects to
+// the path and receives the listening socket of the old process, if one is
+// serving it. Either way it then serves the path itself with Start(). The
+// old process runs its hand-off callback once the socket is sent, to stop
+// accepting and drain its connections.
+class HotRestart {
+ public:
+  explicit HotRestart(const std::string& path);
+  ~HotRestart();
+  HotRestart(const HotRestart&) = delete;
+  HotRestart& operator=(const HotRestart&) = delete;
+
+  // Receives the listening socket of the process serving |path|. Returns an
+  // invalid descriptor if there is none, or if its socket is not bound to
+  // |address|, e.g. after --listen changed. Blocks for a few seconds at most.
+  static base::ScopedFD TakeOver(const std::string& path,
+                                 const IPEndPoint& address);
+
+  // Serves |listen_socket|, which stays owned by the caller, at the path,
+  // replacing a stale socket file. Runs |callback| once it has been sent to
+  // a new process, after which the path is no longer served.
+  int Start(SocketDescriptor listen_socket, base::OnceClosure callback);
+
+ private:
+  void DoAcceptLoop();
+  void OnAcceptComplete(int result);
+  void HandleAcceptResult(int result);
+
+  const std::string path_;
+  SocketDescriptor listen_socket_;
+  std::unique_ptr<UnixDomainServerSocket> server_socket_;
+  SocketDescriptor accepted_socket_;
+  base::OnceClosure callback_;
+
+  base::WeakPtrFactory<HotRestart> weak_ptr_factory_{this};
+};
+
+}  // namespace net
+#endif  // NET_TOOLS_NAIVE_HOT_RESTART_H_
@@ -0,0 +1,833 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#include "net/tools/naive/http2_proxy_session.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "base/bind.h"
+#include "base/check.h"
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/rand_util.h"
+#include "base/threading/thread_task_runner_handle.h"
+#include "net/base/io_buffer.h"
+#include "net/base/net_errors.h"
+#include "net/third_party/quiche/src/quiche/http2/adapter/data_source.h"
+#include "net/third_party/quiche/src/quiche/http2/adapter/http2_protocol.h"
+#include "net/third_party/quiche/src/quiche/http2/adapter/oghttp2_adapter.h"
+#include "net/tools/naive/naive_proxy_delegate.h"
+#include "net/traffic_annotation/network_traffic_annotation.h"
+#include "third_party/abseil-cpp/absl/types/span.h"
+
+namespace net {
+
+namespace {
+// Same as what naive asks of its own HTTP/2 proxy servers.
+constexpr int64_t kSessionWindow = 15 * 1024 * 1024;
+constexpr uint32_t kStreamWindow = 6 * 1024 * 1024;
+constexpr uint32_t kMaxConcurrentStreams = 1000;
+constexpr int kReadBufferSize = 64 * 1024;
+// Frames are not serialized beyond this until the transport catches up, and
+// stream writes complete while less than this is waiting to be sent.
+constexpr size_t kMaxPendingOutput = 64 * 1024;
+constexpr size_t kMaxStreamWriteBuffer = 64 * 1024;
+// See HttpProxySocket.
+constexpr int kMinPaddingSize = 30;
+constexpr int kMaxPaddingSize = kMinPaddingSize + 32;
+
+size_t UnsentSize(const std::string& data, size_t offset) {
+  return data.size() - offset;
+}
+}  // namespace
+
+Http2ProxyStream::Http2ProxyStream(base::WeakPtr<Http2ProxySession> session,
+                                   uint32_t stream_id,
+                                   const HostPortPair& request_endpoint,
+                                   bool client_padding,
+                                   const IPEndPoint& peer_address,
+                                   const IPEndPoint& local_address,
+                                   const NetLogWithSource& net_log)
+    : session_(std::move(session)),
+      stream_id_(stream_id),
+      request_endpoint_(request_endpoint),
+      client_padding_(client_padding),
+      padding_detector_delegate_(nullptr),
+      peer_address_(peer_address),
+      local_address_(local_address),
+      connected_(false),
+      was_ever_used_(false),
+      net_log_(net_log) {}
+
+Http2ProxyStream::~Http2ProxyStream() {
+  Disconnect();
+}
+
+int Http2ProxyStream::Connect(CompletionOnceCallback callback) {
+  if (connected_)
+    return OK;
+  if (!session_)
+    return ERR_CONNECTION_CLOSED;
+
+  if (padding_detector_delegate_) {
+    padding_detector_delegate_->SetClientPaddingSupport(
+        client_padding_ ? PaddingSupport::kCapable
+                        : PaddingSupport::kIncapable);
+  }
+  int rv = session_->RespondStream(stream_id_);
+  if (rv == OK)
+    connected_ = true;
+  return rv;
+}
+
+void Http2ProxyStream::Disconnect() {
+  connected_ = false;
+  if (session_)
+    session_->DetachStream(stream_id_);
+  session_.reset();
+}
+
+bool Http2ProxyStream::IsConnected() const {
+  return connected_ && session_ && session_->IsStreamOpen(stream_id_);
+}
+
+bool Http2ProxyStream::IsConnectedAndIdle() const {
+  return IsConnected();
+}
+
+const NetLogWithSource& Http2ProxyStream::NetLog() const {
+  return net_log_;
+}
+
+bool Http2ProxyStream::WasEverUsed() const {
+  return was_ever_used_;
+}
+
+bool Http2ProxyStream::WasAlpnNegotiated() const {
+  return true;
+}
+
+NextProto Http2ProxyStream::GetNegotiatedProtocol() const {
+  return kProtoHTTP2;
+}
+
+bool Http2ProxyStream::GetSSLInfo(SSLInfo* ssl_info) {
+  return false;
+}
+
+int64_t Http2ProxyStream::GetTotalReceivedBytes() const {
+  NOTIMPLEMENTED();
+  return 0;
+}
+
+void Http2ProxyStream::ApplySocketTag(const SocketTag& tag) {}
+
+int Http2ProxyStream::Read(IOBuffer* buf,
+                           int buf_len,
+                           CompletionOnceCallback callback) {
+  DCHECK(connected_);
+  DCHECK(callback);
+  if (!session_)
+    return ERR_SOCKET_NOT_CONNECTED;
+
+  int rv = session_->ReadStream(stream_id_, buf, buf_len, std::move(callback));
+  if (rv > 0)
+    was_ever_used_ = true;
+  return rv;
+}
+
+int Http2ProxyStream::Write(
+    IOBuffer* buf,
+    int buf_len,
+    CompletionOnceCallback callback,
+    const NetworkTrafficAnnotationTag& traffic_annotation) {
+  DCHECK(connected_);
+  DCHECK(callback);
+  if (!session_)
+    return ERR_SOCKET_NOT_CONNECTED;
+
+  was_ever_used_ = true;
+  return session_->WriteStream(stream_id_, buf, buf_len, std::move(callback));
+}
+
+int Http2ProxyStream::SetReceiveBufferSize(int32_t size) {
+  return ERR_NOT_IMPLEMENTED;
+}
+
+int Http2ProxyStream::SetSendBufferSize(int32_t size) {
+  return ERR_NOT_IMPLEMENTED;
+}
+
+int Http2ProxyStream::GetPeerAddress(IPEndPoint* address) const {
+  *address = peer_address_;
+  return OK;
+}
+
+int Http2ProxyStream::GetLocalAddress(IPEndPoint* address) const {
+  *address = local_address_;
+  return OK;
+}
+
+class Http2ProxySession::StreamDataSource
+    : public http2::adapter::DataFrameSource {
+ public:
+  StreamDataSource(Http2ProxySession* session, uint32_t stream_id)
+      : session_(session), stream_id_(stream_id) {}
+
+  std::pair<int64_t, bool> SelectPayloadLength(size_t max_length) override {
+    return session_->SelectPayloadLength(stream_id_, max_length);
+  }
+
+  bool Send(absl::string_view frame_header, size_t payload_length) override {
+    return session_->SendDataFrame(stream_id_, frame_header, payload_length);
+  }
+
+  bool send_fin() const override { return true; }
+
+ private:
+  // The session owns the adapter, which owns this.
+  Http2ProxySession* const session_;
+  const uint32_t stream_id_;
+};
+
+Http2ProxySession::Stream::Stream() = default;
+
+Http2ProxySession::Stream::~Stream() = default;
+
+Http2ProxySession::Http2ProxySession(
+    std::unique_ptr<StreamSocket> transport,
+    const std::string& proxy_authorization,
+    StreamCallback stream_callback,
+    base::OnceClosure close_callback,
+    const NetworkTrafficAnnotationTag& traffic_annotation)
+    : transport_(std::move(transport)),
+      proxy_authorization_(proxy_authorization),
+      stream_callback_(std::move(stream_callback)),
+      close_callback_(std::move(close_callback)),
+      net_log_(transport_->NetLog()),
+      events_posted_(false),
+      buffered_bytes_(0),
+      closed_(false),
+      traffic_annotation_(traffic_annotation) {
+  transport_->GetPeerAddress(&peer_address_);
+  transport_->GetLocalAddress(&local_address_);
+
+  http2::adapter::OgHttp2Adapter::Options options;
+  options.perspective = http2::adapter::Perspective::kServer;
+  // Ends streams still being uploaded with RST_STREAM NO_ERROR after their
+  // response, e.g. rejected requests.
+  options.rst_stream_no_error_when_incomplete = true;
+  adapter_ = http2::adapter::OgHttp2Adapter::Create(*this, options);
+}
+
+Http2ProxySession::~Http2ProxySession() = default;
+
+void Http2ProxySession::Start() {
+  const http2::adapter::Http2Setting settings[] = {
+      {http2::adapter::MAX_CONCURRENT_STREAMS, kMaxConcurrentStreams},
+      {http2::adapter::INITIAL_WINDOW_SIZE, kStreamWindow},
+  };
+  adapter_->SubmitSettings(settings);
+  read_buf_ = base::MakeRefCounted<IOBuffer>(kReadBufferSize);
+  // Also sends the connection WINDOW_UPDATE.
+  Flush();
+  DoReadLoop();
+}
+
+void Http2ProxySession::Shutdown() {
+  if (closed_)
+    return;
+  adapter_->SubmitShutdownNotice();
+  Flush();
+}
+
+int Http2ProxySession::RespondStream(uint32_t stream_id) {
+  Stream* stream = FindStream(stream_id);
+  if (!stream || closed_)
+    return ERR_CONNECTION_CLOSED;
+  if (stream->error != OK)
+    return stream->error;
+  DCHECK(!stream->responded);
+
+  // The padding header tells naive clients that padding is supported.
+  std::string padding(base::RandInt(kMinPaddingSize, kMaxPaddingSize), '~');
+  FillNonindexHeaderValue(base::RandUint64(), &padding[0], padding.size());
+  const http2::adapter::Header headers[] = {
+      {absl::string_view(":status"), absl::string_view("200")},
+      {absl::string_view("padding"), std::move(padding)},
+  };
+  adapter_->SubmitResponse(
+      stream_id, headers, std::make_unique<StreamDataSource>(this, stream_id));
+  stream->responded = true;
+  Flush();
+  return closed_ ? ERR_CONNECTION_CLOSED : OK;
+}
+
+int Http2ProxySession::ReadStream(uint32_t stream_id,
+                                  IOBuffer* buf,
+                                  int buf_len,
+                                  CompletionOnceCallback callback) {
+  Stream* stream = FindStream(stream_id);
+  if (!stream)
+    return ERR_SOCKET_NOT_CONNECTED;
+  DCHECK(!stream->read_callback);
+
+  int rv = ReadStreamData(stream_id, stream, buf, buf_len);
+  if (rv == ERR_IO_PENDING) {
+    stream->user_read_buf = buf;
+    stream->user_read_buf_len = buf_len;
+    stream->read_callback = std::move(callback);
+    return rv;
+  }
+  // Sends window updates for the data read.
+  if (rv > 0)
+    Flush();
+  return rv;
+}
+
+int Http2ProxySession::WriteStream(uint32_t stream_id,
+                                   IOBuffer* buf,
+                                   int buf_len,
+                                   CompletionOnceCallback callback) {
+  Stream* stream = FindStream(stream_id);
+  if (!stream)
+    return ERR_SOCKET_NOT_CONNECTED;
+  DCHECK(!stream->write_callback);
+  if (stream->error != OK)
+    return stream->error;
+  if (stream->closed || stream->write_fin)
+    return ERR_SOCKET_NOT_CONNECTED;
+
+  stream->write_data.append(buf->data(), buf_len);
+  adapter_->ResumeStream(stream_id);
+  Flush();
+  if (stream->error != OK)
+    return stream->error;
+  if (UnsentSize(stream->write_data, stream->write_offset) <
+      kMaxStreamWriteBuffer) {
+    return buf_len;
+  }
+  stream->user_write_size = buf_len;
+  stream->write_callback = std::move(callback);
+  return ERR_IO_PENDING;
+}
+
+void Http2ProxySession::DetachStream(uint32_t stream_id) {
+  Stream* stream = FindStream(stream_id);
+  if (!stream)
+    return;
+  stream->attached = false;
+  stream->detached = true;
+  stream->user_read_buf = nullptr;
+  stream->read_callback.Reset();
+  stream->write_callback.Reset();
+  DiscardStreamData(stream_id, stream);
+
+  if (stream->closed) {
+    streams_.erase(stream_id);
+    return;
+  }
+  if (closed_)
+    return;
+  if (stream->responded) {
+    // Ends the stream after the data written so far.
+    stream->write_fin = true;
+    adapter_->ResumeStream(stream_id);
+  } else {
+    adapter_->SubmitRst(stream_id,
+                        http2::adapter::Http2ErrorCode::CONNECT_ERROR);
+  }
+  Flush();
+}
+
+bool Http2ProxySession::IsStreamOpen(uint32_t stream_id) const {
+  auto it = streams_.find(stream_id);
+  if (it == streams_.end())
+    return false;
+  const Stream& stream = *it->second;
+  return stream.error == OK && !stream.closed;
+}
+
+std::pair<int64_t, bool> Http2ProxySession::SelectPayloadLength(
+    uint32_t stream_id,
+    size_t max_length) {
+  Stream* stream = FindStream(stream_id);
+  if (!stream)
+    return {http2::adapter::DataFrameSource::kError, false};
+
+  size_t unsent = UnsentSize(stream->write_data, stream->write_offset);
+  size_t length = std::min(max_length, unsent);
+  bool fin = stream->write_fin && length == unsent;
+  if (length == 0 && !fin)
+    return {http2::adapter::DataFrameSource::kBlocked, false};
+  return {static_cast<int64_t>(length), fin};
+}
+
+bool Http2ProxySession::SendDataFrame(uint32_t stream_id,
+                                      absl::string_view frame_header,
+                                      size_t payload_length) {
+  // The adapter keeps the stream ready and retries in the next Send().
+  if (pending_output_.size() >= kMaxPendingOutput)
+    return false;
+  Stream* stream = FindStream(stream_id);
+  DCHECK(stream);
+
+  pending_output_.append(frame_header.data(), frame_header.size());
+  pending_output_.append(stream->write_data, stream->write_offset,
+                         payload_length);
+  stream->write_offset += payload_length;
+  if (stream->write_offset == stream->write_data.size()) {
+    stream->write_data.clear();
+    stream->write_offset = 0;
+  }
+  if (stream->write_callback &&
+      UnsentSize(stream->write_data, stream->write_offset) <
+          kMaxStreamWriteBuffer) {
+    stream_events_.insert(stream_id);
+  }
+  return true;
+}
+
+Http2ProxySession::Stream* Http2ProxySession::FindStream(uint32_t stream_id) {
+  auto it = streams_.find(stream_id);
+  if (it == streams_.end())
+    return nullptr;
+  return it->second.get();
+}
+
+int Http2ProxySession::ReadStreamData(uint32_t stream_id,
+                                      Stream* stream,
+                                      IOBuffer* buf,
+                                      int buf_len) {
+  size_t available = UnsentSize(stream->read_data, stream->read_offset);
+  if (available == 0) {
+    if (stream->error != OK)
+      return stream->error;
+    if (stream->read_closed)
+      return 0;
+    return ERR_IO_PENDING;
+  }
+
+  size_t size = std::min(available, static_cast<size_t>(buf_len));
+  std::memcpy(buf->data(), stream->read_data.data() + stream->read_offset,
+              size);
+  stream->read_offset += size;
+  if (stream->read_offset == stream->read_data.size()) {
+    stream->read_data.clear();
+    stream->read_offset = 0;
+  }
+  buffered_bytes_ -= size;
+  if (!stream->closed && !closed_)
+    adapter_->MarkDataConsumedForStream(stream_id, size);
+  return static_cast<int>(size);
+}
+
+void Http2ProxySession::DiscardStreamData(uint32_t stream_id, Stream* stream) {
+  size_t size = UnsentSize(stream->read_data, stream->read_offset);
+  stream->read_data.clear();
+  stream->read_offset = 0;
+  buffered_bytes_ -= size;
+  if (size > 0 && !stream->closed && !closed_)
+    adapter_->MarkDataConsumedForStream(stream_id, size);
+}
+
+void Http2ProxySession::RejectStream(uint32_t stream_id, const char* status) {
+  const http2::adapter::Header headers[] = {
+      {absl::string_view(":status"), absl::string_view(status)},
+      // Clients only send credentials once challenged.
+      {absl::string_view("proxy-authenticate"),
+       absl::string_view("Basic realm=\"naive\"")},
+  };
+  // Only a 407 carries the challenge. Without a body the response ends the
+  // stream.
+  size_t num_headers = strcmp(status, "407") == 0 ? 2 : 1;
+  adapter_->SubmitResponse(
+      stream_id, absl::MakeConstSpan(headers, num_headers), nullptr);
+  FindStream(stream_id)->responded = true;
+}
+
+void Http2ProxySession::DoReadLoop() {
+  while (!closed_) {
+    int rv = transport_->Read(
+        read_buf_.get(), kReadBufferSize,
+        base::BindOnce(&Http2ProxySession::OnReadComplete,
+                       weak_ptr_factory_.GetWeakPtr()));
+    if (rv == ERR_IO_PENDING)
+      return;
+    rv = HandleReadResult(rv);
+    if (rv != OK)
+      return;
+  }
+}
+
+void Http2ProxySession::OnReadComplete(int result) {
+  if (HandleReadResult(result) == OK)
+    DoReadLoop();
+}
+
+int Http2ProxySession::HandleReadResult(int result) {
+  if (result == 0)
+    result = ERR_CONNECTION_CLOSED;
+  if (result < 0) {
+    Close(result);
+    return result;
+  }
+
+  int64_t processed =
+      adapter_->ProcessBytes(absl::string_view(read_buf_->data(), result));
+  // Sends whatever the adapter has to say, e.g. GOAWAY on errors.
+  Flush();
+  if (processed < 0 || !adapter_->want_read()) {
+    Close(ERR_HTTP2_PROTOCOL_ERROR);
+    return ERR_HTTP2_PROTOCOL_ERROR;
+  }
+  return closed_ ? ERR_CONNECTION_CLOSED : OK;
+}
+
+void Http2ProxySession::MaybePostStreamEvents() {
+  if (events_posted_ || (accepted_streams_.empty() && stream_events_.empty()))
+    return;
+  events_posted_ = true;
+  base::ThreadTaskRunnerHandle::Get()->PostTask(
+      FROM_HERE, base::BindOnce(&Http2ProxySession::ProcessStreamEvents,
+                                weak_ptr_factory_.GetWeakPtr()));
+}
+
+void Http2ProxySession::ProcessStreamEvents() {
+  events_posted_ = false;
+
+  std::vector<uint32_t> accepted_streams;
+  accepted_streams.swap(accepted_streams_);
+  for (uint32_t stream_id : accepted_streams) {
+    Stream* stream = FindStream(stream_id);
+    // Reset before it could be handed out.
+    if (!stream || stream->error != OK || closed_)
+      continue;
+    stream->attached = true;
+    stream_callback_.Run(std::make_unique<Http2ProxyStream>(
+        weak_ptr_factory_.GetWeakPtr(), stream_id,
+        HostPortPair::FromString(stream->authority), stream->has_padding,
+        peer_address_, local_address_, net_log_));
+  }
+
+  std::set<uint32_t> stream_events;
+  stream_events.swap(stream_events_);
+  for (uint32_t stream_id : stream_events) {
+    Stream* stream = FindStream(stream_id);
+    if (!stream)
+      continue;
+    if (stream->padding_to_consume > 0) {
+      if (!stream->closed && !closed_) {
+        adapter_->MarkDataConsumedForStream(stream_id,
+                                            stream->padding_to_consume);
+      }
+      stream->padding_to_consume = 0;
+    }
+    if (stream->read_callback) {
+      int rv = ReadStreamData(stream_id, stream, stream->user_read_buf.get(),
+                              stream->user_read_buf_len);
+      if (rv != ERR_IO_PENDING) {
+        stream->user_read_buf = nullptr;
+        std::move(stream->read_callback).Run(rv);
+        // The callback may have detached the stream.
+        stream = FindStream(stream_id);
+        if (!stream)
+          continue;
+      }
+    }
+    if (stream->write_callback &&
+        (stream->error != OK ||
+         UnsentSize(stream->write_data, stream->write_offset) <
+             kMaxStreamWriteBuffer)) {
+      int rv = stream->error != OK ? stream->error : stream->user_write_size;
+      std::move(stream->write_callback).Run(rv);
+    }
+  }
+
+  // Sends window updates for the data read.
+  Flush();
+}
+
+void Http2ProxySession::Flush() {
+  while (!closed_ && !write_buf_) {
+    // The adapter only refills the connection window once it is almost
+    // empty, so it is topped up here instead.
+    int64_t window_update =
+        kSessionWindow - adapter_->GetReceiveWindowSize() - buffered_bytes_;
+    if (window_update >= kSessionWindow / 2)
+      adapter_->SubmitWindowUpdate(0, static_cast<int>(window_update));
+
+    if (adapter_->Send() != 0) {
+      Close(ERR_HTTP2_PROTOCOL_ERROR);
+      return;
+    }
+    if (pending_output_.empty())
+      break;
+    size_t size = pending_output_.size();
+    write_buf_ = base::MakeRefCounted<DrainableIOBuffer>(
+        base::MakeRefCounted<StringIOBuffer>(std::move(pending_output_)),
+        size);
+    pending_output_.clear();
+    DoWrite();
+  }
+  MaybePostStreamEvents();
+}
+
+void Http2ProxySession::DoWrite() {
+  while (write_buf_->BytesRemaining() > 0) {
+    int rv = transport_->Write(
+        write_buf_.get(), write_buf_->BytesRemaining(),
+        base::BindOnce(&Http2ProxySession::OnWriteComplete,
+                       weak_ptr_factory_.GetWeakPtr()),
+        traffic_annotation_);
+    if (rv == ERR_IO_PENDING)
+      return;
+    if (rv < 0) {
+      Close(rv);
+      return;
+    }
+    write_buf_->DidConsume(rv);
+  }
+  write_buf_ = nullptr;
+}
+
+void Http2ProxySession::OnWriteComplete(int result) {
+  if (result < 0) {
+    Close(result);
+    return;
+  }
+  write_buf_->DidConsume(result);
+  DoWrite();
+  if (!write_buf_)
+    Flush();
+}
+
+void Http2ProxySession::Close(int error) {
+  if (closed_)
+    return;
+  closed_ = true;
+  transport_->Disconnect();
+
+  // Streams still read their data, then fail with |error|.
+  for (auto& [stream_id, stream] : streams_) {
+    if (stream->error == OK)
+      stream->error = error;
+    stream_events_.insert(stream_id);
+  }
+  MaybePostStreamEvents();
+  base::ThreadTaskRunnerHandle::Get()->PostTask(FROM_HERE,
+                                                std::move(close_callback_));
+}
+
+int64_t Http2ProxySession::OnReadyToSend(absl::string_view serialized) {
+  if (closed_)
+    return kSendError;
+  if (pending_output_.size() >= kMaxPendingOutput)
+    return kSendBlocked;
+  pending_output_.append(serialized.data(), serialized.size());
+  return serialized.size();
+}
+
+void Http2ProxySession::OnConnectionError(ConnectionError error) {
+  LOG(INFO) << "HTTP/2 connection error from " << peer_address_.ToString();
+}
+
+void Http2ProxySession::OnSettingsStart() {}
+
+void Http2ProxySession::OnSetting(http2::adapter::Http2Setting setting) {}
+
+void Http2ProxySession::OnSettingsEnd() {}
+
+void Http2ProxySession::OnSettingsAck() {}
+
+bool Http2ProxySession::OnBeginHeadersForStream(
+    http2::adapter::Http2StreamId stream_id) {
+  auto& stream = streams_[stream_id];
+  if (!stream)
+    stream = std::make_unique<Stream>();
+  return true;
+}
+
+Http2ProxySession::OnHeaderResult Http2ProxySession::OnHeaderForStream(
+    http2::adapter::Http2StreamId stream_id,
+    absl::string_view key,
+    absl::string_view value) {
+  Stream* stream = FindStream(stream_id);
+  if (!stream)
+    return HEADER_RST_STREAM;
+  // Trailers are ignored.
+  if (stream->accepted || stream->responded)
+    return HEADER_OK;
+
+  if (key == ":method") {
+    stream->method = std::string(value);
+  } else if (key == ":authority") {
+    stream->authority = std::string(value);
+  } else if (key == "padding") {
+    stream->has_padding = true;
+  } else if (key == "proxy-authorization") {
+    stream->authorized = value == proxy_authorization_;
+  }
+  return HEADER_OK;
+}
+
+bool Http2ProxySession::OnEndHeadersForStream(
+    http2::adapter::Http2StreamId stream_id) {
+  Stream* stream = FindStream(stream_id);
+  if (!stream || stream->accepted || stream->responded)
+    return true;
+
+  if (stream->method != "CONNECT") {
+    // Looks like any web server without the content.
+    RejectStream(stream_id, "404");
+    return true;
+  }
+  if (!proxy_authorization_.empty() && !stream->authorized) {
+    RejectStream(stream_id, "407");
+    return true;
+  }
+  HostPortPair endpoint = HostPortPair::FromString(stream->authority);
+  if (endpoint.host().empty() || endpoint.port() == 0) {
+    RejectStream(stream_id, "400");
+    return true;
+  }
+  stream->accepted = true;
+  accepted_streams_.push_back(stream_id);
+  return true;
+}
+
+bool Http2ProxySession::OnBeginDataForStream(
+    http2::adapter::Http2StreamId stream_id,
+    size_t payload_length) {
+  return true;
+}
+
+bool Http2ProxySession::OnDataPaddingLength(
+    http2::adapter::Http2StreamId stream_id,
+    size_t padding_length) {
+  // The adapter counts the padding after this returns.
+  Stream* stream = FindStream(stream_id);
+  if (stream) {
+    stream->padding_to_consume += padding_length;
+    stream_events_.insert(stream_id);
+  }
+  return true;
+}
+
+bool Http2ProxySession::OnDataForStream(http2::adapter::Http2StreamId stream_id,
+                                        absl::string_view data) {
+  Stream* stream = FindStream(stream_id);
+  if (!stream)
+    return true;
+  if (!stream->accepted || stream->detached) {
+    adapter_->MarkDataConsumedForStream(stream_id, data.size());
+    return true;
+  }
+  stream->read_data.append(data.data(), data.size());
+  buffered_bytes_ += data.size();
+  if (stream->read_callback)
+    stream_events_.insert(stream_id);
+  return true;
+}
+
+void Http2ProxySession::OnEndStream(http2::adapter::Http2StreamId stream_id) {
+  Stream* stream = FindStream(stream_id);
+  if (!stream)
+    return;
+  stream->read_closed = true;
+  stream_events_.insert(stream_id);
+}
+
+void Http2ProxySession::OnRstStream(http2::adapter::Http2StreamId stream_id,
+                                    http2::adapter::Http2ErrorCode error_code) {
+  Stream* stream = FindStream(stream_id);
+  if (!stream)
+    return;
+  if (stream->error == OK)
+    stream->error = ERR_CONNECTION_RESET;
+  stream_events_.insert(stream_id);
+}
+
+bool Http2ProxySession::OnCloseStream(
+    http2::adapter::Http2StreamId stream_id,
+    http2::adapter::Http2ErrorCode error_code) {
+  Stream* stream = FindStream(stream_id);
+  if (!stream)
+    return true;
+  if (!stream->attached) {
+    buffered_bytes_ -= UnsentSize(stream->read_data, stream->read_offset);
+    streams_.erase(stream_id);
+    return true;
+  }
+  // Kept for the Http2ProxyStream to read the rest of the data.
+  stream->closed = true;
+  if (!stream->read_closed && stream->error == OK)
+    stream->error = ERR_CONNECTION_CLOSED;
+  stream_events_.insert(stream_id);
+  return true;
+}
+
+void Http2ProxySession::OnPriorityForStream(
+    http2::adapter::Http2StreamId stream_id,
+    http2::adapter::Http2StreamId parent_stream_id,
+    int weight,
+    bool exclusive) {}
+
+void Http2ProxySession::OnPing(http2::adapter::Http2PingId ping_id,
+                               bool is_ack) {}
+
+void Http2ProxySession::OnPushPromiseForStream(
+    http2::adapter::Http2StreamId stream_id,
+    http2::adapter::Http2StreamId promised_stream_id) {}
+
+bool Http2ProxySession::OnGoAway(
+    http2::adapter::Http2StreamId last_accepted_stream_id,
+    http2::adapter::Http2ErrorCode error_code,
+    absl::string_view opaque_data) {
+  return true;
+}
+
+void Http2ProxySession::OnWindowUpdate(http2::adapter::Http2StreamId stream_id,
+                                       int window_increment) {}
+
+int Http2ProxySession::OnBeforeFrameSent(
+    uint8_t frame_type,
+    http2::adapter::Http2StreamId stream_id,
+    size_t length,
+    uint8_t flags) {
+  return 0;
+}
+
+int Http2ProxySession::OnFrameSent(uint8_t frame_type,
+                                   http2::adapter::Http2StreamId stream_id,
+                                   size_t length,
+                                   uint8_t flags,
+                                   uint32_t error_code) {
+  return 0;
+}
+
+bool Http2ProxySession::OnInvalidFrame(http2::adapter::Http2StreamId stream_id,
+                                       InvalidFrameError error) {
+  return true;
+}
+
+void Http2ProxySession::OnBeginMetadataForStream(
+    http2::adapter::Http2StreamId stream_id,
+    size_t payload_length) {}
+
+bool Http2ProxySession::OnMetadataForStream(
+    http2::adapter::Http2StreamId stream_id,
+    absl::string_view metadata) {
+  return true;
+}
+
+bool Http2ProxySession::OnMetadataEndForStream(
+    http2::adapter::Http2StreamId stream_id) {
+  return true;
+}
+
+void Http2ProxySession::OnErrorDebug(absl::string_view message) {}
+
+}  // namespace net
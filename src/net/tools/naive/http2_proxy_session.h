@@ -0,0 +1,316 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#ifndef NET_TOOLS_NAIVE_HTTP2_PROXY_SESSION_H_
+#define NET_TOOLS_NAIVE_HTTP2_PROXY_SESSION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "base/callback.h"
+#include "base/memory/scoped_refptr.h"
+#include "base/memory/weak_ptr.h"
+#include "net/base/completion_once_callback.h"
+#include "net/base/host_port_pair.h"
+#include "net/base/ip_endpoint.h"
+#include "net/log/net_log_with_source.h"
+#include "net/socket/stream_socket.h"
+#include "net/third_party/quiche/src/quiche/http2/adapter/http2_visitor_interface.h"
+
+namespace http2 {
+namespace adapter {
+class OgHttp2Adapter;
+}  // namespace adapter
+}  // namespace http2
+
+namespace net {
+
+class ClientPaddingDetectorDelegate;
+class DrainableIOBuffer;
+class Http2ProxySession;
+class IOBuffer;
+struct NetworkTrafficAnnotationTag;
+
+// A CONNECT stream of an Http2ProxySession, used as the client socket of a
+// NaiveConnection. Connect() answers the request. The stream data is
+// buffered in the session, so the stream can be destroyed at any time: data
+// already written is still sent before the stream is ended.
+class Http2ProxyStream : public StreamSocket {
+ public:
+  Http2ProxyStream(base::WeakPtr<Http2ProxySession> session,
+                   uint32_t stream_id,
+                   const HostPortPair& request_endpoint,
+                   bool client_padding,
+                   const IPEndPoint& peer_address,
+                   const IPEndPoint& local_address,
+                   const NetLogWithSource& net_log);
+  Http2ProxyStream(const Http2ProxyStream&) = delete;
+  Http2ProxyStream& operator=(const Http2ProxyStream&) = delete;
+
+  // On destruction Disconnect() is called.
+  ~Http2ProxyStream() override;
+
+  const HostPortPair& request_endpoint() const { return request_endpoint_; }
+
+  // Told of the padding support of the client by Connect().
+  void set_padding_detector_delegate(
+      ClientPaddingDetectorDelegate* padding_detector_delegate) {
+    padding_detector_delegate_ = padding_detector_delegate;
+  }
+
+  // StreamSocket implementation.
+  int Connect(CompletionOnceCallback callback) override;
+  void Disconnect() override;
+  bool IsConnected() const override;
+  bool IsConnectedAndIdle() const override;
+  const NetLogWithSource& NetLog() const override;
+  bool WasEverUsed() const override;
+  bool WasAlpnNegotiated() const override;
+  NextProto GetNegotiatedProtocol() const override;
+  bool GetSSLInfo(SSLInfo* ssl_info) override;
+  int64_t GetTotalReceivedBytes() const override;
+  void ApplySocketTag(const SocketTag& tag) override;
+
+  // Socket implementation.
+  int Read(IOBuffer* buf,
+           int buf_len,
+           CompletionOnceCallback callback) override;
+  int Write(IOBuffer* buf,
+            int buf_len,
+            CompletionOnceCallback callback,
+            const NetworkTrafficAnnotationTag& traffic_annotation) override;
+  int SetReceiveBufferSize(int32_t size) override;
+  int SetSendBufferSize(int32_t size) override;
+  int GetPeerAddress(IPEndPoint* address) const override;
+  int GetLocalAddress(IPEndPoint* address) const override;
+
+ private:
+  base::WeakPtr<Http2ProxySession> session_;
+  uint32_t stream_id_;
+  HostPortPair request_endpoint_;
+  bool client_padding_;
+  ClientPaddingDetectorDelegate* padding_detector_delegate_;
+  IPEndPoint peer_address_;
+  IPEndPoint local_address_;
+  bool connected_;
+  bool was_ever_used_;
+  NetLogWithSource net_log_;
+};
+
+// Serves HTTP/2 CONNECT requests, e.g. from naive with --proxy=https://, on
+// one TLS connection. Each accepted request is handed out as an
+// Http2ProxyStream. Other requests are refused, and so are requests without
+// the expected Proxy-Authorization header when one is required.
+class Http2ProxySession : public http2::adapter::Http2VisitorInterface {
+ public:
+  using StreamCallback =
+      base::RepeatingCallback<void(std::unique_ptr<Http2ProxyStream>)>;
+
+  // |stream_callback| receives accepted streams. |close_callback| runs once
+  // the connection is closed, after which the session may be destroyed.
+  Http2ProxySession(std::unique_ptr<StreamSocket> transport,
+                    const std::string& proxy_authorization,
+                    StreamCallback stream_callback,
+                    base::OnceClosure close_callback,
+                    const NetworkTrafficAnnotationTag& traffic_annotation);
+  ~Http2ProxySession() override;
+  Http2ProxySession(const Http2ProxySession&) = delete;
+  Http2ProxySession& operator=(const Http2ProxySession&) = delete;
+
+  void Start();
+
+  // Sends a GOAWAY asking the client to open new streams on another
+  // connection. Streams already open are served until they close.
+  void Shutdown();
+
+  // Http2VisitorInterface implementation.
+  int64_t OnReadyToSend(absl::string_view serialized) override;
+  void OnConnectionError(ConnectionError error) override;
+  void OnSettingsStart() override;
+  void OnSetting(http2::adapter::Http2Setting setting) override;
+  void OnSettingsEnd() override;
+  void OnSettingsAck() override;
+  bool OnBeginHeadersForStream(
+      http2::adapter::Http2StreamId stream_id) override;
+  OnHeaderResult OnHeaderForStream(http2::adapter::Http2StreamId stream_id,
+                                   absl::string_view key,
+                                   absl::string_view value) override;
+  bool OnEndHeadersForStream(http2::adapter::Http2StreamId stream_id) override;
+  bool OnBeginDataForStream(http2::adapter::Http2StreamId stream_id,
+                            size_t payload_length) override;
+  bool OnDataPaddingLength(http2::adapter::Http2StreamId stream_id,
+                           size_t padding_length) override;
+  bool OnDataForStream(http2::adapter::Http2StreamId stream_id,
+                       absl::string_view data) override;
+  void OnEndStream(http2::adapter::Http2StreamId stream_id) override;
+  void OnRstStream(http2::adapter::Http2StreamId stream_id,
+                   http2::adapter::Http2ErrorCode error_code) override;
+  bool OnCloseStream(http2::adapter::Http2StreamId stream_id,
+                     http2::adapter::Http2ErrorCode error_code) override;
+  void OnPriorityForStream(http2::adapter::Http2StreamId stream_id,
+                           http2::adapter::Http2StreamId parent_stream_id,
+                           int weight,
+                           bool exclusive) override;
+  void OnPing(http2::adapter::Http2PingId ping_id, bool is_ack) override;
+  void OnPushPromiseForStream(
+      http2::adapter::Http2StreamId stream_id,
+      http2::adapter::Http2StreamId promised_stream_id) override;
+  bool OnGoAway(http2::adapter::Http2StreamId last_accepted_stream_id,
+                http2::adapter::Http2ErrorCode error_code,
+                absl::string_view opaque_data) override;
+  void OnWindowUpdate(http2::adapter::Http2StreamId stream_id,
+                      int window_increment) override;
+  int OnBeforeFrameSent(uint8_t frame_type,
+                        http2::adapter::Http2StreamId stream_id,
+                        size_t length,
+                        uint8_t flags) override;
+  int OnFrameSent(uint8_t frame_type,
+                  http2::adapter::Http2StreamId stream_id,
+                  size_t length,
+                  uint8_t flags,
+                  uint32_t error_code) override;
+  bool OnInvalidFrame(http2::adapter::Http2StreamId stream_id,
+                      InvalidFrameError error) override;
+  void OnBeginMetadataForStream(http2::adapter::Http2StreamId stream_id,
+                                size_t payload_length) override;
+  bool OnMetadataForStream(http2::adapter::Http2StreamId stream_id,
+                           absl::string_view metadata) override;
+  bool OnMetadataEndForStream(
+      http2::adapter::Http2StreamId stream_id) override;
+  void OnErrorDebug(absl::string_view message) override;
+
+ private:
+  friend class Http2ProxyStream;
+  class StreamDataSource;
+
+  struct Stream {
+    Stream();
+    ~Stream();
+
+    // The request.
+    std::string method;
+    std::string authority;
+    bool has_padding = false;
+    bool authorized = false;
+    // The request is valid and waits to be handed out, or has been.
+    bool accepted = false;
+    // Set while handed out as an Http2ProxyStream.
+    bool attached = false;
+    // The Http2ProxyStream is gone. Data still received is discarded.
+    bool detached = false;
+    bool responded = false;
+    // Closed by the adapter, which no longer knows the stream.
+    bool closed = false;
+
+    // Data received and not read yet is in [read_offset, read_data.size()).
+    std::string read_data;
+    size_t read_offset = 0;
+    // Padding of DATA frames, returned to the flow control windows once the
+    // adapter has counted it.
+    size_t padding_to_consume = 0;
+    // The client ended its side of the stream.
+    bool read_closed = false;
+    scoped_refptr<IOBuffer> user_read_buf;
+    int user_read_buf_len = 0;
+    CompletionOnceCallback read_callback;
+
+    // Data written and not sent yet is in [write_offset, write_data.size()).
+    std::string write_data;
+    size_t write_offset = 0;
+    // Ends the stream once |write_data| is sent.
+    bool write_fin = false;
+    int user_write_size = 0;
+    CompletionOnceCallback write_callback;
+
+    // Set if the stream was reset or the connection closed.
+    int error = 0;
+  };
+
+  // Called by Http2ProxyStream.
+  int RespondStream(uint32_t stream_id);
+  int ReadStream(uint32_t stream_id,
+                 IOBuffer* buf,
+                 int buf_len,
+                 CompletionOnceCallback callback);
+  int WriteStream(uint32_t stream_id,
+                  IOBuffer* buf,
+                  int buf_len,
+                  CompletionOnceCallback callback);
+  void DetachStream(uint32_t stream_id);
+  bool IsStreamOpen(uint32_t stream_id) const;
+
+  // Called by StreamDataSource.
+  std::pair<int64_t, bool> SelectPayloadLength(uint32_t stream_id,
+                                               size_t max_length);
+  bool SendDataFrame(uint32_t stream_id,
+                     absl::string_view frame_header,
+                     size_t payload_length);
+
+  Stream* FindStream(uint32_t stream_id);
+  // Copies readable data of |stream| to |buf| and returns its size, or the
+  // result of the read if there is no data.
+  int ReadStreamData(uint32_t stream_id,
+                     Stream* stream,
+                     IOBuffer* buf,
+                     int buf_len);
+  // Drops the data of |stream| not read yet.
+  void DiscardStreamData(uint32_t stream_id, Stream* stream);
+  // Rejects a request with |status|.
+  void RejectStream(uint32_t stream_id, const char* status);
+
+  void DoReadLoop();
+  void OnReadComplete(int result);
+  int HandleReadResult(int result);
+  void MaybePostStreamEvents();
+  // Hands out new streams and completes stream reads and writes that became
+  // possible while the adapter was busy.
+  void ProcessStreamEvents();
+  // Writes frames queued in the adapter to the transport.
+  void Flush();
+  void DoWrite();
+  void OnWriteComplete(int result);
+  void Close(int error);
+
+  std::unique_ptr<StreamSocket> transport_;
+  std::string proxy_authorization_;
+  StreamCallback stream_callback_;
+  base::OnceClosure close_callback_;
+  IPEndPoint peer_address_;
+  IPEndPoint local_address_;
+  NetLogWithSource net_log_;
+
+  std::unique_ptr<http2::adapter::OgHttp2Adapter> adapter_;
+  std::map<uint32_t, std::unique_ptr<Stream>> streams_;
+
+  // Streams accepted, and streams with reads or writes to complete, while
+  // the adapter was processing input or sending.
+  std::vector<uint32_t> accepted_streams_;
+  std::set<uint32_t> stream_events_;
+
+  scoped_refptr<IOBuffer> read_buf_;
+
+  // Frames from the adapter wait here while |write_buf_| is being written.
+  std::string pending_output_;
+  scoped_refptr<DrainableIOBuffer> write_buf_;
+  bool events_posted_;
+
+  // Received data held for streams. The connection window is topped up to
+  // the session window minus this.
+  size_t buffered_bytes_;
+
+  bool closed_;
+
+  // Traffic annotation for socket control.
+  const NetworkTrafficAnnotationTag& traffic_annotation_;
+
+  base::WeakPtrFactory<Http2ProxySession> weak_ptr_factory_{this};
+};
+
+}  // namespace net
+#endif  // NET_TOOLS_NAIVE_HTTP2_PROXY_SESSION_H_
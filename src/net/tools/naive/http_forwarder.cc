@@ -0,0 +1,1131 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#include "net/tools/naive/http_forwarder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <string>
+#include <utility>
+
+#include "base/bind.h"
+#include "base/check.h"
+#include "base/containers/cxx20_erase.h"
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/rand_util.h"
+#include "base/strings/strcat.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include "base/strings/string_util.h"
+#include "base/threading/thread_task_runner_handle.h"
+#include "net/base/io_buffer.h"
+#include "net/base/load_flags.h"
+#include "net/base/net_errors.h"
+#include "net/base/privacy_mode.h"
+#include "net/base/request_priority.h"
+#include "net/base/url_util.h"
+#include "net/http/http_chunked_decoder.h"
+#include "net/http/http_network_session.h"
+#include "net/http/http_response_headers.h"
+#include "net/http/http_util.h"
+#include "net/http/http_version.h"
+#include "net/proxy_resolution/proxy_info.h"
+#include "net/socket/client_socket_handle.h"
+#include "net/socket/client_socket_pool_manager.h"
+#include "net/socket/stream_socket.h"
+#include "net/tools/naive/naive_proxy_delegate.h"
+#include "net/tools/naive/route_table.h"
+#include "url/gurl.h"
+#include "url/scheme_host_port.h"
+#include "url/url_constants.h"
+
+namespace net {
+
+namespace {
+constexpr int kBufferSize = 64 * 1024;
+constexpr int kFirstPaddings = 8;
+constexpr int kPaddingHeaderSize = 3;
+constexpr int kMaxPaddingSize = 255;
+// The largest payload whose size fits in the padding header.
+constexpr int kMaxPaddedPayloadSize = 65535;
+
+constexpr size_t kMaxIdleTunnelsPerOrigin = 4;
+// Origin servers commonly close idle connections after 30 to 75 seconds.
+constexpr base::TimeDelta kIdleTunnelTimeout = base::Seconds(30);
+
+constexpr char kBadRequest[] = "400 Bad Request";
+constexpr char kForbidden[] = "403 Forbidden";
+constexpr char kBadGateway[] = "502 Bad Gateway";
+}  // namespace
+
+ForwardTunnel::ForwardTunnel(std::unique_ptr<ClientSocketHandle> handle,
+                             bool padded)
+    : handle_(std::move(handle)),
+      num_read_paddings_(padded ? 0 : kFirstPaddings),
+      read_padding_state_(STATE_READ_PAYLOAD_LENGTH_1),
+      payload_length_(0),
+      padding_length_(0),
+      user_read_buf_len_(0),
+      num_write_paddings_(padded ? 0 : kFirstPaddings),
+      user_write_size_(0),
+      traffic_annotation_(nullptr) {}
+
+ForwardTunnel::~ForwardTunnel() = default;
+
+StreamSocket* ForwardTunnel::socket() const {
+  return handle_->socket();
+}
+
+bool ForwardTunnel::IsReusable() const {
+  return socket() && socket()->IsConnectedAndIdle();
+}
+
+int ForwardTunnel::Read(IOBuffer* buf,
+                        int buf_len,
+                        CompletionOnceCallback callback) {
+  DCHECK(!read_callback_);
+  if (num_read_paddings_ >= kFirstPaddings &&
+      read_padding_state_ == STATE_READ_PAYLOAD_LENGTH_1) {
+    return socket()->Read(buf, buf_len, std::move(callback));
+  }
+
+  user_read_buf_ = buf;
+  user_read_buf_len_ = buf_len;
+  int rv = ReadPadded();
+  if (rv == ERR_IO_PENDING) {
+    read_callback_ = std::move(callback);
+  } else {
+    user_read_buf_ = nullptr;
+  }
+  return rv;
+}
+
+int ForwardTunnel::ReadPadded() {
+  // The payload is never larger than what was read, so reading at most
+  // |user_read_buf_len_| bytes keeps it within the user buffer.
+  while (true) {
+    padded_read_buf_ = base::MakeRefCounted<IOBuffer>(user_read_buf_len_);
+    int rv = socket()->Read(
+        padded_read_buf_.get(), user_read_buf_len_,
+        base::BindOnce(&ForwardTunnel::OnReadPaddedComplete,
+                       weak_ptr_factory_.GetWeakPtr()));
+    if (rv <= 0)
+      return rv;
+    // Reads again if there was only padding.
+    rv = Unpad(rv);
+    if (rv > 0)
+      return rv;
+  }
+}
+
+void ForwardTunnel::OnReadPaddedComplete(int result) {
+  if (result > 0) {
+    result = Unpad(result);
+    if (result == 0)
+      result = ReadPadded();
+    if (result == ERR_IO_PENDING)
+      return;
+  }
+  user_read_buf_ = nullptr;
+  std::move(read_callback_).Run(result);
+}
+
+int ForwardTunnel::Unpad(int size) {
+  const char* p = padded_read_buf_->data();
+  char* out = user_read_buf_->data();
+  int out_size = 0;
+  for (int i = 0; i < size;) {
+    if (num_read_paddings_ >= kFirstPaddings &&
+        read_padding_state_ == STATE_READ_PAYLOAD_LENGTH_1) {
+      std::memcpy(out + out_size, p + i, size - i);
+      out_size += size - i;
+      break;
+    }
+    int copy_size;
+    switch (read_padding_state_) {
+      case STATE_READ_PAYLOAD_LENGTH_1:
+        payload_length_ = static_cast<uint8_t>(p[i]);
+        ++i;
+        read_padding_state_ = STATE_READ_PAYLOAD_LENGTH_2;
+        break;
+      case STATE_READ_PAYLOAD_LENGTH_2:
+        payload_length_ = payload_length_ * 256 + static_cast<uint8_t>(p[i]);
+        ++i;
+        read_padding_state_ = STATE_READ_PADDING_LENGTH;
+        break;
+      case STATE_READ_PADDING_LENGTH:
+        padding_length_ = static_cast<uint8_t>(p[i]);
+        ++i;
+        read_padding_state_ = STATE_READ_PAYLOAD;
+        break;
+      case STATE_READ_PAYLOAD:
+        if (payload_length_ <= size - i) {
+          copy_size = payload_length_;
+          read_padding_state_ = STATE_READ_PADDING;
+        } else {
+          copy_size = size - i;
+        }
+        std::memcpy(out + out_size, p + i, copy_size);
+        out_size += copy_size;
+        i += copy_size;
+        payload_length_ -= copy_size;
+        break;
+      case STATE_READ_PADDING:
+        if (padding_length_ <= size - i) {
+          copy_size = padding_length_;
+          read_padding_state_ = STATE_READ_PAYLOAD_LENGTH_1;
+          ++num_read_paddings_;
+        } else {
+          copy_size = size - i;
+        }
+        i += copy_size;
+        padding_length_ -= copy_size;
+        break;
+    }
+  }
+  return out_size;
+}
+
+int ForwardTunnel::Write(
+    IOBuffer* buf,
+    int buf_len,
+    CompletionOnceCallback callback,
+    const NetworkTrafficAnnotationTag& traffic_annotation) {
+  DCHECK(!write_callback_);
+  if (num_write_paddings_ >= kFirstPaddings) {
+    return socket()->Write(buf, buf_len, std::move(callback),
+                           traffic_annotation);
+  }
+
+  // Adds padding.
+  ++num_write_paddings_;
+  user_write_size_ = std::min(buf_len, kMaxPaddedPayloadSize);
+  int padding_size = base::RandInt(0, kMaxPaddingSize);
+  int write_size = kPaddingHeaderSize + user_write_size_ + padding_size;
+  auto padded_buf = base::MakeRefCounted<IOBuffer>(write_size);
+  uint8_t* p = reinterpret_cast<uint8_t*>(padded_buf->data());
+  p[0] = user_write_size_ / 256;
+  p[1] = user_write_size_ % 256;
+  p[2] = padding_size;
+  std::memcpy(p + kPaddingHeaderSize, buf->data(), user_write_size_);
+  std::memset(p + kPaddingHeaderSize + user_write_size_, 0, padding_size);
+  padded_write_buf_ = base::MakeRefCounted<DrainableIOBuffer>(
+      std::move(padded_buf), write_size);
+  traffic_annotation_ = &traffic_annotation;
+
+  int rv = WritePadded();
+  if (rv == ERR_IO_PENDING)
+    write_callback_ = std::move(callback);
+  return rv;
+}
+
+int ForwardTunnel::WritePadded() {
+  // The padded frame is written whole before the payload counts as written.
+  while (padded_write_buf_->BytesRemaining() > 0) {
+    int rv = socket()->Write(
+        padded_write_buf_.get(), padded_write_buf_->BytesRemaining(),
+        base::BindOnce(&ForwardTunnel::OnWritePaddedComplete,
+                       weak_ptr_factory_.GetWeakPtr()),
+        *traffic_annotation_);
+    if (rv < 0)
+      return rv;
+    padded_write_buf_->DidConsume(rv);
+  }
+  padded_write_buf_ = nullptr;
+  return user_write_size_;
+}
+
+void ForwardTunnel::OnWritePaddedComplete(int result) {
+  if (result >= 0) {
+    padded_write_buf_->DidConsume(result);
+    result = WritePadded();
+    if (result == ERR_IO_PENDING)
+      return;
+  }
+  std::move(write_callback_).Run(result);
+}
+
+ForwardTunnelPool::ForwardTunnelPool() = default;
+
+ForwardTunnelPool::~ForwardTunnelPool() = default;
+
+std::unique_ptr<ForwardTunnel> ForwardTunnelPool::Take(
+    const HostPortPair& origin) {
+  auto it = idle_tunnels_.find(origin);
+  if (it == idle_tunnels_.end())
+    return nullptr;
+
+  auto& tunnels = it->second;
+  std::unique_ptr<ForwardTunnel> tunnel;
+  // Tunnels closed by the proxy or the server while idle are dropped.
+  while (!tunnels.empty() && !tunnel) {
+    tunnel = std::move(tunnels.back());
+    tunnels.pop_back();
+    tunnel->idle_timer_.Stop();
+    if (!tunnel->IsReusable())
+      tunnel = nullptr;
+  }
+  if (tunnels.empty())
+    idle_tunnels_.erase(it);
+  return tunnel;
+}
+
+void ForwardTunnelPool::Release(const HostPortPair& origin,
+                                std::unique_ptr<ForwardTunnel> tunnel) {
+  auto& tunnels = idle_tunnels_[origin];
+  if (tunnels.size() >= kMaxIdleTunnelsPerOrigin)
+    tunnels.erase(tunnels.begin());
+
+  // This use of base::Unretained is safe because the timer is owned by the
+  // tunnel, which is owned by this object until it is taken.
+  tunnel->idle_timer_.Start(
+      FROM_HERE, kIdleTunnelTimeout,
+      base::BindOnce(&ForwardTunnelPool::Expire, base::Unretained(this),
+                     origin, tunnel.get()));
+  tunnels.push_back(std::move(tunnel));
+}
+
+void ForwardTunnelPool::Clear() {
+  idle_tunnels_.clear();
+}
+
+void ForwardTunnelPool::Expire(const HostPortPair& origin,
+                               ForwardTunnel* tunnel) {
+  auto it = idle_tunnels_.find(origin);
+  if (it == idle_tunnels_.end())
+    return;
+  base::EraseIf(it->second,
+                [tunnel](const std::unique_ptr<ForwardTunnel>& idle_tunnel) {
+                  return idle_tunnel.get() == tunnel;
+                });
+  if (it->second.empty())
+    idle_tunnels_.erase(it);
+}
+
+HttpForwarder::BodyFramer::BodyFramer() : type_(kEmpty), remaining_(0) {}
+
+HttpForwarder::BodyFramer::~BodyFramer() = default;
+
+void HttpForwarder::BodyFramer::Reset(Type type, int64_t length) {
+  type_ = type;
+  remaining_ = length;
+  chunked_decoder_.reset();
+  if (type_ == kChunked)
+    chunked_decoder_ = std::make_unique<HttpChunkedDecoder>();
+}
+
+int HttpForwarder::BodyFramer::Consume(const char* data, int size) {
+  switch (type_) {
+    case kEmpty:
+      return 0;
+    case kLength: {
+      int consumed = static_cast<int>(std::min<int64_t>(size, remaining_));
+      remaining_ -= consumed;
+      return consumed;
+    }
+    case kChunked: {
+      // The decoder works in place, but the body is forwarded as is.
+      scratch_.assign(data, size);
+      int rv = chunked_decoder_->FilterBuf(scratch_.data(), size);
+      if (rv < 0)
+        return rv;
+      if (chunked_decoder_->reached_eof())
+        return size - chunked_decoder_->bytes_after_eof();
+      return size;
+    }
+    case kUntilClose:
+      return size;
+  }
+}
+
+bool HttpForwarder::BodyFramer::done() const {
+  switch (type_) {
+    case kEmpty:
+      return true;
+    case kLength:
+      return remaining_ == 0;
+    case kChunked:
+      return chunked_decoder_->reached_eof();
+    case kUntilClose:
+      return false;
+  }
+}
+
+HttpForwarder::HttpForwarder(
+    unsigned int id,
+    StreamSocket* client_socket,
+    ForwardTunnelPool* tunnel_pool,
+    const ProxyInfo& proxy_info,
+    const ProxyInfo& direct_proxy_info,
+    const RouteTable* route_table,
+    const SSLConfig& server_ssl_config,
+    const SSLConfig& proxy_ssl_config,
+    HttpNetworkSession* session,
+    const NetworkAnonymizationKey& network_anonymization_key,
+    const NetLogWithSource& net_log,
+    const NetworkTrafficAnnotationTag& traffic_annotation)
+    : id_(id),
+      client_socket_(client_socket),
+      tunnel_pool_(tunnel_pool),
+      proxy_info_(proxy_info),
+      direct_proxy_info_(direct_proxy_info),
+      route_table_(route_table),
+      server_ssl_config_(server_ssl_config),
+      proxy_ssl_config_(proxy_ssl_config),
+      session_(session),
+      network_anonymization_key_(network_anonymization_key),
+      net_log_(net_log),
+      next_state_(STATE_NONE),
+      client_start_(0),
+      client_end_(0),
+      header_scan_offset_(0),
+      tunnel_start_(0),
+      tunnel_end_(0),
+      head_request_(false),
+      client_keep_alive_(false),
+      tunnel_proxy_info_(&proxy_info),
+      in_response_header_(false),
+      upgraded_(false),
+      server_keep_alive_(false),
+      upload_done_(false),
+      download_done_(false),
+      response_started_(false),
+      error_(OK),
+      traffic_annotation_(traffic_annotation) {
+  io_callback_ = base::BindRepeating(&HttpForwarder::OnIOComplete,
+                                     weak_ptr_factory_.GetWeakPtr());
+  client_buf_ = base::MakeRefCounted<GrowableIOBuffer>();
+  client_buf_->SetCapacity(kBufferSize);
+  tunnel_buf_ = base::MakeRefCounted<GrowableIOBuffer>();
+  tunnel_buf_->SetCapacity(kBufferSize);
+}
+
+HttpForwarder::~HttpForwarder() = default;
+
+int HttpForwarder::Run(CompletionOnceCallback callback) {
+  DCHECK_EQ(next_state_, STATE_NONE);
+  DCHECK(!run_callback_);
+
+  next_state_ = STATE_READ_REQUEST;
+  int rv = DoLoop(OK);
+  if (rv == ERR_IO_PENDING)
+    run_callback_ = std::move(callback);
+  return rv;
+}
+
+void HttpForwarder::OnIOComplete(int result) {
+  DCHECK_NE(next_state_, STATE_NONE);
+  int rv = DoLoop(result);
+  if (rv != ERR_IO_PENDING)
+    Finish(rv);
+}
+
+void HttpForwarder::Finish(int result) {
+  DCHECK_NE(result, ERR_IO_PENDING);
+  DCHECK(run_callback_);
+  // Nothing in flight may call back once the connection is done.
+  weak_ptr_factory_.InvalidateWeakPtrs();
+  std::move(run_callback_).Run(result);
+}
+
+int HttpForwarder::DoLoop(int last_io_result) {
+  DCHECK_NE(next_state_, STATE_NONE);
+  int rv = last_io_result;
+  do {
+    State state = next_state_;
+    next_state_ = STATE_NONE;
+    switch (state) {
+      case STATE_READ_REQUEST:
+        DCHECK_EQ(rv, OK);
+        rv = DoReadRequest();
+        break;
+      case STATE_READ_REQUEST_COMPLETE:
+        rv = DoReadRequestComplete(rv);
+        break;
+      case STATE_CONNECT_TUNNEL:
+        DCHECK_EQ(rv, OK);
+        rv = DoConnectTunnel();
+        break;
+      case STATE_CONNECT_TUNNEL_COMPLETE:
+        rv = DoConnectTunnelComplete(rv);
+        break;
+      case STATE_CONFIRM_HANDSHAKE:
+        DCHECK_EQ(rv, OK);
+        rv = DoConfirmHandshake();
+        break;
+      case STATE_CONFIRM_HANDSHAKE_COMPLETE:
+        rv = DoConfirmHandshakeComplete(rv);
+        break;
+      case STATE_WRITE_REQUEST_HEADER:
+        DCHECK_EQ(rv, OK);
+        rv = DoWriteRequestHeader();
+        break;
+      case STATE_WRITE_REQUEST_HEADER_COMPLETE:
+        rv = DoWriteRequestHeaderComplete(rv);
+        break;
+      case STATE_WRITE_ERROR_RESPONSE:
+        DCHECK_EQ(rv, OK);
+        rv = DoWriteErrorResponse();
+        break;
+      case STATE_WRITE_ERROR_RESPONSE_COMPLETE:
+        rv = DoWriteErrorResponseComplete(rv);
+        break;
+      default:
+        NOTREACHED() << "bad state";
+        rv = ERR_UNEXPECTED;
+        break;
+    }
+  } while (rv != ERR_IO_PENDING && next_state_ != STATE_NONE);
+  return rv;
+}
+
+int HttpForwarder::DoReadRequest() {
+  base::StringPiece data(client_buf_->StartOfBuffer() + client_start_,
+                         client_end_ - client_start_);
+  auto header_end = data.find("\r\n\r\n", header_scan_offset_);
+  if (header_end != base::StringPiece::npos) {
+    header_scan_offset_ = 0;
+    int rv = ParseRequestHeader(data.substr(0, header_end));
+    if (rv != OK)
+      return FailRequest(kBadRequest, rv);
+    client_start_ += header_end + 4;
+    next_state_ = STATE_CONNECT_TUNNEL;
+    return OK;
+  }
+  // The end may straddle this read and the next one.
+  header_scan_offset_ = std::max(0, client_end_ - client_start_ - 3);
+
+  if (client_end_ - client_start_ == kBufferSize)
+    return FailRequest(kBadRequest, ERR_MSG_TOO_BIG);
+
+  next_state_ = STATE_READ_REQUEST_COMPLETE;
+  return ReadClient(io_callback_);
+}
+
+int HttpForwarder::DoReadRequestComplete(int result) {
+  if (result < 0)
+    return result;
+
+  if (result == 0) {
+    // The client is done if it closes between requests.
+    if (client_start_ == client_end_)
+      return OK;
+    return ERR_CONNECTION_CLOSED;
+  }
+
+  client_end_ += result;
+  next_state_ = STATE_READ_REQUEST;
+  return OK;
+}
+
+int HttpForwarder::ParseRequestHeader(base::StringPiece header) {
+  auto first_line_end = header.find("\r\n");
+  std::vector<base::StringPiece> request_line =
+      base::SplitStringPiece(header.substr(0, first_line_end), " ",
+                             base::KEEP_WHITESPACE, base::SPLIT_WANT_ALL);
+  if (request_line.size() != 3)
+    return ERR_INVALID_ARGUMENT;
+  base::StringPiece method = request_line[0];
+  base::StringPiece version = request_line[2];
+  if (method == "CONNECT" || !base::StartsWith(version, "HTTP/1.")) {
+    return ERR_INVALID_ARGUMENT;
+  }
+  GURL url(request_line[1]);
+  if (!url.is_valid() || !url.SchemeIs(url::kHttpScheme) || !url.has_host()) {
+    return ERR_INVALID_ARGUMENT;
+  }
+  origin_ = HostPortPair::FromURL(url);
+  head_request_ = method == "HEAD";
+
+  // The origin gets the request in origin-form, without the headers meant
+  // for this proxy.
+  std::string request_header =
+      base::StrCat({method, " ", url.PathForRequestPiece(), " ", version,
+                    "\r\n"});
+  std::string fields;
+  if (first_line_end != base::StringPiece::npos)
+    fields = std::string(header.substr(first_line_end + 2));
+
+  // First finds how the body is framed, and the hop-by-hop headers named
+  // by Connection.
+  bool close = false;
+  bool keep_alive = false;
+  bool connection_upgrade = false;
+  bool has_upgrade = false;
+  bool has_transfer_encoding = false;
+  bool chunked = false;
+  int64_t content_length = -1;
+  std::set<std::string> hop_by_hop_headers = {"keep-alive",
+                                              "proxy-authorization",
+                                              "proxy-connection"};
+  HttpUtil::HeadersIterator it(fields.begin(), fields.end(), "\r\n");
+  while (it.GetNext()) {
+    base::StringPiece name = it.name_piece();
+    if (base::EqualsCaseInsensitiveASCII(name, "proxy-connection") ||
+        base::EqualsCaseInsensitiveASCII(name, "connection")) {
+      HttpUtil::ValuesIterator values(it.values_begin(), it.values_end(),
+                                      ',');
+      while (values.GetNext()) {
+        std::string value = base::ToLowerASCII(values.value_piece());
+        if (value == "close")
+          close = true;
+        if (value == "keep-alive")
+          keep_alive = true;
+        if (value == "upgrade" &&
+            base::EqualsCaseInsensitiveASCII(name, "connection")) {
+          connection_upgrade = true;
+        }
+        // The origin still needs the headers framing the body.
+        if (value != "content-length" && value != "transfer-encoding")
+          hop_by_hop_headers.insert(std::move(value));
+      }
+    } else if (base::EqualsCaseInsensitiveASCII(name, "transfer-encoding")) {
+      // Chunked must be the last coding of a request body.
+      has_transfer_encoding = true;
+      HttpUtil::ValuesIterator values(it.values_begin(), it.values_end(),
+                                      ',');
+      while (values.GetNext()) {
+        chunked =
+            base::EqualsCaseInsensitiveASCII(values.value_piece(), "chunked");
+      }
+    } else if (base::EqualsCaseInsensitiveASCII(name, "content-length")) {
+      // Repeated Content-Length headers must agree, see RFC 9112 6.3.
+      int64_t length;
+      if (!base::StringToInt64(it.values_piece(), &length) || length < 0 ||
+          (content_length >= 0 && length != content_length)) {
+        return ERR_INVALID_ARGUMENT;
+      }
+      content_length = length;
+    } else if (base::EqualsCaseInsensitiveASCII(name, "upgrade")) {
+      has_upgrade = true;
+    }
+  }
+  // A protocol switch is passed on to the origin, which answers it with 101
+  // Switching Protocols.
+  if (connection_upgrade && has_upgrade)
+    hop_by_hop_headers.erase("upgrade");
+  // The origin might frame the body differently from this forwarder, which
+  // allows request smuggling.
+  if (has_transfer_encoding && content_length >= 0)
+    return ERR_INVALID_ARGUMENT;
+
+  it.Reset();
+  while (it.GetNext()) {
+    if (hop_by_hop_headers.count(base::ToLowerASCII(it.name_piece())))
+      continue;
+    base::StrAppend(&request_header,
+                    {it.name_piece(), ": ", it.values_piece(), "\r\n"});
+  }
+  request_header += "\r\n";
+
+  if (has_transfer_encoding) {
+    if (!chunked)
+      return ERR_INVALID_ARGUMENT;
+    request_body_.Reset(BodyFramer::kChunked);
+  } else if (content_length >= 0) {
+    request_body_.Reset(BodyFramer::kLength, content_length);
+  } else {
+    request_body_.Reset(BodyFramer::kEmpty);
+  }
+
+  if (version == "HTTP/1.0") {
+    client_keep_alive_ = keep_alive && !close;
+  } else {
+    client_keep_alive_ = !close;
+  }
+
+  int request_header_size = request_header.size();
+  request_header_buf_ = base::MakeRefCounted<DrainableIOBuffer>(
+      base::MakeRefCounted<StringIOBuffer>(std::move(request_header)),
+      request_header_size);
+  return OK;
+}
+
+int HttpForwarder::FailRequest(const char* status, int error) {
+  LOG(INFO) << "Connection " << id_ << " request to " << origin_.ToString()
+            << " failed: " << ErrorToShortString(error);
+  error_ = error;
+  // Only the connection can be closed once a response is under way.
+  if (response_started_)
+    return error;
+
+  std::string response =
+      base::StrCat({"HTTP/1.1 ", status,
+                    "\r\nConnection: close\r\nContent-Length: 0\r\n\r\n"});
+  int response_size = response.size();
+  error_response_buf_ = base::MakeRefCounted<DrainableIOBuffer>(
+      base::MakeRefCounted<StringIOBuffer>(std::move(response)),
+      response_size);
+  next_state_ = STATE_WRITE_ERROR_RESPONSE;
+  return OK;
+}
+
+int HttpForwarder::DoConnectTunnel() {
+  url::CanonHostInfo host_info;
+  url::SchemeHostPort endpoint(
+      "http", CanonicalizeHost(origin_.HostForURL(), &host_info),
+      origin_.port(), url::SchemeHostPort::ALREADY_CANONICALIZED);
+  if (!endpoint.IsValid())
+    return FailRequest(kBadRequest, ERR_ADDRESS_INVALID);
+
+  tunnel_proxy_info_ = &proxy_info_;
+  if (route_table_) {
+    switch (route_table_->Route(endpoint.host())) {
+      case RouteTable::Action::kProxy:
+        break;
+      case RouteTable::Action::kDirect:
+        tunnel_proxy_info_ = &direct_proxy_info_;
+        break;
+      case RouteTable::Action::kReject:
+        LOG(INFO) << "Connection " << id_ << " rejects request to "
+                  << origin_.ToString();
+        return FailRequest(kForbidden, ERR_BLOCKED_BY_CLIENT);
+    }
+  }
+
+  // The route of an origin does not change, so pooled tunnels to it have
+  // taken the same route.
+  tunnel_ = tunnel_pool_->Take(origin_);
+  if (tunnel_) {
+    LOG(INFO) << "Connection " << id_ << " reuses tunnel to "
+              << origin_.ToString();
+    next_state_ = STATE_WRITE_REQUEST_HEADER;
+    return OK;
+  }
+
+  LOG(INFO) << "Connection " << id_ << " forwards to " << origin_.ToString()
+            << (tunnel_proxy_info_->is_direct() ? " directly" : "");
+
+  next_state_ = STATE_CONNECT_TUNNEL_COMPLETE;
+  tunnel_handle_ = std::make_unique<ClientSocketHandle>();
+  // Ignores socket limit set by socket pool for this type of socket.
+  return InitSocketHandleForRawConnect2(
+      std::move(endpoint), LOAD_IGNORE_LIMITS, MAXIMUM_PRIORITY, session_,
+      *tunnel_proxy_info_, server_ssl_config_, proxy_ssl_config_,
+      PRIVACY_MODE_DISABLED, network_anonymization_key_,
+      SecureDnsPolicy::kAllow, net_log_,
+      tunnel_handle_.get(), io_callback_);
+}
+
+int HttpForwarder::DoConnectTunnelComplete(int result) {
+  if (result < 0)
+    return FailRequest(kBadGateway, result);
+
+  next_state_ = STATE_CONFIRM_HANDSHAKE;
+  return OK;
+}
+
+int HttpForwarder::DoConfirmHandshake() {
+  next_state_ = STATE_CONFIRM_HANDSHAKE_COMPLETE;
+  // The request must not be replayed as TLS early data, see NaiveConnection.
+  return tunnel_handle_->socket()->ConfirmHandshake(io_callback_);
+}
+
+int HttpForwarder::DoConfirmHandshakeComplete(int result) {
+  if (result < 0)
+    return FailRequest(kBadGateway, result);
+
+  // Clients of a forward proxy never pad, so the tunnel is padded whenever
+  // the proxy server supports it. Direct connections are never padded.
+  auto* proxy_delegate =
+      static_cast<NaiveProxyDelegate*>(session_->context().proxy_delegate);
+  DCHECK(proxy_delegate);
+  bool padded = proxy_delegate->GetProxyServerPaddingSupport(
+                    tunnel_proxy_info_->proxy_server()) ==
+                PaddingSupport::kCapable;
+  tunnel_ = std::make_unique<ForwardTunnel>(std::move(tunnel_handle_), padded);
+  next_state_ = STATE_WRITE_REQUEST_HEADER;
+  return OK;
+}
+
+int HttpForwarder::DoWriteRequestHeader() {
+  next_state_ = STATE_WRITE_REQUEST_HEADER_COMPLETE;
+  return tunnel_->Write(request_header_buf_.get(),
+                        request_header_buf_->BytesRemaining(), io_callback_,
+                        traffic_annotation_);
+}
+
+int HttpForwarder::DoWriteRequestHeaderComplete(int result) {
+  if (result < 0)
+    return FailRequest(kBadGateway, result);
+
+  request_header_buf_->DidConsume(result);
+  if (request_header_buf_->BytesRemaining() > 0) {
+    next_state_ = STATE_WRITE_REQUEST_HEADER;
+    return OK;
+  }
+  request_header_buf_ = nullptr;
+
+  // Starts in a new task so that neither direction completes or fails inside
+  // this loop.
+  base::ThreadTaskRunnerHandle::Get()->PostTask(
+      FROM_HERE, base::BindOnce(&HttpForwarder::StartExchange,
+                                weak_ptr_factory_.GetWeakPtr()));
+  return ERR_IO_PENDING;
+}
+
+int HttpForwarder::DoWriteErrorResponse() {
+  next_state_ = STATE_WRITE_ERROR_RESPONSE_COMPLETE;
+  return client_socket_->Write(error_response_buf_.get(),
+                               error_response_buf_->BytesRemaining(),
+                               io_callback_, traffic_annotation_);
+}
+
+int HttpForwarder::DoWriteErrorResponseComplete(int result) {
+  if (result < 0)
+    return result;
+
+  error_response_buf_->DidConsume(result);
+  if (error_response_buf_->BytesRemaining() > 0) {
+    next_state_ = STATE_WRITE_ERROR_RESPONSE;
+    return OK;
+  }
+  return error_;
+}
+
+int HttpForwarder::ReadClient(CompletionOnceCallback callback) {
+  // Moves unforwarded data to the front so that the rest of the buffer is
+  // free.
+  if (client_start_ > 0) {
+    char* start = client_buf_->StartOfBuffer();
+    std::memmove(start, start + client_start_, client_end_ - client_start_);
+    client_end_ -= client_start_;
+    client_start_ = 0;
+  }
+  client_buf_->set_offset(client_end_);
+  DCHECK_LT(0, client_buf_->RemainingCapacity());
+  return client_socket_->Read(client_buf_.get(),
+                              client_buf_->RemainingCapacity(),
+                              std::move(callback));
+}
+
+int HttpForwarder::ReadTunnel(CompletionOnceCallback callback) {
+  if (tunnel_start_ > 0) {
+    char* start = tunnel_buf_->StartOfBuffer();
+    std::memmove(start, start + tunnel_start_, tunnel_end_ - tunnel_start_);
+    tunnel_end_ -= tunnel_start_;
+    tunnel_start_ = 0;
+  }
+  tunnel_buf_->set_offset(tunnel_end_);
+  // Only a response header can fill the buffer.
+  if (tunnel_buf_->RemainingCapacity() == 0)
+    return ERR_RESPONSE_HEADERS_TOO_BIG;
+  return tunnel_->Read(tunnel_buf_.get(), tunnel_buf_->RemainingCapacity(),
+                       std::move(callback));
+}
+
+void HttpForwarder::StartExchange() {
+  upload_done_ = false;
+  download_done_ = false;
+  in_response_header_ = true;
+  upgraded_ = false;
+  server_keep_alive_ = false;
+  response_started_ = false;
+  DCHECK_EQ(tunnel_start_, tunnel_end_);
+
+  auto weak_this = weak_ptr_factory_.GetWeakPtr();
+  DoUpload();
+  // The upload may have failed the exchange already.
+  if (weak_this)
+    DoDownload();
+}
+
+void HttpForwarder::DoUpload() {
+  while (true) {
+    int rv;
+    if (upload_buf_) {
+      rv = tunnel_->Write(
+          upload_buf_.get(), upload_buf_->BytesRemaining(),
+          base::BindOnce(&HttpForwarder::OnUploadWriteComplete,
+                         weak_ptr_factory_.GetWeakPtr()),
+          traffic_annotation_);
+      if (rv == ERR_IO_PENDING)
+        return;
+      rv = HandleUploadWrite(rv);
+    } else if (request_body_.done()) {
+      // After a protocol switch the client keeps sending to the server.
+      if (upgraded_ && request_body_.type() != BodyFramer::kUntilClose) {
+        request_body_.Reset(BodyFramer::kUntilClose);
+        continue;
+      }
+      upload_done_ = true;
+      MaybeCompleteExchange();
+      return;
+    } else if (client_start_ == client_end_) {
+      rv = ReadClient(base::BindOnce(&HttpForwarder::OnUploadReadComplete,
+                                     weak_ptr_factory_.GetWeakPtr()));
+      if (rv == ERR_IO_PENDING)
+        return;
+      rv = HandleUploadRead(rv);
+    } else {
+      char* data = client_buf_->StartOfBuffer() + client_start_;
+      rv = request_body_.Consume(data, client_end_ - client_start_);
+      if (rv > 0) {
+        // Bytes after the body are the next request, which stays buffered.
+        client_start_ += rv;
+        upload_buf_ = base::MakeRefCounted<DrainableIOBuffer>(
+            base::MakeRefCounted<WrappedIOBuffer>(data), rv);
+      }
+    }
+    if (rv < 0) {
+      OnExchangeError(rv);
+      return;
+    }
+  }
+}
+
+int HttpForwarder::HandleUploadRead(int result) {
+  if (result < 0)
+    return result;
+
+  if (result == 0) {
+    if (request_body_.type() != BodyFramer::kUntilClose)
+      return ERR_CONNECTION_CLOSED;
+    request_body_.Reset(BodyFramer::kEmpty);
+    client_keep_alive_ = false;
+    return OK;
+  }
+
+  client_end_ += result;
+  return OK;
+}
+
+int HttpForwarder::HandleUploadWrite(int result) {
+  if (result < 0)
+    return result;
+
+  upload_buf_->DidConsume(result);
+  if (upload_buf_->BytesRemaining() == 0)
+    upload_buf_ = nullptr;
+  return OK;
+}
+
+void HttpForwarder::OnUploadReadComplete(int result) {
+  int rv = HandleUploadRead(result);
+  if (rv < 0) {
+    OnExchangeError(rv);
+    return;
+  }
+  DoUpload();
+}
+
+void HttpForwarder::OnUploadWriteComplete(int result) {
+  int rv = HandleUploadWrite(result);
+  if (rv < 0) {
+    OnExchangeError(rv);
+    return;
+  }
+  DoUpload();
+}
+
+void HttpForwarder::DoDownload() {
+  while (true) {
+    int rv;
+    if (download_buf_) {
+      rv = client_socket_->Write(
+          download_buf_.get(), download_buf_->BytesRemaining(),
+          base::BindOnce(&HttpForwarder::OnDownloadWriteComplete,
+                         weak_ptr_factory_.GetWeakPtr()),
+          traffic_annotation_);
+      if (rv == ERR_IO_PENDING)
+        return;
+      rv = HandleDownloadWrite(rv);
+    } else if (!in_response_header_ && response_body_.done()) {
+      download_done_ = true;
+      MaybeCompleteExchange();
+      return;
+    } else {
+      rv = 0;
+      if (in_response_header_ && tunnel_start_ < tunnel_end_) {
+        rv = ParseResponseHeader();
+      } else if (tunnel_start_ < tunnel_end_) {
+        rv = PrepareDownloadWrite(0);
+      }
+      // Reads more unless a write is prepared.
+      if (rv == 0 && !download_buf_) {
+        rv = ReadTunnel(base::BindOnce(&HttpForwarder::OnDownloadReadComplete,
+                                       weak_ptr_factory_.GetWeakPtr()));
+        if (rv == ERR_IO_PENDING)
+          return;
+        rv = HandleDownloadRead(rv);
+      } else if (rv > 0) {
+        rv = PrepareDownloadWrite(rv);
+      }
+    }
+    if (rv < 0) {
+      OnExchangeError(rv);
+      return;
+    }
+  }
+}
+
+int HttpForwarder::ParseResponseHeader() {
+  const char* data = tunnel_buf_->StartOfBuffer() + tunnel_start_;
+  size_t header_size =
+      HttpUtil::LocateEndOfHeaders(data, tunnel_end_ - tunnel_start_);
+  if (header_size == std::string::npos)
+    return 0;
+
+  auto headers = base::MakeRefCounted<HttpResponseHeaders>(
+      HttpUtil::AssembleRawHeaders(base::StringPiece(data, header_size)));
+  if (headers->GetHttpVersion() < HttpVersion(1, 0))
+    return ERR_INVALID_HTTP_RESPONSE;
+
+  int response_code = headers->response_code();
+  if (response_code == 101) {
+    // Everything after a protocol switch is relayed until either side
+    // closes.
+    in_response_header_ = false;
+    upgraded_ = true;
+    response_body_.Reset(BodyFramer::kUntilClose);
+    if (upload_done_) {
+      upload_done_ = false;
+      base::ThreadTaskRunnerHandle::Get()->PostTask(
+          FROM_HERE, base::BindOnce(&HttpForwarder::DoUpload,
+                                    weak_ptr_factory_.GetWeakPtr()));
+    }
+    return header_size;
+  }
+  // Interim responses are followed by another response header.
+  if (response_code / 100 == 1)
+    return header_size;
+
+  in_response_header_ = false;
+  server_keep_alive_ = headers->IsKeepAlive();
+  int64_t content_length = headers->GetContentLength();
+  if (head_request_ || response_code == 204 || response_code == 304) {
+    response_body_.Reset(BodyFramer::kEmpty);
+  } else if (headers->IsChunkEncoded()) {
+    response_body_.Reset(BodyFramer::kChunked);
+  } else if (content_length >= 0) {
+    response_body_.Reset(BodyFramer::kLength, content_length);
+  } else {
+    // The client also needs the connection closed to see the end.
+    response_body_.Reset(BodyFramer::kUntilClose);
+    server_keep_alive_ = false;
+  }
+  return header_size;
+}
+
+int HttpForwarder::PrepareDownloadWrite(int header_size) {
+  char* data = tunnel_buf_->StartOfBuffer() + tunnel_start_;
+  int size = header_size;
+  if (!in_response_header_) {
+    int rv = response_body_.Consume(data + size,
+                                    tunnel_end_ - tunnel_start_ - size);
+    if (rv < 0)
+      return rv;
+    size += rv;
+  }
+  if (size == 0)
+    return OK;
+
+  tunnel_start_ += size;
+  download_buf_ = base::MakeRefCounted<DrainableIOBuffer>(
+      base::MakeRefCounted<WrappedIOBuffer>(data), size);
+  response_started_ = true;
+  return OK;
+}
+
+int HttpForwarder::HandleDownloadRead(int result) {
+  if (result < 0)
+    return result;
+
+  if (result == 0) {
+    if (!in_response_header_ &&
+        response_body_.type() == BodyFramer::kUntilClose) {
+      response_body_.Reset(BodyFramer::kEmpty);
+      return OK;
+    }
+    if (!response_started_ && tunnel_start_ == tunnel_end_)
+      return ERR_EMPTY_RESPONSE;
+    return ERR_CONNECTION_CLOSED;
+  }
+
+  tunnel_end_ += result;
+  return OK;
+}
+
+int HttpForwarder::HandleDownloadWrite(int result) {
+  if (result < 0)
+    return result;
+
+  download_buf_->DidConsume(result);
+  if (download_buf_->BytesRemaining() == 0)
+    download_buf_ = nullptr;
+  return OK;
+}
+
+void HttpForwarder::OnDownloadReadComplete(int result) {
+  int rv = HandleDownloadRead(result);
+  if (rv < 0) {
+    OnExchangeError(rv);
+    return;
+  }
+  DoDownload();
+}
+
+void HttpForwarder::OnDownloadWriteComplete(int result) {
+  int rv = HandleDownloadWrite(result);
+  if (rv < 0) {
+    OnExchangeError(rv);
+    return;
+  }
+  DoDownload();
+}
+
+void HttpForwarder::OnExchangeError(int error) {
+  // Drops the callbacks of the other direction, which may still have a read
+  // or write in flight.
+  weak_ptr_factory_.InvalidateWeakPtrs();
+  io_callback_ = base::BindRepeating(&HttpForwarder::OnIOComplete,
+                                     weak_ptr_factory_.GetWeakPtr());
+  tunnel_.reset();
+  upload_buf_ = nullptr;
+  download_buf_ = nullptr;
+
+  int rv = FailRequest(kBadGateway, error);
+  if (rv == OK)
+    rv = DoLoop(OK);
+  if (rv != ERR_IO_PENDING)
+    Finish(rv);
+}
+
+void HttpForwarder::MaybeCompleteExchange() {
+  if (download_done_ && !server_keep_alive_) {
+    // The server is done with the connection, whatever the client still
+    // sends.
+    tunnel_.reset();
+    Finish(OK);
+    return;
+  }
+  if (!upload_done_ || !download_done_)
+    return;
+
+  // Data past the end of the response means the server cannot be trusted
+  // with another request.
+  if (server_keep_alive_ && tunnel_start_ == tunnel_end_ &&
+      tunnel_->IsReusable()) {
+    tunnel_pool_->Release(origin_, std::move(tunnel_));
+  } else {
+    tunnel_.reset();
+  }
+  tunnel_start_ = 0;
+  tunnel_end_ = 0;
+
+  if (!client_keep_alive_) {
+    Finish(OK);
+    return;
+  }
+
+  // Continues with the next request in a new task, which also gives other
+  // connections a turn.
+  next_state_ = STATE_READ_REQUEST;
+  base::ThreadTaskRunnerHandle::Get()->PostTask(
+      FROM_HERE, base::BindOnce(&HttpForwarder::OnIOComplete,
+                                weak_ptr_factory_.GetWeakPtr(), OK));
+}
+
+}  // namespace net
@@ -0,0 +1,319 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#ifndef NET_TOOLS_NAIVE_HTTP_FORWARDER_H_
+#define NET_TOOLS_NAIVE_HTTP_FORWARDER_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/memory/scoped_refptr.h"
+#include "base/memory/weak_ptr.h"
+#include "base/strings/string_piece.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+#include "net/base/completion_once_callback.h"
+#include "net/base/completion_repeating_callback.h"
+#include "net/base/host_port_pair.h"
+
+namespace net {
+
+class ClientSocketHandle;
+class DrainableIOBuffer;
+class GrowableIOBuffer;
+class HttpChunkedDecoder;
+class HttpNetworkSession;
+class IOBuffer;
+class NetLogWithSource;
+class NetworkAnonymizationKey;
+class ProxyInfo;
+class RouteTable;
+class StreamSocket;
+struct NetworkTrafficAnnotationTag;
+struct SSLConfig;
+
+// A tunnel to one origin that carries plain HTTP/1.1 requests forwarded for
+// clients. It outlives the client connection it was opened for, so it keeps
+// the padding state of the tunnel stream itself: the first writes are padded
+// and the first reads unpadded once, however many clients use the tunnel.
+class ForwardTunnel {
+ public:
+  ForwardTunnel(std::unique_ptr<ClientSocketHandle> handle, bool padded);
+  ~ForwardTunnel();
+  ForwardTunnel(const ForwardTunnel&) = delete;
+  ForwardTunnel& operator=(const ForwardTunnel&) = delete;
+
+  int Read(IOBuffer* buf, int buf_len, CompletionOnceCallback callback);
+  int Write(IOBuffer* buf,
+            int buf_len,
+            CompletionOnceCallback callback,
+            const NetworkTrafficAnnotationTag& traffic_annotation);
+
+  // Whether the tunnel can carry another request.
+  bool IsReusable() const;
+
+ private:
+  friend class ForwardTunnelPool;
+
+  enum PaddingState {
+    STATE_READ_PAYLOAD_LENGTH_1,
+    STATE_READ_PAYLOAD_LENGTH_2,
+    STATE_READ_PADDING_LENGTH,
+    STATE_READ_PAYLOAD,
+    STATE_READ_PADDING,
+  };
+
+  int ReadPadded();
+  void OnReadPaddedComplete(int result);
+  // Removes padding from |size| bytes in |padded_read_buf_| and copies the
+  // payload to |user_read_buf_|. Returns the payload size.
+  int Unpad(int size);
+
+  int WritePadded();
+  void OnWritePaddedComplete(int result);
+
+  StreamSocket* socket() const;
+
+  std::unique_ptr<ClientSocketHandle> handle_;
+
+  int num_read_paddings_;
+  PaddingState read_padding_state_;
+  int payload_length_;
+  int padding_length_;
+  scoped_refptr<IOBuffer> padded_read_buf_;
+  scoped_refptr<IOBuffer> user_read_buf_;
+  int user_read_buf_len_;
+  CompletionOnceCallback read_callback_;
+
+  int num_write_paddings_;
+  scoped_refptr<DrainableIOBuffer> padded_write_buf_;
+  int user_write_size_;
+  CompletionOnceCallback write_callback_;
+  const NetworkTrafficAnnotationTag* traffic_annotation_;
+
+  // Runs while the tunnel is idle in ForwardTunnelPool.
+  base::OneShotTimer idle_timer_;
+
+  base::WeakPtrFactory<ForwardTunnel> weak_ptr_factory_{this};
+};
+
+// Keeps a few idle tunnels per origin for plain HTTP requests, so that the
+// next request to the same origin, from any client connection, does not wait
+// for a new tunnel stream.
+class ForwardTunnelPool {
+ public:
+  ForwardTunnelPool();
+  ~ForwardTunnelPool();
+  ForwardTunnelPool(const ForwardTunnelPool&) = delete;
+  ForwardTunnelPool& operator=(const ForwardTunnelPool&) = delete;
+
+  // Returns an idle tunnel to |origin|, or nullptr.
+  std::unique_ptr<ForwardTunnel> Take(const HostPortPair& origin);
+
+  // Keeps |tunnel| for later requests to |origin|.
+  void Release(const HostPortPair& origin,
+               std::unique_ptr<ForwardTunnel> tunnel);
+
+  // Closes the idle tunnels, e.g. after the proxy changed.
+  void Clear();
+
+ private:
+  void Expire(const HostPortPair& origin, ForwardTunnel* tunnel);
+
+  // Most recently released last.
+  std::map<HostPortPair, std::vector<std::unique_ptr<ForwardTunnel>>>
+      idle_tunnels_;
+};
+
+// Forwards absolute-form HTTP/1.1 requests, e.g. "GET http://example.com/
+// HTTP/1.1", read from a client connection of the http listener, one request
+// at a time. Each request goes to its origin over a tunnel taken from
+// ForwardTunnelPool or opened for it, and the response is relayed back as
+// is. The client connection is kept alive across requests when both the
+// client and the server allow it, and the tunnel is returned to the pool
+// once the response is complete.
+class HttpForwarder {
+ public:
+  HttpForwarder(unsigned int id,
+                StreamSocket* client_socket,
+                ForwardTunnelPool* tunnel_pool,
+                const ProxyInfo& proxy_info,
+                const ProxyInfo& direct_proxy_info,
+                const RouteTable* route_table,
+                const SSLConfig& server_ssl_config,
+                const SSLConfig& proxy_ssl_config,
+                HttpNetworkSession* session,
+                const NetworkAnonymizationKey& network_anonymization_key,
+                const NetLogWithSource& net_log,
+                const NetworkTrafficAnnotationTag& traffic_annotation);
+  ~HttpForwarder();
+  HttpForwarder(const HttpForwarder&) = delete;
+  HttpForwarder& operator=(const HttpForwarder&) = delete;
+
+  // Forwards requests until the client connection is done. Runs |callback|
+  // with the result if that does not happen synchronously.
+  int Run(CompletionOnceCallback callback);
+
+ private:
+  enum State {
+    STATE_READ_REQUEST,
+    STATE_READ_REQUEST_COMPLETE,
+    STATE_CONNECT_TUNNEL,
+    STATE_CONNECT_TUNNEL_COMPLETE,
+    STATE_CONFIRM_HANDSHAKE,
+    STATE_CONFIRM_HANDSHAKE_COMPLETE,
+    STATE_WRITE_REQUEST_HEADER,
+    STATE_WRITE_REQUEST_HEADER_COMPLETE,
+    STATE_WRITE_ERROR_RESPONSE,
+    STATE_WRITE_ERROR_RESPONSE_COMPLETE,
+    STATE_NONE,
+  };
+
+  // Where an HTTP/1.1 message body ends.
+  class BodyFramer {
+   public:
+    enum Type {
+      kEmpty,
+      kLength,
+      kChunked,
+      kUntilClose,
+    };
+
+    BodyFramer();
+    ~BodyFramer();
+
+    void Reset(Type type, int64_t length = 0);
+    // Returns how many of the |size| bytes at |data| belong to the body, or
+    // a net error.
+    int Consume(const char* data, int size);
+    bool done() const;
+    Type type() const { return type_; }
+
+   private:
+    Type type_;
+    int64_t remaining_;
+    std::unique_ptr<HttpChunkedDecoder> chunked_decoder_;
+    std::string scratch_;
+  };
+
+  void OnIOComplete(int result);
+  int DoLoop(int last_io_result);
+  int DoReadRequest();
+  int DoReadRequestComplete(int result);
+  int DoConnectTunnel();
+  int DoConnectTunnelComplete(int result);
+  int DoConfirmHandshake();
+  int DoConfirmHandshakeComplete(int result);
+  int DoWriteRequestHeader();
+  int DoWriteRequestHeaderComplete(int result);
+  int DoWriteErrorResponse();
+  int DoWriteErrorResponseComplete(int result);
+
+  // Parses the request in |header|, which ends before the blank line, and
+  // prepares the header to be sent to the origin.
+  int ParseRequestHeader(base::StringPiece header);
+  // Answers the client with |status| and closes the connection.
+  int FailRequest(const char* status, int error);
+
+  // Reads more client data into |client_buf_|.
+  int ReadClient(CompletionOnceCallback callback);
+  // Reads more tunnel data into |tunnel_buf_|.
+  int ReadTunnel(CompletionOnceCallback callback);
+
+  // The request body and the response are relayed concurrently once the
+  // request header is sent.
+  void StartExchange();
+  void DoUpload();
+  int HandleUploadRead(int result);
+  int HandleUploadWrite(int result);
+  void OnUploadReadComplete(int result);
+  void OnUploadWriteComplete(int result);
+  void DoDownload();
+  int HandleDownloadRead(int result);
+  int HandleDownloadWrite(int result);
+  void OnDownloadReadComplete(int result);
+  void OnDownloadWriteComplete(int result);
+  // Parses a response header at the start of unforwarded tunnel data, if it
+  // is complete. Returns its size, 0 if incomplete, or a net error.
+  int ParseResponseHeader();
+  // Sets up |download_buf_| to forward |header_size| bytes of response header
+  // and the body bytes following it.
+  int PrepareDownloadWrite(int header_size);
+  void OnExchangeError(int error);
+  void MaybeCompleteExchange();
+  void Finish(int result);
+
+  unsigned int id_;
+  StreamSocket* client_socket_;
+  ForwardTunnelPool* tunnel_pool_;
+  const ProxyInfo& proxy_info_;
+  const ProxyInfo& direct_proxy_info_;
+  const RouteTable* route_table_;
+  const SSLConfig& server_ssl_config_;
+  const SSLConfig& proxy_ssl_config_;
+  HttpNetworkSession* session_;
+  const NetworkAnonymizationKey& network_anonymization_key_;
+  const NetLogWithSource& net_log_;
+
+  CompletionRepeatingCallback io_callback_;
+  CompletionOnceCallback run_callback_;
+
+  State next_state_;
+
+  // Client data read but not yet forwarded is in
+  // [client_start_, client_end_).
+  scoped_refptr<GrowableIOBuffer> client_buf_;
+  int client_start_;
+  int client_end_;
+  // How far past |client_start_| the request header has been searched for
+  // its end, so that bytes are only scanned once however it is split.
+  int header_scan_offset_;
+
+  // Tunnel data read but not yet forwarded is in
+  // [tunnel_start_, tunnel_end_).
+  scoped_refptr<GrowableIOBuffer> tunnel_buf_;
+  int tunnel_start_;
+  int tunnel_end_;
+
+  // The current request.
+  HostPortPair origin_;
+  bool head_request_;
+  bool client_keep_alive_;
+  BodyFramer request_body_;
+  scoped_refptr<DrainableIOBuffer> request_header_buf_;
+  scoped_refptr<DrainableIOBuffer> upload_buf_;
+
+  // Either |proxy_info_| or |direct_proxy_info_|, as routed for |origin_|.
+  const ProxyInfo* tunnel_proxy_info_;
+  std::unique_ptr<ClientSocketHandle> tunnel_handle_;
+  std::unique_ptr<ForwardTunnel> tunnel_;
+
+  // The current response. Header bytes are forwarded along with the body
+  // bytes after them.
+  bool in_response_header_;
+  bool upgraded_;
+  // Whether the response keeps the connection open, as told to the client.
+  bool server_keep_alive_;
+  BodyFramer response_body_;
+  scoped_refptr<DrainableIOBuffer> download_buf_;
+
+  bool upload_done_;
+  bool download_done_;
+  // Set once anything of the response is sent to the client, after which
+  // errors can only close the connection.
+  bool response_started_;
+  scoped_refptr<DrainableIOBuffer> error_response_buf_;
+  int error_;
+
+  // Traffic annotation for socket control.
+  const NetworkTrafficAnnotationTag& traffic_annotation_;
+
+  base::WeakPtrFactory<HttpForwarder> weak_ptr_factory_{this};
+};
+
+}  // namespace net
+#endif  // NET_TOOLS_NAIVE_HTTP_FORWARDER_H_
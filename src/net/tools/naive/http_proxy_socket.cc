@@ -5,6 +5,7 @@
 
 #include "net/tools/naive/http_proxy_socket.h"
 
+#include <algorithm>
 #include <cstring>
 #include <utility>
 
@@ -12,10 +13,10 @@
 #include "base/callback_helpers.h"
 #include "base/logging.h"
 #include "base/rand_util.h"
+#include "base/strings/string_util.h"
 #include "base/sys_byteorder.h"
 #include "net/base/ip_address.h"
 #include "net/base/net_errors.h"
-#include "net/http/http_request_headers.h"
 #include "net/log/net_log.h"
 #include "net/third_party/quiche/src/quiche/spdy/core/hpack/hpack_constants.h"
 #include "net/tools/naive/naive_proxy_delegate.h"
@@ -23,10 +24,18 @@
 namespace net {
 
 namespace {
-constexpr int kBufferSize = 64 * 1024;
-constexpr size_t kMaxHeaderSize = 64 * 1024;
+constexpr int kMaxHeaderSize = 64 * 1024;
+constexpr char kHeaderEnd[] = "\r\n\r\n";
+constexpr int kHeaderEndSize = sizeof(kHeaderEnd) - 1;
 constexpr char kResponseHeader[] = "HTTP/1.1 200 OK\r\nPadding: ";
 constexpr int kResponseHeaderSize = sizeof(kResponseHeader) - 1;
+// Clients only send credentials once challenged.
+constexpr char kAuthRequiredResponse[] =
+    "HTTP/1.1 407 Proxy Authentication Required\r\n"
+    "Proxy-Authenticate: Basic realm=\"naive\"\r\n"
+    "Connection: close\r\n"
+    "Content-Length: 0\r\n\r\n";
+constexpr int kAuthRequiredResponseSize = sizeof(kAuthRequiredResponse) - 1;
 // A plain 200 is 10 bytes. Expected 48 bytes. "Padding" uses up 7 bytes.
 constexpr int kMinPaddingSize = 30;
 constexpr int kMaxPaddingSize = kMinPaddingSize + 32;
@@ -35,12 +44,19 @@ constexpr int kMaxPaddingSize = kMinPaddingSize + 32;
 HttpProxySocket::HttpProxySocket(
     std::unique_ptr<StreamSocket> transport_socket,
     ClientPaddingDetectorDelegate* padding_detector_delegate,
+    const std::string& proxy_authorization,
     const NetworkTrafficAnnotationTag& traffic_annotation)
     : io_callback_(base::BindRepeating(&HttpProxySocket::OnIOComplete,
                                        base::Unretained(this))),
       transport_(std::move(transport_socket)),
       padding_detector_delegate_(padding_detector_delegate),
+      proxy_authorization_(proxy_authorization),
       next_state_(STATE_NONE),
+      read_start_(0),
+      read_end_(0),
+      scan_start_(0),
+      forwarding_(false),
+      auth_required_(false),
       completed_handshake_(false),
       was_ever_used_(false),
       header_write_size_(-1),
@@ -65,7 +81,11 @@ int HttpProxySocket::Connect(CompletionOnceCallback callback) {
     return OK;
 
   next_state_ = STATE_HEADER_READ;
-  buffer_.clear();
+  read_buf_ = base::MakeRefCounted<GrowableIOBuffer>();
+  read_buf_->SetCapacity(kMaxHeaderSize);
+  read_start_ = 0;
+  read_end_ = 0;
+  scan_start_ = 0;
 
   int rv = DoLoop(OK);
   if (rv == ERR_IO_PENDING) {
@@ -142,18 +162,15 @@ int HttpProxySocket::Read(IOBuffer* buf,
   DCHECK(!user_callback_);
   DCHECK(callback);
 
-  if (!buffer_.empty()) {
+  // Data read along with the request header goes first.
+  if (read_buf_) {
     was_ever_used_ = true;
-    int data_len = buffer_.size();
-    if (data_len <= buf_len) {
-      std::memcpy(buf->data(), buffer_.data(), data_len);
-      buffer_.clear();
-      return data_len;
-    } else {
-      std::memcpy(buf->data(), buffer_.data(), buf_len);
-      buffer_ = buffer_.substr(buf_len);
-      return buf_len;
-    }
+    int size = std::min(buf_len, read_end_ - read_start_);
+    std::memcpy(buf->data(), read_buf_->StartOfBuffer() + read_start_, size);
+    read_start_ += size;
+    if (read_start_ == read_end_)
+      read_buf_ = nullptr;
+    return size;
   }
 
   int rv = transport_->Read(
@@ -255,8 +272,11 @@ int HttpProxySocket::DoLoop(int last_io_result) {
 int HttpProxySocket::DoHeaderRead() {
   next_state_ = STATE_HEADER_READ_COMPLETE;
 
-  handshake_buf_ = base::MakeRefCounted<IOBuffer>(kBufferSize);
-  return transport_->Read(handshake_buf_.get(), kBufferSize, io_callback_);
+  if (read_buf_->RemainingCapacity() == 0) {
+    return ERR_MSG_TOO_BIG;
+  }
+  return transport_->Read(read_buf_.get(), read_buf_->RemainingCapacity(),
+                          io_callback_);
 }
 
 int HttpProxySocket::DoHeaderReadComplete(int result) {
@@ -267,57 +287,117 @@ int HttpProxySocket::DoHeaderReadComplete(int result) {
     return ERR_CONNECTION_CLOSED;
   }
 
-  buffer_.append(handshake_buf_->data(), result);
-  if (buffer_.size() > kMaxHeaderSize) {
-    return ERR_MSG_TOO_BIG;
-  }
+  read_end_ += result;
+  read_buf_->set_offset(read_end_);
 
-  auto header_end = buffer_.find("\r\n\r\n");
-  if (header_end == std::string::npos) {
+  base::StringPiece data(read_buf_->StartOfBuffer(), read_end_);
+  auto header_end = data.find(kHeaderEnd, scan_start_);
+  if (header_end == base::StringPiece::npos) {
+    // The end may straddle this read and the next one.
+    scan_start_ = std::max(0, read_end_ - (kHeaderEndSize - 1));
     next_state_ = STATE_HEADER_READ;
     return OK;
   }
 
+  int rv = ParseHeader(data.substr(0, header_end));
+  if (rv == ERR_INVALID_AUTH_CREDENTIALS) {
+    auth_required_ = true;
+    next_state_ = STATE_HEADER_WRITE;
+    return OK;
+  }
+  if (rv != OK)
+    return rv;
+
+  if (forwarding_) {
+    // HttpForwarder reads the request again and answers it.
+    completed_handshake_ = true;
+    next_state_ = STATE_NONE;
+    return OK;
+  }
+
+  read_start_ = header_end + kHeaderEndSize;
+  if (read_start_ == read_end_)
+    read_buf_ = nullptr;
+
+  next_state_ = STATE_HEADER_WRITE;
+  return OK;
+}
+
+int HttpProxySocket::ParseHeader(base::StringPiece header) {
   // HttpProxyClientSocket uses CONNECT for all endpoints.
-  auto first_line_end = buffer_.find("\r\n");
-  auto first_space = buffer_.find(' ');
-  if (first_space == std::string::npos || first_space + 1 >= first_line_end) {
+  auto first_line_end = header.find("\r\n");
+  base::StringPiece request_line = header.substr(0, first_line_end);
+  auto first_space = request_line.find(' ');
+  if (first_space == base::StringPiece::npos ||
+      first_space + 1 >= request_line.size()) {
     return ERR_INVALID_ARGUMENT;
   }
-  if (buffer_.compare(0, first_space, "CONNECT") != 0) {
-    return ERR_INVALID_ARGUMENT;
+
+  // Header lines are looked at in place instead of being collected.
+  bool has_padding = false;
+  bool authorized = proxy_authorization_.empty();
+  base::StringPiece lines = header;
+  for (auto line_end = first_line_end; line_end != base::StringPiece::npos;) {
+    lines.remove_prefix(line_end + 2);
+    line_end = lines.find("\r\n");
+    base::StringPiece line = lines.substr(0, line_end);
+    auto colon = line.find(':');
+    if (colon == base::StringPiece::npos)
+      continue;
+    base::StringPiece name =
+        base::TrimWhitespaceASCII(line.substr(0, colon), base::TRIM_ALL);
+    if (base::EqualsCaseInsensitiveASCII(name, "padding")) {
+      has_padding = true;
+    } else if (!authorized &&
+               base::EqualsCaseInsensitiveASCII(name, "proxy-authorization")) {
+      authorized = base::TrimWhitespaceASCII(line.substr(colon + 1),
+                                             base::TRIM_ALL) ==
+                   proxy_authorization_;
+    }
+  }
+  if (!authorized)
+    return ERR_INVALID_AUTH_CREDENTIALS;
+
+  if (request_line.substr(0, first_space) != "CONNECT") {
+    // Plain HTTP requests to a forward proxy name the URL in absolute form.
+    if (!base::StartsWith(request_line.substr(first_space + 1), "http://",
+                          base::CompareCase::INSENSITIVE_ASCII)) {
+      return ERR_INVALID_ARGUMENT;
+    }
+    forwarding_ = true;
+    padding_detector_delegate_->SetClientPaddingSupport(
+        PaddingSupport::kIncapable);
+    return OK;
   }
-  auto second_space = buffer_.find(' ', first_space + 1);
-  if (second_space == std::string::npos || second_space >= first_line_end) {
+  auto second_space = request_line.find(' ', first_space + 1);
+  if (second_space == base::StringPiece::npos) {
     return ERR_INVALID_ARGUMENT;
   }
   request_endpoint_ = HostPortPair::FromString(
-      buffer_.substr(first_space + 1, second_space - (first_space + 1)));
-
-  auto second_line = first_line_end + 2;
-  HttpRequestHeaders headers;
-  std::string headers_str;
-  if (second_line < header_end) {
-    headers_str = buffer_.substr(second_line, header_end - second_line);
-    headers.AddHeadersFromString(headers_str);
-  }
-  if (headers.HasHeader("padding")) {
+      request_line.substr(first_space + 1, second_space - (first_space + 1)));
+
+  if (has_padding) {
     padding_detector_delegate_->SetClientPaddingSupport(
         PaddingSupport::kCapable);
   } else {
     padding_detector_delegate_->SetClientPaddingSupport(
         PaddingSupport::kIncapable);
   }
-
-  buffer_ = buffer_.substr(header_end + 4);
-
-  next_state_ = STATE_HEADER_WRITE;
   return OK;
 }
 
 int HttpProxySocket::DoHeaderWrite() {
   next_state_ = STATE_HEADER_WRITE_COMPLETE;
 
+  if (auth_required_) {
+    header_write_size_ = kAuthRequiredResponseSize;
+    handshake_buf_ = base::MakeRefCounted<IOBuffer>(header_write_size_);
+    std::memcpy(handshake_buf_->data(), kAuthRequiredResponse,
+                header_write_size_);
+    return transport_->Write(handshake_buf_.get(), header_write_size_,
+                             io_callback_, traffic_annotation_);
+  }
+
   // Adds padding.
   int padding_size = base::RandInt(kMinPaddingSize, kMaxPaddingSize);
   header_write_size_ = kResponseHeaderSize + padding_size + 4;
@@ -340,6 +420,9 @@ int HttpProxySocket::DoHeaderWriteComplete(int result) {
     return ERR_FAILED;
   }
 
+  if (auth_required_)
+    return ERR_INVALID_AUTH_CREDENTIALS;
+
   completed_handshake_ = true;
   next_state_ = STATE_NONE;
   return OK;
@@ -12,6 +12,7 @@
 #include <string>
 
 #include "base/memory/scoped_refptr.h"
+#include "base/strings/string_piece.h"
 #include "net/base/completion_once_callback.h"
 #include "net/base/completion_repeating_callback.h"
 #include "net/base/host_port_pair.h"
@@ -30,8 +31,11 @@ class ClientPaddingDetectorDelegate;
 // This StreamSocket is used to setup a HTTP CONNECT tunnel.
 class HttpProxySocket : public StreamSocket {
  public:
+  // Unless |proxy_authorization| is empty, requests must carry it as their
+  // Proxy-Authorization header, e.g. "Basic dXNlcjpwYXNz".
   HttpProxySocket(std::unique_ptr<StreamSocket> transport_socket,
                   ClientPaddingDetectorDelegate* padding_detector_delegate,
+                  const std::string& proxy_authorization,
                   const NetworkTrafficAnnotationTag& traffic_annotation);
   HttpProxySocket(const HttpProxySocket&) = delete;
   HttpProxySocket& operator=(const HttpProxySocket&) = delete;
@@ -41,6 +45,10 @@ class HttpProxySocket : public StreamSocket {
 
   const HostPortPair& request_endpoint() const;
 
+  // Whether the client sent a plain HTTP request for HttpForwarder instead of
+  // CONNECT. The request is then returned by Read() as it was received.
+  bool is_forwarding() const { return forwarding_; }
+
   // StreamSocket implementation.
 
   int Connect(CompletionOnceCallback callback) override;
@@ -88,24 +96,38 @@ class HttpProxySocket : public StreamSocket {
   int DoHeaderWriteComplete(int result);
   int DoHeaderRead();
   int DoHeaderReadComplete(int result);
+  // Parses the CONNECT request in |header|, which ends before the blank line.
+  int ParseHeader(base::StringPiece header);
 
   CompletionRepeatingCallback io_callback_;
 
   // Stores the underlying socket.
   std::unique_ptr<StreamSocket> transport_;
   ClientPaddingDetectorDelegate* padding_detector_delegate_;
+  std::string proxy_authorization_;
 
   State next_state_;
 
   // Stores the callback to the layer above, called on completing Connect().
   CompletionOnceCallback user_callback_;
 
-  // This IOBuffer is used by the class to read and write
-  // SOCKS handshake data. The length contains the expected size to
-  // read or write.
+  // This IOBuffer is used by the class to write the response header.
   scoped_refptr<IOBuffer> handshake_buf_;
 
-  std::string buffer_;
+  // Holds the request header as it is read, and afterwards the data read
+  // along with it until Read() has returned all of it. Bytes in
+  // [read_start_, read_end_) are not consumed yet.
+  scoped_refptr<GrowableIOBuffer> read_buf_;
+  int read_start_;
+  int read_end_;
+  // Where to resume searching for the end of the header, so that bytes are
+  // only scanned once however the header is split across reads.
+  int scan_start_;
+
+  bool forwarding_;
+  // Whether the request lacked the listen credentials, in which case a 407
+  // challenge is written instead of 200 before failing.
+  bool auth_required_;
   bool completed_handshake_;
   bool was_ever_used_;
   int header_write_size_;
@@ -0,0 +1,184 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#include "net/tools/naive/https_proxy_server_socket.h"
+
+#include <utility>
+
+#include "base/bind.h"
+#include "base/check.h"
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/threading/thread_task_runner_handle.h"
+#include "net/base/net_errors.h"
+#include "net/socket/ssl_server_socket.h"
+#include "net/socket/stream_socket.h"
+#include "net/tools/naive/http2_proxy_session.h"
+
+namespace net {
+
+HttpsProxyServerSocket::HttpsProxyServerSocket(
+    std::unique_ptr<ServerSocket> transport,
+    std::unique_ptr<SSLServerContext> context,
+    const std::string& proxy_authorization,
+    const NetworkTrafficAnnotationTag& traffic_annotation)
+    : transport_(std::move(transport)),
+      context_(std::move(context)),
+      proxy_authorization_(proxy_authorization),
+      accepting_(false),
+      accept_error_(OK),
+      last_connection_id_(0),
+      user_socket_(nullptr),
+      traffic_annotation_(traffic_annotation) {
+  DCHECK(transport_);
+  DCHECK(context_);
+}
+
+HttpsProxyServerSocket::~HttpsProxyServerSocket() = default;
+
+int HttpsProxyServerSocket::Listen(const IPEndPoint& address, int backlog) {
+  return transport_->Listen(address, backlog);
+}
+
+int HttpsProxyServerSocket::GetLocalAddress(IPEndPoint* address) const {
+  if (!transport_)
+    return ERR_SOCKET_NOT_CONNECTED;
+  return transport_->GetLocalAddress(address);
+}
+
+int HttpsProxyServerSocket::Accept(std::unique_ptr<StreamSocket>* socket,
+                                   CompletionOnceCallback callback) {
+  DCHECK(!user_callback_);
+
+  // Connections are accepted and handshaken regardless of Accept() calls
+  // from the first one on.
+  if (!accepting_) {
+    accepting_ = true;
+    DoAcceptLoop();
+  }
+
+  if (!ready_sockets_.empty()) {
+    *socket = std::move(ready_sockets_.front());
+    ready_sockets_.pop_front();
+    return OK;
+  }
+  if (accept_error_ != OK)
+    return accept_error_;
+
+  user_socket_ = socket;
+  user_callback_ = std::move(callback);
+  return ERR_IO_PENDING;
+}
+
+void HttpsProxyServerSocket::StopListening() {
+  transport_.reset();
+  for (auto& [connection_id, session] : sessions_)
+    session->Shutdown();
+}
+
+void HttpsProxyServerSocket::DoAcceptLoop() {
+  if (!transport_)
+    return;
+  int result;
+  do {
+    result = transport_->Accept(
+        &accepted_socket_,
+        base::BindOnce(&HttpsProxyServerSocket::OnAcceptComplete,
+                       weak_ptr_factory_.GetWeakPtr()));
+    if (result == ERR_IO_PENDING)
+      return;
+    HandleAcceptResult(result);
+  } while (result == OK);
+}
+
+void HttpsProxyServerSocket::OnAcceptComplete(int result) {
+  HandleAcceptResult(result);
+  if (result == OK)
+    DoAcceptLoop();
+}
+
+void HttpsProxyServerSocket::HandleAcceptResult(int result) {
+  if (result != OK) {
+    accept_error_ = result;
+    if (user_callback_) {
+      user_socket_ = nullptr;
+      base::ThreadTaskRunnerHandle::Get()->PostTask(
+          FROM_HERE, base::BindOnce(std::move(user_callback_), result));
+    }
+    return;
+  }
+
+  std::unique_ptr<SSLServerSocket> socket =
+      context_->CreateSSLServerSocket(std::move(accepted_socket_));
+  unsigned int connection_id = ++last_connection_id_;
+  int rv = socket->Handshake(
+      base::BindOnce(&HttpsProxyServerSocket::OnHandshakeComplete,
+                     weak_ptr_factory_.GetWeakPtr(), connection_id));
+  if (rv == ERR_IO_PENDING) {
+    handshakes_[connection_id] = std::move(socket);
+    return;
+  }
+  HandleHandshakeResult(connection_id, std::move(socket), rv);
+}
+
+void HttpsProxyServerSocket::OnHandshakeComplete(unsigned int connection_id,
+                                                 int result) {
+  auto it = handshakes_.find(connection_id);
+  if (it == handshakes_.end())
+    return;
+  std::unique_ptr<SSLServerSocket> socket = std::move(it->second);
+  handshakes_.erase(it);
+  HandleHandshakeResult(connection_id, std::move(socket), result);
+}
+
+void HttpsProxyServerSocket::HandleHandshakeResult(
+    unsigned int connection_id,
+    std::unique_ptr<SSLServerSocket> socket,
+    int result) {
+  if (result != OK) {
+    LOG(INFO) << "TLS handshake failed: " << ErrorToShortString(result);
+    return;
+  }
+  if (socket->GetNegotiatedProtocol() != kProtoHTTP2) {
+    AddReadySocket(std::move(socket));
+    return;
+  }
+
+  auto session_ptr = std::make_unique<Http2ProxySession>(
+      std::move(socket), proxy_authorization_,
+      base::BindRepeating(&HttpsProxyServerSocket::OnStreamAccepted,
+                          weak_ptr_factory_.GetWeakPtr()),
+      base::BindOnce(&HttpsProxyServerSocket::OnSessionClosed,
+                     weak_ptr_factory_.GetWeakPtr(), connection_id),
+      traffic_annotation_);
+  auto* session = session_ptr.get();
+  sessions_[connection_id] = std::move(session_ptr);
+  session->Start();
+  // Finished its handshake after StopListening().
+  if (!transport_)
+    session->Shutdown();
+}
+
+void HttpsProxyServerSocket::OnStreamAccepted(
+    std::unique_ptr<Http2ProxyStream> stream) {
+  AddReadySocket(std::move(stream));
+}
+
+void HttpsProxyServerSocket::OnSessionClosed(unsigned int connection_id) {
+  sessions_.erase(connection_id);
+}
+
+void HttpsProxyServerSocket::AddReadySocket(
+    std::unique_ptr<StreamSocket> socket) {
+  if (!user_callback_) {
+    ready_sockets_.push_back(std::move(socket));
+    return;
+  }
+  *user_socket_ = std::move(socket);
+  user_socket_ = nullptr;
+  // Not run from inside the session, which the new connection may use.
+  base::ThreadTaskRunnerHandle::Get()->PostTask(
+      FROM_HERE, base::BindOnce(std::move(user_callback_), OK));
+}
+
+}  // namespace net
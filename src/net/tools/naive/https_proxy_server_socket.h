@@ -0,0 +1,90 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#ifndef NET_TOOLS_NAIVE_HTTPS_PROXY_SERVER_SOCKET_H_
+#define NET_TOOLS_NAIVE_HTTPS_PROXY_SERVER_SOCKET_H_
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "base/containers/circular_deque.h"
+#include "base/memory/weak_ptr.h"
+#include "net/base/completion_once_callback.h"
+#include "net/socket/server_socket.h"
+
+namespace net {
+
+class Http2ProxySession;
+class Http2ProxyStream;
+class SSLServerContext;
+class SSLServerSocket;
+class StreamSocket;
+struct NetworkTrafficAnnotationTag;
+
+// Terminates TLS on connections accepted by another ServerSocket. Connections
+// negotiating h2 are served by an Http2ProxySession, and Accept() returns
+// each of their CONNECT streams. Other connections are returned as they are,
+// to be read as HTTP/1.1 proxy requests.
+class HttpsProxyServerSocket : public ServerSocket {
+ public:
+  HttpsProxyServerSocket(std::unique_ptr<ServerSocket> transport,
+                         std::unique_ptr<SSLServerContext> context,
+                         const std::string& proxy_authorization,
+                         const NetworkTrafficAnnotationTag& traffic_annotation);
+  ~HttpsProxyServerSocket() override;
+  HttpsProxyServerSocket(const HttpsProxyServerSocket&) = delete;
+  HttpsProxyServerSocket& operator=(const HttpsProxyServerSocket&) = delete;
+
+  // ServerSocket implementation.
+  int Listen(const IPEndPoint& address, int backlog) override;
+  int GetLocalAddress(IPEndPoint* address) const override;
+  int Accept(std::unique_ptr<StreamSocket>* socket,
+             CompletionOnceCallback callback) override;
+
+  // Closes the transport, and asks h2 clients to open no more streams on
+  // their connections. Connections already accepted are kept, and streams
+  // the clients still open on them are returned by Accept().
+  void StopListening();
+
+ private:
+  void DoAcceptLoop();
+  void OnAcceptComplete(int result);
+  void HandleAcceptResult(int result);
+
+  void OnHandshakeComplete(unsigned int connection_id, int result);
+  void HandleHandshakeResult(unsigned int connection_id,
+                             std::unique_ptr<SSLServerSocket> socket,
+                             int result);
+
+  void OnStreamAccepted(std::unique_ptr<Http2ProxyStream> stream);
+  void OnSessionClosed(unsigned int connection_id);
+
+  // Hands |socket| to the pending Accept(), or keeps it for the next one.
+  void AddReadySocket(std::unique_ptr<StreamSocket> socket);
+
+  std::unique_ptr<ServerSocket> transport_;
+  std::unique_ptr<SSLServerContext> context_;
+  std::string proxy_authorization_;
+
+  bool accepting_;
+  std::unique_ptr<StreamSocket> accepted_socket_;
+  // Set once the transport fails to accept, for the next Accept().
+  int accept_error_;
+
+  // Connections in the TLS handshake, then those serving h2, by ID.
+  unsigned int last_connection_id_;
+  std::map<unsigned int, std::unique_ptr<SSLServerSocket>> handshakes_;
+  std::map<unsigned int, std::unique_ptr<Http2ProxySession>> sessions_;
+
+  base::circular_deque<std::unique_ptr<StreamSocket>> ready_sockets_;
+  std::unique_ptr<StreamSocket>* user_socket_;
+  CompletionOnceCallback user_callback_;
+
+  const NetworkTrafficAnnotationTag& traffic_annotation_;
+
+  base::WeakPtrFactory<HttpsProxyServerSocket> weak_ptr_factory_{this};
+};
+
+}  // namespace net
+#endif  // NET_TOOLS_NAIVE_HTTPS_PROXY_SERVER_SOCKET_H_
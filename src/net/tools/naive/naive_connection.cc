@@ -5,11 +5,13 @@
 
 #include "net/tools/naive/naive_connection.h"
 
+#include <algorithm>
 #include <cstring>
 #include <utility>
 
 #include "base/bind.h"
 #include "base/callback_helpers.h"
+#include "base/location.h"
 #include "base/logging.h"
 #include "base/rand_util.h"
 #include "base/strings/strcat.h"
@@ -21,14 +23,22 @@
 #include "net/base/net_errors.h"
 #include "net/base/privacy_mode.h"
 #include "net/base/url_util.h"
+#include "net/http/http_proxy_connect_job.h"
+#include "net/http/proxy_client_socket.h"
 #include "net/proxy_resolution/proxy_info.h"
+#include "net/quic/quic_proxy_client_socket.h"
 #include "net/socket/client_socket_handle.h"
 #include "net/socket/client_socket_pool_manager.h"
 #include "net/socket/stream_socket.h"
 #include "net/spdy/spdy_session.h"
+#include "net/tools/naive/connection_tracer.h"
+#include "net/tools/naive/http_forwarder.h"
+#include "net/tools/naive/http2_proxy_session.h"
 #include "net/tools/naive/http_proxy_socket.h"
 #include "net/tools/naive/redirect_resolver.h"
+#include "net/tools/naive/route_table.h"
 #include "net/tools/naive/socks5_server_socket.h"
+#include "net/tools/naive/speculative_tunnel_pool.h"
 #include "url/scheme_host_port.h"
 
 #if BUILDFLAG(IS_LINUX)
@@ -48,16 +58,37 @@ constexpr int kBufferSize = 64 * 1024;
 constexpr int kFirstPaddings = 8;
 constexpr int kPaddingHeaderSize = 3;
 constexpr int kMaxPaddingSize = 255;
+
+// Interactive tunnels, e.g. SSH, go ahead of everything else, and bulk ones
+// yield to all others. RFC 9218 urgencies are 0 and 4 respectively, against
+// the default of 3 that all tunnels otherwise get.
+constexpr RequestPriority kInteractiveTunnelPriority = HIGHEST;
+constexpr RequestPriority kBulkTunnelPriority = IDLE;
 }  // namespace
 
+TunnelPriorityPolicy::TunnelPriorityPolicy() = default;
+
+TunnelPriorityPolicy::TunnelPriorityPolicy(const TunnelPriorityPolicy&) =
+    default;
+
+TunnelPriorityPolicy& TunnelPriorityPolicy::operator=(
+    const TunnelPriorityPolicy&) = default;
+
+TunnelPriorityPolicy::~TunnelPriorityPolicy() = default;
+
 NaiveConnection::NaiveConnection(
     unsigned int id,
     ClientProtocol protocol,
     std::unique_ptr<PaddingDetectorDelegate> padding_detector_delegate,
     const ProxyInfo& proxy_info,
+    const ProxyInfo& direct_proxy_info,
+    const RouteTable* route_table,
     const SSLConfig& server_ssl_config,
     const SSLConfig& proxy_ssl_config,
     RedirectResolver* resolver,
+    SpeculativeTunnelPool* speculative_tunnel_pool,
+    ForwardTunnelPool* forward_tunnel_pool,
+    const TunnelPriorityPolicy& priority_policy,
     HttpNetworkSession* session,
     const NetworkAnonymizationKey& network_anonymization_key,
     const NetLogWithSource& net_log,
@@ -67,25 +98,39 @@ NaiveConnection::NaiveConnection(
       protocol_(protocol),
       padding_detector_delegate_(std::move(padding_detector_delegate)),
       proxy_info_(proxy_info),
+      direct_proxy_info_(direct_proxy_info),
+      route_table_(route_table),
       server_ssl_config_(server_ssl_config),
       proxy_ssl_config_(proxy_ssl_config),
       resolver_(resolver),
+      speculative_tunnel_pool_(speculative_tunnel_pool),
+      forward_tunnel_pool_(forward_tunnel_pool),
+      priority_policy_(priority_policy),
       session_(session),
       network_anonymization_key_(network_anonymization_key),
       net_log_(net_log),
       next_state_(STATE_NONE),
+      route_proxy_info_(&proxy_info),
       client_socket_(std::move(accepted_socket)),
       server_socket_handle_(std::make_unique<ClientSocketHandle>()),
       sockets_{client_socket_.get(), nullptr},
       errors_{OK, OK},
       write_pending_{false, false},
+      pulling_{false, false},
+      bytes_in_flight_{0, 0},
+      push_sizes_{0, 0},
+      max_bytes_in_flight_(kBufferSize),
       early_pull_pending_(false),
       can_push_to_server_(false),
       early_pull_result_(ERR_IO_PENDING),
       num_paddings_{0, 0},
       read_padding_state_(STATE_READ_PAYLOAD_LENGTH_1),
       full_duplex_(false),
+      early_data_retried_(false),
+      priority_(HttpProxyConnectJob::kH2QuicTunnelPriority),
+      bytes_passed_(0),
       time_func_(&base::TimeTicks::Now),
+      trace_(nullptr),
       traffic_annotation_(traffic_annotation) {
   io_callback_ = base::BindRepeating(&NaiveConnection::OnIOComplete,
                                      weak_ptr_factory_.GetWeakPtr());
@@ -114,6 +159,7 @@ int NaiveConnection::Connect(CompletionOnceCallback callback) {
 
 void NaiveConnection::Disconnect() {
   full_duplex_ = false;
+  forwarder_.reset();
   // Closes server side first because latency is higher.
   if (server_socket_handle_->socket())
     server_socket_handle_->socket()->Disconnect();
@@ -162,6 +208,13 @@ int NaiveConnection::DoLoop(int last_io_result) {
       case STATE_CONNECT_SERVER_COMPLETE:
         rv = DoConnectServerComplete(rv);
         break;
+      case STATE_CONFIRM_HANDSHAKE:
+        DCHECK_EQ(rv, OK);
+        rv = DoConfirmHandshake();
+        break;
+      case STATE_CONFIRM_HANDSHAKE_COMPLETE:
+        rv = DoConfirmHandshakeComplete(rv);
+        break;
       default:
         NOTREACHED() << "bad state";
         rv = ERR_UNEXPECTED;
@@ -181,6 +234,28 @@ int NaiveConnection::DoConnectClientComplete(int result) {
   if (result < 0)
     return result;
 
+  if (trace_)
+    trace_->handshake_time = time_func_();
+
+  // Plain HTTP requests are forwarded one by one, each to its own origin.
+  if (protocol_ == ClientProtocol::kHttp &&
+      static_cast<const HttpProxySocket*>(client_socket_.get())
+          ->is_forwarding()) {
+    forwarder_ = std::make_unique<HttpForwarder>(
+        id_, client_socket_.get(), forward_tunnel_pool_, proxy_info_,
+        direct_proxy_info_, route_table_, server_ssl_config_,
+        proxy_ssl_config_, session_, network_anonymization_key_, net_log_,
+        traffic_annotation_);
+    next_state_ = STATE_NONE;
+    return OK;
+  }
+
+  int rv = DetermineOrigin();
+  if (rv != OK)
+    return rv;
+  if (trace_)
+    trace_->origin = origin_.ToString();
+
   // For proxy client sockets, padding support detection is finished after the
   // first server response which means there will be one missed early pull. For
   // proxy server sockets (HttpProxySocket), padding support detection is
@@ -205,18 +280,19 @@ int NaiveConnection::DoConnectClientComplete(int result) {
   return OK;
 }
 
-int NaiveConnection::DoConnectServer() {
-  next_state_ = STATE_CONNECT_SERVER_COMPLETE;
-
-  HostPortPair origin;
+int NaiveConnection::DetermineOrigin() {
   if (protocol_ == ClientProtocol::kSocks5) {
     const auto* socket =
         static_cast<const Socks5ServerSocket*>(client_socket_.get());
-    origin = socket->request_endpoint();
+    origin_ = socket->request_endpoint();
   } else if (protocol_ == ClientProtocol::kHttp) {
     const auto* socket =
         static_cast<const HttpProxySocket*>(client_socket_.get());
-    origin = socket->request_endpoint();
+    origin_ = socket->request_endpoint();
+  } else if (protocol_ == ClientProtocol::kHttps) {
+    const auto* socket =
+        static_cast<const Http2ProxyStream*>(client_socket_.get());
+    origin_ = socket->request_endpoint();
   } else if (protocol_ == ClientProtocol::kRedir) {
 #if BUILDFLAG(IS_LINUX)
     const auto* socket =
@@ -242,9 +318,9 @@ int NaiveConnection::DoConnectServer() {
         const auto& addr = ipe.address();
         auto name = resolver_->FindNameByAddress(addr);
         if (!name.empty()) {
-          origin = HostPortPair(name, ipe.port());
+          origin_ = HostPortPair(name, ipe.port());
         } else if (!resolver_->IsInResolvedRange(addr)) {
-          origin = HostPortPair::FromIPEndPoint(ipe);
+          origin_ = HostPortPair::FromIPEndPoint(ipe);
         } else {
           LOG(ERROR) << "Connection " << id_ << " to unresolved name for "
                      << addr.ToString();
@@ -262,37 +338,158 @@ int NaiveConnection::DoConnectServer() {
 
   url::CanonHostInfo host_info;
   url::SchemeHostPort endpoint(
-      "http", CanonicalizeHost(origin.HostForURL(), &host_info), origin.port(),
-      url::SchemeHostPort::ALREADY_CANONICALIZED);
+      "http", CanonicalizeHost(origin_.HostForURL(), &host_info),
+      origin_.port(), url::SchemeHostPort::ALREADY_CANONICALIZED);
   if (!endpoint.IsValid()) {
     LOG(ERROR) << "Connection " << id_ << " to invalid origin "
-               << origin.ToString();
+               << origin_.ToString();
     return ERR_ADDRESS_INVALID;
   }
 
-  LOG(INFO) << "Connection " << id_ << " to " << origin.ToString();
+  LOG(INFO) << "Connection " << id_ << " to " << origin_.ToString();
+
+  if (!route_table_)
+    return OK;
+  switch (route_table_->Route(endpoint.host())) {
+    case RouteTable::Action::kProxy:
+      break;
+    case RouteTable::Action::kDirect:
+      LOG(INFO) << "Connection " << id_ << " goes direct";
+      route_proxy_info_ = &direct_proxy_info_;
+      // Nothing to pad to the origin.
+      padding_detector_delegate_->SetProxyServer(
+          direct_proxy_info_.proxy_server());
+      break;
+    case RouteTable::Action::kReject:
+      LOG(INFO) << "Connection " << id_ << " is rejected";
+      return ERR_BLOCKED_BY_CLIENT;
+  }
+
+  return OK;
+}
+
+int NaiveConnection::DoConnectServer() {
+  next_state_ = STATE_CONNECT_SERVER_COMPLETE;
+
+  if (trace_)
+    trace_->connect_start_time = time_func_();
+
+  if (priority_policy_.interactive_ports.count(origin_.port()))
+    priority_ = kInteractiveTunnelPriority;
+
+  // Speculative tunnels only go through the proxy.
+  if (speculative_tunnel_pool_ && route_proxy_info_ == &proxy_info_) {
+    speculative_tunnel_ = speculative_tunnel_pool_->Take(origin_);
+    if (speculative_tunnel_) {
+      LOG(INFO) << "Connection " << id_ << " adopts speculative tunnel";
+      int rv = speculative_tunnel_->result();
+      if (rv == ERR_IO_PENDING)
+        speculative_tunnel_->SetCallback(io_callback_);
+      return rv;
+    }
+  }
+
+  // Already validated by DetermineOrigin().
+  url::CanonHostInfo host_info;
+  url::SchemeHostPort endpoint(
+      "http", CanonicalizeHost(origin_.HostForURL(), &host_info),
+      origin_.port(), url::SchemeHostPort::ALREADY_CANONICALIZED);
 
   // Ignores socket limit set by socket pool for this type of socket.
   return InitSocketHandleForRawConnect2(
       std::move(endpoint), LOAD_IGNORE_LIMITS, MAXIMUM_PRIORITY, session_,
-      proxy_info_, server_ssl_config_, proxy_ssl_config_, PRIVACY_MODE_DISABLED,
-      network_anonymization_key_, net_log_, server_socket_handle_.get(),
-      io_callback_);
+      *route_proxy_info_, server_ssl_config_, proxy_ssl_config_,
+      PRIVACY_MODE_DISABLED, network_anonymization_key_,
+      SecureDnsPolicy::kAllow, net_log_,
+      server_socket_handle_.get(), io_callback_);
 }
 
 int NaiveConnection::DoConnectServerComplete(int result) {
-  if (result < 0)
+  if (result < 0) {
+    if (MaybeRetryEarlyData(result))
+      return ERR_IO_PENDING;
     return result;
+  }
 
+  if (speculative_tunnel_)
+    server_socket_handle_ = speculative_tunnel_->PassHandle();
   DCHECK(server_socket_handle_->socket());
   sockets_[kServer] = server_socket_handle_->socket();
+  // Buffers are never reused after being written to the server, see Pull().
+  if (route_proxy_info_->proxy_server().is_quic()) {
+    static_cast<QuicProxyClientSocket*>(sockets_[kServer])
+        ->set_zero_copy_writes(true);
+  }
+  // The socket pool opens all tunnels at kH2QuicTunnelPriority.
+  if (priority_ != HttpProxyConnectJob::kH2QuicTunnelPriority)
+    SetPriority(priority_);
+
+  next_state_ = STATE_CONFIRM_HANDSHAKE;
+  return OK;
+}
+
+int NaiveConnection::DoConfirmHandshake() {
+  next_state_ = STATE_CONFIRM_HANDSHAKE_COMPLETE;
+  // The tunnel request may have gone out as TLS early data, which can be
+  // replayed. Client data must wait until the handshake is confirmed.
+  return sockets_[kServer]->ConfirmHandshake(io_callback_);
+}
+
+int NaiveConnection::DoConfirmHandshakeComplete(int result) {
+  if (result < 0) {
+    if (MaybeRetryEarlyData(result))
+      return ERR_IO_PENDING;
+    return result;
+  }
+
+  if (trace_)
+    trace_->connect_end_time = time_func_();
 
   full_duplex_ = true;
   next_state_ = STATE_NONE;
   return OK;
 }
 
+bool NaiveConnection::MaybeRetryEarlyData(int result) {
+  if (result != ERR_EARLY_DATA_REJECTED &&
+      result != ERR_WRONG_VERSION_ON_EARLY_DATA) {
+    return false;
+  }
+  if (early_data_retried_)
+    return false;
+  early_data_retried_ = true;
+
+  // Nothing from the client has been sent to the proxy, and the session cache
+  // no longer offers early data for it, so it is safe to connect again. This
+  // happens in a new task because the failed session is still shutting down.
+  LOG(INFO) << "Connection " << id_ << " retries after early data rejected";
+  next_state_ = STATE_CONNECT_SERVER;
+  base::ThreadTaskRunnerHandle::Get()->PostTask(
+      FROM_HERE, base::BindOnce(&NaiveConnection::RetryConnectServer,
+                                weak_ptr_factory_.GetWeakPtr()));
+  return true;
+}
+
+void NaiveConnection::RetryConnectServer() {
+  speculative_tunnel_.reset();
+  sockets_[kServer] = nullptr;
+  server_socket_handle_ = std::make_unique<ClientSocketHandle>();
+  OnIOComplete(OK);
+}
+
+void NaiveConnection::SetPriority(RequestPriority priority) {
+  DCHECK(sockets_[kServer]);
+  priority_ = priority;
+  if (route_proxy_info_->proxy_server().is_http_like()) {
+    static_cast<ProxyClientSocket*>(sockets_[kServer])
+        ->SetStreamPriority(priority);
+  }
+}
+
 int NaiveConnection::Run(CompletionOnceCallback callback) {
+  if (forwarder_)
+    return forwarder_->Run(std::move(callback));
+
   DCHECK(sockets_[kClient]);
   DCHECK(sockets_[kServer]);
   DCHECK_EQ(next_state_, STATE_NONE);
@@ -319,7 +516,8 @@ int NaiveConnection::Run(CompletionOnceCallback callback) {
     Pull(kClient, kServer);
   } else if (!early_pull_pending_) {
     DCHECK_GT(early_pull_result_, 0);
-    Push(kClient, kServer, early_pull_result_);
+    Push(kClient, kServer, std::move(read_buffers_[kClient]),
+         early_pull_result_);
   }
   Pull(kServer, kClient);
 
@@ -327,6 +525,7 @@ int NaiveConnection::Run(CompletionOnceCallback callback) {
 }
 
 void NaiveConnection::Pull(Direction from, Direction to) {
+  pulling_[from] = true;
   if (errors_[kClient] < 0 || errors_[kServer] < 0)
     return;
 
@@ -355,7 +554,14 @@ void NaiveConnection::Pull(Direction from, Direction to) {
     OnPullComplete(from, to, rv);
 }
 
-void NaiveConnection::Push(Direction from, Direction to, int size) {
+void NaiveConnection::Push(Direction from,
+                           Direction to,
+                           scoped_refptr<IOBuffer> buffer,
+                           int size) {
+  if (trace_)
+    push_start_time_[to] = time_func_();
+  push_sizes_[from] = size;
+
   int write_size = size;
   int write_offset = 0;
   auto padding_direction = padding_detector_delegate_->GetPaddingDirection();
@@ -363,9 +569,9 @@ void NaiveConnection::Push(Direction from, Direction to, int size) {
     // Adds padding.
     ++num_paddings_[from];
     int padding_size = base::RandInt(0, kMaxPaddingSize);
-    auto* buffer = static_cast<GrowableIOBuffer*>(read_buffers_[from].get());
-    buffer->set_offset(0);
-    uint8_t* p = reinterpret_cast<uint8_t*>(buffer->data());
+    auto* padded_buffer = static_cast<GrowableIOBuffer*>(buffer.get());
+    padded_buffer->set_offset(0);
+    uint8_t* p = reinterpret_cast<uint8_t*>(padded_buffer->data());
     p[0] = size / 256;
     p[1] = size % 256;
     p[2] = padding_size;
@@ -373,7 +579,7 @@ void NaiveConnection::Push(Direction from, Direction to, int size) {
     write_size = kPaddingHeaderSize + size + padding_size;
   } else if (to == padding_direction && num_paddings_[from] < kFirstPaddings) {
     // Removes padding.
-    const char* p = read_buffers_[from]->data();
+    const char* p = buffer->data();
     bool trivial_padding = false;
     if (read_padding_state_ == STATE_READ_PAYLOAD_LENGTH_1 &&
         size >= kPaddingHeaderSize) {
@@ -441,7 +647,7 @@ void NaiveConnection::Push(Direction from, Direction to, int size) {
         }
       }
       write_size = unpadded_ptr - unpadded_buffer->data();
-      read_buffers_[from] = unpadded_buffer;
+      buffer = unpadded_buffer;
     }
     if (write_size == 0) {
       OnPushComplete(from, to, OK);
@@ -450,7 +656,7 @@ void NaiveConnection::Push(Direction from, Direction to, int size) {
   }
 
   write_buffers_[to] = base::MakeRefCounted<DrainableIOBuffer>(
-      std::move(read_buffers_[from]), write_offset + write_size);
+      std::move(buffer), write_offset + write_size);
   if (write_offset) {
     write_buffers_[to]->DidConsume(write_offset);
   }
@@ -519,6 +725,7 @@ void NaiveConnection::OnPushError(Direction from, Direction to, int error) {
 }
 
 void NaiveConnection::OnPullComplete(Direction from, Direction to, int result) {
+  pulling_[from] = false;
   if (from == kClient && early_pull_pending_) {
     early_pull_pending_ = false;
     early_pull_result_ = result ? result : ERR_CONNECTION_CLOSED;
@@ -529,15 +736,42 @@ void NaiveConnection::OnPullComplete(Direction from, Direction to, int result) {
     return;
   }
 
+  if (trace_) {
+    if (trace_->first_byte_time[from].is_null())
+      trace_->first_byte_time[from] = time_func_();
+    trace_->bytes[from] += result;
+  }
+
+  bytes_in_flight_[from] += result;
+
   if (from == kClient && !can_push_to_server_)
     return;
 
-  Push(from, to, result);
+  // The other side is gone, and this one follows once its write is done.
+  if (!IsConnected(to)) {
+    bytes_in_flight_[from] -= result;
+    return;
+  }
+
+  // Data pulled while the previous write is pending waits its turn.
+  if (write_pending_[to]) {
+    pending_pushes_[from].emplace_back(std::move(read_buffers_[from]), result);
+  } else {
+    Push(from, to, std::move(read_buffers_[from]), result);
+  }
+  SchedulePull(from, to);
 }
 
 void NaiveConnection::OnPushComplete(Direction from, Direction to, int result) {
   if (result >= 0 && write_buffers_[to] != nullptr) {
     bytes_passed_without_yielding_[from] += result;
+    bytes_passed_ += result;
+    if (priority_policy_.bulk_after_bytes > 0 &&
+        bytes_passed_ >= priority_policy_.bulk_after_bytes &&
+        priority_ != kBulkTunnelPriority && sockets_[kServer]) {
+      LOG(INFO) << "Connection " << id_ << " demoted to bulk";
+      SetPriority(kBulkTunnelPriority);
+    }
     write_buffers_[to]->DidConsume(result);
     int size = write_buffers_[to]->BytesRemaining();
     if (size > 0) {
@@ -553,9 +787,40 @@ void NaiveConnection::OnPushComplete(Direction from, Direction to, int result) {
   }
 
   write_pending_[to] = false;
-  // Checks for termination even if result is OK.
-  OnPushError(from, to, result >= 0 ? OK : result);
+  bytes_in_flight_[from] -= push_sizes_[from];
+  if (trace_ && result >= 0) {
+    base::TimeDelta duration = time_func_() - push_start_time_[to];
+    if (duration >= stall_threshold_) {
+      ++trace_->num_stalls[to];
+      trace_->stall_duration[to] += duration;
+      trace_->max_stall_duration[to] =
+          std::max(trace_->max_stall_duration[to], duration);
+    }
+  }
+
+  if (result >= 0 && !pending_pushes_[from].empty() && IsConnected(to)) {
+    auto [buffer, size] = std::move(pending_pushes_[from].front());
+    pending_pushes_[from].pop_front();
+    Push(from, to, std::move(buffer), size);
+  } else {
+    for (const auto& [buffer, size] : pending_pushes_[from])
+      bytes_in_flight_[from] -= size;
+    pending_pushes_[from].clear();
+    // Checks for termination even if result is OK.
+    OnPushError(from, to, result >= 0 ? OK : result);
+  }
+
+  SchedulePull(from, to);
+}
+
+void NaiveConnection::SchedulePull(Direction from, Direction to) {
+  if (pulling_[from] || !IsConnected(from) || !IsConnected(to))
+    return;
+  // Every pull may fill a whole buffer.
+  if (bytes_in_flight_[from] + kBufferSize > max_bytes_in_flight_)
+    return;
 
+  pulling_[from] = true;
   if (bytes_passed_without_yielding_[from] > kYieldAfterBytesRead ||
       time_func_() > yield_after_time_[from]) {
     bytes_passed_without_yielding_[from] = 0;
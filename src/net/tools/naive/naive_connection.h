@@ -6,21 +6,31 @@
 #ifndef NET_TOOLS_NAIVE_NAIVE_CONNECTION_H_
 #define NET_TOOLS_NAIVE_NAIVE_CONNECTION_H_
 
+#include <stdint.h>
+
 #include <memory>
+#include <set>
 #include <string>
+#include <utility>
 
+#include "base/containers/circular_deque.h"
 #include "base/memory/scoped_refptr.h"
 #include "base/memory/weak_ptr.h"
 #include "base/time/time.h"
 #include "net/base/completion_once_callback.h"
 #include "net/base/completion_repeating_callback.h"
+#include "net/base/host_port_pair.h"
+#include "net/base/request_priority.h"
 #include "net/tools/naive/naive_protocol.h"
 #include "net/tools/naive/naive_proxy_delegate.h"
 
 namespace net {
 
 class ClientSocketHandle;
+struct ConnectionTrace;
 class DrainableIOBuffer;
+class ForwardTunnelPool;
+class HttpForwarder;
 class HttpNetworkSession;
 class IOBuffer;
 class NetLogWithSource;
@@ -30,6 +40,24 @@ struct NetworkTrafficAnnotationTag;
 struct SSLConfig;
 class RedirectResolver;
 class NetworkAnonymizationKey;
+class RouteTable;
+class SpeculativeTunnel;
+class SpeculativeTunnelPool;
+
+// How tunnels are prioritized against each other when they share an HTTP/2 or
+// HTTP/3 session to the proxy.
+struct TunnelPriorityPolicy {
+  TunnelPriorityPolicy();
+  TunnelPriorityPolicy(const TunnelPriorityPolicy&);
+  TunnelPriorityPolicy& operator=(const TunnelPriorityPolicy&);
+  ~TunnelPriorityPolicy();
+
+  // Tunnels to these destination ports start out interactive.
+  std::set<uint16_t> interactive_ports;
+  // Tunnels are demoted to bulk after passing this many bytes in either
+  // direction. Zero never demotes them.
+  int64_t bulk_after_bytes = 0;
+};
 
 class NaiveConnection {
  public:
@@ -40,9 +68,14 @@ class NaiveConnection {
       ClientProtocol protocol,
       std::unique_ptr<PaddingDetectorDelegate> padding_detector_delegate,
       const ProxyInfo& proxy_info,
+      const ProxyInfo& direct_proxy_info,
+      const RouteTable* route_table,
       const SSLConfig& server_ssl_config,
       const SSLConfig& proxy_ssl_config,
       RedirectResolver* resolver,
+      SpeculativeTunnelPool* speculative_tunnel_pool,
+      ForwardTunnelPool* forward_tunnel_pool,
+      const TunnelPriorityPolicy& priority_policy,
       HttpNetworkSession* session,
       const NetworkAnonymizationKey& network_anonymization_key,
       const NetLogWithSource& net_log,
@@ -53,6 +86,18 @@ class NaiveConnection {
   NaiveConnection& operator=(const NaiveConnection&) = delete;
 
   unsigned int id() const { return id_; }
+
+  // Allows reading up to |size| bytes from each side ahead of writing them
+  // to the other, in buffers of 64 KiB. Defaults to one buffer.
+  void set_max_bytes_in_flight(int size) { max_bytes_in_flight_ = size; }
+
+  // Records the timing of the connection in |trace| until it is reset to
+  // nullptr. Writes stalled for |stall_threshold| are counted.
+  void set_trace(ConnectionTrace* trace, base::TimeDelta stall_threshold) {
+    trace_ = trace;
+    stall_threshold_ = stall_threshold;
+  }
+
   int Connect(CompletionOnceCallback callback);
   void Disconnect();
   int Run(CompletionOnceCallback callback);
@@ -63,6 +108,8 @@ class NaiveConnection {
     STATE_CONNECT_CLIENT_COMPLETE,
     STATE_CONNECT_SERVER,
     STATE_CONNECT_SERVER_COMPLETE,
+    STATE_CONFIRM_HANDSHAKE,
+    STATE_CONFIRM_HANDSHAKE_COMPLETE,
     STATE_NONE,
   };
 
@@ -79,10 +126,25 @@ class NaiveConnection {
   int DoLoop(int last_io_result);
   int DoConnectClient();
   int DoConnectClientComplete(int result);
+  // Finds the origin requested by the client and how to connect to it.
+  int DetermineOrigin();
   int DoConnectServer();
   int DoConnectServerComplete(int result);
+  int DoConfirmHandshake();
+  int DoConfirmHandshakeComplete(int result);
+  // Returns true if the server connection is going to be retried because the
+  // proxy rejected TLS early data.
+  bool MaybeRetryEarlyData(int result);
+  void RetryConnectServer();
+  // Reprioritizes the tunnel stream, if the server connection is one.
+  void SetPriority(RequestPriority priority);
   void Pull(Direction from, Direction to);
-  void Push(Direction from, Direction to, int size);
+  // Pulls again unless a pull is pending or the in-flight budget is used up.
+  void SchedulePull(Direction from, Direction to);
+  void Push(Direction from,
+            Direction to,
+            scoped_refptr<IOBuffer> buffer,
+            int size);
   void Disconnect(Direction side);
   bool IsConnected(Direction side);
   void OnBothDisconnected();
@@ -95,9 +157,14 @@ class NaiveConnection {
   ClientProtocol protocol_;
   std::unique_ptr<PaddingDetectorDelegate> padding_detector_delegate_;
   const ProxyInfo& proxy_info_;
+  const ProxyInfo& direct_proxy_info_;
+  const RouteTable* route_table_;
   const SSLConfig& server_ssl_config_;
   const SSLConfig& proxy_ssl_config_;
   RedirectResolver* resolver_;
+  SpeculativeTunnelPool* speculative_tunnel_pool_;
+  ForwardTunnelPool* forward_tunnel_pool_;
+  const TunnelPriorityPolicy& priority_policy_;
   HttpNetworkSession* session_;
   const NetworkAnonymizationKey& network_anonymization_key_;
   const NetLogWithSource& net_log_;
@@ -108,14 +175,31 @@ class NaiveConnection {
 
   State next_state_;
 
+  HostPortPair origin_;
+  // Either |proxy_info_| or |direct_proxy_info_|, as routed for |origin_|.
+  const ProxyInfo* route_proxy_info_;
+
   std::unique_ptr<StreamSocket> client_socket_;
   std::unique_ptr<ClientSocketHandle> server_socket_handle_;
+  // Set while adopting a tunnel opened by |speculative_tunnel_pool_|.
+  std::unique_ptr<SpeculativeTunnel> speculative_tunnel_;
+  // Set if the client sends plain HTTP requests instead of CONNECT.
+  std::unique_ptr<HttpForwarder> forwarder_;
 
   StreamSocket* sockets_[kNumDirections];
   scoped_refptr<IOBuffer> read_buffers_[kNumDirections];
   scoped_refptr<DrainableIOBuffer> write_buffers_[kNumDirections];
   int errors_[kNumDirections];
   bool write_pending_[kNumDirections];
+  bool pulling_[kNumDirections];
+  // Pulled data waiting for the pending write to the other side.
+  base::circular_deque<std::pair<scoped_refptr<IOBuffer>, int>>
+      pending_pushes_[kNumDirections];
+  // Bytes pulled from each side and not yet written to the other, and the
+  // size of the data pulled for the current write.
+  int bytes_in_flight_[kNumDirections];
+  int push_sizes_[kNumDirections];
+  int max_bytes_in_flight_;
   int bytes_passed_without_yielding_[kNumDirections];
   base::TimeTicks yield_after_time_[kNumDirections];
 
@@ -130,8 +214,21 @@ class NaiveConnection {
 
   bool full_duplex_;
 
+  // Set once the server connection has been retried after early data was
+  // rejected.
+  bool early_data_retried_;
+
+  // Current priority of the tunnel stream, see TunnelPriorityPolicy.
+  RequestPriority priority_;
+  int64_t bytes_passed_;
+
   TimeFunc time_func_;
 
+  ConnectionTrace* trace_;
+  base::TimeDelta stall_threshold_;
+  // When the current write to each side started, if traced.
+  base::TimeTicks push_start_time_[kNumDirections];
+
   // Traffic annotation for socket control.
   const NetworkTrafficAnnotationTag& traffic_annotation_;
 
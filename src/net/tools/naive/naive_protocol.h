@@ -8,6 +8,7 @@ namespace net {
 enum class ClientProtocol {
   kSocks5,
   kHttp,
+  kHttps,
   kRedir,
 };
 
@@ -7,9 +7,11 @@
 
 #include <utility>
 
+#include "base/base64.h"
 #include "base/bind.h"
 #include "base/location.h"
 #include "base/logging.h"
+#include "base/strings/string_util.h"
 #include "base/threading/thread_task_runner_handle.h"
 #include "net/base/load_flags.h"
 #include "net/base/net_errors.h"
@@ -20,8 +22,13 @@
 #include "net/socket/client_socket_pool_manager.h"
 #include "net/socket/server_socket.h"
 #include "net/socket/stream_socket.h"
+#include "net/tools/naive/connection_tracer.h"
+#include "net/tools/naive/http2_proxy_session.h"
 #include "net/tools/naive/http_proxy_socket.h"
+#include "net/tools/naive/https_proxy_server_socket.h"
 #include "net/tools/naive/naive_proxy_delegate.h"
+#include "net/tools/naive/redirect_resolver.h"
+#include "net/tools/naive/route_table.h"
 #include "net/tools/naive/socks5_server_socket.h"
 
 namespace net {
@@ -39,21 +46,22 @@ NaiveProxy::NaiveProxy(std::unique_ptr<ServerSocket> listen_socket,
       listen_user_(listen_user),
       listen_pass_(listen_pass),
       concurrency_(concurrency),
+      route_table_(nullptr),
+      tracer_(nullptr),
       resolver_(resolver),
       session_(session),
       net_log_(
           NetLogWithSource::Make(session->net_log(), NetLogSourceType::NONE)),
       last_id_(0),
+      max_bytes_in_flight_(0),
       traffic_annotation_(traffic_annotation) {
   const auto& proxy_config = static_cast<ConfiguredProxyResolutionService*>(
                                  session_->proxy_resolution_service())
                                  ->config();
   DCHECK(proxy_config);
-  const ProxyList& proxy_list =
-      proxy_config.value().value().proxy_rules().single_proxies;
-  DCHECK(!proxy_list.IsEmpty());
-  proxy_info_.UseProxyList(proxy_list);
-  proxy_info_.set_traffic_annotation(
+  SetProxyList(proxy_config.value().value().proxy_rules().single_proxies);
+  direct_proxy_info_.UseDirect();
+  direct_proxy_info_.set_traffic_annotation(
       net::MutableNetworkTrafficAnnotationTag(traffic_annotation_));
 
   // See HttpStreamFactory::Job::DoInitConnectionImpl()
@@ -66,13 +74,24 @@ NaiveProxy::NaiveProxy(std::unique_ptr<ServerSocket> listen_socket,
       session_->params().ignore_certificate_errors;
   proxy_ssl_config_.ignore_certificate_errors =
       session_->params().ignore_certificate_errors;
-  // TODO(https://crbug.com/964642): Also enable 0-RTT for TLS proxies.
   server_ssl_config_.early_data_enabled = session_->params().enable_early_data;
+  // The tunnel request to the proxy may go out as 0-RTT early data. Client
+  // data waits for the handshake to be confirmed, see NaiveConnection.
+  proxy_ssl_config_.early_data_enabled = session_->params().enable_early_data;
+
+  if (protocol_ == ClientProtocol::kHttps && !listen_user_.empty()) {
+    std::string credentials;
+    base::Base64Encode(listen_user_ + ":" + listen_pass_, &credentials);
+    proxy_authorization_ = "Basic " + credentials;
+  }
 
-  for (int i = 0; i < concurrency_; i++) {
-    network_anonymization_keys_.push_back(NetworkAnonymizationKey::CreateTransient());
+  if (protocol_ == ClientProtocol::kHttp ||
+      protocol_ == ClientProtocol::kHttps) {
+    forward_tunnel_pool_ = std::make_unique<ForwardTunnelPool>();
   }
 
+  SetConcurrency(concurrency);
+
   DCHECK(listen_socket_);
   // Start accepting connections in next run loop in case when delegate is not
   // ready to get callbacks.
@@ -83,6 +102,77 @@ NaiveProxy::NaiveProxy(std::unique_ptr<ServerSocket> listen_socket,
 
 NaiveProxy::~NaiveProxy() = default;
 
+void NaiveProxy::EnableSpeculativeConnect(base::TimeDelta window) {
+  DCHECK(resolver_);
+  // Tunnels opened ahead of time share the first partition; the client
+  // connection adopting one does not pick its own.
+  speculative_tunnel_pool_ = std::make_unique<SpeculativeTunnelPool>(
+      window, proxy_infos_.back(), server_ssl_config_, proxy_ssl_config_,
+      session_, network_anonymization_keys_[0], net_log_);
+  resolver_->set_name_resolved_callback(base::BindRepeating(
+      &NaiveProxy::OnNameResolved, weak_ptr_factory_.GetWeakPtr()));
+}
+
+void NaiveProxy::SetConcurrency(int concurrency) {
+  DCHECK_GT(concurrency, 0);
+  concurrency_ = concurrency;
+  while (network_anonymization_keys_.size() <
+         static_cast<size_t>(concurrency_)) {
+    network_anonymization_keys_.push_back(
+        NetworkAnonymizationKey::CreateTransient());
+  }
+}
+
+void NaiveProxy::SetProxyList(const ProxyList& proxy_list) {
+  DCHECK(!proxy_list.IsEmpty());
+  ProxyInfo& proxy_info = proxy_infos_.emplace_back();
+  proxy_info.UseProxyList(proxy_list);
+  proxy_info.set_traffic_annotation(
+      net::MutableNetworkTrafficAnnotationTag(traffic_annotation_));
+  if (speculative_tunnel_pool_)
+    speculative_tunnel_pool_->SetProxyInfo(proxy_info);
+  if (forward_tunnel_pool_)
+    forward_tunnel_pool_->Clear();
+}
+
+void NaiveProxy::Drain(base::TimeDelta timeout, base::OnceClosure callback) {
+  LOG(INFO) << "Draining " << connection_by_id_.size() << " connections";
+  if (protocol_ == ClientProtocol::kHttps) {
+    // Keeps serving the HTTP/2 connections, whose clients may still open
+    // streams until they see the GOAWAY.
+    static_cast<HttpsProxyServerSocket*>(listen_socket_.get())
+        ->StopListening();
+  } else {
+    listen_socket_.reset();
+  }
+  if (resolver_)
+    resolver_->StopListening();
+
+  if (connection_by_id_.empty()) {
+    std::move(callback).Run();
+    return;
+  }
+  drain_callback_ = std::move(callback);
+  drain_timer_.Start(FROM_HERE, timeout,
+                     base::BindOnce(&NaiveProxy::OnDrainTimeout,
+                                    weak_ptr_factory_.GetWeakPtr()));
+}
+
+void NaiveProxy::OnDrainTimeout() {
+  LOG(INFO) << "Drain timed out with " << connection_by_id_.size()
+            << " connections open";
+  std::move(drain_callback_).Run();
+}
+
+void NaiveProxy::OnNameResolved(const std::string& name) {
+  // Only proxied connections can adopt the tunnel.
+  if (route_table_ && route_table_->Route(base::ToLowerASCII(name)) !=
+                          RouteTable::Action::kProxy) {
+    return;
+  }
+  speculative_tunnel_pool_->Preconnect(name);
+}
+
 void NaiveProxy::DoAcceptLoop() {
   int result;
   do {
@@ -114,20 +204,32 @@ void NaiveProxy::DoConnect() {
   auto* proxy_delegate =
       static_cast<NaiveProxyDelegate*>(session_->context().proxy_delegate);
   DCHECK(proxy_delegate);
-  DCHECK(!proxy_info_.is_empty());
-  const auto& proxy_server = proxy_info_.proxy_server();
+  const ProxyInfo& proxy_info = proxy_infos_.back();
+  DCHECK(!proxy_info.is_empty());
+  const auto& proxy_server = proxy_info.proxy_server();
+  // https listeners hand out HTTP/2 CONNECT streams, and TLS connections
+  // carrying HTTP/1.1 requests like those of http listeners.
+  ClientProtocol protocol = protocol_;
+  if (protocol_ == ClientProtocol::kHttps &&
+      accepted_socket_->GetNegotiatedProtocol() != kProtoHTTP2) {
+    protocol = ClientProtocol::kHttp;
+  }
   auto padding_detector_delegate = std::make_unique<PaddingDetectorDelegate>(
-      proxy_delegate, proxy_server, protocol_);
+      proxy_delegate, proxy_server, protocol);
 
-  if (protocol_ == ClientProtocol::kSocks5) {
+  if (protocol == ClientProtocol::kSocks5) {
     socket = std::make_unique<Socks5ServerSocket>(std::move(accepted_socket_),
                                                   listen_user_, listen_pass_,
                                                   traffic_annotation_);
-  } else if (protocol_ == ClientProtocol::kHttp) {
-    socket = std::make_unique<HttpProxySocket>(std::move(accepted_socket_),
-                                               padding_detector_delegate.get(),
-                                               traffic_annotation_);
-  } else if (protocol_ == ClientProtocol::kRedir) {
+  } else if (protocol == ClientProtocol::kHttp) {
+    socket = std::make_unique<HttpProxySocket>(
+        std::move(accepted_socket_), padding_detector_delegate.get(),
+        proxy_authorization_, traffic_annotation_);
+  } else if (protocol == ClientProtocol::kHttps) {
+    auto* stream = static_cast<Http2ProxyStream*>(accepted_socket_.get());
+    stream->set_padding_detector_delegate(padding_detector_delegate.get());
+    socket = std::move(accepted_socket_);
+  } else if (protocol == ClientProtocol::kRedir) {
     socket = std::move(accepted_socket_);
   } else {
     return;
@@ -136,10 +238,18 @@ void NaiveProxy::DoConnect() {
   last_id_++;
   const auto& nak = network_anonymization_keys_[last_id_ % concurrency_];
   auto connection_ptr = std::make_unique<NaiveConnection>(
-      last_id_, protocol_, std::move(padding_detector_delegate), proxy_info_,
-      server_ssl_config_, proxy_ssl_config_, resolver_, session_, nak, net_log_,
-      std::move(socket), traffic_annotation_);
+      last_id_, protocol, std::move(padding_detector_delegate), proxy_info,
+      direct_proxy_info_, route_table_, server_ssl_config_, proxy_ssl_config_,
+      resolver_, speculative_tunnel_pool_.get(), forward_tunnel_pool_.get(),
+      priority_policy_, session_, nak, net_log_, std::move(socket),
+      traffic_annotation_);
   auto* connection = connection_ptr.get();
+  if (max_bytes_in_flight_ > 0)
+    connection->set_max_bytes_in_flight(max_bytes_in_flight_);
+  if (tracer_) {
+    connection->set_trace(tracer_->Begin(connection->id()),
+                          tracer_->stall_threshold());
+  }
   connection_by_id_[connection->id()] = std::move(connection_ptr);
   int result = connection->Connect(
       base::BindRepeating(&NaiveProxy::OnConnectComplete,
@@ -192,6 +302,11 @@ void NaiveProxy::Close(unsigned int connection_id, int reason) {
   LOG(INFO) << "Connection " << connection_id
             << " closed: " << ErrorToShortString(reason);
 
+  if (tracer_) {
+    it->second->set_trace(nullptr, base::TimeDelta());
+    tracer_->End(connection_id, reason);
+  }
+
   // The call stack might have callbacks which still have the pointer of
   // connection. Instead of referencing connection with ID all the time,
   // destroys the connection in next run loop to make sure any pending
@@ -199,6 +314,12 @@ void NaiveProxy::Close(unsigned int connection_id, int reason) {
   base::ThreadTaskRunnerHandle::Get()->DeleteSoon(FROM_HERE,
                                                   std::move(it->second));
   connection_by_id_.erase(it);
+
+  if (drain_callback_ && connection_by_id_.empty()) {
+    drain_timer_.Stop();
+    LOG(INFO) << "Drained all connections";
+    std::move(drain_callback_).Run();
+  }
 }
 
 NaiveConnection* NaiveProxy::FindConnection(unsigned int connection_id) {
@@ -6,28 +6,37 @@
 #ifndef NET_TOOLS_NAIVE_NAIVE_PROXY_H_
 #define NET_TOOLS_NAIVE_NAIVE_PROXY_H_
 
+#include <deque>
+#include <list>
 #include <map>
 #include <memory>
-#include <vector>
 
+#include "base/callback.h"
 #include "base/memory/weak_ptr.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
 #include "net/base/completion_repeating_callback.h"
 #include "net/base/network_isolation_key.h"
 #include "net/log/net_log_with_source.h"
 #include "net/proxy_resolution/proxy_info.h"
 #include "net/ssl/ssl_config.h"
+#include "net/tools/naive/http_forwarder.h"
 #include "net/tools/naive/naive_connection.h"
 #include "net/tools/naive/naive_protocol.h"
+#include "net/tools/naive/speculative_tunnel_pool.h"
 
 namespace net {
 
 class ClientSocketHandle;
+class ConnectionTracer;
 class HttpNetworkSession;
 class NaiveConnection;
+class ProxyList;
 class ServerSocket;
 class StreamSocket;
 struct NetworkTrafficAnnotationTag;
 class RedirectResolver;
+class RouteTable;
 
 class NaiveProxy {
  public:
@@ -43,7 +52,42 @@ class NaiveProxy {
   NaiveProxy(const NaiveProxy&) = delete;
   NaiveProxy& operator=(const NaiveProxy&) = delete;
 
+  // Opens a tunnel whenever the redirect resolver answers a name, to be
+  // adopted by the connection that follows within |window|.
+  void EnableSpeculativeConnect(base::TimeDelta window);
+
+  // Spreads new connections over |concurrency| network partitions, each with
+  // its own connections to the proxy.
+  void SetConcurrency(int concurrency);
+
+  // Sends new connections through |proxy_list|. Connections already open
+  // keep their proxy, and the speculative tunnels not adopted yet and the
+  // idle forward tunnels are closed.
+  void SetProxyList(const ProxyList& proxy_list);
+
+  void set_priority_policy(const TunnelPriorityPolicy& priority_policy) {
+    priority_policy_ = priority_policy;
+  }
+
+  // See NaiveConnection::set_max_bytes_in_flight(). Zero keeps its default.
+  void set_max_bytes_in_flight(int size) { max_bytes_in_flight_ = size; }
+
+  // Routes connections by |route_table|, which must outlive this.
+  void set_route_table(const RouteTable* route_table) {
+    route_table_ = route_table;
+  }
+
+  // Traces connections into |tracer|, which must outlive this.
+  void set_connection_tracer(ConnectionTracer* tracer) { tracer_ = tracer; }
+
+  // Stops accepting connections, and runs |callback| once the connections
+  // already accepted have closed, or after |timeout| with them still open.
+  // Also stops the redirect resolver.
+  void Drain(base::TimeDelta timeout, base::OnceClosure callback);
+
  private:
+  void OnNameResolved(const std::string& name);
+
   void DoAcceptLoop();
   void OnAcceptComplete(int result);
   void HandleAcceptResult(int result);
@@ -58,14 +102,24 @@ class NaiveProxy {
 
   void Close(unsigned int connection_id, int reason);
 
+  void OnDrainTimeout();
+
   NaiveConnection* FindConnection(unsigned int connection_id);
 
   std::unique_ptr<ServerSocket> listen_socket_;
   ClientProtocol protocol_;
   std::string listen_user_;
   std::string listen_pass_;
+  // Expected of HTTP/1.1 requests on https listeners with credentials.
+  std::string proxy_authorization_;
   int concurrency_;
-  ProxyInfo proxy_info_;
+  // The last one is used for new connections. Earlier ones are kept for the
+  // connections and pools still referring to them.
+  std::list<ProxyInfo> proxy_infos_;
+  // For connections routed around the proxy.
+  ProxyInfo direct_proxy_info_;
+  const RouteTable* route_table_;
+  ConnectionTracer* tracer_;
   SSLConfig server_ssl_config_;
   SSLConfig proxy_ssl_config_;
   RedirectResolver* resolver_;
@@ -76,10 +130,25 @@ class NaiveProxy {
 
   std::unique_ptr<StreamSocket> accepted_socket_;
 
-  std::vector<NetworkAnonymizationKey> network_anonymization_keys_;
+  // Indexed by connection ID modulo |concurrency_|. Never shrinks, as
+  // connections and pools refer to the keys.
+  std::deque<NetworkAnonymizationKey> network_anonymization_keys_;
+
+  // Tunnels kept for plain HTTP requests of http listeners.
+  std::unique_ptr<ForwardTunnelPool> forward_tunnel_pool_;
 
   std::map<unsigned int, std::unique_ptr<NaiveConnection>> connection_by_id_;
 
+  std::unique_ptr<SpeculativeTunnelPool> speculative_tunnel_pool_;
+
+  TunnelPriorityPolicy priority_policy_;
+
+  int max_bytes_in_flight_;
+
+  // Set while draining.
+  base::OnceClosure drain_callback_;
+  base::OneShotTimer drain_timer_;
+
   const NetworkTrafficAnnotationTag& traffic_annotation_;
 
   base::WeakPtrFactory<NaiveProxy> weak_ptr_factory_{this};
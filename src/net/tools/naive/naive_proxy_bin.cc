@@ -6,34 +6,49 @@
 #include <cstdlib>
 #include <iostream>
 #include <limits>
+#include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "base/at_exit.h"
+#include "base/base64.h"
+#include "base/bind.h"
 #include "base/command_line.h"
 #include "base/feature_list.h"
 #include "base/files/file_path.h"
+#include "base/files/file_util.h"
 #include "base/json/json_file_value_serializer.h"
 #include "base/json/json_writer.h"
 #include "base/logging.h"
+#include "base/observer_list.h"
 #include "base/rand_util.h"
 #include "base/run_loop.h"
 #include "base/strings/escape.h"
 #include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 #include "base/system/sys_info.h"
 #include "base/task/single_thread_task_executor.h"
 #include "base/task/thread_pool/thread_pool_instance.h"
+#include "base/time/time.h"
 #include "base/values.h"
 #include "build/build_config.h"
 #include "components/version_info/version_info.h"
 #include "net/base/auth.h"
+#include "net/base/ip_address.h"
+#include "net/base/ip_endpoint.h"
+#include "net/base/network_change_notifier.h"
 #include "net/base/network_isolation_key.h"
 #include "net/base/url_util.h"
 #include "net/cert/cert_verifier.h"
+#include "net/cert/x509_certificate.h"
 #include "net/cert_net/cert_net_fetcher_url_request.h"
 #include "net/dns/host_resolver.h"
+#include "net/dns/public/dns_config_overrides.h"
+#include "net/dns/public/dns_over_https_config.h"
+#include "net/dns/public/secure_dns_mode.h"
 #include "net/dns/mapped_host_resolver.h"
 #include "net/http/http_auth.h"
 #include "net/http/http_auth_cache.h"
@@ -49,20 +64,35 @@
 #include "net/log/net_log_util.h"
 #include "net/proxy_resolution/configured_proxy_resolution_service.h"
 #include "net/proxy_resolution/proxy_config.h"
+#include "net/proxy_resolution/proxy_config_service.h"
 #include "net/proxy_resolution/proxy_config_service_fixed.h"
 #include "net/proxy_resolution/proxy_config_with_annotation.h"
+#include "net/quic/quic_context.h"
 #include "net/socket/client_socket_pool_manager.h"
 #include "net/socket/ssl_client_socket.h"
+#include "net/socket/ssl_server_socket.h"
 #include "net/socket/tcp_server_socket.h"
+#include "net/socket/tcp_socket.h"
 #include "net/socket/udp_server_socket.h"
 #include "net/ssl/ssl_key_logger_impl.h"
+#include "net/ssl/ssl_server_config.h"
+#include "net/third_party/quiche/src/quiche/quic/core/crypto/crypto_protocol.h"
+#include "net/third_party/quiche/src/quiche/quic/core/quic_constants.h"
+#include "net/third_party/quiche/src/quiche/quic/core/quic_tag.h"
 #include "net/third_party/quiche/src/quiche/quic/core/quic_versions.h"
+#include "net/tools/naive/bounded_net_log_observer.h"
+#include "net/tools/naive/connection_tracer.h"
+#include "net/tools/naive/https_proxy_server_socket.h"
 #include "net/tools/naive/naive_protocol.h"
 #include "net/tools/naive/naive_proxy.h"
 #include "net/tools/naive/naive_proxy_delegate.h"
 #include "net/tools/naive/redirect_resolver.h"
+#include "net/tools/naive/route_table.h"
 #include "net/traffic_annotation/network_traffic_annotation.h"
 #include "net/url_request/url_request_context.h"
+#include "third_party/boringssl/src/include/openssl/bio.h"
+#include "third_party/boringssl/src/include/openssl/evp.h"
+#include "third_party/boringssl/src/include/openssl/pem.h"
 #include "net/url_request/url_request_context_builder.h"
 #include "url/gurl.h"
 #include "url/scheme_host_port.h"
@@ -73,6 +103,14 @@
 #include "base/mac/scoped_nsautorelease_pool.h"
 #endif
 
+#if BUILDFLAG(IS_POSIX)
+#include <signal.h>
+
+#include "base/files/scoped_file.h"
+#include "net/tools/naive/hot_restart.h"
+#include "net/tools/naive/signal_watcher.h"
+#endif
+
 namespace {
 
 constexpr int kListenBackLog = 512;
@@ -84,14 +122,35 @@ constexpr net::NetworkTrafficAnnotationTag kTrafficAnnotation =
 
 struct CommandLine {
   std::string listen;
+  base::FilePath listen_cert;
+  base::FilePath listen_key;
   std::string proxy;
   std::string concurrency;
   std::string extra_headers;
+  std::string interactive_ports;
+  std::string bulk_after;
+  std::string relay_buffer;
   std::string host_resolver_rules;
+  base::FilePath route_rules;
   std::string resolver_range;
+  std::string resolver_preconnect;
+  std::string happy_eyeballs;
+  std::string dns;
+  std::string dns_concurrency;
+  bool quic_pacing_offload;
+  std::string quic_congestion_control;
+  std::string quic_connection_options;
+  bool quic_migrate;
+  bool quic_shared_socket;
+  base::FilePath hot_restart;
+  std::string hot_restart_drain;
   bool no_log;
   base::FilePath log;
   base::FilePath log_net_log;
+  std::string log_net_log_buffer;
+  std::string log_net_log_events;
+  base::FilePath log_connections;
+  std::string log_connections_stall;
   base::FilePath ssl_key_log_file;
 };
 
@@ -101,16 +160,36 @@ struct Params {
   std::string listen_pass;
   std::string listen_addr;
   int listen_port;
+  scoped_refptr<net::X509Certificate> listen_cert;
+  bssl::UniquePtr<EVP_PKEY> listen_key;
   int concurrency;
   net::HttpRequestHeaders extra_headers;
+  net::TunnelPriorityPolicy priority_policy;
+  int relay_buffer_size;
   std::string proxy_url;
   std::u16string proxy_user;
   std::u16string proxy_pass;
   std::string host_resolver_rules;
+  std::unique_ptr<net::RouteTable> route_table;
   net::IPAddress resolver_range;
   size_t resolver_prefix;
+  base::TimeDelta resolver_preconnect_window;
+  base::TimeDelta happy_eyeballs_attempt_delay;
+  net::DnsOverHttpsConfig doh_config;
+  size_t max_concurrent_resolves;
+  bool quic_pacing_offload;
+  quic::QuicTag quic_congestion_control;
+  quic::QuicTagVector quic_connection_options;
+  bool quic_migrate;
+  bool quic_shared_socket;
+  std::string hot_restart_path;
+  base::TimeDelta hot_restart_drain;
   logging::LoggingSettings log_settings;
   base::FilePath net_log_path;
+  size_t net_log_buffer_size;
+  std::vector<net::NetLogEventType> net_log_events;
+  base::FilePath connection_trace_path;
+  base::TimeDelta connection_stall_threshold;
   base::FilePath ssl_key_path;
 };
 
@@ -134,16 +213,44 @@ void GetCommandLine(const base::CommandLine& proc, CommandLine* cmdline) {
                  "-h, --help                 Show this message\n"
                  "--version                  Print version\n"
                  "--listen=<proto>://[addr][:port]\n"
-                 "                           proto: socks, http\n"
+                 "                           proto: socks, http, https\n"
                  "                                  redir (Linux only)\n"
+                 "--listen-cert=<path>       PEM certificate chain for https\n"
+                 "--listen-key=<path>        PEM private key for https\n"
                  "--proxy=<proto>://[<user>:<pass>@]<hostname>[:<port>]\n"
                  "                           proto: https, quic\n"
                  "--insecure-concurrency=<N> Use N connections, insecure\n"
                  "--extra-headers=...        Extra headers split by CRLF\n"
+                 "--interactive-ports=<port>[,<port>...]\n"
+                 "                           Prioritize these ports\n"
+                 "--bulk-after=<bytes>       Deprioritize large tunnels\n"
+                 "--relay-buffer=<bytes>     Read ahead per direction\n"
                  "--host-resolver-rules=...  Resolver rules\n"
+                 "--route-rules=<path>       Direct, proxy or reject by rule\n"
                  "--resolver-range=...       Redirect resolver range\n"
+                 "--resolver-preconnect=<ms> Connect on DNS answer\n"
+                 "--happy-eyeballs=<ms>      Race connection attempts\n"
+                 "--dns=<url>                DNS-over-HTTPS via the proxy\n"
+                 "--dns-concurrency=<N>      Max concurrent DNS lookups\n"
+                 "--quic-pacing-offload      Pace QUIC in the kernel\n"
+                 "--quic-congestion-control=<bbr2|cubic>\n"
+                 "--quic-connection-options=<TAG>[,<TAG>...]\n"
+                 "--quic-migrate             Keep QUIC across net changes\n"
+                 "--quic-shared-socket       One UDP socket for all QUIC\n"
+                 "--hot-restart=<path>       Take over and hand over the\n"
+                 "                           listening socket at <path>\n"
+                 "--hot-restart-drain=<s>    Max. drain time after handing\n"
+                 "                           over\n"
                  "--log[=<path>]             Log to stderr, or file\n"
                  "--log-net-log=<path>       Save NetLog\n"
+                 "--log-net-log-buffer=<N>   Keep last N bytes of NetLog\n"
+                 "                           in memory, save on SIGUSR1\n"
+                 "--log-net-log-events=...   Only buffer these events,\n"
+                 "                           with --log-net-log-buffer\n"
+                 "--log-connections=<path>   Trace connections, save on\n"
+                 "                           SIGUSR2\n"
+                 "--log-connections-stall=<ms>\n"
+                 "                           Min. duration of a write stall\n"
                  "--ssl-key-log-file=<path>  Save SSL keys for Wireshark\n"
               << std::endl;
     exit(EXIT_SUCCESS);
@@ -155,19 +262,44 @@ void GetCommandLine(const base::CommandLine& proc, CommandLine* cmdline) {
   }
 
   cmdline->listen = proc.GetSwitchValueASCII("listen");
+  cmdline->listen_cert = proc.GetSwitchValuePath("listen-cert");
+  cmdline->listen_key = proc.GetSwitchValuePath("listen-key");
   cmdline->proxy = proc.GetSwitchValueASCII("proxy");
   cmdline->concurrency = proc.GetSwitchValueASCII("insecure-concurrency");
   cmdline->extra_headers = proc.GetSwitchValueASCII("extra-headers");
+  cmdline->interactive_ports = proc.GetSwitchValueASCII("interactive-ports");
+  cmdline->bulk_after = proc.GetSwitchValueASCII("bulk-after");
+  cmdline->relay_buffer = proc.GetSwitchValueASCII("relay-buffer");
   cmdline->host_resolver_rules =
       proc.GetSwitchValueASCII("host-resolver-rules");
+  cmdline->route_rules = proc.GetSwitchValuePath("route-rules");
   cmdline->resolver_range = proc.GetSwitchValueASCII("resolver-range");
+  cmdline->resolver_preconnect =
+      proc.GetSwitchValueASCII("resolver-preconnect");
+  cmdline->happy_eyeballs = proc.GetSwitchValueASCII("happy-eyeballs");
+  cmdline->dns = proc.GetSwitchValueASCII("dns");
+  cmdline->dns_concurrency = proc.GetSwitchValueASCII("dns-concurrency");
+  cmdline->quic_pacing_offload = proc.HasSwitch("quic-pacing-offload");
+  cmdline->quic_congestion_control =
+      proc.GetSwitchValueASCII("quic-congestion-control");
+  cmdline->quic_connection_options =
+      proc.GetSwitchValueASCII("quic-connection-options");
+  cmdline->quic_migrate = proc.HasSwitch("quic-migrate");
+  cmdline->quic_shared_socket = proc.HasSwitch("quic-shared-socket");
+  cmdline->hot_restart = proc.GetSwitchValuePath("hot-restart");
+  cmdline->hot_restart_drain = proc.GetSwitchValueASCII("hot-restart-drain");
   cmdline->no_log = !proc.HasSwitch("log");
   cmdline->log = proc.GetSwitchValuePath("log");
   cmdline->log_net_log = proc.GetSwitchValuePath("log-net-log");
+  cmdline->log_net_log_buffer = proc.GetSwitchValueASCII("log-net-log-buffer");
+  cmdline->log_net_log_events = proc.GetSwitchValueASCII("log-net-log-events");
+  cmdline->log_connections = proc.GetSwitchValuePath("log-connections");
+  cmdline->log_connections_stall =
+      proc.GetSwitchValueASCII("log-connections-stall");
   cmdline->ssl_key_log_file = proc.GetSwitchValuePath("ssl-key-log-file");
 }
 
-void GetCommandLineFromConfig(const base::FilePath& config_path,
+bool GetCommandLineFromConfig(const base::FilePath& config_path,
                               CommandLine* cmdline) {
   JSONFileValueDeserializer reader(config_path);
   int error_code;
@@ -176,16 +308,24 @@ void GetCommandLineFromConfig(const base::FilePath& config_path,
   if (value == nullptr) {
     std::cerr << "Error reading " << config_path << ": (" << error_code << ") "
               << error_message << std::endl;
-    exit(EXIT_FAILURE);
+    return false;
   }
   if (!value->is_dict()) {
     std::cerr << "Invalid config format" << std::endl;
-    exit(EXIT_FAILURE);
+    return false;
   }
   const auto* listen = value->FindStringKey("listen");
   if (listen) {
     cmdline->listen = *listen;
   }
+  const auto* listen_cert = value->FindStringKey("listen-cert");
+  if (listen_cert) {
+    cmdline->listen_cert = base::FilePath::FromUTF8Unsafe(*listen_cert);
+  }
+  const auto* listen_key = value->FindStringKey("listen-key");
+  if (listen_key) {
+    cmdline->listen_key = base::FilePath::FromUTF8Unsafe(*listen_key);
+  }
   const auto* proxy = value->FindStringKey("proxy");
   if (proxy) {
     cmdline->proxy = *proxy;
@@ -198,14 +338,69 @@ void GetCommandLineFromConfig(const base::FilePath& config_path,
   if (extra_headers) {
     cmdline->extra_headers = *extra_headers;
   }
+  const auto* interactive_ports = value->FindStringKey("interactive-ports");
+  if (interactive_ports) {
+    cmdline->interactive_ports = *interactive_ports;
+  }
+  const auto* bulk_after = value->FindStringKey("bulk-after");
+  if (bulk_after) {
+    cmdline->bulk_after = *bulk_after;
+  }
+  const auto* relay_buffer = value->FindStringKey("relay-buffer");
+  if (relay_buffer) {
+    cmdline->relay_buffer = *relay_buffer;
+  }
   const auto* host_resolver_rules = value->FindStringKey("host-resolver-rules");
   if (host_resolver_rules) {
     cmdline->host_resolver_rules = *host_resolver_rules;
   }
+  const auto* route_rules = value->FindStringKey("route-rules");
+  if (route_rules) {
+    cmdline->route_rules = base::FilePath::FromUTF8Unsafe(*route_rules);
+  }
   const auto* resolver_range = value->FindStringKey("resolver-range");
   if (resolver_range) {
     cmdline->resolver_range = *resolver_range;
   }
+  const auto* resolver_preconnect = value->FindStringKey("resolver-preconnect");
+  if (resolver_preconnect) {
+    cmdline->resolver_preconnect = *resolver_preconnect;
+  }
+  const auto* happy_eyeballs = value->FindStringKey("happy-eyeballs");
+  if (happy_eyeballs) {
+    cmdline->happy_eyeballs = *happy_eyeballs;
+  }
+  const auto* dns = value->FindStringKey("dns");
+  if (dns) {
+    cmdline->dns = *dns;
+  }
+  const auto* dns_concurrency = value->FindStringKey("dns-concurrency");
+  if (dns_concurrency) {
+    cmdline->dns_concurrency = *dns_concurrency;
+  }
+  cmdline->quic_pacing_offload =
+      value->FindBoolKey("quic-pacing-offload").value_or(false);
+  const auto* quic_congestion_control =
+      value->FindStringKey("quic-congestion-control");
+  if (quic_congestion_control) {
+    cmdline->quic_congestion_control = *quic_congestion_control;
+  }
+  const auto* quic_connection_options =
+      value->FindStringKey("quic-connection-options");
+  if (quic_connection_options) {
+    cmdline->quic_connection_options = *quic_connection_options;
+  }
+  cmdline->quic_migrate = value->FindBoolKey("quic-migrate").value_or(false);
+  cmdline->quic_shared_socket =
+      value->FindBoolKey("quic-shared-socket").value_or(false);
+  const auto* hot_restart = value->FindStringKey("hot-restart");
+  if (hot_restart) {
+    cmdline->hot_restart = base::FilePath::FromUTF8Unsafe(*hot_restart);
+  }
+  const auto* hot_restart_drain = value->FindStringKey("hot-restart-drain");
+  if (hot_restart_drain) {
+    cmdline->hot_restart_drain = *hot_restart_drain;
+  }
   cmdline->no_log = true;
   const auto* log = value->FindStringKey("log");
   if (log) {
@@ -216,11 +411,30 @@ void GetCommandLineFromConfig(const base::FilePath& config_path,
   if (log_net_log) {
     cmdline->log_net_log = base::FilePath::FromUTF8Unsafe(*log_net_log);
   }
+  const auto* log_net_log_buffer = value->FindStringKey("log-net-log-buffer");
+  if (log_net_log_buffer) {
+    cmdline->log_net_log_buffer = *log_net_log_buffer;
+  }
+  const auto* log_net_log_events = value->FindStringKey("log-net-log-events");
+  if (log_net_log_events) {
+    cmdline->log_net_log_events = *log_net_log_events;
+  }
+  const auto* log_connections = value->FindStringKey("log-connections");
+  if (log_connections) {
+    cmdline->log_connections =
+        base::FilePath::FromUTF8Unsafe(*log_connections);
+  }
+  const auto* log_connections_stall =
+      value->FindStringKey("log-connections-stall");
+  if (log_connections_stall) {
+    cmdline->log_connections_stall = *log_connections_stall;
+  }
   const auto* ssl_key_log_file = value->FindStringKey("ssl-key-log-file");
   if (ssl_key_log_file) {
     cmdline->ssl_key_log_file =
         base::FilePath::FromUTF8Unsafe(*ssl_key_log_file);
   }
+  return true;
 }
 
 std::string GetProxyFromURL(const GURL& url) {
@@ -235,9 +449,6 @@ bool ParseCommandLine(const CommandLine& cmdline, Params* params) {
   params->protocol = net::ClientProtocol::kSocks5;
   params->listen_addr = "0.0.0.0";
   params->listen_port = 1080;
-  url::AddStandardScheme("socks",
-                         url::SCHEME_WITH_HOST_PORT_AND_USER_INFORMATION);
-  url::AddStandardScheme("redir", url::SCHEME_WITH_HOST_AND_PORT);
   if (!cmdline.listen.empty()) {
     GURL url(cmdline.listen);
     if (url.scheme() == "socks") {
@@ -246,6 +457,9 @@ bool ParseCommandLine(const CommandLine& cmdline, Params* params) {
     } else if (url.scheme() == "http") {
       params->protocol = net::ClientProtocol::kHttp;
       params->listen_port = 8080;
+    } else if (url.scheme() == "https") {
+      params->protocol = net::ClientProtocol::kHttps;
+      params->listen_port = 443;
     } else if (url.scheme() == "redir") {
 #if BUILDFLAG(IS_LINUX)
       params->protocol = net::ClientProtocol::kRedir;
@@ -280,6 +494,43 @@ bool ParseCommandLine(const CommandLine& cmdline, Params* params) {
     }
   }
 
+  if (params->protocol == net::ClientProtocol::kHttps) {
+    // Both may be in one file, e.g. the certificate chain followed by the key.
+    std::string cert_pem;
+    if (cmdline.listen_cert.empty() ||
+        !base::ReadFileToString(cmdline.listen_cert, &cert_pem)) {
+      std::cerr << "Invalid listen certificate file" << std::endl;
+      return false;
+    }
+    net::CertificateList certs =
+        net::X509Certificate::CreateCertificateListFromBytes(
+            base::as_bytes(base::make_span(cert_pem)),
+            net::X509Certificate::FORMAT_PEM_CERT_SEQUENCE);
+    if (certs.empty()) {
+      std::cerr << "Invalid listen certificate" << std::endl;
+      return false;
+    }
+    std::vector<bssl::UniquePtr<CRYPTO_BUFFER>> intermediates;
+    for (size_t i = 1; i < certs.size(); ++i)
+      intermediates.push_back(bssl::UpRef(certs[i]->cert_buffer()));
+    params->listen_cert = net::X509Certificate::CreateFromBuffer(
+        bssl::UpRef(certs[0]->cert_buffer()), std::move(intermediates));
+
+    std::string key_pem;
+    if (cmdline.listen_key.empty() ||
+        !base::ReadFileToString(cmdline.listen_key, &key_pem)) {
+      std::cerr << "Invalid listen key file" << std::endl;
+      return false;
+    }
+    bssl::UniquePtr<BIO> bio(BIO_new_mem_buf(key_pem.data(), key_pem.size()));
+    params->listen_key.reset(
+        PEM_read_bio_PrivateKey(bio.get(), nullptr, nullptr, nullptr));
+    if (!params->listen_cert || !params->listen_key) {
+      std::cerr << "Invalid listen key" << std::endl;
+      return false;
+    }
+  }
+
   params->proxy_url = "direct://";
   GURL url(cmdline.proxy);
   GURL::Replacements remove_auth;
@@ -307,8 +558,54 @@ bool ParseCommandLine(const CommandLine& cmdline, Params* params) {
 
   params->extra_headers.AddHeadersFromString(cmdline.extra_headers);
 
+  for (const auto& port_str :
+       base::SplitString(cmdline.interactive_ports, ",", base::TRIM_WHITESPACE,
+                         base::SPLIT_WANT_NONEMPTY)) {
+    int port;
+    if (!base::StringToInt(port_str, &port) || port <= 0 || port > 65535) {
+      std::cerr << "Invalid interactive port: " << port_str << std::endl;
+      return false;
+    }
+    params->priority_policy.interactive_ports.insert(port);
+  }
+
+  if (!cmdline.bulk_after.empty()) {
+    if (!base::StringToInt64(cmdline.bulk_after,
+                             &params->priority_policy.bulk_after_bytes) ||
+        params->priority_policy.bulk_after_bytes <= 0) {
+      std::cerr << "Invalid bulk threshold" << std::endl;
+      return false;
+    }
+  }
+
+  params->relay_buffer_size = 0;
+  if (!cmdline.relay_buffer.empty()) {
+    // At least one 64 KiB read buffer, and at most 64 MiB.
+    if (!base::StringToInt(cmdline.relay_buffer,
+                           &params->relay_buffer_size) ||
+        params->relay_buffer_size < (64 << 10) ||
+        params->relay_buffer_size > (64 << 20)) {
+      std::cerr << "Invalid relay buffer size" << std::endl;
+      return false;
+    }
+  }
+
   params->host_resolver_rules = cmdline.host_resolver_rules;
 
+  if (!cmdline.route_rules.empty()) {
+    std::string rules;
+    if (!base::ReadFileToString(cmdline.route_rules, &rules)) {
+      std::cerr << "Invalid route rules file" << std::endl;
+      return false;
+    }
+    params->route_table = std::make_unique<net::RouteTable>();
+    std::string error;
+    if (!params->route_table->Load(rules, &error)) {
+      std::cerr << "Invalid route rules: " << error << std::endl;
+      return false;
+    }
+  }
+
   if (params->protocol == net::ClientProtocol::kRedir) {
     std::string range = "100.64.0.0/10";
     if (!cmdline.resolver_range.empty())
@@ -323,6 +620,88 @@ bool ParseCommandLine(const CommandLine& cmdline, Params* params) {
       std::cerr << "IPv6 resolver range not supported" << std::endl;
       return false;
     }
+
+    if (!cmdline.resolver_preconnect.empty()) {
+      int window_ms;
+      if (!base::StringToInt(cmdline.resolver_preconnect, &window_ms) ||
+          window_ms <= 0) {
+        std::cerr << "Invalid resolver preconnect window" << std::endl;
+        return false;
+      }
+      params->resolver_preconnect_window = base::Milliseconds(window_ms);
+    }
+  }
+
+  if (!cmdline.happy_eyeballs.empty()) {
+    int delay_ms;
+    if (!base::StringToInt(cmdline.happy_eyeballs, &delay_ms) ||
+        delay_ms < 10) {
+      std::cerr << "Invalid Happy Eyeballs delay" << std::endl;
+      return false;
+    }
+    params->happy_eyeballs_attempt_delay = base::Milliseconds(delay_ms);
+  }
+
+  if (!cmdline.dns.empty()) {
+    auto doh_config = net::DnsOverHttpsConfig::FromString(cmdline.dns);
+    if (!doh_config) {
+      std::cerr << "Invalid DNS-over-HTTPS server" << std::endl;
+      return false;
+    }
+    params->doh_config = std::move(*doh_config);
+  }
+
+  params->max_concurrent_resolves =
+      net::HostResolver::ManagerOptions::kDefaultParallelism;
+  if (!cmdline.dns_concurrency.empty()) {
+    if (!base::StringToSizeT(cmdline.dns_concurrency,
+                             &params->max_concurrent_resolves) ||
+        params->max_concurrent_resolves == 0) {
+      std::cerr << "Invalid DNS concurrency" << std::endl;
+      return false;
+    }
+  }
+
+  params->quic_pacing_offload = cmdline.quic_pacing_offload;
+
+  if (cmdline.quic_congestion_control.empty() ||
+      cmdline.quic_congestion_control == "bbr2") {
+    params->quic_congestion_control = quic::kB2ON;
+  } else if (cmdline.quic_congestion_control == "cubic") {
+    params->quic_congestion_control = quic::kQBIC;
+  } else {
+    std::cerr << "Invalid QUIC congestion control" << std::endl;
+    return false;
+  }
+
+  for (const auto& tag :
+       base::SplitString(cmdline.quic_connection_options, ",",
+                         base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY)) {
+    if (tag.size() > 4) {
+      std::cerr << "Invalid QUIC connection option: " << tag << std::endl;
+      return false;
+    }
+    params->quic_connection_options.push_back(quic::ParseQuicTag(tag));
+  }
+  params->quic_migrate = cmdline.quic_migrate;
+  params->quic_shared_socket = cmdline.quic_shared_socket;
+
+  params->hot_restart_path = cmdline.hot_restart.AsUTF8Unsafe();
+#if !BUILDFLAG(IS_POSIX)
+  if (!params->hot_restart_path.empty()) {
+    std::cerr << "Hot restart only supports POSIX." << std::endl;
+    return false;
+  }
+#endif
+  params->hot_restart_drain = base::Seconds(60);
+  if (!cmdline.hot_restart_drain.empty()) {
+    int drain_seconds;
+    if (!base::StringToInt(cmdline.hot_restart_drain, &drain_seconds) ||
+        drain_seconds < 0) {
+      std::cerr << "Invalid hot restart drain time" << std::endl;
+      return false;
+    }
+    params->hot_restart_drain = base::Seconds(drain_seconds);
   }
 
   if (!cmdline.no_log) {
@@ -337,6 +716,66 @@ bool ParseCommandLine(const CommandLine& cmdline, Params* params) {
   }
 
   params->net_log_path = cmdline.log_net_log;
+
+  params->net_log_buffer_size = 0;
+  if (!cmdline.log_net_log_buffer.empty()) {
+#if BUILDFLAG(IS_POSIX)
+    if (!base::StringToSizeT(cmdline.log_net_log_buffer,
+                             &params->net_log_buffer_size) ||
+        params->net_log_buffer_size == 0) {
+      std::cerr << "Invalid NetLog buffer size" << std::endl;
+      return false;
+    }
+    if (params->net_log_path.empty()) {
+      std::cerr << "NetLog buffer requires --log-net-log" << std::endl;
+      return false;
+    }
+#else
+    std::cerr << "NetLog buffer only supports POSIX." << std::endl;
+    return false;
+#endif
+  }
+
+  if (!cmdline.log_net_log_events.empty()) {
+    // Only the buffer filters events before serializing them.
+    if (params->net_log_buffer_size == 0) {
+      std::cerr << "NetLog events require --log-net-log-buffer" << std::endl;
+      return false;
+    }
+    std::map<base::StringPiece, net::NetLogEventType> event_type_by_name;
+    for (int i = 0; i < static_cast<int>(net::NetLogEventType::COUNT); ++i) {
+      auto type = static_cast<net::NetLogEventType>(i);
+      event_type_by_name[net::NetLogEventTypeToString(type)] = type;
+    }
+    for (base::StringPiece name : base::SplitStringPiece(
+             cmdline.log_net_log_events, ",", base::TRIM_WHITESPACE,
+             base::SPLIT_WANT_NONEMPTY)) {
+      auto it = event_type_by_name.find(name);
+      if (it == event_type_by_name.end()) {
+        std::cerr << "Invalid NetLog event type: " << name << std::endl;
+        return false;
+      }
+      params->net_log_events.push_back(it->second);
+    }
+  }
+
+  params->connection_trace_path = cmdline.log_connections;
+#if !BUILDFLAG(IS_POSIX)
+  if (!params->connection_trace_path.empty()) {
+    std::cerr << "Connection tracing only supports POSIX." << std::endl;
+    return false;
+  }
+#endif
+  params->connection_stall_threshold = base::Milliseconds(100);
+  if (!cmdline.log_connections_stall.empty()) {
+    int stall_ms;
+    if (!base::StringToInt(cmdline.log_connections_stall, &stall_ms) ||
+        stall_ms <= 0) {
+      std::cerr << "Invalid connection stall threshold" << std::endl;
+      return false;
+    }
+    params->connection_stall_threshold = base::Milliseconds(stall_ms);
+  }
   params->ssl_key_path = cmdline.ssl_key_log_file;
 
   return true;
@@ -374,10 +813,12 @@ class PrintingLogObserver : public NetLog::ThreadSafeObserver {
     const char* source_type = NetLog::SourceTypeToString(entry.source.type);
     const char* event_type = NetLogEventTypeToString(entry.type);
     const char* event_phase = NetLog::EventPhaseToString(entry.phase);
-    base::Value params(entry.ToValue());
+    // Serializes only the parameters; the rest is printed directly.
     std::string params_str;
-    base::JSONWriter::Write(params, &params_str);
-    params_str.insert(0, ": ");
+    if (entry.HasParams()) {
+      base::JSONWriter::Write(entry.params, &params_str);
+      params_str.insert(0, ": ");
+    }
 
     VLOG(1) << source_type << "(" << entry.source.id << "): " << event_type
             << ": " << event_phase << params_str;
@@ -404,11 +845,71 @@ std::unique_ptr<URLRequestContext> BuildCertURLRequestContext(NetLog* net_log) {
   return builder.Build();
 }
 
-// Builds a URLRequestContext assuming there's only a single loop.
+// A proxy config service whose config is replaced on reload, notifying the
+// resolution service that observes it.
+class ReloadableProxyConfigService : public ProxyConfigService {
+ public:
+  explicit ReloadableProxyConfigService(const ProxyConfig& config)
+      : config_(config, kTrafficAnnotation) {}
+  ReloadableProxyConfigService(const ReloadableProxyConfigService&) = delete;
+  ReloadableProxyConfigService& operator=(
+      const ReloadableProxyConfigService&) = delete;
+
+  void SetConfig(const ProxyConfig& config) {
+    config_ = ProxyConfigWithAnnotation(config, kTrafficAnnotation);
+    for (auto& observer : observers_)
+      observer.OnProxyConfigChanged(config_, CONFIG_VALID);
+  }
+
+  // ProxyConfigService implementation:
+  void AddObserver(Observer* observer) override {
+    observers_.AddObserver(observer);
+  }
+  void RemoveObserver(Observer* observer) override {
+    observers_.RemoveObserver(observer);
+  }
+  ConfigAvailability GetLatestProxyConfig(
+      ProxyConfigWithAnnotation* config) override {
+    *config = config_;
+    return CONFIG_VALID;
+  }
+
+ private:
+  ProxyConfigWithAnnotation config_;
+  base::ObserverList<Observer>::Unchecked observers_;
+};
+
+// Forces QUIC for the proxy of |params| if it is a quic:// proxy, and adds
+// its credentials, if any, to the auth cache of |context|.
+void AddProxyCredentials(const Params& params, URLRequestContext* context) {
+  if (params.proxy_url.empty())
+    return;
+  std::string proxy_url = params.proxy_url;
+  GURL proxy_gurl(proxy_url);
+  if (proxy_url.compare(0, 7, "quic://") == 0) {
+    proxy_url.replace(0, 4, "https");
+    proxy_gurl = GURL(proxy_url);
+    context->quic_context()->params()->origins_to_force_quic_on.insert(
+        net::HostPortPair::FromURL(proxy_gurl));
+  }
+  if (params.proxy_user.empty() || params.proxy_pass.empty())
+    return;
+  auto* session = context->http_transaction_factory()->GetSession();
+  url::SchemeHostPort auth_origin(proxy_gurl);
+  AuthCredentials credentials(params.proxy_user, params.proxy_pass);
+  session->http_auth_cache()->Add(
+      auth_origin, HttpAuth::AUTH_PROXY,
+      /*realm=*/{}, HttpAuth::AUTH_SCHEME_BASIC, {},
+      /*challenge=*/"Basic", credentials, /*path=*/"/");
+}
+
+// Builds a URLRequestContext assuming there's only a single loop. Sets
+// |proxy_config_service| to its proxy config service, which it owns.
 std::unique_ptr<URLRequestContext> BuildURLRequestContext(
     const Params& params,
     scoped_refptr<CertNetFetcherURLRequest> cert_net_fetcher,
-    NetLog* net_log) {
+    NetLog* net_log,
+    ReloadableProxyConfigService** proxy_config_service) {
   URLRequestContextBuilder builder;
 
   builder.DisableHttpCache();
@@ -417,48 +918,160 @@ std::unique_ptr<URLRequestContext> BuildURLRequestContext(
   ProxyConfig proxy_config;
   proxy_config.proxy_rules().ParseFromString(params.proxy_url);
   LOG(INFO) << "Proxying via " << params.proxy_url;
+  auto reloadable_proxy_config_service =
+      std::make_unique<ReloadableProxyConfigService>(proxy_config);
+  *proxy_config_service = reloadable_proxy_config_service.get();
   auto proxy_service =
       ConfiguredProxyResolutionService::CreateWithoutProxyResolver(
-          std::make_unique<ProxyConfigServiceFixed>(
-              ProxyConfigWithAnnotation(proxy_config, kTrafficAnnotation)),
-          net_log);
+          std::move(reloadable_proxy_config_service), net_log);
   proxy_service->ForceReloadProxyConfig();
   builder.set_proxy_resolution_service(std::move(proxy_service));
 
-  if (!params.host_resolver_rules.empty()) {
-    builder.set_host_mapping_rules(params.host_resolver_rules);
+  HostResolver::ManagerOptions resolver_options;
+  resolver_options.max_concurrent_resolves = params.max_concurrent_resolves;
+  if (!params.doh_config.servers().empty()) {
+    // Resolves A, AAAA and HTTPS records in parallel over DoH. The DoH
+    // requests are tunneled through the proxy like any other request, while
+    // the proxy itself is bootstrapped with the insecure async resolver.
+    resolver_options.insecure_dns_client_enabled = true;
+    DnsConfigOverrides& overrides = resolver_options.dns_config_overrides;
+    overrides.dns_over_https_config = params.doh_config;
+    overrides.secure_dns_mode = SecureDnsMode::kSecure;
+    overrides.dns_over_https_via_proxy = true;
+    auto https_svcb_options = HostResolver::HttpsSvcbOptions::FromFeatures();
+    https_svcb_options.enable = true;
+    resolver_options.https_svcb_options = https_svcb_options;
   }
+  builder.set_host_resolver(HostResolver::CreateStandaloneResolver(
+      net_log, std::move(resolver_options), params.host_resolver_rules,
+      /*enable_caching=*/true));
 
   builder.SetCertVerifier(
       CertVerifier::CreateDefault(std::move(cert_net_fetcher)));
 
+  if (!params.happy_eyeballs_attempt_delay.is_zero()) {
+    HttpNetworkSessionParams session_params;
+    session_params.happy_eyeballs_attempt_delay =
+        params.happy_eyeballs_attempt_delay;
+    builder.set_http_network_session_params(session_params);
+  }
+
   builder.set_proxy_delegate(
       std::make_unique<NaiveProxyDelegate>(params.extra_headers));
 
+  // QuicStreamFactory copies the QUIC params when the session is built, so
+  // they must be complete before Build().
+  if (params.proxy_url.compare(0, 7, "quic://") == 0) {
+    auto quic_context = std::make_unique<QuicContext>();
+    auto* quic = quic_context->params();
+    quic->supported_versions = {quic::ParsedQuicVersion::RFCv1()};
+    // Idle and ping alarms do not mind running a little late, and firing
+    // them together saves wakeups.
+    quic->use_alarm_wheel = true;
+    quic->alarm_wheel_slack = base::Milliseconds(100);
+    quic->enable_pacing_offload = params.quic_pacing_offload;
+    // Tunnels are long-lived and multiplex bulk transfers, so they get the
+    // largest receive windows QUIC allows, and stay up through pauses in
+    // traffic for longer than a browser connection would. Open streams keep
+    // them alive with a PING every quic::kPingTimeoutSecs.
+    quic->session_max_recv_window_size =
+        static_cast<int32_t>(quic::kSessionReceiveWindowLimit);
+    quic->stream_max_recv_window_size =
+        static_cast<int32_t>(quic::kStreamReceiveWindowLimit);
+    quic->idle_connection_timeout = base::Minutes(5);
+    // Congestion control is negotiated per endpoint: connection options ask
+    // the server to use it for downloads, and client connection options
+    // apply it to uploads. kAFFE lets the server tune how often this side
+    // acknowledges with ACK_FREQUENCY frames.
+    quic->connection_options.push_back(params.quic_congestion_control);
+    quic->client_connection_options.push_back(params.quic_congestion_control);
+    quic->client_connection_options.push_back(quic::kAFFE);
+    for (quic::QuicTag tag : params.quic_connection_options) {
+      quic->connection_options.push_back(tag);
+      quic->client_connection_options.push_back(tag);
+    }
+    if (params.quic_migrate) {
+      // Moves the session to a new socket, validated by path probing, when
+      // the local address changes, writes fail or the path degrades, rather
+      // than dropping every tunnel on it. Where network handles are
+      // supported, it may move to another network instead. Idle sessions are
+      // kept too, as new tunnels will need them. Retransmittable PINGs notice
+      // a dead path while tunnels are open but quiet. The QUIC_SESSION events
+      // of the NetLog show whether a session may migrate.
+      quic->allow_port_migration = true;
+      quic->migrate_sessions_on_ip_change = true;
+      quic->migrate_sessions_on_network_change_v2 = true;
+      quic->migrate_sessions_early_v2 = true;
+      quic->migrate_idle_sessions = true;
+      quic->retransmittable_on_wire_timeout =
+          net::kDefaultRetransmittableOnWireTimeout;
+    }
+    // All sessions are read from one socket, routed by the client connection
+    // ID.
+    quic->use_shared_socket = params.quic_shared_socket;
+    builder.set_quic_context(std::move(quic_context));
+  }
+
   auto context = builder.Build();
+  AddProxyCredentials(params, context.get());
+  return context;
+}
 
-  if (!params.proxy_url.empty() && !params.proxy_user.empty() &&
-      !params.proxy_pass.empty()) {
-    auto* session = context->http_transaction_factory()->GetSession();
-    auto* auth_cache = session->http_auth_cache();
-    std::string proxy_url = params.proxy_url;
-    GURL proxy_gurl(proxy_url);
-    if (proxy_url.compare(0, 7, "quic://") == 0) {
-      proxy_url.replace(0, 4, "https");
-      proxy_gurl = GURL(proxy_url);
-      auto* quic = context->quic_context()->params();
-      quic->supported_versions = {quic::ParsedQuicVersion::RFCv1()};
-      quic->origins_to_force_quic_on.insert(
-          net::HostPortPair::FromURL(proxy_gurl));
-    }
-    url::SchemeHostPort auth_origin(proxy_gurl);
-    AuthCredentials credentials(params.proxy_user, params.proxy_pass);
-    auth_cache->Add(auth_origin, HttpAuth::AUTH_PROXY,
-                    /*realm=*/{}, HttpAuth::AUTH_SCHEME_BASIC, {},
-                    /*challenge=*/"Basic", credentials, /*path=*/"/");
+// Re-reads |config_path| and applies what can change without a restart to
+// new connections: extra-headers, insecure-concurrency, proxy and log.
+// Open connections and the sessions to the proxy are kept. Other options
+// only take effect on restart.
+void ReloadConfig(const base::FilePath& config_path,
+                  Params* params,
+                  NaiveProxy* naive_proxy,
+                  URLRequestContext* context,
+                  ReloadableProxyConfigService* proxy_config_service) {
+  LOG(INFO) << "Reloading " << config_path;
+  CommandLine cmdline;
+  Params new_params;
+  if (!GetCommandLineFromConfig(config_path, &cmdline) ||
+      !ParseCommandLine(cmdline, &new_params)) {
+    LOG(ERROR) << "Invalid config, keeping the current one";
+    return;
   }
 
-  return context;
+  // Copies the log file path, which |cmdline| owns.
+  logging::InitLogging(new_params.log_settings);
+
+  if (new_params.extra_headers.ToString() != params->extra_headers.ToString()) {
+    static_cast<NaiveProxyDelegate*>(context->proxy_delegate())
+        ->set_extra_headers(new_params.extra_headers);
+    params->extra_headers = new_params.extra_headers;
+    LOG(INFO) << "Reloaded extra headers";
+  }
+
+  if (new_params.concurrency != params->concurrency) {
+    naive_proxy->SetConcurrency(new_params.concurrency);
+    params->concurrency = new_params.concurrency;
+    LOG(INFO) << "Reloaded concurrency: " << params->concurrency;
+  }
+
+  if (new_params.proxy_url != params->proxy_url ||
+      new_params.proxy_user != params->proxy_user ||
+      new_params.proxy_pass != params->proxy_pass) {
+    // The QUIC parameters of the context are only set up for a quic://
+    // proxy at startup.
+    if ((new_params.proxy_url.compare(0, 7, "quic://") == 0) !=
+        (params->proxy_url.compare(0, 7, "quic://") == 0)) {
+      LOG(ERROR) << "Switching to or from a quic:// proxy needs a restart";
+      return;
+    }
+    AddProxyCredentials(new_params, context);
+    ProxyConfig proxy_config;
+    proxy_config.proxy_rules().ParseFromString(new_params.proxy_url);
+    // Requests of the context, e.g. for DoH, resolve their proxy with it.
+    proxy_config_service->SetConfig(proxy_config);
+    naive_proxy->SetProxyList(proxy_config.proxy_rules().single_proxies);
+    params->proxy_url = new_params.proxy_url;
+    params->proxy_user = new_params.proxy_user;
+    params->proxy_pass = new_params.proxy_pass;
+    LOG(INFO) << "Proxying new connections via " << params->proxy_url;
+  }
 }
 }  // namespace
 }  // namespace net
@@ -468,8 +1081,12 @@ int main(int argc, char* argv[]) {
 
   url::AddStandardScheme("quic",
                          url::SCHEME_WITH_HOST_PORT_AND_USER_INFORMATION);
+  url::AddStandardScheme("socks",
+                         url::SCHEME_WITH_HOST_PORT_AND_USER_INFORMATION);
+  url::AddStandardScheme("redir", url::SCHEME_WITH_HOST_AND_PORT);
   base::FeatureList::InitializeInstance(
-      "PartitionConnectionsByNetworkIsolationKey", std::string());
+      "PartitionConnectionsByNetworkIsolationKey,EnableTLS13EarlyData",
+      std::string());
   net::ClientSocketPoolManager::set_max_sockets_per_pool(
       net::HttpNetworkSession::NORMAL_SOCKET_POOL,
       kDefaultMaxSocketsPerPool * kExpectedMaxUsers);
@@ -491,18 +1108,22 @@ int main(int argc, char* argv[]) {
 
   CommandLine cmdline;
   Params params;
+  // Reloaded on SIGHUP.
+  base::FilePath config_path;
   const auto& proc = *base::CommandLine::ForCurrentProcess();
   const auto& args = proc.GetArgs();
   if (args.empty()) {
     if (proc.argv().size() >= 2) {
       GetCommandLine(proc, &cmdline);
     } else {
-      auto path = base::FilePath::FromUTF8Unsafe("config.json");
-      GetCommandLineFromConfig(path, &cmdline);
+      config_path = base::FilePath::FromUTF8Unsafe("config.json");
     }
   } else {
-    base::FilePath path(args[0]);
-    GetCommandLineFromConfig(path, &cmdline);
+    config_path = base::FilePath(args[0]);
+  }
+  if (!config_path.empty() &&
+      !GetCommandLineFromConfig(config_path, &cmdline)) {
+    return EXIT_FAILURE;
   }
   if (!ParseCommandLine(cmdline, &params)) {
     return EXIT_FAILURE;
@@ -514,6 +1135,12 @@ int main(int argc, char* argv[]) {
 
   naive_partition_alloc_support::ReconfigureAfterTaskRunnerInit();
 
+  // Reports the local address changes that migrating QUIC sessions act on.
+  // Must outlive the URL request contexts.
+  std::unique_ptr<net::NetworkChangeNotifier> network_change_notifier;
+  if (params.quic_migrate)
+    network_change_notifier = net::NetworkChangeNotifier::CreateIfNeeded();
+
   if (!params.ssl_key_path.empty()) {
     net::SSLClientSocket::SetSSLKeyLogger(
         std::make_unique<net::SSLKeyLoggerImpl>(params.ssl_key_path));
@@ -525,7 +1152,13 @@ int main(int argc, char* argv[]) {
   // printing_log_observer.
   net::NetLog* net_log = net::NetLog::Get();
   std::unique_ptr<net::FileNetLogObserver> observer;
-  if (!params.net_log_path.empty()) {
+  std::unique_ptr<net::BoundedNetLogObserver> bounded_observer;
+  if (params.net_log_buffer_size > 0) {
+    bounded_observer = std::make_unique<net::BoundedNetLogObserver>(
+        params.net_log_buffer_size, params.net_log_events, GetConstants());
+    bounded_observer->StartObserving(net_log,
+                                     net::NetLogCaptureMode::kDefault);
+  } else if (!params.net_log_path.empty()) {
     observer = net::FileNetLogObserver::CreateUnbounded(
         params.net_log_path, net::NetLogCaptureMode::kDefault, GetConstants());
     observer->StartObserving(net_log);
@@ -548,15 +1181,40 @@ int main(int argc, char* argv[]) {
   cert_net_fetcher = base::MakeRefCounted<net::CertNetFetcherURLRequest>();
   cert_net_fetcher->SetURLRequestContext(cert_context.get());
 #endif
-  auto context =
-      net::BuildURLRequestContext(params, std::move(cert_net_fetcher), net_log);
+  net::ReloadableProxyConfigService* proxy_config_service = nullptr;
+  auto context = net::BuildURLRequestContext(
+      params, std::move(cert_net_fetcher), net_log, &proxy_config_service);
   auto* session = context->http_transaction_factory()->GetSession();
 
+  auto listen_tcp_socket = std::make_unique<net::TCPSocket>(
+      /*socket_performance_watcher=*/nullptr, net_log, net::NetLogSource());
+#if BUILDFLAG(IS_POSIX)
+  // Its descriptor is handed over on hot restart.
+  net::TCPSocket* listen_tcp_socket_ptr = listen_tcp_socket.get();
+#endif
   auto listen_socket =
-      std::make_unique<net::TCPServerSocket>(net_log, net::NetLogSource());
+      std::make_unique<net::TCPServerSocket>(std::move(listen_tcp_socket));
 
-  int result = listen_socket->ListenWithAddressAndPort(
-      params.listen_addr, params.listen_port, kListenBackLog);
+  net::IPAddress listen_addr;
+  if (!listen_addr.AssignFromIPLiteral(params.listen_addr)) {
+    LOG(ERROR) << "Failed to listen: " << net::ERR_ADDRESS_INVALID;
+    return EXIT_FAILURE;
+  }
+  net::IPEndPoint listen_endpoint(listen_addr, params.listen_port);
+  int result = net::ERR_FAILED;
+#if BUILDFLAG(IS_POSIX)
+  if (!params.hot_restart_path.empty()) {
+    base::ScopedFD listen_fd =
+        net::HotRestart::TakeOver(params.hot_restart_path, listen_endpoint);
+    if (listen_fd.is_valid()) {
+      result = listen_socket->AdoptSocket(listen_fd.release());
+      if (result == net::OK)
+        LOG(INFO) << "Took over listening socket from previous process";
+    }
+  }
+#endif
+  if (result != net::OK)
+    result = listen_socket->Listen(listen_endpoint, kListenBackLog);
   if (result != net::OK) {
     LOG(ERROR) << "Failed to listen: " << result;
     return EXIT_FAILURE;
@@ -564,19 +1222,31 @@ int main(int argc, char* argv[]) {
   LOG(INFO) << "Listening on " << params.listen_addr << ":"
             << params.listen_port;
 
+  std::unique_ptr<net::ServerSocket> server_socket = std::move(listen_socket);
+  if (params.protocol == net::ClientProtocol::kHttps) {
+    net::SSLServerConfig ssl_server_config;
+    ssl_server_config.alpn_protos = {net::kProtoHTTP2, net::kProtoHTTP11};
+    std::string proxy_authorization;
+    if (!params.listen_user.empty()) {
+      base::Base64Encode(params.listen_user + ":" + params.listen_pass,
+                         &proxy_authorization);
+      proxy_authorization = "Basic " + proxy_authorization;
+    }
+    server_socket = std::make_unique<net::HttpsProxyServerSocket>(
+        std::move(server_socket),
+        net::CreateSSLServerContext(params.listen_cert.get(),
+                                    params.listen_key.get(), ssl_server_config),
+        proxy_authorization, kTrafficAnnotation);
+  }
+
   std::unique_ptr<net::RedirectResolver> resolver;
   if (params.protocol == net::ClientProtocol::kRedir) {
     auto resolver_socket =
         std::make_unique<net::UDPServerSocket>(net_log, net::NetLogSource());
+    // Also lets the resolver bind while that of the process it takes over
+    // from is still open.
     resolver_socket->AllowAddressReuse();
-    net::IPAddress listen_addr;
-    if (!listen_addr.AssignFromIPLiteral(params.listen_addr)) {
-      LOG(ERROR) << "Failed to open resolver: " << net::ERR_ADDRESS_INVALID;
-      return EXIT_FAILURE;
-    }
-
-    result = resolver_socket->Listen(
-        net::IPEndPoint(listen_addr, params.listen_port));
+    result = resolver_socket->Listen(listen_endpoint);
     if (result != net::OK) {
       LOG(ERROR) << "Failed to open resolver: " << result;
       return EXIT_FAILURE;
@@ -587,12 +1257,70 @@ int main(int argc, char* argv[]) {
         params.resolver_prefix);
   }
 
-  net::NaiveProxy naive_proxy(std::move(listen_socket), params.protocol,
+  std::unique_ptr<net::ConnectionTracer> connection_tracer;
+  if (!params.connection_trace_path.empty()) {
+    connection_tracer = std::make_unique<net::ConnectionTracer>(
+        params.connection_stall_threshold);
+  }
+  net::NaiveProxy naive_proxy(std::move(server_socket), params.protocol,
                               params.listen_user, params.listen_pass,
                               params.concurrency, resolver.get(), session,
                               kTrafficAnnotation);
+  if (resolver && !params.resolver_preconnect_window.is_zero()) {
+    naive_proxy.EnableSpeculativeConnect(params.resolver_preconnect_window);
+  }
+  naive_proxy.set_priority_policy(params.priority_policy);
+  naive_proxy.set_max_bytes_in_flight(params.relay_buffer_size);
+  if (params.route_table) {
+    LOG(INFO) << "Loaded " << params.route_table->rule_count()
+              << " route rules";
+    naive_proxy.set_route_table(params.route_table.get());
+  }
+  if (connection_tracer)
+    naive_proxy.set_connection_tracer(connection_tracer.get());
+
+#if BUILDFLAG(IS_POSIX)
+  net::SignalWatcher signal_watcher;
+  if (bounded_observer) {
+    signal_watcher.Watch(
+        SIGUSR1, base::BindRepeating(&net::BoundedNetLogObserver::Dump,
+                                     base::Unretained(bounded_observer.get()),
+                                     params.net_log_path));
+  }
+  if (connection_tracer) {
+    signal_watcher.Watch(
+        SIGUSR2, base::BindRepeating(&net::ConnectionTracer::Dump,
+                                     base::Unretained(connection_tracer.get()),
+                                     params.connection_trace_path));
+  }
+  if (!config_path.empty()) {
+    signal_watcher.Watch(
+        SIGHUP, base::BindRepeating(
+                    &net::ReloadConfig, config_path, base::Unretained(&params),
+                    base::Unretained(&naive_proxy),
+                    base::Unretained(context.get()),
+                    base::Unretained(proxy_config_service)));
+  }
+#endif
+
+  base::RunLoop run_loop;
+#if BUILDFLAG(IS_POSIX)
+  std::unique_ptr<net::HotRestart> hot_restart;
+  if (!params.hot_restart_path.empty()) {
+    hot_restart = std::make_unique<net::HotRestart>(params.hot_restart_path);
+    // Exits once drained after handing the listening socket over.
+    result = hot_restart->Start(
+        listen_tcp_socket_ptr->SocketDescriptorForTesting(),
+        base::BindOnce(&net::NaiveProxy::Drain, base::Unretained(&naive_proxy),
+                       params.hot_restart_drain, run_loop.QuitClosure()));
+    if (result != net::OK) {
+      LOG(ERROR) << "Failed to serve hot restart: " << result;
+      return EXIT_FAILURE;
+    }
+  }
+#endif
 
-  base::RunLoop().Run();
+  run_loop.Run();
 
   return EXIT_SUCCESS;
 }
@@ -104,7 +104,7 @@ PaddingDetectorDelegate::PaddingDetectorDelegate(
     const ProxyServer& proxy_server,
     ClientProtocol client_protocol)
     : naive_proxy_delegate_(naive_proxy_delegate),
-      proxy_server_(proxy_server),
+      proxy_server_(&proxy_server),
       client_protocol_(client_protocol),
       detected_client_padding_support_(PaddingSupport::kUnknown),
       cached_server_padding_support_(PaddingSupport::kUnknown) {}
@@ -137,6 +137,11 @@ void PaddingDetectorDelegate::SetClientPaddingSupport(
   detected_client_padding_support_ = padding_support;
 }
 
+void PaddingDetectorDelegate::SetProxyServer(const ProxyServer& proxy_server) {
+  proxy_server_ = &proxy_server;
+  cached_server_padding_support_ = PaddingSupport::kUnknown;
+}
+
 PaddingSupport PaddingDetectorDelegate::GetClientPaddingSupport() {
   // Not possible to detect padding capability given underlying protocol.
   if (client_protocol_ == ClientProtocol::kSocks5) {
@@ -152,7 +157,7 @@ PaddingSupport PaddingDetectorDelegate::GetServerPaddingSupport() {
   if (cached_server_padding_support_ != PaddingSupport::kUnknown)
     return cached_server_padding_support_;
   cached_server_padding_support_ =
-      naive_proxy_delegate_->GetProxyServerPaddingSupport(proxy_server_);
+      naive_proxy_delegate_->GetProxyServerPaddingSupport(*proxy_server_);
   return cached_server_padding_support_;
 }
 
@@ -12,6 +12,7 @@
 #include "net/base/net_errors.h"
 #include "net/base/proxy_delegate.h"
 #include "net/base/proxy_server.h"
+#include "net/http/http_request_headers.h"
 #include "net/proxy_resolution/proxy_retry_info.h"
 #include "net/tools/naive/naive_protocol.h"
 #include "url/gurl.h"
@@ -23,7 +24,6 @@ void InitializeNonindexCodes();
 void FillNonindexHeaderValue(uint64_t unique_bits, char* buf, int len);
 
 class ProxyInfo;
-class HttpRequestHeaders;
 class HttpResponseHeaders;
 
 enum class PaddingSupport {
@@ -53,8 +53,13 @@ class NaiveProxyDelegate : public ProxyDelegate {
 
   PaddingSupport GetProxyServerPaddingSupport(const ProxyServer& proxy_server);
 
+  // Applies to tunnel requests from now on.
+  void set_extra_headers(const HttpRequestHeaders& extra_headers) {
+    extra_headers_ = extra_headers;
+  }
+
  private:
-  const HttpRequestHeaders& extra_headers_;
+  HttpRequestHeaders extra_headers_;
   std::map<ProxyServer, PaddingSupport> padding_state_by_server_;
 };
 
@@ -75,13 +80,16 @@ class PaddingDetectorDelegate : public ClientPaddingDetectorDelegate {
   bool IsPaddingSupportKnown();
   Direction GetPaddingDirection();
   void SetClientPaddingSupport(PaddingSupport padding_support) override;
+  // Changes the server side to |proxy_server|, e.g. direct for connections
+  // routed around the proxy. Must be called before padding is detected.
+  void SetProxyServer(const ProxyServer& proxy_server);
 
  private:
   PaddingSupport GetClientPaddingSupport();
   PaddingSupport GetServerPaddingSupport();
 
   NaiveProxyDelegate* naive_proxy_delegate_;
-  const ProxyServer& proxy_server_;
+  const ProxyServer* proxy_server_;
   ClientProtocol client_protocol_;
 
   PaddingSupport detected_client_padding_support_;
@@ -52,6 +52,10 @@ RedirectResolver::RedirectResolver(std::unique_ptr<DatagramServerSocket> socket,
 
 RedirectResolver::~RedirectResolver() = default;
 
+void RedirectResolver::StopListening() {
+  socket_.reset();
+}
+
 void RedirectResolver::DoRead() {
   for (;;) {
     int rv = socket_->RecvFrom(
@@ -207,6 +211,9 @@ int RedirectResolver::HandleReadResult(int result) {
       return ERR_NO_BUFFER_SPACE;
     }
     std::memcpy(buffer_->data(), response.io_buffer()->data(), size);
+
+    if (name_resolved_callback_)
+      name_resolved_callback_.Run(name);
   } else {
     absl::optional<DnsQuery> query_opt;
     query_opt.emplace(query.id(), query.qname(), query.qtype());
@@ -10,7 +10,9 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <utility>
 
+#include "base/callback.h"
 #include "base/memory/ref_counted.h"
 #include "base/memory/weak_ptr.h"
 #include "base/time/time.h"
@@ -35,6 +37,9 @@ struct Resolution {
 
 class RedirectResolver {
  public:
+  using NameResolvedCallback =
+      base::RepeatingCallback<void(const std::string& name)>;
+
   RedirectResolver(std::unique_ptr<DatagramServerSocket> socket,
                    const IPAddress& range,
                    size_t prefix);
@@ -45,6 +50,14 @@ class RedirectResolver {
   bool IsInResolvedRange(const IPAddress& address) const;
   std::string FindNameByAddress(const IPAddress& address) const;
 
+  // Closes the socket. Names already answered can still be found.
+  void StopListening();
+
+  // Runs |callback| with every name answered with a fake address.
+  void set_name_resolved_callback(NameResolvedCallback callback) {
+    name_resolved_callback_ = std::move(callback);
+  }
+
  private:
   void DoRead();
   void OnRecv(int result);
@@ -62,6 +75,8 @@ class RedirectResolver {
   std::map<uint32_t, std::list<Resolution>::iterator> resolution_by_addr_;
   std::list<Resolution> resolutions_;
 
+  NameResolvedCallback name_resolved_callback_;
+
   base::WeakPtrFactory<RedirectResolver> weak_ptr_factory_{this};
 };
 
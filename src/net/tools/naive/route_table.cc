@@ -0,0 +1,284 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#include "net/tools/naive/route_table.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "base/check.h"
+#include "base/hash/hash.h"
+#include "base/strings/strcat.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include "base/strings/string_util.h"
+#include "net/base/ip_address.h"
+
+namespace net {
+
+namespace {
+// No rule, or no keyword node.
+constexpr uint32_t kNone = std::numeric_limits<uint32_t>::max();
+
+bool ParseAction(base::StringPiece value, RouteTable::Action* action) {
+  if (base::EqualsCaseInsensitiveASCII(value, "PROXY")) {
+    *action = RouteTable::Action::kProxy;
+  } else if (base::EqualsCaseInsensitiveASCII(value, "DIRECT")) {
+    *action = RouteTable::Action::kDirect;
+  } else if (base::EqualsCaseInsensitiveASCII(value, "REJECT")) {
+    *action = RouteTable::Action::kReject;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Lowercases |value| and strips the dots around it, so that e.g.
+// ".Example.com" matches like the canonical "example.com".
+std::string NormalizeName(base::StringPiece value) {
+  return base::ToLowerASCII(base::TrimString(value, ".", base::TRIM_ALL));
+}
+}  // namespace
+
+size_t RouteTable::AddressKeyHash::operator()(const AddressKey& key) const {
+  return base::HashInts64(key.high, key.low);
+}
+
+RouteTable::RouteTable()
+    : match_rule_(kNone), keyword_nodes_(1, KeywordNode{0, kNone}) {}
+
+RouteTable::~RouteTable() = default;
+
+bool RouteTable::Load(base::StringPiece rules, std::string* error) {
+  DCHECK(actions_.empty());
+
+  // Names are copied into |names_| at the end so that it is allocated once.
+  std::vector<std::pair<std::string, uint32_t>> exact_names;
+  std::vector<std::pair<std::string, uint32_t>> suffix_names;
+
+  int line_number = 0;
+  for (base::StringPiece line : base::SplitStringPiece(
+           rules, "\n", base::TRIM_WHITESPACE, base::SPLIT_WANT_ALL)) {
+    ++line_number;
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    auto invalid = [&](base::StringPiece reason) {
+      *error = base::StrCat(
+          {"line ", base::NumberToString(line_number), ": ", reason});
+      return false;
+    };
+
+    std::vector<base::StringPiece> fields = base::SplitStringPiece(
+        line, ",", base::TRIM_WHITESPACE, base::SPLIT_WANT_ALL);
+    base::StringPiece type = fields[0];
+    bool is_match = base::EqualsCaseInsensitiveASCII(type, "MATCH") ||
+                    base::EqualsCaseInsensitiveASCII(type, "FINAL");
+    // Fields after the action, e.g. no-resolve, are ignored.
+    size_t action_index = is_match ? 1 : 2;
+    if (fields.size() <= action_index)
+      return invalid("missing action");
+    Action action;
+    if (!ParseAction(fields[action_index], &action))
+      return invalid("unknown action");
+    auto rule = static_cast<uint32_t>(actions_.size());
+    base::StringPiece value = fields[1];
+
+    if (is_match) {
+      match_rule_ = std::min(match_rule_, rule);
+    } else if (base::EqualsCaseInsensitiveASCII(type, "DOMAIN")) {
+      std::string name = NormalizeName(value);
+      if (name.empty())
+        return invalid("empty domain");
+      exact_names.emplace_back(std::move(name), rule);
+    } else if (base::EqualsCaseInsensitiveASCII(type, "DOMAIN-SUFFIX")) {
+      std::string name = NormalizeName(value);
+      if (name.empty())
+        return invalid("empty domain");
+      suffix_names.emplace_back(std::move(name), rule);
+    } else if (base::EqualsCaseInsensitiveASCII(type, "DOMAIN-KEYWORD")) {
+      if (value.empty())
+        return invalid("empty keyword");
+      AddKeyword(base::ToLowerASCII(value), rule);
+    } else if (base::EqualsCaseInsensitiveASCII(type, "IP-CIDR") ||
+               base::EqualsCaseInsensitiveASCII(type, "IP-CIDR6")) {
+      IPAddress address;
+      size_t prefix_length;
+      if (!ParseCIDRBlock(value, &address, &prefix_length))
+        return invalid("invalid CIDR block");
+      if (address.IsIPv4()) {
+        address = ConvertIPv4ToIPv4MappedIPv6(address);
+        prefix_length += 96;
+      }
+      addresses_[prefix_length].emplace(
+          MakeAddressKey(address, prefix_length), rule);
+    } else {
+      continue;
+    }
+    actions_.push_back(action);
+  }
+
+  size_t names_size = 0;
+  for (const auto& names : {&exact_names, &suffix_names}) {
+    for (const auto& [name, rule] : *names)
+      names_size += name.size();
+  }
+  names_.reserve(names_size);
+  exact_names_.reserve(exact_names.size());
+  suffix_names_.reserve(suffix_names.size());
+  for (auto [names, map] : {std::make_pair(&exact_names, &exact_names_),
+                            std::make_pair(&suffix_names, &suffix_names_)}) {
+    for (const auto& [name, rule] : *names) {
+      base::StringPiece key(names_.data() + names_.size(), name.size());
+      names_.append(name);
+      // Rules are in order, so the first one of duplicates is kept.
+      map->emplace(key, rule);
+    }
+  }
+
+  BuildKeywordLinks();
+  return true;
+}
+
+RouteTable::Action RouteTable::Route(base::StringPiece host) const {
+  if (!host.empty() && host.back() == '.')
+    host.remove_suffix(1);
+
+  uint32_t rule = std::min({match_rule_, MatchName(host), MatchKeyword(host)});
+  IPAddress address;
+  if (!addresses_.empty() && ParseURLHostnameToAddress(host, &address))
+    rule = std::min(rule, MatchAddress(address));
+
+  if (rule == kNone)
+    return Action::kProxy;
+  return actions_[rule];
+}
+
+// static
+RouteTable::AddressKey RouteTable::MakeAddressKey(const IPAddress& address,
+                                                  size_t prefix_length) {
+  DCHECK(address.IsIPv6());
+  const auto& bytes = address.bytes();
+  AddressKey key = {0, 0};
+  for (size_t i = 0; i < 8; ++i)
+    key.high = key.high << 8 | bytes[i];
+  for (size_t i = 8; i < 16; ++i)
+    key.low = key.low << 8 | bytes[i];
+
+  if (prefix_length == 0) {
+    key.high = 0;
+    key.low = 0;
+  } else if (prefix_length <= 64) {
+    key.high &= ~uint64_t{0} << (64 - prefix_length);
+    key.low = 0;
+  } else if (prefix_length < 128) {
+    key.low &= ~uint64_t{0} << (128 - prefix_length);
+  }
+  return key;
+}
+
+void RouteTable::AddKeyword(base::StringPiece keyword, uint32_t rule) {
+  uint32_t node = 0;
+  for (char c : keyword) {
+    uint64_t edge = uint64_t{node} << 8 | static_cast<uint8_t>(c);
+    auto it = keyword_edges_.find(edge);
+    if (it == keyword_edges_.end()) {
+      keyword_nodes_.push_back(KeywordNode{0, kNone});
+      it = keyword_edges_
+               .emplace(edge, static_cast<uint32_t>(keyword_nodes_.size() - 1))
+               .first;
+    }
+    node = it->second;
+  }
+  keyword_nodes_[node].rule = std::min(keyword_nodes_[node].rule, rule);
+}
+
+void RouteTable::BuildKeywordLinks() {
+  std::vector<std::vector<std::pair<uint8_t, uint32_t>>> children(
+      keyword_nodes_.size());
+  for (const auto& [edge, child] : keyword_edges_)
+    children[edge >> 8].emplace_back(static_cast<uint8_t>(edge), child);
+
+  // Breadth first, so that fail links always point to finished nodes.
+  std::vector<uint32_t> queue = {0};
+  for (size_t i = 0; i < queue.size(); ++i) {
+    uint32_t node = queue[i];
+    for (const auto& [byte, child] : children[node]) {
+      uint32_t fail = 0;
+      if (node != 0) {
+        uint32_t next;
+        uint32_t state = keyword_nodes_[node].fail;
+        while ((next = FindKeywordEdge(state, byte)) == kNone && state != 0)
+          state = keyword_nodes_[state].fail;
+        if (next != kNone)
+          fail = next;
+      }
+      keyword_nodes_[child].fail = fail;
+      keyword_nodes_[child].rule =
+          std::min(keyword_nodes_[child].rule, keyword_nodes_[fail].rule);
+      queue.push_back(child);
+    }
+  }
+}
+
+uint32_t RouteTable::FindKeywordEdge(uint32_t node, uint8_t byte) const {
+  auto it = keyword_edges_.find(uint64_t{node} << 8 | byte);
+  if (it == keyword_edges_.end())
+    return kNone;
+  return it->second;
+}
+
+uint32_t RouteTable::MatchName(base::StringPiece host) const {
+  uint32_t rule = kNone;
+  auto it = exact_names_.find(host);
+  if (it != exact_names_.end())
+    rule = it->second;
+
+  if (suffix_names_.empty())
+    return rule;
+  // Tries the name itself, then the name after each dot.
+  base::StringPiece suffix = host;
+  while (true) {
+    it = suffix_names_.find(suffix);
+    if (it != suffix_names_.end())
+      rule = std::min(rule, it->second);
+    size_t dot = suffix.find('.');
+    if (dot == base::StringPiece::npos)
+      break;
+    suffix.remove_prefix(dot + 1);
+  }
+  return rule;
+}
+
+uint32_t RouteTable::MatchKeyword(base::StringPiece host) const {
+  if (keyword_edges_.empty())
+    return kNone;
+
+  uint32_t rule = kNone;
+  uint32_t node = 0;
+  for (char c : host) {
+    auto byte = static_cast<uint8_t>(c);
+    uint32_t next;
+    while ((next = FindKeywordEdge(node, byte)) == kNone && node != 0)
+      node = keyword_nodes_[node].fail;
+    if (next != kNone)
+      node = next;
+    rule = std::min(rule, keyword_nodes_[node].rule);
+  }
+  return rule;
+}
+
+uint32_t RouteTable::MatchAddress(const IPAddress& address) const {
+  IPAddress mapped =
+      address.IsIPv4() ? ConvertIPv4ToIPv4MappedIPv6(address) : address;
+  uint32_t rule = kNone;
+  for (const auto& [prefix_length, keys] : addresses_) {
+    auto it = keys.find(MakeAddressKey(mapped, prefix_length));
+    if (it != keys.end())
+      rule = std::min(rule, it->second);
+  }
+  return rule;
+}
+
+}  // namespace net
@@ -0,0 +1,115 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#ifndef NET_TOOLS_NAIVE_ROUTE_TABLE_H_
+#define NET_TOOLS_NAIVE_ROUTE_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/strings/string_piece.h"
+
+namespace net {
+
+class IPAddress;
+
+// Decides how connections to each origin are made, from rules in the format
+// of common rule lists, one per line:
+//
+//   DOMAIN,www.example.com,DIRECT
+//   DOMAIN-SUFFIX,example.com,PROXY
+//   DOMAIN-KEYWORD,tracker,REJECT
+//   IP-CIDR,192.168.0.0/16,DIRECT
+//   IP-CIDR6,fc00::/7,DIRECT
+//   MATCH,PROXY
+//
+// The first matching rule wins, and origins that no rule matches are proxied.
+// IP rules only match origins given as IP addresses, since names are resolved
+// by the proxy. Other rule types, e.g. GEOIP, are skipped.
+//
+// Rules are compiled into hash tables keyed by name and by masked address,
+// and an Aho-Corasick automaton of keywords. A lookup costs one probe per
+// label of the name, one pass over the name, and one probe per IP prefix
+// length in use, however many rules there are.
+class RouteTable {
+ public:
+  enum class Action {
+    kProxy,
+    kDirect,
+    kReject,
+  };
+
+  RouteTable();
+  ~RouteTable();
+  RouteTable(const RouteTable&) = delete;
+  RouteTable& operator=(const RouteTable&) = delete;
+
+  // Parses and compiles |rules|. On failure returns false and describes the
+  // first invalid line in |error|.
+  bool Load(base::StringPiece rules, std::string* error);
+
+  // |host| is a canonicalized host name or IP literal.
+  Action Route(base::StringPiece host) const;
+
+  size_t rule_count() const { return actions_.size(); }
+
+ private:
+  // An IPv6 address, or an IPv4-mapped one, with bits past the prefix
+  // cleared.
+  struct AddressKey {
+    bool operator==(const AddressKey& other) const {
+      return high == other.high && low == other.low;
+    }
+
+    uint64_t high;
+    uint64_t low;
+  };
+
+  struct AddressKeyHash {
+    size_t operator()(const AddressKey& key) const;
+  };
+
+  struct KeywordNode {
+    uint32_t fail;
+    // The first rule whose keyword ends here or at a node on the fail chain.
+    uint32_t rule;
+  };
+
+  using NameMap =
+      std::unordered_map<base::StringPiece, uint32_t, base::StringPieceHash>;
+  using AddressMap = std::unordered_map<AddressKey, uint32_t, AddressKeyHash>;
+
+  static AddressKey MakeAddressKey(const IPAddress& address,
+                                   size_t prefix_length);
+
+  void AddKeyword(base::StringPiece keyword, uint32_t rule);
+  void BuildKeywordLinks();
+  uint32_t FindKeywordEdge(uint32_t node, uint8_t byte) const;
+
+  uint32_t MatchName(base::StringPiece host) const;
+  uint32_t MatchKeyword(base::StringPiece host) const;
+  uint32_t MatchAddress(const IPAddress& address) const;
+
+  std::vector<Action> actions_;
+  uint32_t match_rule_;
+
+  // Names of DOMAIN and DOMAIN-SUFFIX rules, which the maps point into.
+  std::string names_;
+  NameMap exact_names_;
+  NameMap suffix_names_;
+
+  // Node 0 is the root. Edges are keyed by (node << 8 | byte).
+  std::vector<KeywordNode> keyword_nodes_;
+  std::unordered_map<uint64_t, uint32_t> keyword_edges_;
+
+  // By IPv6 prefix length.
+  std::map<size_t, AddressMap> addresses_;
+};
+
+}  // namespace net
+#endif  // NET_TOOLS_NAIVE_ROUTE_TABLE_H_
@@ -0,0 +1,101 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#include "net/tools/naive/signal_watcher.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <tuple>
+#include <utility>
+
+#include "base/check.h"
+#include "base/files/file_util.h"
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/posix/eintr_wrapper.h"
+#include "base/task/current_thread.h"
+
+namespace net {
+
+namespace {
+int g_signal_write_fd = -1;
+
+void HandleSignal(int signum) {
+  int saved_errno = errno;
+  unsigned char byte = static_cast<unsigned char>(signum);
+  // Drops the signal if the pipe is full; a wakeup is already pending.
+  std::ignore = HANDLE_EINTR(write(g_signal_write_fd, &byte, 1));
+  errno = saved_errno;
+}
+}  // namespace
+
+SignalWatcher::SignalWatcher() : controller_(FROM_HERE) {}
+
+SignalWatcher::~SignalWatcher() {
+  for (const auto& [signum, callback] : callbacks_) {
+    signal(signum, SIG_DFL);
+  }
+  g_signal_write_fd = -1;
+}
+
+bool SignalWatcher::Watch(int signum, base::RepeatingClosure callback) {
+  DCHECK_GT(signum, 0);
+  DCHECK_LT(signum, 256);
+  if (!read_fd_.is_valid() && !StartWatching())
+    return false;
+
+  callbacks_[signum] = std::move(callback);
+
+  struct sigaction action = {};
+  action.sa_handler = HandleSignal;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  if (sigaction(signum, &action, nullptr) != 0) {
+    PLOG(ERROR) << "sigaction";
+    callbacks_.erase(signum);
+    return false;
+  }
+  return true;
+}
+
+bool SignalWatcher::StartWatching() {
+  DCHECK_EQ(g_signal_write_fd, -1) << "Only one SignalWatcher is supported";
+  int fds[2];
+  if (!base::CreateLocalNonBlockingPipe(fds)) {
+    PLOG(ERROR) << "pipe";
+    return false;
+  }
+  read_fd_.reset(fds[0]);
+  write_fd_.reset(fds[1]);
+  if (!base::SetCloseOnExec(read_fd_.get()) ||
+      !base::SetCloseOnExec(write_fd_.get())) {
+    PLOG(ERROR) << "fcntl";
+    return false;
+  }
+  if (!base::CurrentIOThread::Get()->WatchFileDescriptor(
+          read_fd_.get(), /*persistent=*/true,
+          base::MessagePumpForIO::WATCH_READ, &controller_, this)) {
+    LOG(ERROR) << "Failed to watch signal pipe";
+    return false;
+  }
+  g_signal_write_fd = write_fd_.get();
+  return true;
+}
+
+void SignalWatcher::OnFileCanReadWithoutBlocking(int fd) {
+  unsigned char signals[64];
+  for (;;) {
+    ssize_t n = HANDLE_EINTR(read(fd, signals, sizeof(signals)));
+    if (n <= 0)
+      return;
+    for (ssize_t i = 0; i < n; ++i) {
+      auto it = callbacks_.find(signals[i]);
+      if (it != callbacks_.end())
+        it->second.Run();
+    }
+  }
+}
+
+}  // namespace net
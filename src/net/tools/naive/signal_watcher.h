@@ -0,0 +1,43 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#ifndef NET_TOOLS_NAIVE_SIGNAL_WATCHER_H_
+#define NET_TOOLS_NAIVE_SIGNAL_WATCHER_H_
+
+#include <map>
+
+#include "base/callback.h"
+#include "base/files/scoped_file.h"
+#include "base/message_loop/message_pump_for_io.h"
+
+namespace net {
+
+// Turns POSIX signals into callbacks on the IO thread that created the
+// watcher. The signal handler only writes the signal number to a self-pipe,
+// so callbacks may do arbitrary work. At most one watcher may exist.
+class SignalWatcher : public base::MessagePumpForIO::FdWatcher {
+ public:
+  SignalWatcher();
+  ~SignalWatcher() override;
+  SignalWatcher(const SignalWatcher&) = delete;
+  SignalWatcher& operator=(const SignalWatcher&) = delete;
+
+  // Runs |callback| each time |signum| is delivered. Replaces the previous
+  // callback for the same signal.
+  bool Watch(int signum, base::RepeatingClosure callback);
+
+  // base::MessagePumpForIO::FdWatcher implementation.
+  void OnFileCanReadWithoutBlocking(int fd) override;
+  void OnFileCanWriteWithoutBlocking(int fd) override {}
+
+ private:
+  bool StartWatching();
+
+  base::ScopedFD read_fd_;
+  base::ScopedFD write_fd_;
+  std::map<int, base::RepeatingClosure> callbacks_;
+  base::MessagePumpForIO::FdWatchController controller_;
+};
+
+}  // namespace net
+#endif  // NET_TOOLS_NAIVE_SIGNAL_WATCHER_H_
@@ -5,6 +5,7 @@
 
 #include "net/tools/naive/socks5_server_socket.h"
 
+#include <algorithm>
 #include <cstring>
 #include <utility>
 
@@ -27,9 +28,12 @@ enum SocksCommandType {
   kCommandUDPAssociate = 0x03,
 };
 
-static constexpr unsigned int kGreetReadHeaderSize = 2;
-static constexpr unsigned int kAuthReadHeaderSize = 2;
-static constexpr unsigned int kReadHeaderSize = 5;
+static constexpr int kGreetReadHeaderSize = 2;
+static constexpr int kAuthReadHeaderSize = 2;
+static constexpr int kReadHeaderSize = 5;
+// Holds the largest possible greeting, authentication and request, which are
+// at most 1032 bytes together, and some application data sent along.
+static constexpr int kReadBufferSize = 4096;
 static constexpr char kSOCKS5Version = '\x05';
 static constexpr char kSOCKS5Reserved = '\x00';
 static constexpr char kAuthMethodNone = '\x00';
@@ -53,6 +57,8 @@ Socks5ServerSocket::Socks5ServerSocket(
                                        base::Unretained(this))),
       transport_(std::move(transport_socket)),
       next_state_(STATE_NONE),
+      read_start_(0),
+      read_end_(0),
       completed_handshake_(false),
       bytes_sent_(0),
       was_ever_used_(false),
@@ -82,6 +88,11 @@ int Socks5ServerSocket::Connect(CompletionOnceCallback callback) {
 
   next_state_ = STATE_GREET_READ;
   buffer_.clear();
+  read_buf_ = base::MakeRefCounted<GrowableIOBuffer>();
+  read_buf_->SetCapacity(kReadBufferSize);
+  read_start_ = 0;
+  read_end_ = 0;
+  net_log_.BeginEvent(NetLogEventType::SOCKS5_GREET_READ);
 
   int rv = DoLoop(OK);
   if (rv == ERR_IO_PENDING) {
@@ -160,6 +171,17 @@ int Socks5ServerSocket::Read(IOBuffer* buf,
   DCHECK(!user_callback_);
   DCHECK(callback);
 
+  // Application data read along with the handshake goes first.
+  if (read_buf_) {
+    int size = std::min(buf_len, read_end_ - read_start_);
+    std::memcpy(buf->data(), read_buf_->StartOfBuffer() + read_start_, size);
+    read_start_ += size;
+    if (read_start_ == read_end_)
+      read_buf_ = nullptr;
+    was_ever_used_ = true;
+    return size;
+  }
+
   int rv = transport_->Read(
       buf, buf_len,
       base::BindOnce(&Socks5ServerSocket::OnReadWriteComplete,
@@ -236,13 +258,18 @@ int Socks5ServerSocket::DoLoop(int last_io_result) {
     switch (state) {
       case STATE_GREET_READ:
         DCHECK_EQ(OK, rv);
-        net_log_.BeginEvent(NetLogEventType::SOCKS5_GREET_READ);
         rv = DoGreetRead();
+        if (next_state_ != STATE_GREET_READ_COMPLETE) {
+          net_log_.EndEventWithNetErrorCode(
+              NetLogEventType::SOCKS5_GREET_READ, rv);
+        }
         break;
       case STATE_GREET_READ_COMPLETE:
         rv = DoGreetReadComplete(rv);
-        net_log_.EndEventWithNetErrorCode(NetLogEventType::SOCKS5_GREET_READ,
-                                          rv);
+        if (rv < 0) {
+          net_log_.EndEventWithNetErrorCode(
+              NetLogEventType::SOCKS5_GREET_READ, rv);
+        }
         break;
       case STATE_GREET_WRITE:
         DCHECK_EQ(OK, rv);
@@ -270,13 +297,18 @@ int Socks5ServerSocket::DoLoop(int last_io_result) {
         break;
       case STATE_HANDSHAKE_READ:
         DCHECK_EQ(OK, rv);
-        net_log_.BeginEvent(NetLogEventType::SOCKS5_HANDSHAKE_READ);
         rv = DoHandshakeRead();
+        if (next_state_ != STATE_HANDSHAKE_READ_COMPLETE) {
+          net_log_.EndEventWithNetErrorCode(
+              NetLogEventType::SOCKS5_HANDSHAKE_READ, rv);
+        }
         break;
       case STATE_HANDSHAKE_READ_COMPLETE:
         rv = DoHandshakeReadComplete(rv);
-        net_log_.EndEventWithNetErrorCode(
-            NetLogEventType::SOCKS5_HANDSHAKE_READ, rv);
+        if (rv < 0) {
+          net_log_.EndEventWithNetErrorCode(
+              NetLogEventType::SOCKS5_HANDSHAKE_READ, rv);
+        }
         break;
       case STATE_HANDSHAKE_WRITE:
         DCHECK_EQ(OK, rv);
@@ -297,18 +329,32 @@ int Socks5ServerSocket::DoLoop(int last_io_result) {
   return rv;
 }
 
-int Socks5ServerSocket::DoGreetRead() {
-  next_state_ = STATE_GREET_READ_COMPLETE;
+int Socks5ServerSocket::ReadMore() {
+  // Moves unparsed data to the front so that the rest of the buffer is free.
+  if (read_start_ > 0) {
+    char* start = read_buf_->StartOfBuffer();
+    std::memmove(start, start + read_start_, read_end_ - read_start_);
+    read_end_ -= read_start_;
+    read_start_ = 0;
+  }
+  read_buf_->set_offset(read_end_);
+  DCHECK_LT(0, read_buf_->RemainingCapacity());
+  return transport_->Read(read_buf_.get(), read_buf_->RemainingCapacity(),
+                          io_callback_);
+}
 
-  if (buffer_.empty()) {
-    read_header_size_ = kGreetReadHeaderSize;
+// Handshake messages may arrive in pieces or together, so every read state
+// first parses what is buffered and only reads if that is not enough.
+int Socks5ServerSocket::DoGreetRead() {
+  int rv = ParseGreeting();
+  if (rv != ERR_IO_PENDING) {
+    if (rv == OK)
+      next_state_ = STATE_GREET_WRITE;
+    return rv;
   }
 
-  int handshake_buf_len = read_header_size_ - buffer_.size();
-  DCHECK_LT(0, handshake_buf_len);
-  handshake_buf_ = base::MakeRefCounted<IOBuffer>(handshake_buf_len);
-  return transport_->Read(handshake_buf_.get(), handshake_buf_len,
-                          io_callback_);
+  next_state_ = STATE_GREET_READ_COMPLETE;
+  return ReadMore();
 }
 
 int Socks5ServerSocket::DoGreetReadComplete(int result) {
@@ -321,46 +367,42 @@ int Socks5ServerSocket::DoGreetReadComplete(int result) {
     return ERR_SOCKS_CONNECTION_FAILED;
   }
 
-  buffer_.append(handshake_buf_->data(), result);
+  read_end_ += result;
+  next_state_ = STATE_GREET_READ;
+  return OK;
+}
 
-  // When the first few bytes are read, check how many more are required
-  // and accordingly increase them
-  if (buffer_.size() == kGreetReadHeaderSize) {
-    if (buffer_[0] != kSOCKS5Version) {
-      net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_UNEXPECTED_VERSION,
-                                     "version", buffer_[0]);
-      return ERR_SOCKS_CONNECTION_FAILED;
-    }
-    int nmethods = buffer_[1];
-    if (nmethods == 0) {
-      net_log_.AddEvent(NetLogEventType::SOCKS_NO_REQUESTED_AUTH);
-      return ERR_SOCKS_CONNECTION_FAILED;
-    }
+int Socks5ServerSocket::ParseGreeting() {
+  const char* data = read_buf_->StartOfBuffer() + read_start_;
+  const int size = read_end_ - read_start_;
 
-    read_header_size_ += nmethods;
-    next_state_ = STATE_GREET_READ;
-    return OK;
+  if (size < kGreetReadHeaderSize)
+    return ERR_IO_PENDING;
+  if (data[0] != kSOCKS5Version) {
+    net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_UNEXPECTED_VERSION,
+                                   "version", data[0]);
+    return ERR_SOCKS_CONNECTION_FAILED;
   }
-
-  if (buffer_.size() == read_header_size_) {
-    int nmethods = buffer_[1];
-    char expected_method = kAuthMethodNone;
-    if (!user_.empty() || !pass_.empty()) {
-      expected_method = kAuthMethodUserPass;
-    }
-    void* match =
-        std::memchr(&buffer_[kGreetReadHeaderSize], expected_method, nmethods);
-    if (match) {
-      auth_method_ = expected_method;
-    } else {
-      auth_method_ = kAuthMethodNoAcceptable;
-    }
-    buffer_.clear();
-    next_state_ = STATE_GREET_WRITE;
-    return OK;
+  int nmethods = static_cast<uint8_t>(data[1]);
+  if (nmethods == 0) {
+    net_log_.AddEvent(NetLogEventType::SOCKS_NO_REQUESTED_AUTH);
+    return ERR_SOCKS_CONNECTION_FAILED;
   }
+  if (size < kGreetReadHeaderSize + nmethods)
+    return ERR_IO_PENDING;
 
-  next_state_ = STATE_GREET_READ;
+  char expected_method = kAuthMethodNone;
+  if (!user_.empty() || !pass_.empty()) {
+    expected_method = kAuthMethodUserPass;
+  }
+  const void* match =
+      std::memchr(data + kGreetReadHeaderSize, expected_method, nmethods);
+  if (match) {
+    auth_method_ = expected_method;
+  } else {
+    auth_method_ = kAuthMethodNoAcceptable;
+  }
+  read_start_ += kGreetReadHeaderSize + nmethods;
   return OK;
 }
 
@@ -389,6 +431,7 @@ int Socks5ServerSocket::DoGreetWriteComplete(int result) {
   if (bytes_sent_ == buffer_.size()) {
     buffer_.clear();
     if (auth_method_ == kAuthMethodNone) {
+      net_log_.BeginEvent(NetLogEventType::SOCKS5_HANDSHAKE_READ);
       next_state_ = STATE_HANDSHAKE_READ;
     } else if (auth_method_ == kAuthMethodUserPass) {
       next_state_ = STATE_AUTH_READ;
@@ -403,17 +446,15 @@ int Socks5ServerSocket::DoGreetWriteComplete(int result) {
 }
 
 int Socks5ServerSocket::DoAuthRead() {
-  next_state_ = STATE_AUTH_READ_COMPLETE;
-
-  if (buffer_.empty()) {
-    read_header_size_ = kAuthReadHeaderSize;
+  int rv = ParseAuth();
+  if (rv != ERR_IO_PENDING) {
+    if (rv == OK)
+      next_state_ = STATE_AUTH_WRITE;
+    return rv;
   }
 
-  int handshake_buf_len = read_header_size_ - buffer_.size();
-  DCHECK_LT(0, handshake_buf_len);
-  handshake_buf_ = base::MakeRefCounted<IOBuffer>(handshake_buf_len);
-  return transport_->Read(handshake_buf_.get(), handshake_buf_len,
-                          io_callback_);
+  next_state_ = STATE_AUTH_READ_COMPLETE;
+  return ReadMore();
 }
 
 int Socks5ServerSocket::DoAuthReadComplete(int result) {
@@ -424,44 +465,39 @@ int Socks5ServerSocket::DoAuthReadComplete(int result) {
     return ERR_SOCKS_CONNECTION_FAILED;
   }
 
-  buffer_.append(handshake_buf_->data(), result);
-
-  // When the first few bytes are read, check how many more are required
-  // and accordingly increase them
-  if (buffer_.size() == kAuthReadHeaderSize) {
-    if (buffer_[0] != kSubnegotiationVersion) {
-      net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_UNEXPECTED_VERSION,
-                                     "version", buffer_[0]);
-      return ERR_SOCKS_CONNECTION_FAILED;
-    }
-    int username_len = buffer_[1];
-    read_header_size_ += username_len + 1;
-    next_state_ = STATE_AUTH_READ;
-    return OK;
-  }
+  read_end_ += result;
+  next_state_ = STATE_AUTH_READ;
+  return OK;
+}
 
-  if (buffer_.size() == read_header_size_) {
-    int username_len = buffer_[1];
-    int password_len = buffer_[kAuthReadHeaderSize + username_len];
-    size_t password_offset = kAuthReadHeaderSize + username_len + 1;
-    if (buffer_.size() == password_offset && password_len != 0) {
-      read_header_size_ += password_len;
-      next_state_ = STATE_AUTH_READ;
-      return OK;
-    }
+int Socks5ServerSocket::ParseAuth() {
+  const char* data = read_buf_->StartOfBuffer() + read_start_;
+  const int size = read_end_ - read_start_;
 
-    if (buffer_.compare(kAuthReadHeaderSize, username_len, user_) == 0 &&
-        buffer_.compare(password_offset, password_len, pass_) == 0) {
-      auth_status_ = kAuthStatusSuccess;
-    } else {
-      auth_status_ = kAuthStatusFailure;
-    }
-    buffer_.clear();
-    next_state_ = STATE_AUTH_WRITE;
-    return OK;
+  if (size < kAuthReadHeaderSize)
+    return ERR_IO_PENDING;
+  if (data[0] != kSubnegotiationVersion) {
+    net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_UNEXPECTED_VERSION,
+                                   "version", data[0]);
+    return ERR_SOCKS_CONNECTION_FAILED;
   }
-
-  next_state_ = STATE_AUTH_READ;
+  int username_len = static_cast<uint8_t>(data[1]);
+  int password_offset = kAuthReadHeaderSize + username_len + 1;
+  if (size < password_offset)
+    return ERR_IO_PENDING;
+  int password_len = static_cast<uint8_t>(data[password_offset - 1]);
+  if (size < password_offset + password_len)
+    return ERR_IO_PENDING;
+
+  if (user_.compare(0, std::string::npos, data + kAuthReadHeaderSize,
+                    username_len) == 0 &&
+      pass_.compare(0, std::string::npos, data + password_offset,
+                    password_len) == 0) {
+    auth_status_ = kAuthStatusSuccess;
+  } else {
+    auth_status_ = kAuthStatusFailure;
+  }
+  read_start_ += password_offset + password_len;
   return OK;
 }
 
@@ -490,6 +526,7 @@ int Socks5ServerSocket::DoAuthWriteComplete(int result) {
   if (bytes_sent_ == buffer_.size()) {
     buffer_.clear();
     if (auth_status_ == kAuthStatusSuccess) {
+      net_log_.BeginEvent(NetLogEventType::SOCKS5_HANDSHAKE_READ);
       next_state_ = STATE_HANDSHAKE_READ;
     } else {
       return ERR_SOCKS_CONNECTION_FAILED;
@@ -501,17 +538,15 @@ int Socks5ServerSocket::DoAuthWriteComplete(int result) {
 }
 
 int Socks5ServerSocket::DoHandshakeRead() {
-  next_state_ = STATE_HANDSHAKE_READ_COMPLETE;
-
-  if (buffer_.empty()) {
-    read_header_size_ = kReadHeaderSize;
+  int rv = ParseRequest();
+  if (rv != ERR_IO_PENDING) {
+    if (rv == OK)
+      next_state_ = STATE_HANDSHAKE_WRITE;
+    return rv;
   }
 
-  int handshake_buf_len = read_header_size_ - buffer_.size();
-  DCHECK_LT(0, handshake_buf_len);
-  handshake_buf_ = base::MakeRefCounted<IOBuffer>(handshake_buf_len);
-  return transport_->Read(handshake_buf_.get(), handshake_buf_len,
-                          io_callback_);
+  next_state_ = STATE_HANDSHAKE_READ_COMPLETE;
+  return ReadMore();
 }
 
 int Socks5ServerSocket::DoHandshakeReadComplete(int result) {
@@ -525,84 +560,79 @@ int Socks5ServerSocket::DoHandshakeReadComplete(int result) {
     return ERR_SOCKS_CONNECTION_FAILED;
   }
 
-  buffer_.append(handshake_buf_->data(), result);
-
-  // When the first few bytes are read, check how many more are required
-  // and accordingly increase them
-  if (buffer_.size() == kReadHeaderSize) {
-    if (buffer_[0] != kSOCKS5Version || buffer_[2] != kSOCKS5Reserved) {
-      net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_UNEXPECTED_VERSION,
-                                     "version", buffer_[0]);
-      return ERR_SOCKS_CONNECTION_FAILED;
-    }
-    SocksCommandType command = static_cast<SocksCommandType>(buffer_[1]);
-    if (command == kCommandConnect) {
-      // The proxy replies with success immediately without first connecting
-      // to the requested endpoint.
-      reply_ = kReplySuccess;
-    } else if (command == kCommandBind || command == kCommandUDPAssociate) {
-      reply_ = kReplyCommandNotSupported;
-    } else {
-      net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_UNEXPECTED_COMMAND,
-                                     "commmand", buffer_[1]);
-      return ERR_SOCKS_CONNECTION_FAILED;
-    }
+  read_end_ += result;
+  next_state_ = STATE_HANDSHAKE_READ;
+  return OK;
+}
 
-    // We check the type of IP/Domain the server returns and accordingly
-    // increase the size of the request. For domains, we need to read the
-    // size of the domain, so the initial request size is upto the domain
-    // size. Since for IPv4/IPv6 the size is fixed and hence no 'size' is
-    // read, we substract 1 byte from the additional request size.
-    address_type_ = static_cast<SocksEndPointAddressType>(buffer_[3]);
-    if (address_type_ == kEndPointDomain) {
-      address_size_ = static_cast<uint8_t>(buffer_[4]);
-      if (address_size_ == 0) {
-        net_log_.AddEvent(NetLogEventType::SOCKS_ZERO_LENGTH_DOMAIN);
-        return ERR_SOCKS_CONNECTION_FAILED;
-      }
-    } else if (address_type_ == kEndPointResolvedIPv4) {
-      address_size_ = sizeof(struct in_addr);
-      --read_header_size_;
-    } else if (address_type_ == kEndPointResolvedIPv6) {
-      address_size_ = sizeof(struct in6_addr);
-      --read_header_size_;
-    } else {
-      // Aborts connection on unspecified address type.
-      net_log_.AddEventWithIntParams(
-          NetLogEventType::SOCKS_UNKNOWN_ADDRESS_TYPE, "address_type",
-          buffer_[3]);
-      return ERR_SOCKS_CONNECTION_FAILED;
-    }
+int Socks5ServerSocket::ParseRequest() {
+  const char* data = read_buf_->StartOfBuffer() + read_start_;
+  const int size = read_end_ - read_start_;
 
-    read_header_size_ += address_size_ + sizeof(uint16_t);
-    next_state_ = STATE_HANDSHAKE_READ;
-    return OK;
+  if (size < kReadHeaderSize)
+    return ERR_IO_PENDING;
+  if (data[0] != kSOCKS5Version || data[2] != kSOCKS5Reserved) {
+    net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_UNEXPECTED_VERSION,
+                                   "version", data[0]);
+    return ERR_SOCKS_CONNECTION_FAILED;
+  }
+  SocksCommandType command = static_cast<SocksCommandType>(data[1]);
+  if (command == kCommandConnect) {
+    // The proxy replies with success immediately without first connecting
+    // to the requested endpoint.
+    reply_ = kReplySuccess;
+  } else if (command == kCommandBind || command == kCommandUDPAssociate) {
+    reply_ = kReplyCommandNotSupported;
+  } else {
+    net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_UNEXPECTED_COMMAND,
+                                   "commmand", data[1]);
+    return ERR_SOCKS_CONNECTION_FAILED;
   }
 
-  // When the final bytes are read, setup handshake.
-  if (buffer_.size() == read_header_size_) {
-    size_t port_start = read_header_size_ - sizeof(uint16_t);
-    uint16_t port_net;
-    std::memcpy(&port_net, &buffer_[port_start], sizeof(uint16_t));
-    uint16_t port_host = base::NetToHost16(port_net);
-
-    size_t address_start = port_start - address_size_;
-    if (address_type_ == kEndPointDomain) {
-      std::string domain(&buffer_[address_start], address_size_);
-      request_endpoint_ = HostPortPair(domain, port_host);
-    } else {
-      IPAddress ip_addr(
-          reinterpret_cast<const uint8_t*>(&buffer_[address_start]),
-          address_size_);
-      IPEndPoint endpoint(ip_addr, port_host);
-      request_endpoint_ = HostPortPair::FromIPEndPoint(endpoint);
+  // Domains are preceded by their length, which is part of the header. IPv4
+  // and IPv6 addresses start right after the address type.
+  auto address_type = static_cast<SocksEndPointAddressType>(data[3]);
+  int address_start;
+  int address_size;
+  if (address_type == kEndPointDomain) {
+    address_start = kReadHeaderSize;
+    address_size = static_cast<uint8_t>(data[4]);
+    if (address_size == 0) {
+      net_log_.AddEvent(NetLogEventType::SOCKS_ZERO_LENGTH_DOMAIN);
+      return ERR_SOCKS_CONNECTION_FAILED;
     }
-    buffer_.clear();
-    next_state_ = STATE_HANDSHAKE_WRITE;
-    return OK;
+  } else if (address_type == kEndPointResolvedIPv4) {
+    address_start = kReadHeaderSize - 1;
+    address_size = sizeof(struct in_addr);
+  } else if (address_type == kEndPointResolvedIPv6) {
+    address_start = kReadHeaderSize - 1;
+    address_size = sizeof(struct in6_addr);
+  } else {
+    // Aborts connection on unspecified address type.
+    net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_UNKNOWN_ADDRESS_TYPE,
+                                   "address_type", data[3]);
+    return ERR_SOCKS_CONNECTION_FAILED;
   }
 
-  next_state_ = STATE_HANDSHAKE_READ;
+  const int port_start = address_start + address_size;
+  const int request_size = port_start + sizeof(uint16_t);
+  if (size < request_size)
+    return ERR_IO_PENDING;
+
+  uint16_t port_net;
+  std::memcpy(&port_net, data + port_start, sizeof(uint16_t));
+  uint16_t port_host = base::NetToHost16(port_net);
+
+  if (address_type == kEndPointDomain) {
+    std::string domain(data + address_start, address_size);
+    request_endpoint_ = HostPortPair(domain, port_host);
+  } else {
+    IPAddress ip_addr(reinterpret_cast<const uint8_t*>(data + address_start),
+                      address_size);
+    IPEndPoint endpoint(ip_addr, port_host);
+    request_endpoint_ = HostPortPair::FromIPEndPoint(endpoint);
+  }
+  read_start_ += request_size;
   return OK;
 }
 
@@ -646,6 +676,8 @@ int Socks5ServerSocket::DoHandshakeWriteComplete(int result) {
     if (reply_ == kReplySuccess) {
       completed_handshake_ = true;
       next_state_ = STATE_NONE;
+      if (read_start_ == read_end_)
+        read_buf_ = nullptr;
     } else {
       net_log_.AddEventWithIntParams(NetLogEventType::SOCKS_SERVER_ERROR,
                                      "error_code", reply_);
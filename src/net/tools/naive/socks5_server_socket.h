@@ -115,6 +115,15 @@ class Socks5ServerSocket : public StreamSocket {
   int DoHandshakeWrite();
   int DoHandshakeWriteComplete(int result);
 
+  // Each parses one message from the unparsed data in |read_buf_| and
+  // consumes it. Returns ERR_IO_PENDING if the message is not complete yet.
+  int ParseGreeting();
+  int ParseAuth();
+  int ParseRequest();
+
+  // Reads more of the handshake into |read_buf_| after the unparsed data.
+  int ReadMore();
+
   CompletionRepeatingCallback io_callback_;
 
   // Stores the underlying socket.
@@ -125,15 +134,21 @@ class Socks5ServerSocket : public StreamSocket {
   // Stores the callback to the layer above, called on completing Connect().
   CompletionOnceCallback user_callback_;
 
-  // This IOBuffer is used by the class to read and write
-  // SOCKS handshake data. The length contains the expected size to
-  // read or write.
+  // This IOBuffer is used by the class to write SOCKS handshake data. The
+  // length contains the expected size to write.
   scoped_refptr<IOBuffer> handshake_buf_;
 
-  // While writing, this buffer stores the complete write handshake data.
-  // While reading, it stores the handshake information received so far.
+  // Stores the complete write handshake data.
   std::string buffer_;
 
+  // Handshake data is read into this buffer as it arrives, and parsed from
+  // |read_start_| up to |read_end_|. Clients may send the greeting, the
+  // authentication and the request without waiting for replies, followed
+  // by application data, which is returned by Read() after the handshake.
+  scoped_refptr<GrowableIOBuffer> read_buf_;
+  int read_start_;
+  int read_end_;
+
   // This becomes true when the SOCKS handshake has completed and the
   // overlying connection is free to communicate.
   bool completed_handshake_;
@@ -141,13 +156,8 @@ class Socks5ServerSocket : public StreamSocket {
   // Contains the bytes sent by the SOCKS handshake.
   size_t bytes_sent_;
 
-  size_t read_header_size_;
-
   bool was_ever_used_;
 
-  SocksEndPointAddressType address_type_;
-  int address_size_;
-
   std::string user_;
   std::string pass_;
   char auth_method_;
@@ -0,0 +1,137 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#include "net/tools/naive/speculative_tunnel_pool.h"
+
+#include <utility>
+
+#include "base/bind.h"
+#include "base/check.h"
+#include "base/location.h"
+#include "base/logging.h"
+#include "net/base/load_flags.h"
+#include "net/base/privacy_mode.h"
+#include "net/base/request_priority.h"
+#include "net/base/url_util.h"
+#include "net/http/http_network_session.h"
+#include "net/proxy_resolution/proxy_info.h"
+#include "net/quic/quic_proxy_client_socket.h"
+#include "net/socket/client_socket_handle.h"
+#include "net/socket/client_socket_pool_manager.h"
+#include "net/socket/stream_socket.h"
+#include "url/scheme_host_port.h"
+
+namespace net {
+
+SpeculativeTunnel::SpeculativeTunnel()
+    : handle_(std::make_unique<ClientSocketHandle>()) {}
+
+SpeculativeTunnel::~SpeculativeTunnel() = default;
+
+void SpeculativeTunnel::SetCallback(CompletionOnceCallback callback) {
+  DCHECK_EQ(result_, ERR_IO_PENDING);
+  callback_ = std::move(callback);
+}
+
+std::unique_ptr<ClientSocketHandle> SpeculativeTunnel::PassHandle() {
+  return std::move(handle_);
+}
+
+void SpeculativeTunnel::OnConnectComplete(int result) {
+  // A Fast Open request over QUIC waits for the first write, but this tunnel
+  // is opened so that the proxy connects before any data is there.
+  if (result == OK && quic_) {
+    result = static_cast<QuicProxyClientSocket*>(handle_->socket())
+                 ->SendPendingRequestHeaders();
+  }
+  result_ = result;
+  if (callback_)
+    std::move(callback_).Run(result);
+}
+
+SpeculativeTunnelPool::SpeculativeTunnelPool(
+    base::TimeDelta window,
+    const ProxyInfo& proxy_info,
+    const SSLConfig& server_ssl_config,
+    const SSLConfig& proxy_ssl_config,
+    HttpNetworkSession* session,
+    const NetworkAnonymizationKey& network_anonymization_key,
+    const NetLogWithSource& net_log)
+    : window_(window),
+      proxy_info_(&proxy_info),
+      server_ssl_config_(server_ssl_config),
+      proxy_ssl_config_(proxy_ssl_config),
+      session_(session),
+      network_anonymization_key_(network_anonymization_key),
+      net_log_(net_log) {}
+
+SpeculativeTunnelPool::~SpeculativeTunnelPool() = default;
+
+void SpeculativeTunnelPool::Preconnect(const std::string& name) {
+  HostPortPair origin(name, kPort);
+  if (tunnels_.count(origin))
+    return;
+
+  url::CanonHostInfo host_info;
+  url::SchemeHostPort endpoint(
+      "http", CanonicalizeHost(origin.HostForURL(), &host_info), origin.port(),
+      url::SchemeHostPort::ALREADY_CANONICALIZED);
+  if (!endpoint.IsValid())
+    return;
+
+  auto tunnel = std::make_unique<SpeculativeTunnel>();
+  auto* tunnel_ptr = tunnel.get();
+  tunnel_ptr->quic_ = proxy_info_->proxy_server().is_quic();
+  tunnels_[origin] = std::move(tunnel);
+  // This use of base::Unretained is safe because the timer is owned by the
+  // tunnel, which is owned by this object until it is taken.
+  tunnel_ptr->expiry_timer_.Start(
+      FROM_HERE, window_,
+      base::BindOnce(&SpeculativeTunnelPool::Expire, base::Unretained(this),
+                     origin));
+
+  int rv = InitSocketHandleForRawConnect2(
+      std::move(endpoint), LOAD_IGNORE_LIMITS, MAXIMUM_PRIORITY, session_,
+      *proxy_info_, server_ssl_config_, proxy_ssl_config_,
+      PRIVACY_MODE_DISABLED, network_anonymization_key_,
+      SecureDnsPolicy::kAllow, net_log_,
+      tunnel_ptr->handle_.get(),
+      base::BindOnce(&SpeculativeTunnel::OnConnectComplete,
+                     tunnel_ptr->weak_ptr_factory_.GetWeakPtr()));
+  if (rv != ERR_IO_PENDING)
+    tunnel_ptr->OnConnectComplete(rv);
+}
+
+std::unique_ptr<SpeculativeTunnel> SpeculativeTunnelPool::Take(
+    const HostPortPair& origin) {
+  auto it = tunnels_.find(origin);
+  if (it == tunnels_.end())
+    return nullptr;
+  std::unique_ptr<SpeculativeTunnel> tunnel = std::move(it->second);
+  tunnels_.erase(it);
+  tunnel->expiry_timer_.Stop();
+
+  if (tunnel->result() == ERR_IO_PENDING)
+    return tunnel;
+  // Lets the caller connect again rather than report a stale failure.
+  if (tunnel->result() != OK || !tunnel->handle_->socket() ||
+      !tunnel->handle_->socket()->IsConnected()) {
+    return nullptr;
+  }
+  return tunnel;
+}
+
+void SpeculativeTunnelPool::SetProxyInfo(const ProxyInfo& proxy_info) {
+  proxy_info_ = &proxy_info;
+  tunnels_.clear();
+}
+
+void SpeculativeTunnelPool::Expire(const HostPortPair& origin) {
+  auto it = tunnels_.find(origin);
+  if (it == tunnels_.end())
+    return;
+  LOG(INFO) << "Speculative tunnel to " << origin.ToString() << " unused";
+  tunnels_.erase(it);
+}
+
+}  // namespace net
@@ -0,0 +1,107 @@
+// Copyright 2022 klzgrad <kizdiv@gmail.com>. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#ifndef NET_TOOLS_NAIVE_SPECULATIVE_TUNNEL_POOL_H_
+#define NET_TOOLS_NAIVE_SPECULATIVE_TUNNEL_POOL_H_
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "base/memory/weak_ptr.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+#include "net/base/completion_once_callback.h"
+#include "net/base/host_port_pair.h"
+#include "net/base/net_errors.h"
+
+namespace net {
+
+class ClientSocketHandle;
+class HttpNetworkSession;
+class NetLogWithSource;
+class NetworkAnonymizationKey;
+class ProxyInfo;
+struct SSLConfig;
+
+// A tunnel opened before any client asked for it.
+class SpeculativeTunnel {
+ public:
+  SpeculativeTunnel();
+  ~SpeculativeTunnel();
+  SpeculativeTunnel(const SpeculativeTunnel&) = delete;
+  SpeculativeTunnel& operator=(const SpeculativeTunnel&) = delete;
+
+  // ERR_IO_PENDING while the tunnel is being established.
+  int result() const { return result_; }
+
+  // Runs |callback| once the tunnel is established or failed. Only valid
+  // while result() is ERR_IO_PENDING.
+  void SetCallback(CompletionOnceCallback callback);
+
+  std::unique_ptr<ClientSocketHandle> PassHandle();
+
+ private:
+  friend class SpeculativeTunnelPool;
+
+  void OnConnectComplete(int result);
+
+  std::unique_ptr<ClientSocketHandle> handle_;
+  int result_ = ERR_IO_PENDING;
+  // Goes through a quic:// proxy.
+  bool quic_ = false;
+  CompletionOnceCallback callback_;
+  base::OneShotTimer expiry_timer_;
+
+  base::WeakPtrFactory<SpeculativeTunnel> weak_ptr_factory_{this};
+};
+
+// Opens tunnels to the names handed out by RedirectResolver, so that the
+// client connection which follows the DNS answer can adopt a tunnel that is
+// already established or in progress instead of starting from scratch.
+// Tunnels not adopted within |window| are closed.
+class SpeculativeTunnelPool {
+ public:
+  // Only this port is preconnected, because the client's port is not known
+  // at DNS time.
+  static constexpr uint16_t kPort = 443;
+
+  SpeculativeTunnelPool(
+      base::TimeDelta window,
+      const ProxyInfo& proxy_info,
+      const SSLConfig& server_ssl_config,
+      const SSLConfig& proxy_ssl_config,
+      HttpNetworkSession* session,
+      const NetworkAnonymizationKey& network_anonymization_key,
+      const NetLogWithSource& net_log);
+  ~SpeculativeTunnelPool();
+  SpeculativeTunnelPool(const SpeculativeTunnelPool&) = delete;
+  SpeculativeTunnelPool& operator=(const SpeculativeTunnelPool&) = delete;
+
+  // Starts a tunnel to |name| unless there is one already.
+  void Preconnect(const std::string& name);
+
+  // Returns the tunnel to |origin| if it is established or in progress, or
+  // nullptr.
+  std::unique_ptr<SpeculativeTunnel> Take(const HostPortPair& origin);
+
+  // Opens later tunnels through |proxy_info|, which must outlive this, and
+  // closes those not taken yet.
+  void SetProxyInfo(const ProxyInfo& proxy_info);
+
+ private:
+  void Expire(const HostPortPair& origin);
+
+  const base::TimeDelta window_;
+  const ProxyInfo* proxy_info_;
+  const SSLConfig& server_ssl_config_;
+  const SSLConfig& proxy_ssl_config_;
+  HttpNetworkSession* session_;
+  const NetworkAnonymizationKey& network_anonymization_key_;
+  const NetLogWithSource& net_log_;
+
+  std::map<HostPortPair, std::unique_ptr<SpeculativeTunnel>> tunnels_;
+};
+
+}  // namespace net
+#endif  // NET_TOOLS_NAIVE_SPECULATIVE_TUNNEL_POOL_H_